@@ -11,12 +11,15 @@
 #ifndef BAS_CLIENT_HPP
 #define BAS_CLIENT_HPP
 
+#include <bas/config.hpp>
+
 #include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
 
 #include <bas/io_service_pool.hpp>
 #include <bas/service_handler.hpp>
 #include <bas/service_handler_pool.hpp>
+#include <bas/socket_traits.hpp>
 
 namespace bas {
 
@@ -29,12 +32,12 @@ public:
   /// Define type reference of boost::asio::io_service.
   typedef boost::asio::io_service io_service_t;
 
-  /// Define type reference of boost::asio::ip::tcp::endpoint.
-  typedef boost::asio::ip::tcp::endpoint endpoint_t;
+  /// Define type reference of the endpoint of the socket protocol.
+  typedef typename socket_traits<Socket_Service>::endpoint_t endpoint_t;
 
   /// The type of the service_handler.
   typedef service_handler<Work_Handler, Socket_Service> service_handler_t;
-  typedef boost::shared_ptr<service_handler_t> service_handler_ptr;
+  typedef typename service_handler_t::service_handler_ptr service_handler_ptr;
 
   /// The type of the service_handler_pool.
   typedef service_handler_pool<Work_Handler, Work_Allocator, Socket_Service> service_handler_pool_t;
@@ -0,0 +1,292 @@
+//
+// completion_queue.hpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_COMPLETION_QUEUE_HPP
+#define BAS_COMPLETION_QUEUE_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <deque>
+#include <map>
+
+#include <bas/mem_fn_handler.hpp>
+
+namespace bas {
+
+// Capacity of the ring between an io_service and a work_service, set to 0
+//   for posting every completion to the work_service.
+#if !defined(BAS_COMPLETION_QUEUE_SIZE)
+# define BAS_COMPLETION_QUEUE_SIZE   1024
+#endif
+
+// Maximum completions delivered by one callback of the work_service.
+#if !defined(BAS_COMPLETION_QUEUE_BATCH)
+# define BAS_COMPLETION_QUEUE_BATCH  64
+#endif
+
+/// Completion delivered from io_service thread to work_service thread.
+struct work_completion
+{
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Deliver the completion to the target if invoke is true, then release the target.
+  typedef void (*function_t)(const work_completion& completion, bool invoke);
+
+  function_t function;
+  void* target;
+  size_t state;
+  size_t value;
+  boost::system::error_code ec;
+
+  work_completion(function_t f = 0,
+      void* t = 0,
+      size_t s = 0,
+      size_t v = 0,
+      boost::system::error_code e = boost::system::error_code())
+    : function(f),
+      target(t),
+      state(s),
+      value(v),
+      ec(e)
+  {
+  }
+};
+
+/// Queue of completions from one io_service thread to one work_service thread.
+//    Completions are pushed to a lock-free single producer/single consumer ring
+//    by the thread running the io_service, and the work_service is signalled
+//    once per batch instead of once per completion.
+class completion_queue
+  : private boost::noncopyable
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Define type reference of boost::asio::io_service.
+  typedef boost::asio::io_service io_service_t;
+
+  /// Constructor.
+  completion_queue(io_service_t& work_service, size_t capacity = BAS_COMPLETION_QUEUE_SIZE)
+    : work_service_(work_service),
+      ring_(capacity),
+      scheduled_(false),
+      overflowed_(false),
+      mutex_(),
+      overflow_()
+  {
+  }
+
+  /// Destructor.
+  ~completion_queue()
+  {
+    clear();
+  }
+
+  /// Push a completion, must be called from the thread running the io_service.
+  void push(const work_completion& completion)
+  {
+    // Ring is full or overflowed completions are pending, keep the order by the overflow queue.
+    if (overflowed_ || !ring_.push(completion))
+    {
+      scoped_lock_t lock(mutex_);
+
+      // Overflow is finished by work_service thread, all previous completions are delivered.
+      if (overflowed_ || !ring_.push(completion))
+      {
+        overflow_.push_back(completion);
+
+        if (!overflowed_)
+        {
+          overflowed_ = true;
+          work_service_.post(mem_fn_handler0<completion_queue*,
+                                             completion_queue,
+                                             &completion_queue::drain_overflow>(this));
+        }
+
+        return;
+      }
+    }
+
+    // Signal the work_service once for all completions in the ring.
+    if (!scheduled_.exchange(true))
+      work_service_.post(mem_fn_handler0<completion_queue*,
+                                         completion_queue,
+                                         &completion_queue::drain>(this));
+  }
+
+  /// Release all completions without delivering.
+  void clear()
+  {
+    work_completion completion;
+    while (ring_.pop(completion))
+      completion.function(completion, false);
+
+    std::deque<work_completion> overflow;
+    {
+      scoped_lock_t lock(mutex_);
+      overflow.swap(overflow_);
+    }
+
+    for (size_t i = 0; i < overflow.size(); ++i)
+      overflow[i].function(overflow[i], false);
+  }
+
+private:
+  typedef boost::asio::detail::mutex mutex_t;
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+
+  /// Deliver completions in the ring in work_service thread.
+  void drain()
+  {
+    size_t count = 0;
+    work_completion completion;
+
+    for (;;)
+    {
+      while (count < BAS_COMPLETION_QUEUE_BATCH && ring_.pop(completion))
+      {
+        completion.function(completion, true);
+        ++count;
+      }
+
+      // Let other handlers of the work_service run, continue later.
+      if (count >= BAS_COMPLETION_QUEUE_BATCH)
+      {
+        work_service_.post(mem_fn_handler0<completion_queue*,
+                                           completion_queue,
+                                           &completion_queue::drain>(this));
+        return;
+      }
+
+      scheduled_ = false;
+
+      // Completion pushed after the ring was found empty, deliver it if not signalled.
+      if (ring_.read_available() == 0 || scheduled_.exchange(true))
+        return;
+    }
+  }
+
+  /// Deliver overflowed completions in work_service thread.
+  void drain_overflow()
+  {
+    std::deque<work_completion> overflow;
+    work_completion completion;
+
+    for (;;)
+    {
+      // Completions in the ring are pushed before the overflowed ones.
+      while (ring_.pop(completion))
+        completion.function(completion, true);
+
+      {
+        scoped_lock_t lock(mutex_);
+
+        // Completions pushed from now on go to the ring again.
+        if (overflow_.empty())
+        {
+          overflowed_ = false;
+          return;
+        }
+
+        overflow.swap(overflow_);
+      }
+
+      for (size_t i = 0; i < overflow.size(); ++i)
+        overflow[i].function(overflow[i], true);
+
+      overflow.clear();
+    }
+  }
+
+  /// The work_service for delivering completions.
+  io_service_t& work_service_;
+
+  /// Ring of the completions.
+  boost::lockfree::spsc_queue<work_completion> ring_;
+
+  /// Flag to indicate delivering of the ring is scheduled or running.
+  boost::atomic<bool> scheduled_;
+
+  /// Flag to indicate completions are pushed to the overflow queue.
+  boost::atomic<bool> overflowed_;
+
+  /// Mutex for protecting overflowed completions.
+  mutex_t mutex_;
+
+  /// Completions pushed when the ring is full.
+  std::deque<work_completion> overflow_;
+};
+
+/// Service of the work_service for holding completion queues of each io_service.
+class completion_queue_service
+  : public boost::asio::detail::service_base<completion_queue_service>
+{
+public:
+  /// Define type reference of boost::asio::io_service.
+  typedef boost::asio::io_service io_service_t;
+
+  /// Constructor.
+  explicit completion_queue_service(io_service_t& work_service)
+    : boost::asio::detail::service_base<completion_queue_service>(work_service),
+      work_service_(work_service),
+      mutex_(),
+      queues_()
+  {
+  }
+
+  /// Get the completion queue from the given io_service to the work_service.
+  completion_queue& get_queue(io_service_t& io_service)
+  {
+    scoped_lock_t lock(mutex_);
+
+    queue_ptr& queue = queues_[&io_service];
+    if (queue.get() == 0)
+      queue.reset(new completion_queue(work_service_));
+
+    return *queue;
+  }
+
+  /// Release all undelivered completions.
+  void shutdown_service()
+  {
+    scoped_lock_t lock(mutex_);
+
+    for (queue_map::iterator iter = queues_.begin(); iter != queues_.end(); ++iter)
+      iter->second->clear();
+  }
+
+private:
+  typedef boost::asio::detail::mutex mutex_t;
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+  typedef boost::shared_ptr<completion_queue> queue_ptr;
+  typedef std::map<io_service_t*, queue_ptr> queue_map;
+
+  /// The work_service owning the service.
+  io_service_t& work_service_;
+
+  /// Mutex for protecting the queues.
+  mutex_t mutex_;
+
+  /// The completion queues, one for each io_service.
+  queue_map queues_;
+};
+
+} // namespace bas
+
+#endif // BAS_COMPLETION_QUEUE_HPP
@@ -0,0 +1,83 @@
+//
+// config.hpp
+// ~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_CONFIG_HPP
+#define BAS_CONFIG_HPP
+
+#include <boost/version.hpp>
+
+// Define BAS_HAS_IO_URING before including any bas header to run all socket
+//   I/O of service_handler/server/client on the io_uring backend of boost::asio
+//   instead of the epoll reactor. The backend is fixed for the whole process,
+//   because boost::asio selects its reactor at compile time.
+//   Requirements: Linux 5.10 or later, boost 1.78 or later and liburing (-luring).
+#if defined(BAS_HAS_IO_URING)
+
+# if !defined(__linux__)
+#  error "BAS_HAS_IO_URING is only supported on Linux."
+# endif
+
+# if (BOOST_VERSION < 107800)
+#  error "BAS_HAS_IO_URING requires boost 1.78 or later."
+# endif
+
+// The backend must be selected before boost::asio is configured.
+# if defined(BOOST_ASIO_DETAIL_CONFIG_HPP) && !defined(BOOST_ASIO_HAS_IO_URING)
+#  error "Include bas headers before boost/asio.hpp when BAS_HAS_IO_URING is defined."
+# endif
+
+# if !defined(BOOST_ASIO_HAS_IO_URING)
+#  define BOOST_ASIO_HAS_IO_URING 1
+# endif
+
+// Use io_uring for sockets too, not only for files.
+# if !defined(BOOST_ASIO_DISABLE_EPOLL)
+#  define BOOST_ASIO_DISABLE_EPOLL 1
+# endif
+
+#endif // defined(BAS_HAS_IO_URING)
+
+// Datagrams are received and sent in batches by recvmmsg/sendmmsg on Linux,
+//   define BAS_NO_MMSG to use one system call per datagram instead.
+#if defined(__linux__) && !defined(BAS_NO_MMSG) && !defined(BAS_HAS_MMSG)
+# define BAS_HAS_MMSG 1
+#endif
+
+// The shared memory socket is built on memfd and eventfd of Linux, define
+//   BAS_NO_SHM_SOCKET to leave it out.
+#if defined(__linux__) && !defined(BAS_NO_SHM_SOCKET) && !defined(BAS_HAS_SHM_SOCKET)
+# define BAS_HAS_SHM_SOCKET 1
+#endif
+
+// Listening sockets are handed over to a new process by SCM_RIGHTS on Linux,
+//   define BAS_NO_LISTENER_HANDOFF to leave it out.
+#if defined(__linux__) && !defined(BAS_NO_LISTENER_HANDOFF) && !defined(BAS_HAS_LISTENER_HANDOFF)
+# define BAS_HAS_LISTENER_HANDOFF 1
+#endif
+
+/// Size of a cache line, used for padding data shared between threads.
+#if !defined(BAS_CACHE_LINE_SIZE)
+# define BAS_CACHE_LINE_SIZE 64
+#endif
+
+/// Name of the I/O backend compiled into bas.
+#if defined(BAS_HAS_IO_URING)
+# define BAS_IO_BACKEND "io_uring"
+#elif defined(_WIN32)
+# define BAS_IO_BACKEND "iocp"
+#elif defined(__linux__)
+# define BAS_IO_BACKEND "epoll"
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+# define BAS_IO_BACKEND "kqueue"
+#else
+# define BAS_IO_BACKEND "select"
+#endif
+
+#endif // BAS_CONFIG_HPP
@@ -12,12 +12,55 @@
 #define BAS_IO_SERVICE_GROUP_HPP
 
 #include <boost/assert.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
 #include <bas/io_service_pool.hpp>
 #include <vector>
 
 namespace bas {
 
+// Seconds to wait for the connections to finish when stopping gracefully, they are closed after that.
+#if !defined(BAS_DRAIN_TIMEOUT)
+# define BAS_DRAIN_TIMEOUT             30
+#endif
+
+// Milliseconds to wait for the connections closed at the drain deadline, before stopping by force.
+#if !defined(BAS_DRAIN_CLOSE_TIMEOUT)
+# define BAS_DRAIN_CLOSE_TIMEOUT       1000
+#endif
+
+// Milliseconds between two checks of the connections left while draining.
+#if !defined(BAS_DRAIN_CHECK_INTERVAL)
+# define BAS_DRAIN_CHECK_INTERVAL      1
+#endif
+
+/// Statistics of the last graceful stop of io_service_group.
+struct drain_stats
+{
+  /// Number of live connections when the drain started.
+  boost::uint64_t connections;
+
+  /// Number of connections closed at the deadline.
+  boost::uint64_t closed;
+
+  /// Number of connections left after closing, abandoned by stopping by force.
+  boost::uint64_t abandoned;
+
+  /// Microseconds from the start of the drain until no connection was left.
+  boost::uint64_t drain_time;
+
+  drain_stats()
+    : connections(0),
+      closed(0),
+      abandoned(0),
+      drain_time(0)
+  {
+  }
+};
+
 /// Class for holding multi io_service_pool.
 class io_service_group
   : private boost::noncopyable
@@ -26,6 +69,12 @@ public:
   /// Define type reference of std::size_t.
   typedef std::size_t size_t;
 
+  /// Define type reference of boost::asio::detail::mutex.
+  typedef boost::asio::detail::mutex mutex_t;
+
+  /// Define type reference of boost::asio::detail::mutex::scoped_lock.
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+
   /// Define shared_ptr type of io_service_pool.
   typedef boost::shared_ptr<io_service_pool> io_service_pool_ptr;
 
@@ -39,9 +88,13 @@ public:
   /// Constructor.
   io_service_group(size_t group_size = work_pool + 1,
       bool force_stop = false)
-    : io_service_pools_(),
+    : mutex_(),
+      io_service_pools_(),
+      started_(false),
+      stopping_(false),
       force_stop_(force_stop),
-      started_(false)
+      drain_timeout_(BAS_DRAIN_TIMEOUT),
+      drain_stats_()
   {
     BOOST_ASSERT(group_size > work_pool);
 
@@ -68,6 +121,32 @@ public:
     return *this;
   }
 
+  /// Set seconds to wait for the connections to finish when stopping gracefully.
+  ///   The connections left are closed after that, 0 to close them at once.
+  io_service_group& set_drain_timeout(unsigned int seconds = BAS_DRAIN_TIMEOUT)
+  {
+    if (!started_)
+      drain_timeout_ = seconds;
+
+    return *this;
+  }
+
+  /// Get the statistics of the last graceful stop.
+  drain_stats get_drain_stats() const
+  {
+    return drain_stats_;
+  }
+
+  /// Get the number of live connections on all io_service_pool.
+  size_t connections()
+  {
+    size_t count = 0;
+    for (size_t i = io_service_pools_.size(); i > 0; --i)
+      count += io_service_pools_[i - 1]->connections();
+
+    return count;
+  }
+
   /// Get specified io_service_pool to use.
   io_service_pool& get(size_t index)
   {
@@ -98,36 +177,89 @@ public:
   /// Stop the io_service_group.
   void stop()
   {
-    if (!started_)
+    stop(force_stop_);
+  }
+
+  /// Stop the io_service_group with given mode, the handlers left are abandoned in force mode.
+  ///   Accepting new connections should be stopped before, by the server. A stop
+  ///   called while another one is draining returns at once.
+  void stop(bool force_stop)
+  {
+    // Lock for the io_service_group stopped by more than one thread.
+    scoped_lock_t lock(mutex_);
+
+    if (!started_ || stopping_)
       return;
 
-    // Stop all io_service_pool.
+    // For gracefully close, drain the connections while all threads keep running,
+    //   handlers posted from one pool to another are performed meanwhile. The
+    //   lock is not held for the drain, which may last the whole drain timeout.
+    if (!force_stop)
+    {
+      stopping_ = true;
+      lock.unlock();
+      force_stop = !drain();
+      lock.lock();
+      stopping_ = false;
+    }
+
+    // Stop all io_service_pool, nothing is left to do for connections in graceful mode.
     for (size_t i = io_service_pools_.size(); i > 0; --i)
-      io_service_pools_[i - 1]->stop(force_stop_);
+      io_service_pools_[i - 1]->stop(force_stop);
 
-    // For gracefully close, continue to repeat several times to dispatch and perform asynchronous operations/handlers.
-    while (!force_stop_)
-    {
-      bool idle = true;
-      for (size_t i = io_service_pools_.size(); idle && i > 0; --i)
-        idle = io_service_pools_[i - 1]->idle();
+    started_ = false;
+  }
 
-      if (idle)
-        break;
+private:
+  /// Wait for the connections to finish, close the ones left at the deadline.
+  ///   Returns false if some connections are still left after closing.
+  bool drain()
+  {
+    using namespace boost::posix_time;
+
+    ptime start = microsec_clock::universal_time();
+    ptime deadline = start + seconds(drain_timeout_);
+    bool closing = false;
 
-      // Start all io_service_pool with non-blocked mode.
-      for (size_t i = io_service_pools_.size(); i > 0; --i)
-        io_service_pools_[i - 1]->start();
+    drain_stats stats;
+    stats.connections = connections();
 
-      // Stop all io_service_pool with graceful mode.
-      for (size_t i = io_service_pools_.size(); i > 0; --i)
-        io_service_pools_[i - 1]->stop();
+    for (size_t left = stats.connections; left != 0; left = connections())
+    {
+      ptime now = microsec_clock::universal_time();
+      if (now >= deadline)
+      {
+        if (closing)
+        {
+          stats.abandoned = left;
+          break;
+        }
+
+        // Close the connections left, their work handlers are notified as usual.
+        stats.closed = close_connections(boost::asio::error::shut_down);
+        deadline = now + milliseconds(BAS_DRAIN_CLOSE_TIMEOUT);
+        closing = true;
+      }
+
+      boost::this_thread::sleep(milliseconds(BAS_DRAIN_CHECK_INTERVAL));
     }
 
-    started_ = false;
+    stats.drain_time = (microsec_clock::universal_time() - start).total_microseconds();
+    drain_stats_ = stats;
+
+    return stats.abandoned == 0;
+  }
+
+  /// Close the live connections on all io_service_pool, returns the number closed.
+  size_t close_connections(const boost::system::error_code& ec)
+  {
+    size_t count = 0;
+    for (size_t i = io_service_pools_.size(); i > 0; --i)
+      count += io_service_pools_[i - 1]->close_connections(ec);
+
+    return count;
   }
 
-private:
   /// Clear and release shared_pre of io_service_pool.
   void clear()
   {
@@ -139,14 +271,26 @@ private:
   }
 
 private:
+  /// Mutex for synchronize stopping.
+  mutex_t mutex_;
+
   /// The io_service_pool objects used to perform synchronous works.
   std::vector<io_service_pool_ptr> io_service_pools_;
   
   /// Start flag of the io_service_group.
   bool started_;
 
+  /// Flag of the io_service_group being drained by stop.
+  bool stopping_;
+
   /// Stop mode of the io_service_group.
   bool force_stop_;
+
+  /// Seconds to wait for the connections to finish when stopping gracefully.
+  unsigned int drain_timeout_;
+
+  /// The statistics of the last graceful stop.
+  drain_stats drain_stats_;
 };
 
 } // namespace bas
@@ -0,0 +1,156 @@
+//
+// io_service_load.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_IO_SERVICE_LOAD_HPP
+#define BAS_IO_SERVICE_LOAD_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/atomic.hpp>
+#include <vector>
+
+namespace bas {
+
+/// A connection counted by io_service_load, linked for closing it when a drain times out.
+struct io_load_entry
+{
+  /// Take a reference of the connection, fails if it's being released.
+  typedef bool (*acquire_function)(io_load_entry& entry);
+
+  /// Close the connection and drop the reference taken by acquire.
+  typedef void (*close_function)(io_load_entry& entry, const boost::system::error_code& ec);
+
+  io_load_entry(void* t = 0, acquire_function a = 0, close_function c = 0)
+    : prev(0),
+      next(0),
+      target(t),
+      acquire(a),
+      close(c)
+  {
+  }
+
+  io_load_entry* prev;
+  io_load_entry* next;
+  void* target;
+  acquire_function acquire;
+  close_function close;
+};
+
+/// Service for counting the live connections of an io_service.
+//    A connection holds a reference for each of its outstanding operations on
+//    the io_service and on its work_service, so the io_service has nothing
+//    left to do for connections once none is counted.
+class io_service_load
+  : public boost::asio::detail::service_base<io_service_load>
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Define type reference of boost::asio::detail::mutex.
+  typedef boost::asio::detail::mutex mutex_t;
+
+  /// Define type reference of boost::asio::detail::mutex::scoped_lock.
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+
+  /// Constructor.
+  explicit io_service_load(boost::asio::io_service& io_service)
+    : boost::asio::detail::service_base<io_service_load>(io_service),
+      connections_(0),
+      mutex_(),
+      entries_(0)
+  {
+  }
+
+  /// Nothing to destroy.
+  void shutdown_service()
+  {
+  }
+
+  /// Count a connection bound to the io_service.
+  void add(io_load_entry& entry)
+  {
+    {
+      // Lock for synchronize access to data.
+      scoped_lock_t lock(mutex_);
+
+      entry.prev = 0;
+      entry.next = entries_;
+      if (entries_ != 0)
+        entries_->prev = &entry;
+      entries_ = &entry;
+    }
+
+    connections_.fetch_add(1, boost::memory_order_relaxed);
+  }
+
+  /// Count a connection released from the io_service.
+  void remove(io_load_entry& entry)
+  {
+    {
+      // Lock for synchronize access to data.
+      scoped_lock_t lock(mutex_);
+
+      if (entry.prev != 0)
+        entry.prev->next = entry.next;
+      else
+        entries_ = entry.next;
+      if (entry.next != 0)
+        entry.next->prev = entry.prev;
+      entry.prev = 0;
+      entry.next = 0;
+    }
+
+    connections_.fetch_sub(1, boost::memory_order_relaxed);
+  }
+
+  /// Close all live connections with the given error_code, returns the number closed.
+  size_t close_all(const boost::system::error_code& ec)
+  {
+    std::vector<io_load_entry*> entries;
+
+    {
+      // Lock for synchronize access to data.
+      scoped_lock_t lock(mutex_);
+
+      for (io_load_entry* entry = entries_; entry != 0; entry = entry->next)
+        if (entry->acquire(*entry))
+          entries.push_back(entry);
+    }
+
+    // Close out of the lock, a connection may be released by its close.
+    for (size_t i = 0; i < entries.size(); ++i)
+      entries[i]->close(*entries[i], ec);
+
+    return entries.size();
+  }
+
+  /// Get the number of live connections.
+  size_t connections() const
+  {
+    return connections_.load(boost::memory_order_relaxed);
+  }
+
+private:
+  /// The number of live connections.
+  boost::atomic<size_t> connections_;
+
+  /// Mutex for synchronize access to the list of live connections.
+  mutex_t mutex_;
+
+  /// The list of live connections.
+  io_load_entry* entries_;
+};
+
+} // namespace bas
+
+#endif // BAS_IO_SERVICE_LOAD_HPP
@@ -11,20 +11,58 @@
 #ifndef BAS_IO_SERVICE_POOL_HPP
 #define BAS_IO_SERVICE_POOL_HPP
 
+#include <bas/config.hpp>
+
 #include <boost/assert.hpp>
 #include <boost/thread.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/detail/mutex.hpp>
-#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <map>
 #include <vector>
 
+#include <bas/io_service_load.hpp>
+#include <bas/work_scheduler.hpp>
+#include <bas/mem_fn_handler.hpp>
+
 namespace bas {
 
 #define BAS_IO_SERVICE_POOL_INIT_SIZE       4
 #define BAS_IO_SERVICE_POOL_HIGH_WATERMARK  32
 #define BAS_IO_SERVICE_POOL_THREAD_LOAD     100
+#define BAS_IO_SERVICE_POOL_SPIN_TIME       0
+
+// Milliseconds between flushes of the busy-poll statistics of a thread which never blocks.
+#if !defined(BAS_IO_SERVICE_POOL_SPIN_STATS_INTERVAL)
+# define BAS_IO_SERVICE_POOL_SPIN_STATS_INTERVAL  100
+#endif
+
+/// Statistics of the busy-poll run mode of io_service_pool.
+struct spin_stats
+{
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Microseconds spent polling without finding any ready handler.
+  boost::uint64_t spin_time;
+
+  /// Number of handlers executed by polling, without blocking first.
+  boost::uint64_t spin_hits;
+
+  /// Number of times a thread exhausted its spin budget and blocked.
+  boost::uint64_t sleeps;
+
+  spin_stats()
+    : spin_time(0),
+      spin_hits(0),
+      sleeps(0)
+  {
+  }
+};
 
 /// A pool of io_service objects.
 class io_service_pool
@@ -40,20 +78,40 @@ public:
   /// Define type reference of boost::asio::detail::mutex::scoped_lock.
   typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
 
+  /// Strategies for choosing the io_service of a new connection.
+  enum strategy_t
+  {
+    /// Choose io_service one by one.
+    round_robin = 0,
+
+    /// Choose the io_service with the least live connections.
+    least_loaded,
+
+    /// Choose the less loaded one of two io_services picked at random.
+    power_of_two
+  };
+
   /// Constructor.
   io_service_pool(size_t pool_init_size = BAS_IO_SERVICE_POOL_INIT_SIZE,
       size_t pool_high_watermark = BAS_IO_SERVICE_POOL_HIGH_WATERMARK,
       size_t pool_thread_load = BAS_IO_SERVICE_POOL_THREAD_LOAD)
     : mutex_(),
+      blocked_(false),
+      idle_(true),
       io_services_(),
       threads_(),
       work_(),
       pool_init_size_(pool_init_size),
       pool_high_watermark_(pool_high_watermark),
       pool_thread_load_(pool_thread_load),
-      next_io_service_(0),
-      blocked_(false),
-      idle_(true)
+      spin_time_(BAS_IO_SERVICE_POOL_SPIN_TIME),
+      spin_stats_(),
+      work_scheduling_(false),
+      tenant_weights_(),
+      strategy_(round_robin),
+      snapshots_(),
+      snapshot_(0),
+      next_io_service_(0)
   {
     BOOST_ASSERT(pool_init_size_ != 0);
     BOOST_ASSERT(pool_high_watermark_ >= pool_init_size_);
@@ -62,6 +120,8 @@ public:
     // Create io_service pool.
     for (size_t i = 0; i < pool_init_size_; ++i)
       io_services_.push_back(io_service_ptr(new boost::asio::io_service));
+
+    publish_snapshot();
   }
 
   /// Destruct the pool object.
@@ -70,6 +130,10 @@ public:
     // Stop all io_service objects in the pool.
     stop();
 
+    // Release snapshots before the io_services referenced by them.
+    snapshot_ = 0;
+    snapshots_.clear();
+
     // Destroy io_service pool.
     for (size_t i = io_services_.size(); i > 0 ; --i)
       io_services_[i - 1].reset();
@@ -96,6 +160,94 @@ public:
     return *this;
   }
 
+  /// Set the busy-poll budget in microseconds, 0 to block at once.
+  ///   Each thread keeps calling poll() on its io_service for up to the given
+  ///   time before it blocks in run_one(), trading CPU for wake-up latency.
+  io_service_pool& set_spin_time(size_t spin_microseconds = BAS_IO_SERVICE_POOL_SPIN_TIME)
+  {
+    if (threads_.empty())
+      spin_time_ = spin_microseconds;
+
+    return *this;
+  }
+
+  /// Set scheduling of handlers by priority and tenant, for a pool used as work_service.
+  ///   Completions of the handlers bound to the pool are delivered by the
+  ///   work_scheduler of each io_service instead of in arriving order.
+  io_service_pool& set_work_scheduling(bool scheduling = true)
+  {
+    if (threads_.empty())
+      work_scheduling_ = scheduling;
+
+    return *this;
+  }
+
+  /// Get scheduling status of handlers by priority and tenant.
+  bool get_work_scheduling() const
+  {
+    return work_scheduling_;
+  }
+
+  /// Set the weight of the tenant on all io_services of the pool, for a pool used as work_service.
+  ///   The tenant runs weight times the works of a tenant with weight 1.
+  io_service_pool& set_tenant_weight(size_t tenant, size_t weight)
+  {
+    BOOST_ASSERT(weight != 0);
+
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    // Keep the weight for io_services created later.
+    tenant_weights_[tenant] = weight;
+
+    for (size_t i = 0; i < io_services_.size(); ++i)
+      boost::asio::use_service<work_scheduler>(*io_services_[i]).set_weight(tenant, weight);
+
+    return *this;
+  }
+
+  /// Get the statistics of queue delay of the given priority class, accumulated over all io_services.
+  work_class_stats get_work_stats(size_t priority)
+  {
+    const snapshot_t& snapshot = *snapshot_.load(boost::memory_order_acquire);
+
+    work_class_stats stats;
+    for (size_t i = 0; i < snapshot.size(); ++i)
+      stats.merge(boost::asio::use_service<work_scheduler>(*snapshot[i].io_service).get_stats(priority));
+
+    return stats;
+  }
+
+  /// Set the strategy for choosing the io_service of a new connection.
+  io_service_pool& set_strategy(strategy_t strategy = round_robin)
+  {
+    if (threads_.empty())
+      strategy_ = strategy;
+
+    return *this;
+  }
+
+  /// Get the strategy for choosing the io_service of a new connection.
+  strategy_t get_strategy() const
+  {
+    return strategy_;
+  }
+
+  /// Get the busy-poll budget in microseconds.
+  size_t get_spin_time() const
+  {
+    return spin_time_;
+  }
+
+  /// Get the statistics of busy-poll run mode, accumulated over all threads.
+  spin_stats get_spin_stats()
+  {
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    return spin_stats_;
+  }
+
   /// Get the size of the pool.
   size_t size()
   {
@@ -111,6 +263,30 @@ public:
     return pool_thread_load_;
   }
 
+  /// Get the number of live connections on all io_services of the pool.
+  size_t connections()
+  {
+    const snapshot_t& snapshot = *snapshot_.load(boost::memory_order_acquire);
+
+    size_t count = 0;
+    for (size_t i = 0; i < snapshot.size(); ++i)
+      count += snapshot[i].load->connections();
+
+    return count;
+  }
+
+  /// Close the live connections on all io_services of the pool, returns the number closed.
+  size_t close_connections(const boost::system::error_code& ec)
+  {
+    const snapshot_t& snapshot = *snapshot_.load(boost::memory_order_acquire);
+
+    size_t count = 0;
+    for (size_t i = 0; i < snapshot.size(); ++i)
+      count += snapshot[i].load->close_all(ec);
+
+    return count;
+  }
+
   /// Get work status of the pool.
   bool idle()
   {
@@ -146,6 +322,8 @@ public:
       for (size_t i = io_services_.size(); i > pool_init_size_; --i)
         io_services_.pop_back();
 
+      publish_snapshot();
+
       // The pool is still idle now, set to true.
       idle_ = true;
 
@@ -186,17 +364,47 @@ public:
       wait();
   }
 
-  /// Get an io_service to use.
+  /// Get an io_service to use, no lock is taken.
   boost::asio::io_service& get_io_service()
   {
-    // Lock for synchronize access to data.
-    scoped_lock_t lock(mutex_);
+    const snapshot_t& snapshot = *snapshot_.load(boost::memory_order_acquire);
+
+    BOOST_ASSERT(!snapshot.empty());
+
+    size_t count = snapshot.size();
+    size_t next = next_io_service_.fetch_add(1, boost::memory_order_relaxed);
+
+    if (count == 1 || strategy_ == round_robin)
+      return *snapshot[next % count].io_service;
+
+    if (strategy_ == least_loaded)
+    {
+      // Start from a rotating index, spread connections among the equally loaded.
+      size_t best = next % count;
+      size_t best_load = snapshot[best].load->connections();
+      for (size_t i = 1; i < count && best_load != 0; ++i)
+      {
+        size_t index = (next + i) % count;
+        size_t load = snapshot[index].load->connections();
+        if (load < best_load)
+        {
+          best = index;
+          best_load = load;
+        }
+      }
+
+      return *snapshot[best].io_service;
+    }
 
-    // Use a round-robin scheme to choose the next io_service to use.
-    if (next_io_service_ >= io_services_.size())
-      next_io_service_ = 0;
+    // Pick two different io_services by hashing the counter, use the less loaded one.
+    size_t hash = static_cast<size_t>((next + 1) * 2654435761UL);
+    size_t first = hash % count;
+    size_t second = (first + 1 + (hash >> 16) % (count - 1)) % count;
 
-    return *io_services_[next_io_service_++];
+    if (snapshot[second].load->connections() < snapshot[first].load->connections())
+      return *snapshot[second].io_service;
+
+    return *snapshot[first].io_service;
   }
 
   /// Get an io_service to use. if need then create one to use.
@@ -205,21 +413,31 @@ public:
     // Calculate the required number of threads.
     size_t threads_number = load / pool_thread_load_;
 
-    // Lock for synchronize access to data.
-    scoped_lock_t lock(mutex_);
+    // Take the lock only if the pool may grow.
+    size_t service_count = snapshot_.load(boost::memory_order_acquire)->size();
+    if (threads_number <= service_count || service_count >= pool_high_watermark_)
+      return get_io_service();
 
-    size_t service_count = io_services_.size();
-    if (!blocked_                            && \
-        !work_.empty()                       && \
-        !threads_.empty()                    && \
-        threads_number > service_count       && \
-        service_count < pool_high_watermark_)
     {
-      // Create new io_service and start it.
-      io_service_ptr io_service(new boost::asio::io_service);
-      io_services_.push_back(io_service);
-      start_one(io_service);
-      next_io_service_ = service_count;
+      // Lock for synchronize access to data.
+      scoped_lock_t lock(mutex_);
+
+      service_count = io_services_.size();
+      if (!blocked_                            && \
+          !work_.empty()                       && \
+          !threads_.empty()                    && \
+          threads_number > service_count       && \
+          service_count < pool_high_watermark_)
+      {
+        // Create new io_service and start it.
+        io_service_ptr io_service(new boost::asio::io_service);
+        io_services_.push_back(io_service);
+        start_one(io_service);
+        publish_snapshot();
+
+        // Use the new io_service for this connection.
+        return *io_service;
+      }
     }
 
     return get_io_service();
@@ -230,6 +448,33 @@ private:
   typedef boost::shared_ptr<boost::asio::io_service::work> work_ptr;
   typedef boost::shared_ptr<boost::thread> thread_ptr;
 
+  /// An io_service and its connection counter.
+  struct snapshot_entry
+  {
+    boost::asio::io_service* io_service;
+    io_service_load* load;
+  };
+
+  /// Immutable list of the io_services, replaced as a whole when the pool changes.
+  typedef std::vector<snapshot_entry> snapshot_t;
+  typedef boost::shared_ptr<snapshot_t> snapshot_ptr;
+
+  /// Publish a new snapshot of io_services_, must be called with the lock held.
+  ///   Old snapshots are kept until the pool is destroyed, because a reader
+  ///   may still be using one.
+  void publish_snapshot()
+  {
+    snapshot_ptr snapshot(new snapshot_t(io_services_.size()));
+    for (size_t i = 0; i < io_services_.size(); ++i)
+    {
+      (*snapshot)[i].io_service = io_services_[i].get();
+      (*snapshot)[i].load = &boost::asio::use_service<io_service_load>(*io_services_[i]);
+    }
+
+    snapshots_.push_back(snapshot);
+    snapshot_.store(snapshot.get(), boost::memory_order_release);
+  }
+
   /// Wait for all threads in the pool to exit.
   void wait()
   {
@@ -248,7 +493,8 @@ private:
   void run_service(io_service_ptr io_service)
   {
     // Run the io_service and check executed handler number.
-    if (io_service->run() != 0)
+    size_t count = (spin_time_ == 0) ? io_service->run() : spin_service(*io_service);
+    if (count != 0)
     {
       // Lock for synchronize access to data.
       scoped_lock_t lock(mutex_);
@@ -258,20 +504,106 @@ private:
     }
   }
 
+  /// Run an io_service with spin-then-block mode, return executed handler number.
+  size_t spin_service(boost::asio::io_service& io_service)
+  {
+    using namespace boost::posix_time;
+
+    const time_duration budget = microseconds(static_cast<long>(spin_time_));
+    const time_duration interval = milliseconds(BAS_IO_SERVICE_POOL_SPIN_STATS_INTERVAL);
+    ptime flushed = microsec_clock::universal_time();
+    spin_stats stats;
+    size_t count = 0;
+
+    while (!io_service.stopped())
+    {
+      // Poll until some handlers are ready or the budget is exhausted.
+      ptime start = microsec_clock::universal_time();
+      ptime now = start;
+      size_t n = 0;
+      while ((n = io_service.poll()) == 0 && !io_service.stopped())
+      {
+        now = microsec_clock::universal_time();
+        if (now - start >= budget)
+          break;
+      }
+
+      if (n != 0)
+      {
+        count += n;
+        stats.spin_hits += n;
+        stats.spin_time += (now - start).total_microseconds();
+
+        // A busy thread may never sleep, flush statistics periodically too.
+        if (now - flushed >= interval)
+        {
+          merge_spin_stats(stats);
+          stats = spin_stats();
+          flushed = now;
+        }
+        continue;
+      }
+
+      stats.spin_time += (now - start).total_microseconds();
+
+      if (io_service.stopped())
+        break;
+
+      // Budget exhausted, flush statistics before sleeping.
+      ++stats.sleeps;
+      merge_spin_stats(stats);
+      stats = spin_stats();
+      flushed = now;
+
+      // Block until one handler is executed, or the io_service is stopped or runs out of work.
+      n = io_service.run_one();
+      if (n == 0)
+        break;
+
+      count += n;
+    }
+
+    merge_spin_stats(stats);
+
+    return count;
+  }
+
+  /// Accumulate statistics of one thread into the pool.
+  void merge_spin_stats(const spin_stats& stats)
+  {
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    spin_stats_.spin_time += stats.spin_time;
+    spin_stats_.spin_hits += stats.spin_hits;
+    spin_stats_.sleeps += stats.sleeps;
+  }
+
   /// Start an io_service.
   void start_one(io_service_ptr io_service)
   {
     // Reset the io_service in preparation for a subsequent run() invocation.
     io_service->reset();
 
+    // Enable the work_scheduler before any handler is bound to the io_service.
+    if (work_scheduling_)
+    {
+      work_scheduler& scheduler = boost::asio::use_service<work_scheduler>(*io_service);
+      scheduler.enable();
+
+      for (std::map<size_t, size_t>::const_iterator iter = tenant_weights_.begin(); iter != tenant_weights_.end(); ++iter)
+        scheduler.set_weight(iter->first, iter->second);
+    }
+
     // Give the io_service work to do so that its run() functions will not
     //   exit until work was explicitly destroyed.
     work_.push_back(work_ptr(new boost::asio::io_service::work(*io_service)));
 
     // Create a thread to run the io_service.
-    threads_.push_back(thread_ptr(new boost::thread(boost::bind(&io_service_pool::run_service,
-                                                                this,
-                                                                io_service))));
+    threads_.push_back(thread_ptr(new boost::thread(mem_fn_handler1<io_service_pool*,
+                                                                    io_service_pool,
+                                                                    io_service_ptr,
+                                                                    &io_service_pool::run_service>(this, io_service))));
   }
 
   /// Force stop all io_service objects in the pool.
@@ -310,8 +642,29 @@ private:
   /// The carrying load of each thread.
   size_t pool_thread_load_;
 
-  /// The next io_service to use for a connection.
-  size_t next_io_service_;
+  /// The busy-poll budget of each thread in microseconds.
+  size_t spin_time_;
+
+  /// The statistics of busy-poll run mode.
+  spin_stats spin_stats_;
+
+  /// Flag to indicate scheduling of handlers by priority and tenant.
+  bool work_scheduling_;
+
+  /// The weights of tenants for the work_scheduler of each io_service.
+  std::map<size_t, size_t> tenant_weights_;
+
+  /// The strategy for choosing the io_service of a new connection.
+  strategy_t strategy_;
+
+  /// All published snapshots of the io_services.
+  std::vector<snapshot_ptr> snapshots_;
+
+  /// The current snapshot of the io_services.
+  boost::atomic<const snapshot_t*> snapshot_;
+
+  /// Counter for choosing the next io_service to use for a connection.
+  boost::atomic<size_t> next_io_service_;
 };
 
 } // namespace bas
@@ -0,0 +1,427 @@
+//
+// listener_handoff.hpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_LISTENER_HANDOFF_HPP
+#define BAS_LISTENER_HANDOFF_HPP
+
+#include <bas/config.hpp>
+
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+
+#include <boost/asio.hpp>
+#include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bas/io_service_pool.hpp>
+#include <bas/mem_fn_handler.hpp>
+
+namespace bas {
+
+// Maximum number of listening sockets handed over at once.
+#if !defined(BAS_HANDOFF_MAX_LISTENERS)
+# define BAS_HANDOFF_MAX_LISTENERS  16
+#endif
+
+// Seconds to wait for the running process to hand its listening sockets over.
+#if !defined(BAS_HANDOFF_TIMEOUT)
+# define BAS_HANDOFF_TIMEOUT        5
+#endif
+
+/// The first descriptor passed by systemd socket activation.
+#define BAS_LISTEN_FDS_START        3
+
+/// Get the listening sockets passed by systemd socket activation, returns the number of them.
+///   The variables are for this process only, they are removed from the
+///   environment unless unset_environment is false.
+inline std::size_t listen_fds(std::vector<int>& fds, bool unset_environment = true)
+{
+  const char* pid = std::getenv("LISTEN_PID");
+  const char* count = std::getenv("LISTEN_FDS");
+
+  if (pid != 0 && count != 0 && std::atol(pid) == static_cast<long>(::getpid()))
+  {
+    long n = std::atol(count);
+    for (long i = 0; i < n; ++i)
+    {
+      int fd = BAS_LISTEN_FDS_START + static_cast<int>(i);
+
+      // Don't leak the sockets to child processes.
+      ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+      fds.push_back(fd);
+    }
+  }
+
+  if (unset_environment)
+  {
+    ::unsetenv("LISTEN_PID");
+    ::unsetenv("LISTEN_FDS");
+    ::unsetenv("LISTEN_FDNAMES");
+  }
+
+  return fds.size();
+}
+
+/// Hand the listening sockets of a server over to a new process, for restarting without downtime.
+//    The running process offers its listening sockets on a unix domain socket
+//    path. A new process takes them from the path with SCM_RIGHTS, starts to
+//    accept on them and confirms, then the handler of the offer is called, by
+//    which the running process stops accepting, drains its connections and
+//    exits. Connections coming meanwhile wait in the backlog of the listening
+//    sockets shared by both processes, none of them is refused. The path is
+//    open to the owner only, and the sockets are handed to a process of the
+//    same user only.
+class listener_handoff
+  : private boost::noncopyable
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// The protocol of the socket handing the listening sockets over.
+  typedef boost::asio::local::stream_protocol protocol_t;
+
+  /// The type of the handler called when a new process has taken the listening sockets.
+  typedef boost::function<void (const boost::system::error_code&)> handler_t;
+
+  /// Constructor.
+  listener_handoff()
+    : service_pool_(1, 1),
+      acceptor_(service_pool_.get_io_service()),
+      peer_(service_pool_.get_io_service()),
+      listeners_(),
+      handler_(),
+      confirm_(0),
+      offered_(false)
+  {
+  }
+
+  /// Destructor.
+  ~listener_handoff()
+  {
+    close();
+  }
+
+  /// Take the listening sockets offered on the path by the running process, in the new process.
+  ///   Returns false with ec set if no process offers them, then the server
+  ///   binds its endpoint as usual. The caller owns the sockets taken.
+  bool take(const std::string& path, std::vector<int>& listeners, boost::system::error_code& ec)
+  {
+    peer_.connect(protocol_t::endpoint(path), ec);
+    if (!ec)
+      receive_listeners(listeners, ec);
+
+    if (ec)
+    {
+      boost::system::error_code ignored_ec;
+      peer_.close(ignored_ec);
+      return false;
+    }
+
+    return true;
+  }
+
+  /// Tell the process which offered the listening sockets that they are accepted on, in the new process.
+  void confirm()
+  {
+    if (!peer_.is_open())
+      return;
+
+    boost::system::error_code ignored_ec;
+    boost::asio::write(peer_, boost::asio::buffer(&confirm_, 1), ignored_ec);
+    peer_.close(ignored_ec);
+  }
+
+  /// Offer the listening sockets on the path until a new process takes them, in the running process.
+  ///   The handler is called in a background thread once the new process has
+  ///   confirmed, the sockets are offered again if it goes away before that.
+  void offer(const std::string& path,
+      const std::vector<int>& listeners,
+      handler_t handler,
+      boost::system::error_code& ec)
+  {
+    BOOST_ASSERT(!listeners.empty() && listeners.size() <= BAS_HANDOFF_MAX_LISTENERS);
+
+    if (offered_)
+      return;
+
+    protocol_t::endpoint endpoint(path);
+
+    // Take the path over from the process offering before, if any. It may be
+    //   still listening, so the socket file is removed without probing it.
+    struct stat info;
+    if (::lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+      ::unlink(path.c_str());
+
+    acceptor_.open(endpoint.protocol(), ec);
+    if (!ec)
+      acceptor_.bind(endpoint, ec);
+
+    // Restrict the path before listening, no one can connect in between.
+    if (!ec && ::chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0)
+      ec = last_error();
+
+    if (!ec)
+      acceptor_.listen(boost::asio::socket_base::max_connections, ec);
+    if (ec)
+    {
+      boost::system::error_code ignored_ec;
+      acceptor_.close(ignored_ec);
+      return;
+    }
+
+    listeners_ = listeners;
+    handler_ = handler;
+    offered_ = true;
+
+    accept_one();
+
+    // Serve the new process in a background thread.
+    service_pool_.start();
+  }
+
+  /// Stop offering, can't be called from the handler.
+  void close()
+  {
+    if (!offered_)
+      return;
+
+    // Close the sockets in the same thread.
+    service_pool_.get_io_service().dispatch(mem_fn_handler0<listener_handoff*,
+        listener_handoff,
+        &listener_handoff::close_i>(this));
+
+    service_pool_.stop();
+
+    offered_ = false;
+  }
+
+private:
+  /// Close the sockets in io_service thread.
+  void close_i()
+  {
+    boost::system::error_code ignored_ec;
+    acceptor_.close(ignored_ec);
+    peer_.close(ignored_ec);
+  }
+
+  /// Wait for a new process to connect.
+  void accept_one()
+  {
+    acceptor_.async_accept(peer_,
+        mem_fn_wait_handler<listener_handoff*,
+            listener_handoff,
+            &listener_handoff::handle_accept>(this));
+  }
+
+  /// Handle completion of an asynchronous accept operation.
+  void handle_accept(const boost::system::error_code& e)
+  {
+    // The offer has been stopped.
+    if (e == boost::asio::error::operation_aborted)
+      return;
+
+    boost::system::error_code ec = e;
+    if (!ec)
+      check_peer(ec);
+    if (!ec)
+      send_listeners(ec);
+
+    if (ec)
+    {
+      boost::system::error_code ignored_ec;
+      peer_.close(ignored_ec);
+
+      accept_one();
+      return;
+    }
+
+    // Wait for the new process to confirm.
+    boost::asio::async_read(peer_,
+        boost::asio::buffer(&confirm_, 1),
+        mem_fn_io_handler<listener_handoff*,
+            listener_handoff,
+            &listener_handoff::handle_confirm>(this));
+  }
+
+  /// Handle completion of reading the confirmation.
+  void handle_confirm(const boost::system::error_code& e, std::size_t bytes_transferred)
+  {
+    // The offer has been stopped.
+    if (e == boost::asio::error::operation_aborted)
+      return;
+
+    boost::system::error_code ignored_ec;
+    peer_.close(ignored_ec);
+
+    // The new process has gone away without taking over, offer to the next one.
+    if (e || bytes_transferred != 1)
+    {
+      accept_one();
+      return;
+    }
+
+    // The path belongs to the new process now, it's left in place.
+    acceptor_.close(ignored_ec);
+
+    if (handler_)
+      handler_(e);
+  }
+
+  /// Check that the new process runs as the same user as this one.
+  void check_peer(boost::system::error_code& ec)
+  {
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(peer_.native_handle(), SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+      ec = last_error();
+    else if (credentials.uid != ::geteuid())
+      ec = boost::asio::error::access_denied;
+  }
+
+  /// Send the number of listening sockets and the sockets to the new process.
+  void send_listeners(boost::system::error_code& ec)
+  {
+    boost::uint32_t count = static_cast<boost::uint32_t>(listeners_.size());
+    char control[CMSG_SPACE(sizeof(int) * BAS_HANDOFF_MAX_LISTENERS)];
+    std::memset(control, 0, sizeof(control));
+
+    iovec iov;
+    iov.iov_base = &count;
+    iov.iov_len = sizeof(count);
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    std::memcpy(CMSG_DATA(cmsg), &listeners_[0], sizeof(int) * count);
+
+    // A small message on a new connection does not block.
+    if (::sendmsg(peer_.native_handle(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(count)))
+      ec = last_error();
+  }
+
+  /// Receive the number of listening sockets and the sockets from the running process.
+  void receive_listeners(std::vector<int>& listeners, boost::system::error_code& ec)
+  {
+    // Don't hang the start of the new process on a stuck one.
+    pollfd pfd;
+    pfd.fd = peer_.native_handle();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int ready = ::poll(&pfd, 1, BAS_HANDOFF_TIMEOUT * 1000);
+    if (ready <= 0)
+    {
+      ec = (ready == 0) ? boost::system::error_code(boost::asio::error::timed_out) : last_error();
+      return;
+    }
+
+    boost::uint32_t count = 0;
+    char control[CMSG_SPACE(sizeof(int) * BAS_HANDOFF_MAX_LISTENERS)];
+    std::memset(control, 0, sizeof(control));
+
+    iovec iov;
+    iov.iov_base = &count;
+    iov.iov_len = sizeof(count);
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = ::recvmsg(peer_.native_handle(), &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (n < 0)
+    {
+      ec = last_error();
+      return;
+    }
+
+    // Keep every descriptor received, even from a malformed message, to close them.
+    std::vector<int> fds;
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != 0 && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    {
+      fds.resize((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      if (!fds.empty())
+        std::memcpy(&fds[0], CMSG_DATA(cmsg), sizeof(int) * fds.size());
+    }
+
+    if (n == 0)
+      ec = boost::asio::error::eof;
+    else if (n != static_cast<ssize_t>(sizeof(count)) || count == 0 || fds.size() != count || (msg.msg_flags & MSG_CTRUNC) != 0)
+      ec = boost::asio::error::invalid_argument;
+
+    if (ec)
+    {
+      for (size_t i = 0; i < fds.size(); ++i)
+        ::close(fds[i]);
+
+      return;
+    }
+
+    listeners.insert(listeners.end(), fds.begin(), fds.end());
+  }
+
+  /// Get the error of the last system call.
+  static boost::system::error_code last_error()
+  {
+    return boost::system::error_code(errno, boost::asio::error::get_system_category());
+  }
+
+private:
+  /// The pool of io_service objects used to serve the new process.
+  io_service_pool service_pool_;
+
+  /// The acceptor of the path offering the listening sockets.
+  protocol_t::acceptor acceptor_;
+
+  /// The connection between the running process and the new one.
+  protocol_t::socket peer_;
+
+  /// The listening sockets offered.
+  std::vector<int> listeners_;
+
+  /// The handler called when a new process has taken the listening sockets.
+  handler_t handler_;
+
+  /// The confirmation byte.
+  char confirm_;
+
+  /// Flag to indicate whether the listening sockets are offered.
+  bool offered_;
+};
+
+} // namespace bas
+
+#endif // defined(BAS_HAS_LISTENER_HANDOFF)
+
+#endif // BAS_LISTENER_HANDOFF_HPP
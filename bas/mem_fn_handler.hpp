@@ -0,0 +1,188 @@
+//
+// mem_fn_handler.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_MEM_FN_HANDLER_HPP
+#define BAS_MEM_FN_HANDLER_HPP
+
+#include <cstddef>
+
+#include <boost/system/error_code.hpp>
+#include <boost/type_traits/remove_const.hpp>
+#include <boost/type_traits/remove_reference.hpp>
+
+namespace bas {
+
+// Function objects calling a member function known at compile time.
+//   Unlike boost::bind, the member function pointer is a template argument,
+//   so a handler only holds the object pointer and the bound arguments, and
+//   the call is resolved statically.
+
+/// Trait for the stored type of a bound argument.
+template<typename Arg>
+struct mem_fn_arg
+{
+  typedef typename boost::remove_const<typename boost::remove_reference<Arg>::type>::type type;
+};
+
+/// Function object for calling a member function without argument.
+template<typename Pointer, typename T, void (T::*Fn)()>
+class mem_fn_handler0
+{
+public:
+  explicit mem_fn_handler0(const Pointer& object)
+    : object_(object)
+  {
+  }
+
+  void operator()()
+  {
+    ((*object_).*Fn)();
+  }
+
+private:
+  Pointer object_;
+};
+
+/// Function object for calling a member function with one bound argument.
+template<typename Pointer, typename T, typename Arg1, void (T::*Fn)(Arg1)>
+class mem_fn_handler1
+{
+public:
+  mem_fn_handler1(const Pointer& object, const typename mem_fn_arg<Arg1>::type& arg1)
+    : object_(object),
+      arg1_(arg1)
+  {
+  }
+
+  void operator()()
+  {
+    ((*object_).*Fn)(arg1_);
+  }
+
+private:
+  Pointer object_;
+  typename mem_fn_arg<Arg1>::type arg1_;
+};
+
+/// Function object for calling a member function with two bound arguments.
+template<typename Pointer, typename T, typename Arg1, typename Arg2, void (T::*Fn)(Arg1, Arg2)>
+class mem_fn_handler2
+{
+public:
+  mem_fn_handler2(const Pointer& object,
+      const typename mem_fn_arg<Arg1>::type& arg1,
+      const typename mem_fn_arg<Arg2>::type& arg2)
+    : object_(object),
+      arg1_(arg1),
+      arg2_(arg2)
+  {
+  }
+
+  void operator()()
+  {
+    ((*object_).*Fn)(arg1_, arg2_);
+  }
+
+private:
+  Pointer object_;
+  typename mem_fn_arg<Arg1>::type arg1_;
+  typename mem_fn_arg<Arg2>::type arg2_;
+};
+
+/// Function object for calling a member function with three bound arguments.
+template<typename Pointer, typename T, typename Arg1, typename Arg2, typename Arg3, void (T::*Fn)(Arg1, Arg2, Arg3)>
+class mem_fn_handler3
+{
+public:
+  mem_fn_handler3(const Pointer& object,
+      const typename mem_fn_arg<Arg1>::type& arg1,
+      const typename mem_fn_arg<Arg2>::type& arg2,
+      const typename mem_fn_arg<Arg3>::type& arg3)
+    : object_(object),
+      arg1_(arg1),
+      arg2_(arg2),
+      arg3_(arg3)
+  {
+  }
+
+  void operator()()
+  {
+    ((*object_).*Fn)(arg1_, arg2_, arg3_);
+  }
+
+private:
+  Pointer object_;
+  typename mem_fn_arg<Arg1>::type arg1_;
+  typename mem_fn_arg<Arg2>::type arg2_;
+  typename mem_fn_arg<Arg3>::type arg3_;
+};
+
+/// Function object for completion of wait, connect and accept operations.
+template<typename Pointer, typename T, void (T::*Fn)(const boost::system::error_code&)>
+class mem_fn_wait_handler
+{
+public:
+  explicit mem_fn_wait_handler(const Pointer& object)
+    : object_(object)
+  {
+  }
+
+  void operator()(const boost::system::error_code& ec)
+  {
+    ((*object_).*Fn)(ec);
+  }
+
+private:
+  Pointer object_;
+};
+
+/// Function object for completion of wait, connect and accept operations with one bound argument.
+template<typename Pointer, typename T, typename Arg1, void (T::*Fn)(const boost::system::error_code&, Arg1)>
+class mem_fn_wait_handler1
+{
+public:
+  mem_fn_wait_handler1(const Pointer& object, const typename mem_fn_arg<Arg1>::type& arg1)
+    : object_(object),
+      arg1_(arg1)
+  {
+  }
+
+  void operator()(const boost::system::error_code& ec)
+  {
+    ((*object_).*Fn)(ec, arg1_);
+  }
+
+private:
+  Pointer object_;
+  typename mem_fn_arg<Arg1>::type arg1_;
+};
+
+/// Function object for completion of read and write operations.
+template<typename Pointer, typename T, void (T::*Fn)(const boost::system::error_code&, std::size_t)>
+class mem_fn_io_handler
+{
+public:
+  explicit mem_fn_io_handler(const Pointer& object)
+    : object_(object)
+  {
+  }
+
+  void operator()(const boost::system::error_code& ec, std::size_t bytes_transferred)
+  {
+    ((*object_).*Fn)(ec, bytes_transferred);
+  }
+
+private:
+  Pointer object_;
+};
+
+} // namespace bas
+
+#endif // BAS_MEM_FN_HANDLER_HPP
@@ -0,0 +1,132 @@
+//
+// rate_limiter.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_RATE_LIMITER_HPP
+#define BAS_RATE_LIMITER_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/assert.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace bas {
+
+/// Token bucket for limiting the bytes sent per second.
+//    Tokens are refilled at rate bytes per second up to burst bytes. A send
+//    always takes its tokens and may leave the bucket in debt, the caller
+//    waits until the debt is paid. Large sends are never starved and the
+//    long-term rate is kept. A limiter may be shared by a group of handlers
+//    running in different threads.
+class rate_limiter
+  : private boost::noncopyable
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Constructor, the burst is one second of rate if not given.
+  explicit rate_limiter(size_t rate, size_t burst = 0)
+    : mutex_(),
+      rate_(0),
+      burst_(0),
+      tokens_(0),
+      last_(boost::posix_time::microsec_clock::universal_time())
+  {
+    set_rate(rate, burst);
+    tokens_ = static_cast<double>(burst_);
+  }
+
+  /// Change the rate and the burst, can be called from any thread.
+  void set_rate(size_t rate, size_t burst = 0)
+  {
+    BOOST_ASSERT(rate != 0);
+
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    rate_ = rate;
+    burst_ = (burst == 0) ? rate : burst;
+    if (tokens_ > static_cast<double>(burst_))
+      tokens_ = static_cast<double>(burst_);
+  }
+
+  /// Get the rate in bytes per second.
+  size_t get_rate()
+  {
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    return rate_;
+  }
+
+  /// Get the burst in bytes.
+  size_t get_burst()
+  {
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    return burst_;
+  }
+
+  /// Take tokens for sending bytes, return the time to wait before sending.
+  boost::posix_time::time_duration acquire(size_t bytes)
+  {
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    // Refill tokens for the elapsed time.
+    if (now > last_)
+    {
+      tokens_ += static_cast<double>(rate_) * (now - last_).total_microseconds() / 1000000.0;
+      if (tokens_ > static_cast<double>(burst_))
+        tokens_ = static_cast<double>(burst_);
+
+      last_ = now;
+    }
+
+    tokens_ -= static_cast<double>(bytes);
+    if (tokens_ >= 0)
+      return boost::posix_time::time_duration();
+
+    // Wait until the debt is paid.
+    return boost::posix_time::microseconds(static_cast<long>(-tokens_ * 1000000.0 / rate_) + 1);
+  }
+
+private:
+  typedef boost::asio::detail::mutex mutex_t;
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+
+  /// Mutex for synchronize access to data.
+  mutex_t mutex_;
+
+  /// The rate in bytes per second.
+  size_t rate_;
+
+  /// The burst in bytes.
+  size_t burst_;
+
+  /// Available tokens, negative for debt.
+  double tokens_;
+
+  /// The time of last refilling.
+  boost::posix_time::ptime last_;
+};
+
+/// Define type reference of boost::shared_ptr<rate_limiter>.
+typedef boost::shared_ptr<rate_limiter> rate_limiter_ptr;
+
+} // namespace bas
+
+#endif // BAS_RATE_LIMITER_HPP
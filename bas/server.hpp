@@ -11,21 +11,29 @@
 #ifndef BAS_SERVER_HPP
 #define BAS_SERVER_HPP
 
+#include <bas/config.hpp>
+
 #include <boost/assert.hpp>
 #include <boost/asio.hpp>
-#include <boost/bind.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <bas/io_service_group.hpp>
+#include <bas/mem_fn_handler.hpp>
 #include <bas/service_handler.hpp>
 #include <bas/service_handler_pool.hpp>
+#include <bas/socket_traits.hpp>
 
 namespace bas {
 
 #define BAS_ACCEPT_QUEUE_LENGTH   250
 #define BAS_ACCEPT_DELAY_SECONDS  1
 
+#if defined(SO_BUSY_POLL)
+/// Socket option for busy polling the device queue on blocking receives, in microseconds.
+typedef boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL> busy_poll;
+#endif
+
 /// The top-level class of the server.
 template<typename Work_Handler, typename Work_Allocator, typename Socket_Service = boost::asio::ip::tcp::socket>
 class server
@@ -35,12 +43,17 @@ public:
   /// Define type reference of std::size_t.
   typedef std::size_t size_type;
 
-  /// Define type reference of boost::asio::ip::tcp::endpoint.
-  typedef boost::asio::ip::tcp::endpoint endpoint_t;
+  /// The types of the protocol carried by the socket.
+  typedef socket_traits<Socket_Service> socket_traits_t;
+  typedef typename socket_traits_t::endpoint_t endpoint_t;
+  typedef typename socket_traits_t::acceptor_t acceptor_t;
+
+  /// The type of the native handle of the listening socket.
+  typedef typename acceptor_t::native_handle_type native_handle_t;
 
   /// The type of the service_handler.
   typedef service_handler<Work_Handler, Socket_Service> service_handler_t;
-  typedef boost::shared_ptr<service_handler_t> service_handler_ptr;
+  typedef typename service_handler_t::service_handler_ptr service_handler_ptr;
 
   /// The type of the service_handler_pool.
   typedef service_handler_pool<Work_Handler, Work_Allocator, Socket_Service> service_handler_pool_t;
@@ -63,6 +76,9 @@ public:
       acceptor_service_pool_(1),
       acceptor_(acceptor_service_pool_.get_io_service()),
       timer_(acceptor_.get_io_service()),
+      busy_poll_(0),
+      listener_(),
+      has_listener_(false),
       started_(false),
       block_(false),
       has_service_group_(true)
@@ -89,6 +105,9 @@ public:
       acceptor_service_pool_(1),
       acceptor_(acceptor_service_pool_.get_io_service()),
       timer_(acceptor_.get_io_service()),
+      busy_poll_(0),
+      listener_(),
+      has_listener_(false),
       started_(false),
       block_(false),
       has_service_group_(false)
@@ -126,6 +145,15 @@ public:
     return *this;
   }
 
+  /// Set seconds to wait for the connections to finish when stopping gracefully.
+  server& set_drain_timeout(unsigned int seconds = BAS_DRAIN_TIMEOUT)
+  {
+    if (!started_ && service_group_.get() != 0)
+      service_group_->set_drain_timeout(seconds);
+
+    return *this;
+  }
+
   /// Set io_service_group to use.
   server& set(io_service_group_ptr& service_group)
   {
@@ -139,16 +167,63 @@ public:
     return *this;
   }
 
-  /// Start server with non-blocked model.
+  /// Set SO_BUSY_POLL in microseconds for accepted sockets, 0 to disable.
+  ///   Only effective on platforms supporting SO_BUSY_POLL.
+  server& set_busy_poll(int microseconds)
+  {
+    if (!started_)
+      busy_poll_ = microseconds;
+
+    return *this;
+  }
+
+  /// Accept on a listening socket instead of binding the endpoint, the server owns it.
+  ///   The socket is passed from another process, such as the one taken by
+  ///   listener_handoff or the one of systemd socket activation.
+  server& set_listener(native_handle_t listener)
+  {
+    if (!started_)
+    {
+      listener_ = listener;
+      has_listener_ = true;
+    }
+
+    return *this;
+  }
+
+  /// Get the listening socket, valid while the server is started.
+  native_handle_t listener()
+  {
+    return acceptor_.native_handle();
+  }
+
+  /// Start server with non-blocked model, throws if the endpoint can't be
+  ///   bound or the listening socket can't be assigned.
   void start()
   {
-    start(false);
+    boost::system::error_code ec;
+    start(false, ec);
+    boost::asio::detail::throw_error(ec);
   }
 
-  /// Run server with blocked model.
+  /// Start server with non-blocked model, ec is set if it fails.
+  void start(boost::system::error_code& ec)
+  {
+    start(false, ec);
+  }
+
+  /// Run server with blocked model, throws if it fails to start.
   void run()
   {
-    start(true);
+    boost::system::error_code ec;
+    start(true, ec);
+    boost::asio::detail::throw_error(ec);
+  }
+
+  /// Run server with blocked model, ec is set if it fails to start.
+  void run(boost::system::error_code& ec)
+  {
+    start(true, ec);
   }
 
   /// Stop server.
@@ -160,15 +235,16 @@ public:
       return;
 
     // Close the acceptor in the same thread.
-    acceptor_.get_io_service().dispatch(boost::bind(&boost::asio::ip::tcp::acceptor::close,
-        &acceptor_));
+    acceptor_.get_io_service().dispatch(mem_fn_handler0<server*,
+        server,
+        &server::close_acceptor>(this));
 
     // Stop accept_service_pool.
     acceptor_service_pool_.stop();
 
     if (!block_)
     {
-      // Stop internal io_service_group.
+      // Stop internal io_service_group, the connections are drained after accepting stopped.
       if (has_service_group_)
         service_group_->stop();
 
@@ -176,25 +252,63 @@ public:
     }
   }
 
+  /// Stop accepting new connections, the connections in progress are kept.
+  void stop_accept()
+  {
+    if (!started_)
+      return;
+
+    // Close the acceptor in the same thread.
+    acceptor_.get_io_service().dispatch(mem_fn_handler0<server*,
+        server,
+        &server::close_acceptor>(this));
+  }
+
 private:
   /// Start server with given mode.
-  void start(bool block)
+  void start(bool block, boost::system::error_code& ec)
   {
+    ec = boost::system::error_code();
     if (started_                  || \
         service_group_.get() == 0 || \
         !has_service_group_ && !service_group_->started())
       return;
 
-    // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
-    acceptor_.open(endpoint_.protocol());
-    acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    if (has_listener_)
+    {
+      // Accept on the listening socket passed from another process.
+      acceptor_.assign(endpoint_.protocol(), listener_, ec);
+      if (ec)
+      {
+        // The server owns the socket, it's closed even if not assigned.
+        close_listener();
+        return;
+      }
+    }
+    else
+    {
+      // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
+      acceptor_.open(endpoint_.protocol(), ec);
+      if (!ec)
+        acceptor_.set_option(boost::asio::socket_base::reuse_address(true), ec);
+
+      // A local endpoint needs the socket file left by last run removed.
+      if (!ec)
+      {
+        prepare_bind(endpoint_);
+        acceptor_.bind(endpoint_, ec);
+      }
 
-    boost::system::error_code e;
-    acceptor_.bind(endpoint_, e);
-    if (e)
-      return;
+      if (!ec)
+        acceptor_.listen(boost::asio::socket_base::max_connections, ec);
 
-    acceptor_.listen();
+      if (ec)
+      {
+        boost::system::error_code ignored_ec;
+        acceptor_.close(ignored_ec);
+        return;
+      }
+    }
   
     // Accept new connections.
     for (size_t i = 0; i < accept_queue_length_; ++i)
@@ -228,11 +342,33 @@ private:
     }
   }
 
+  /// Close the listening socket passed from another process, which is not assigned.
+  void close_listener()
+  {
+#if defined(BOOST_WINDOWS)
+    ::closesocket(listener_);
+#else
+    ::close(listener_);
+#endif
+    has_listener_ = false;
+  }
+
+  /// Close the acceptor in io_service thread.
+  void close_acceptor()
+  {
+    boost::system::error_code ignored_ec;
+    acceptor_.close(ignored_ec);
+
+    // Don't accept again after the delay.
+    timer_.cancel(ignored_ec);
+  }
+
   /// Start an asynchronous accept, can be call from any thread.
   void accept_one()
   {
-    acceptor_.get_io_service().dispatch(boost::bind(&server::accept_one_i,
-        this));
+    acceptor_.get_io_service().dispatch(mem_fn_handler0<server*,
+        server,
+        &server::accept_one_i>(this));
   }
 
   /// Start an asynchronous accept in io_service thread.
@@ -246,19 +382,19 @@ private:
     if (handler.get() == 0)
     {
       timer_.expires_from_now(boost::posix_time::seconds(BAS_ACCEPT_DELAY_SECONDS));
-      timer_.async_wait(boost::bind(&server::handle_timeout,
-          this,
-          boost::asio::placeholders::error));
+      timer_.async_wait(mem_fn_wait_handler<server*,
+          server,
+          &server::handle_timeout>(this));
       
       return;
     }
 
     // Use new handler to accept.
     acceptor_.async_accept(handler->socket().lowest_layer(),
-        boost::bind(&server::handle_accept,
-            this,
-            boost::asio::placeholders::error,
-            handler));
+        mem_fn_wait_handler1<server*,
+            server,
+            service_handler_ptr,
+            &server::handle_accept>(this, handler));
   }
 
   /// Handle completion of an asynchronous accept operation.
@@ -267,6 +403,15 @@ private:
   {
     if (!e)
     {
+#if defined(SO_BUSY_POLL)
+      // Enable busy polling on the accepted socket.
+      if (busy_poll_ != 0)
+      {
+        boost::system::error_code ignored_ec;
+        handler->socket().lowest_layer().set_option(busy_poll(busy_poll_), ignored_ec);
+      }
+#endif
+
       // Start the first operation of the current handler.
       handler->start();
 
@@ -307,7 +452,7 @@ private:
   io_service_pool acceptor_service_pool_;
 
   /// The acceptor used to listen for incoming connections.
-  boost::asio::ip::tcp::acceptor acceptor_;
+  acceptor_t acceptor_;
 
   /// The timer for repeat accept delay.
   boost::asio::deadline_timer timer_;
@@ -318,6 +463,15 @@ private:
   /// The queue length for async_accept.
   size_t accept_queue_length_;
 
+  /// The SO_BUSY_POLL value of accepted sockets in microseconds.
+  int busy_poll_;
+
+  /// The listening socket passed from another process.
+  native_handle_t listener_;
+
+  /// Flag to indicate whether the server accepts on a listening socket passed from another process.
+  bool has_listener_;
+
   /// Flag to indicate whether the server is started.
   bool started_;
 
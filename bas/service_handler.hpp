@@ -11,15 +11,30 @@
 #ifndef BAS_SERVICE_HANDLER_HPP
 #define BAS_SERVICE_HANDLER_HPP
 
+#include <bas/config.hpp>
+
 #include <boost/assert.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/atomic.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
-#include <boost/bind.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/enable_shared_from_this.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/utility/in_place_factory.hpp>
+#include <algorithm>
+#include <vector>
 
+#include <bas/completion_queue.hpp>
 #include <bas/io_buffer.hpp>
+#include <bas/io_service_load.hpp>
+#include <bas/mem_fn_handler.hpp>
+#include <bas/rate_limiter.hpp>
+#include <bas/shared_buffers.hpp>
+#include <bas/socket_traits.hpp>
+#include <bas/work_scheduler.hpp>
 
 namespace bas {
 
@@ -58,57 +73,133 @@ struct event_t
 /// Define type reference of enevt_t.
 typedef event_t event;
 
+/// Interface for recycling a service_handler when its last reference is released.
+template<typename Service_Handler>
+class service_handler_recycler
+{
+public:
+  /// Destructor.
+  virtual ~service_handler_recycler()
+  {
+  }
+
+  /// Take back the handler, which is no longer referenced.
+  virtual void put_handler(Service_Handler* handler_ptr) = 0;
+};
+
 /// Object for handle socket asynchronous operations.
+//    The work allocator makes the work handler and the socket in the storage
+//    of the handler by make_handler(address) and make_socket(address, io_service).
+//    The work handler may refer to the service_handler before it is complete,
+//    so it is placed behind the handler in the same block, which requires the
+//    handler to be made by new.
 template<typename Work_Handler, typename Socket_Service = boost::asio::ip::tcp::socket>
 class service_handler
-  : public boost::enable_shared_from_this<service_handler<Work_Handler, Socket_Service> >,
-    private boost::noncopyable
+  : private boost::noncopyable
 {
 public:
-  using boost::enable_shared_from_this<service_handler<Work_Handler, Socket_Service> >::shared_from_this;
-
   /// Define type reference of std::size_t.
   typedef std::size_t size_t;
 
   /// Define type reference of boost::asio::io_service.
   typedef boost::asio::io_service io_service_t;
 
-  /// Define type reference of boost::asio::ip::tcp::endpoint.
-  typedef boost::asio::ip::tcp::endpoint endpoint_t;
+  /// Define type reference of the endpoint of the socket protocol.
+  typedef typename socket_traits<Socket_Service>::endpoint_t endpoint_t;
 
   /// The type of the service_handler.
   typedef service_handler<Work_Handler, Socket_Service> service_handler_t;
 
+  /// The type of the reference counted pointer to service_handler.
+  typedef boost::intrusive_ptr<service_handler_t> service_handler_ptr;
+
+  /// The type of the object recycling the service_handler.
+  typedef service_handler_recycler<service_handler_t> recycler_t;
+  typedef boost::shared_ptr<recycler_t> recycler_ptr;
+
   /// The type of the work_handler.
   typedef Work_Handler work_handler_t;
 
   /// The type of the socket that will be used to provide asynchronous operations.
   typedef Socket_Service socket_t;
 
-  /// Constructor.
-  service_handler(work_handler_t* work_handler,
+  /// Constructor, the work handler is made by the work allocator in place.
+  template<typename Work_Allocator>
+  service_handler(Work_Allocator& work_allocator,
       size_t read_buffer_size,
       size_t write_buffer_size = 0,
       unsigned int session_timeout = 0,
       unsigned int io_timeout = 0)
-    : work_handler_(work_handler),
+    : ref_count_(0),
+      stopped_(true),
+      half_close_(false),
+      io_service_(0),
+      work_service_(0),
+      running_(0),
+      completion_queue_(0),
+      scheduler_(0),
+      priority_(BAS_WORK_PRIORITY_DEFAULT),
+      tenant_(BAS_WORK_TENANT_DEFAULT),
+      io_load_(0),
+      io_entry_(this, &service_handler_t::acquire_entry, &service_handler_t::close_entry),
+      work_handler_(0),
       socket_(),
+      read_buffer_(read_buffer_size),
+      write_buffer_(write_buffer_size),
       session_timer_(),
       io_timer_(),
-      io_service_(0),
-      work_service_(0),
-      stopped_(true),
+      write_timer_(),
+      pace_timer_(),
+      rate_limiter_(),
+      group_rate_limiter_(),
       session_timeout_(session_timeout),
       io_timeout_(io_timeout),
-      read_buffer_(read_buffer_size),
-      write_buffer_(write_buffer_size)
+      recycler_(),
+      events_mutex_(),
+      events_scheduled_(false),
+      pending_events_(),
+      delivering_events_()
   {
-    BOOST_ASSERT(work_handler_.get() != 0);
+    // Make the work handler last, nothing can throw after it is constructed.
+    work_handler_ = work_allocator.make_handler(reinterpret_cast<char*>(this) + work_handler_offset());
+
+    BOOST_ASSERT(work_handler_ != 0);
   }
 
   /// Destruct the service handler.
   ~service_handler()
   {
+    work_handler_->~work_handler_t();
+  }
+
+  /// Allocate the handler and its work handler in one block, the handler
+  ///   starts on a cache line boundary and the padding of the reference
+  ///   count keeps it away from the members behind it.
+  static void* operator new(std::size_t size)
+  {
+    BOOST_ASSERT(size == sizeof(service_handler_t));
+
+    void* block = ::operator new(work_handler_offset() + sizeof(work_handler_t) + BAS_CACHE_LINE_SIZE);
+    std::size_t address = (reinterpret_cast<std::size_t>(block) + BAS_CACHE_LINE_SIZE)
+        & ~static_cast<std::size_t>(BAS_CACHE_LINE_SIZE - 1);
+
+    // Keep the allocated block just before the handler for releasing it.
+    reinterpret_cast<void**>(address)[-1] = block;
+
+    return reinterpret_cast<void*>(address);
+  }
+
+  /// Release the block allocated for the handler.
+  static void operator delete(void* address)
+  {
+    if (address != 0)
+      ::operator delete(static_cast<void**>(address)[-1]);
+  }
+
+  /// Get a reference counted pointer to the service_handler.
+  service_handler_ptr shared_from_this()
+  {
+    return service_handler_ptr(this);
   }
 
   /// Get the io_buffer for incoming data.
@@ -142,11 +233,17 @@ public:
   /// Get the socket associated with the service_handler.
   socket_t& socket()
   {
-    BOOST_ASSERT(socket_.get() != 0);
+    BOOST_ASSERT(socket_.is_initialized());
 
     return *socket_;
   }
 
+  /// Get the work handler, only for use in work_service thread.
+  work_handler_t& work_handler()
+  {
+    return *work_handler_;
+  }
+
   /// Close the handler with the given error_code from any thread.
   void close(const boost::system::error_code& ec)
   {
@@ -155,9 +252,10 @@ public:
       return;
 
     // Dispatch to io_service thread.
-    io_service().dispatch(boost::bind(&service_handler_t::close_i,
-                                      shared_from_this(),
-                                      ec));
+    io_service().dispatch(mem_fn_handler1<service_handler_ptr,
+                                          service_handler_t,
+                                          const boost::system::error_code&,
+                                          &service_handler_t::close_i>(shared_from_this(), ec));
   }
 
   /// Close the handler with the error_code 0 from any thread.
@@ -166,6 +264,22 @@ public:
     close(boost::system::error_code());
   }
 
+  /// Set delivering of end of stream before starting to read.
+  ///   If set, end of stream is delivered to on_read with 0 bytes transferred
+  ///   instead of closing the handler, so the sending side keeps working.
+  void set_half_close(bool half_close = true)
+  {
+    half_close_ = half_close;
+  }
+
+  /// Shut down the sending side of the socket from any thread, the peer reads end of stream.
+  void shutdown_send()
+  {
+    io_service().dispatch(mem_fn_handler0<service_handler_ptr,
+                                          service_handler_t,
+                                          &service_handler_t::shutdown_send_i>(shared_from_this()));
+  }
+
   /// Start asynchronous read operation from any thread.
   /// Caller must be sure that read_buffer().space() > 0.
   void async_read_some()
@@ -183,9 +297,13 @@ public:
   template<typename Buffers>
   void async_read_some(const Buffers& buffers)
   {
-    io_service().dispatch(boost::bind(&service_handler_t::async_read_some_i<Buffers>,
-                                      shared_from_this(),
-                                      buffers));
+    typedef typename buffers_holder<Buffers>::type buffers_t;
+
+    io_service().dispatch(mem_fn_handler1<service_handler_ptr,
+                                          service_handler_t,
+                                          const buffers_t&,
+                                          &service_handler_t::template async_read_some_i<buffers_t> >(shared_from_this(),
+                                              buffers_holder<Buffers>::hold(buffers)));
   }
 
   /// Start asynchronous read operation from any thread.
@@ -205,9 +323,13 @@ public:
   template<typename Buffers>
   void async_read(const Buffers& buffers)
   {
-    io_service().dispatch(boost::bind(&service_handler_t::async_read_i<Buffers>,
-                                      shared_from_this(),
-                                      buffers));
+    typedef typename buffers_holder<Buffers>::type buffers_t;
+
+    io_service().dispatch(mem_fn_handler1<service_handler_ptr,
+                                          service_handler_t,
+                                          const buffers_t&,
+                                          &service_handler_t::template async_read_i<buffers_t> >(shared_from_this(),
+                                              buffers_holder<Buffers>::hold(buffers)));
   }
 
   /// Start asynchronous write operation from any thread.
@@ -240,25 +362,111 @@ public:
   template<typename Buffers>
   void async_write(const Buffers& buffers)
   {
-    io_service().dispatch(boost::bind(&service_handler_t::async_write_i<Buffers>,
-                                      shared_from_this(),
-                                      buffers));
+    typedef typename buffers_holder<Buffers>::type buffers_t;
+
+    io_service().dispatch(mem_fn_handler1<service_handler_ptr,
+                                          service_handler_t,
+                                          const buffers_t&,
+                                          &service_handler_t::template async_write_i<buffers_t> >(shared_from_this(),
+                                              buffers_holder<Buffers>::hold(buffers)));
+  }
+
+  /// Cancel the session timeout from any thread, for a long lived session
+  ///   whose peer is checked by the work handler itself.
+  void cancel_session_timeout()
+  {
+    io_service().dispatch(mem_fn_handler0<service_handler_ptr,
+                                          service_handler_t,
+                                          &service_handler_t::cancel_session_expiry>(shared_from_this()));
+  }
+
+  /// Limit the bytes written per second of the handler from any thread, 0 for no limit.
+  ///   Call it in on_open or later. The kernel paces the socket by
+  ///   SO_MAX_PACING_RATE if supported, the burst is ignored then. Otherwise
+  ///   writes over budget are deferred by a timer on the io_service.
+  void set_rate_limit(size_t rate, size_t burst = 0)
+  {
+    io_service().dispatch(mem_fn_handler2<service_handler_ptr,
+                                          service_handler_t,
+                                          size_t,
+                                          size_t,
+                                          &service_handler_t::set_rate_limit_i>(shared_from_this(), rate, burst));
+  }
+
+  /// Share the limiter with a group of handlers from any thread, null for no limit.
+  ///   Writes over the budget of the group are deferred by a timer on the io_service.
+  void set_rate_limiter(const rate_limiter_ptr& limiter)
+  {
+    io_service().dispatch(mem_fn_handler1<service_handler_ptr,
+                                          service_handler_t,
+                                          const rate_limiter_ptr&,
+                                          &service_handler_t::set_rate_limiter_i>(shared_from_this(), limiter));
   }
 
   /// Post event to the child handler from the parent handler.
   void parent_post(const event_t event)
   {
-    work_service().post(boost::bind(&service_handler_t::do_parent,
-                                    shared_from_this(),
-                                    event));
+    work_service().post(mem_fn_handler1<service_handler_ptr,
+                                        service_handler_t,
+                                        const event_t,
+                                        &service_handler_t::do_parent>(shared_from_this(), event));
   }
 
   /// Post event to the parent handler from the child handler.
   void child_post(const event_t event)
   {
-    work_service().post(boost::bind(&service_handler_t::do_child,
-                                    shared_from_this(),
-                                    event));
+    work_service().post(mem_fn_handler1<service_handler_ptr,
+                                        service_handler_t,
+                                        const event_t,
+                                        &service_handler_t::do_child>(shared_from_this(), event));
+  }
+
+  /// Dispatch event to the child handler from the parent handler.
+  /// If called in the work_service thread and the handler is not running any
+  ///   callback of the work handler, on_parent is called at once. Otherwise the
+  ///   event is queued, and all queued events are delivered in one callback.
+  void parent_dispatch(const event_t event)
+  {
+    dispatch_event(pending_event(&service_handler_t::do_parent, event));
+  }
+
+  /// Dispatch event to the parent handler from the child handler.
+  /// If called in the work_service thread and the handler is not running any
+  ///   callback of the work handler, on_child is called at once. Otherwise the
+  ///   event is queued, and all queued events are delivered in one callback.
+  void child_dispatch(const event_t event)
+  {
+    dispatch_event(pending_event(&service_handler_t::do_child, event));
+  }
+
+  /// Set the priority class of the handler, 0 is the most urgent.
+  ///   Only used when work scheduling is enabled. It's assigned by the work
+  ///   allocator when the handler is bound, and may be changed in on_clear or
+  ///   on_open of the work handler, before any i/o operation is started.
+  void set_priority(size_t priority)
+  {
+    priority_ = priority;
+  }
+
+  /// Get the priority class of the handler.
+  size_t get_priority() const
+  {
+    return priority_;
+  }
+
+  /// Set the tenant of the handler, tenants share the work_service by weights.
+  ///   Only used when work scheduling is enabled. It's assigned by the work
+  ///   allocator when the handler is bound, and may be changed in on_clear or
+  ///   on_open of the work handler, before any i/o operation is started.
+  void set_tenant(size_t tenant)
+  {
+    tenant_ = tenant;
+  }
+
+  /// Get the tenant of the handler.
+  size_t get_tenant() const
+  {
+    return tenant_;
   }
 
 private:
@@ -266,6 +474,69 @@ private:
   template<typename, typename, typename> friend class server;
   template<typename, typename, typename> friend class client;
 
+  /// Event queued by parent_dispatch or child_dispatch.
+  struct pending_event
+  {
+    typedef void (service_handler_t::*function_t)(const event_t);
+
+    pending_event(function_t f, const event_t& e)
+      : function(f),
+        event(e)
+    {
+    }
+
+    function_t function;
+    event_t event;
+  };
+
+  /// Guard for counting the running callbacks of the work handler.
+  class running_guard
+  {
+  public:
+    explicit running_guard(size_t& running)
+      : running_(running)
+    {
+      ++running_;
+    }
+
+    ~running_guard()
+    {
+      --running_;
+    }
+
+  private:
+    size_t& running_;
+  };
+
+  /// Increment the reference count of the handler.
+  friend void intrusive_ptr_add_ref(service_handler_t* handler_ptr)
+  {
+    handler_ptr->ref_count_.fetch_add(1, boost::memory_order_relaxed);
+  }
+
+  /// Decrement the reference count of the handler, recycle or delete it when no longer referenced.
+  friend void intrusive_ptr_release(service_handler_t* handler_ptr)
+  {
+    if (handler_ptr->ref_count_.fetch_sub(1, boost::memory_order_acq_rel) != 1)
+      return;
+
+    if (handler_ptr->recycler_.get() == 0)
+    {
+      delete handler_ptr;
+      return;
+    }
+
+    // Hold the recycler, the handler may be deleted by it.
+    recycler_ptr recycler(handler_ptr->recycler_);
+    recycler->put_handler(handler_ptr);
+  }
+
+  /// Set the object recycling the handler when its last reference is released.
+  void set_recycler(const recycler_ptr& recycler)
+  {
+    recycler_ = recycler;
+  }
+
   /// Bind a service_handler with the given io_service and work_service.
   template<typename Work_Allocator>
   void bind(io_service_t& io_service,
@@ -273,17 +544,34 @@ private:
             Work_Allocator& work_allocator)
   {
     stopped_ = false;
+    half_close_ = false;
 
-    socket_.reset(work_allocator.make_socket(io_service));
-
+    // Construct the socket and timers in place, no allocation is required.
+    socket_ = socket_factory<Work_Allocator>(work_allocator, io_service);
     if (session_timeout_ != 0)
-      session_timer_.reset(new boost::asio::deadline_timer(io_service));
+      session_timer_ = timer_factory(io_service);
     if (io_timeout_ != 0)
-      io_timer_.reset(new boost::asio::deadline_timer(io_service));
+    {
+      io_timer_ = timer_factory(io_service);
+      write_timer_ = timer_factory(io_service);
+    }
 
     io_service_ = &io_service;
     work_service_ = &work_service;
 
+    // Use the scheduler of work_service if enabled, the work allocator assigns
+    //   the tags and the work handler can change them in on_clear.
+    work_scheduler& scheduler = boost::asio::use_service<work_scheduler>(work_service);
+    scheduler_ = scheduler.enabled() ? &scheduler : 0;
+    priority_ = BAS_WORK_PRIORITY_DEFAULT;
+    tenant_ = BAS_WORK_TENANT_DEFAULT;
+    assign_work_tags(work_allocator, priority_, tenant_);
+
+#if (BAS_COMPLETION_QUEUE_SIZE != 0)
+    // Cache the completion queue from io_service to work_service.
+    completion_queue_ = &boost::asio::use_service<completion_queue_service>(work_service).get_queue(io_service);
+#endif
+
     // Clear buffers for new operations.
     read_buffer().clear();
     write_buffer().clear();
@@ -296,12 +584,26 @@ private:
   /// Release and reset temporary variables.
   void clear()
   {
-    // Release allocated socket.
-    socket_.reset();
+    // Destroy the socket.
+    socket_ = boost::none;
 
     // Reset io_service and work_service.
     io_service_ = 0;
     work_service_ = 0;
+    completion_queue_ = 0;
+    scheduler_ = 0;
+
+    // Release limiters and the pacing timer of the io_service.
+    rate_limiter_.reset();
+    group_rate_limiter_.reset();
+    pace_timer_ = boost::none;
+
+    // Release the connection from the io_service.
+    if (io_load_ != 0)
+    {
+      io_load_->remove(io_entry_);
+      io_load_ = 0;
+    }
 
     // Clear buffers for new operations.
     read_buffer().clear();
@@ -312,10 +614,13 @@ private:
   void connect(endpoint_t& peer_endpoint,
                endpoint_t& local_endpoint = endpoint_t())
   {
-    io_service().dispatch(boost::bind(&service_handler_t::connect_i,
-                                      shared_from_this(),
-                                      peer_endpoint,
-                                      local_endpoint));
+    io_service().dispatch(mem_fn_handler2<service_handler_ptr,
+                                          service_handler_t,
+                                          endpoint_t&,
+                                          endpoint_t&,
+                                          &service_handler_t::connect_i>(shared_from_this(),
+                                              peer_endpoint,
+                                              local_endpoint));
   }
 
   /// Start asynchronous connect, can be call from any thread.
@@ -327,32 +632,55 @@ private:
     // Set per_connection_data.
     work_handler_->set_data(data);
 
-    io_service().dispatch(boost::bind(&service_handler_t::connect_i,
-                                      shared_from_this(),
-                                      peer_endpoint,
-                                      local_endpoint));
+    io_service().dispatch(mem_fn_handler2<service_handler_ptr,
+                                          service_handler_t,
+                                          endpoint_t&,
+                                          endpoint_t&,
+                                          &service_handler_t::connect_i>(shared_from_this(),
+                                              peer_endpoint,
+                                              local_endpoint));
   }
 
   /// Start the first operation, can be call from any thread.
   void start()
   {
-    BOOST_ASSERT(socket_.get() != 0);
+    BOOST_ASSERT(socket_.is_initialized());
     BOOST_ASSERT(io_service_ != 0);
     BOOST_ASSERT(work_service_ != 0);
 
+    // Count the open connection for choosing io_service by load and for draining,
+    //   a handler waiting for accept or connect isn't counted.
+    if (io_load_ == 0)
+    {
+      io_load_ = &boost::asio::use_service<io_service_load>(*io_service_);
+      io_load_->add(io_entry_);
+    }
+
     // Set timer for session timeout. If start from connect, set it again.
     set_session_expiry();
 
+    // Schedule do_open by the tags of the handler.
+    if (scheduler_ != 0)
+    {
+      // The reference is released by complete.
+      intrusive_ptr_add_ref(this);
+      scheduler_->schedule(priority_,
+          tenant_,
+          work_completion(&service_handler_t::complete, this, event_t::open));
+      return;
+    }
+
     // Post to work_service for executing do_open.
-    work_service().post(boost::bind(&service_handler_t::do_open,
-                                    shared_from_this()));
+    work_service().post(mem_fn_handler0<service_handler_ptr,
+                                        service_handler_t,
+                                        &service_handler_t::do_open>(shared_from_this()));
   }
 
 private:
   /// Start an asynchronous connect from io_service thread.
   void connect_i(endpoint_t& peer_endpoint, endpoint_t& local_endpoint)
   {
-    BOOST_ASSERT(socket_.get() != 0);
+    BOOST_ASSERT(socket_.is_initialized());
     BOOST_ASSERT(io_service_ != 0);
     BOOST_ASSERT(work_service_ != 0);
 
@@ -375,13 +703,13 @@ private:
     // Set timer for session timeout.
     set_session_expiry();
     // Set timer for i/o operation timeout.
-    set_io_expiry();
+    set_io_expiry(io_timer_);
 
     // Use lowest_layer socket for ssl.
     socket().lowest_layer().async_connect(peer_endpoint,
-                                boost::bind(&service_handler_t::handle_connect,
-                                            shared_from_this(),
-                                            boost::asio::placeholders::error));
+        mem_fn_wait_handler<service_handler_ptr,
+                            service_handler_t,
+                            &service_handler_t::handle_connect>(shared_from_this()));
   }
 
   /// Start an asynchronous operation from io_service thread to read any amount of data to buffers from the socket.
@@ -393,13 +721,12 @@ private:
       return;
 
     // Set timer for i/o operation timeout.
-    set_io_expiry();
+    set_io_expiry(io_timer_);
 
     socket().async_read_some(buffers,
-                  boost::bind(&service_handler_t::handle_read,
-                              shared_from_this(),
-                              boost::asio::placeholders::error,
-                              boost::asio::placeholders::bytes_transferred));
+        mem_fn_io_handler<service_handler_ptr,
+                          service_handler_t,
+                          &service_handler_t::handle_read>(shared_from_this()));
   }
 
   /// Start an asynchronous operation from io_service thread to read a certain amount of data to buffers from the socket.
@@ -411,14 +738,56 @@ private:
       return;
 
     // Set timer for i/o operation timeout.
-    set_io_expiry();
+    set_io_expiry(io_timer_);
 
     boost::asio::async_read(socket(),
-                     buffers,
-                     boost::bind(&service_handler_t::handle_read,
-                                 shared_from_this(),
-                                 boost::asio::placeholders::error,
-                                 boost::asio::placeholders::bytes_transferred));
+        buffers,
+        mem_fn_io_handler<service_handler_ptr,
+                          service_handler_t,
+                          &service_handler_t::handle_read>(shared_from_this()));
+  }
+
+  /// Shut down the sending side of the socket in io_service thread.
+  void shutdown_send_i()
+  {
+    // The handler has been stopped, do nothing.
+    if (stopped_)
+      return;
+
+    boost::system::error_code ignored_ec;
+    socket().lowest_layer().shutdown(boost::asio::socket_base::shutdown_send, ignored_ec);
+  }
+
+  /// Set the limit of the handler in io_service thread.
+  void set_rate_limit_i(size_t rate, size_t burst)
+  {
+    rate_limiter_.reset();
+
+#if defined(SO_MAX_PACING_RATE)
+    if (!stopped_)
+    {
+      typedef boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_MAX_PACING_RATE> max_pacing_rate;
+
+      // The kernel takes the rate as unsigned, all bits set for no limit.
+      unsigned int pacing_rate = ~0U;
+      if ((rate != 0) && (rate < pacing_rate))
+        pacing_rate = static_cast<unsigned int>(rate);
+
+      boost::system::error_code ec;
+      socket().lowest_layer().set_option(max_pacing_rate(static_cast<int>(pacing_rate)), ec);
+      if (!ec)
+        return;
+    }
+#endif
+
+    if (rate != 0)
+      rate_limiter_.reset(new rate_limiter(rate, burst));
+  }
+
+  /// Set the limiter of the group in io_service thread.
+  void set_rate_limiter_i(const rate_limiter_ptr& limiter)
+  {
+    group_rate_limiter_ = limiter;
   }
 
   /// Start an asynchronous operation from io_service thread to write buffers to the socket.
@@ -429,53 +798,95 @@ private:
     if (stopped_)
       return;
 
+    // Defer the write until the limiters have budget for it.
+    if (rate_limiter_.get() != 0 || group_rate_limiter_.get() != 0)
+    {
+      size_t bytes = boost::asio::buffer_size(buffers);
+      boost::posix_time::time_duration delay;
+      if (rate_limiter_.get() != 0)
+        delay = rate_limiter_->acquire(bytes);
+      if (group_rate_limiter_.get() != 0)
+        delay = (std::max)(delay, group_rate_limiter_->acquire(bytes));
+
+      if (delay > boost::posix_time::time_duration())
+      {
+        if (!pace_timer_)
+          pace_timer_ = timer_factory(io_service());
+
+        pace_timer_->expires_from_now(delay);
+        pace_timer_->async_wait(mem_fn_wait_handler1<service_handler_ptr,
+                                                     service_handler_t,
+                                                     const Buffers&,
+                                                     &service_handler_t::template handle_pace<Buffers> >(shared_from_this(),
+                                                         buffers));
+        return;
+      }
+    }
+
+    start_write(buffers);
+  }
+
+  /// Handle the end of a deferred write in io_service thread.
+  template<typename Buffers>
+  void handle_pace(const boost::system::error_code& ec, const Buffers& buffers)
+  {
+    // The handler is stopped or timer is cancelled, do nothing.
+    if (stopped_ || ec == boost::asio::error::operation_aborted)
+      return;
+
+    start_write(buffers);
+  }
+
+  /// Write buffers to the socket in io_service thread.
+  template<typename Buffers>
+  void start_write(const Buffers& buffers)
+  {
     // Set timer for i/o operation timeout.
-    set_io_expiry();
+    set_io_expiry(write_timer_);
 
     boost::asio::async_write(socket(),
-                     buffers,
-                     boost::bind(&service_handler_t::handle_write,
-                                 shared_from_this(),
-                                 boost::asio::placeholders::error,
-                                 boost::asio::placeholders::bytes_transferred));
+        buffers,
+        mem_fn_io_handler<service_handler_ptr,
+                          service_handler_t,
+                          &service_handler_t::handle_write>(shared_from_this()));
   }
 
   /// Set timer for session timeout.
   void set_session_expiry(void)
   {
-    if ((session_timeout_ == 0) || (session_timer_.get() == 0))
+    if ((session_timeout_ == 0) || !session_timer_)
       return;
 
     session_timer_->expires_from_now(boost::posix_time::seconds(session_timeout_));
-    session_timer_->async_wait(boost::bind(&service_handler_t::handle_timeout,
-                                           shared_from_this(),
-                                           boost::asio::placeholders::error));
+    session_timer_->async_wait(mem_fn_wait_handler<service_handler_ptr,
+                                                   service_handler_t,
+                                                   &service_handler_t::handle_timeout>(shared_from_this()));
   }
 
   /// Cancel timer for session timeout.
   void cancel_session_expiry(void)
   {
-    if (session_timer_.get() != 0)
+    if (session_timer_)
       session_timer_->cancel();
   }
 
-  /// Set timer for i/o operation timeout.
-  void set_io_expiry(void)
+  /// Set the timer for i/o operation timeout.
+  void set_io_expiry(boost::optional<boost::asio::deadline_timer>& timer)
   {
-    if ((io_timeout_ == 0) || (io_timer_.get() == 0))
+    if ((io_timeout_ == 0) || !timer)
       return;
 
-    io_timer_->expires_from_now(boost::posix_time::seconds(io_timeout_));
-    io_timer_->async_wait(boost::bind(&service_handler_t::handle_timeout,
-                                      shared_from_this(),
-                                      boost::asio::placeholders::error));
+    timer->expires_from_now(boost::posix_time::seconds(io_timeout_));
+    timer->async_wait(mem_fn_wait_handler<service_handler_ptr,
+                                              service_handler_t,
+                                              &service_handler_t::handle_timeout>(shared_from_this()));
   }
 
-  /// Cancel timer for i/o operation timeout.
-  void cancel_io_expiry(void)
+  /// Cancel the timer for i/o operation timeout.
+  void cancel_io_expiry(boost::optional<boost::asio::deadline_timer>& timer)
   {
-    if (io_timer_.get() != 0)
-      io_timer_->cancel();
+    if (timer)
+      timer->cancel();
   }
 
   /// Handle completion of a connect operation in io_service thread.
@@ -486,7 +897,7 @@ private:
       return;
 
     // Cancel timer for i/o operation timeout, even if expired.
-    cancel_io_expiry();
+    cancel_io_expiry(io_timer_);
 
     if (!ec)
       start();
@@ -502,14 +913,12 @@ private:
       return;
 
     // Cancel timer for i/o operation timeout, even if expired.
-    cancel_io_expiry();
+    cancel_io_expiry(io_timer_);
 
-    if (!ec)
+    if (!ec || (half_close_ && ec == boost::asio::error::eof))
     {
-      // Post to work_service for executing do_read.
-      work_service().post(boost::bind(&service_handler_t::do_read,
-                                      shared_from_this(),
-                                      bytes_transferred));
+      // Deliver to work_service for executing do_read, end of stream is read of 0 bytes.
+      post_completion(event_t(event_t::read, bytes_transferred));
     }
     else
       close_i(ec);
@@ -523,14 +932,12 @@ private:
       return;
 
     // Cancel timer for i/o operation timeout, even if expired.
-    cancel_io_expiry();
+    cancel_io_expiry(write_timer_);
 
     if (!ec)
     {
-      // Post to work_service for executing do_write.
-      work_service().post(boost::bind(&service_handler_t::do_write,
-                                      shared_from_this(),
-                                      bytes_transferred));
+      // Deliver to work_service for executing do_write.
+      post_completion(event_t(event_t::write, bytes_transferred));
     }
     else
       close_i(ec);
@@ -555,17 +962,112 @@ private:
 
       // Initiate graceful service_handler closure.
       boost::system::error_code ignored_ec;
-      socket().lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
+      socket().lowest_layer().shutdown(boost::asio::socket_base::shutdown_both, ignored_ec);
       socket().lowest_layer().close(ignored_ec);
 
       // Timer is not expired or expired but not dispatched, cancel it.
       cancel_session_expiry();
-      cancel_io_expiry();
+      cancel_io_expiry(io_timer_);
+      cancel_io_expiry(write_timer_);
+
+      // Drop the deferred write.
+      if (pace_timer_)
+        pace_timer_->cancel();
+
+      // Deliver to work_service for executing do_close.
+      post_completion(event_t(event_t::close, 0, ec));
+    }
+  }
+
+  /// Deliver completion of read, write or close from io_service thread to work_service thread.
+  void post_completion(const event_t& event)
+  {
+    if (scheduler_ != 0)
+    {
+      // The reference is released by complete.
+      intrusive_ptr_add_ref(this);
+      scheduler_->schedule(priority_,
+          tenant_,
+          work_completion(&service_handler_t::complete,
+                          this,
+                          event.state,
+                          event.value,
+                          event.ec));
+      return;
+    }
+
+#if (BAS_COMPLETION_QUEUE_SIZE != 0)
+    BOOST_ASSERT(completion_queue_ != 0);
+
+    // The reference is released by complete.
+    intrusive_ptr_add_ref(this);
+    completion_queue_->push(work_completion(&service_handler_t::complete,
+                                            this,
+                                            event.state,
+                                            event.value,
+                                            event.ec));
+#else
+    work_service().post(mem_fn_handler1<service_handler_ptr,
+                                        service_handler_t,
+                                        const event_t,
+                                        &service_handler_t::do_completion>(shared_from_this(), event));
+#endif
+  }
+
+  /// Deliver completion from completion_queue or work_scheduler in work_service thread.
+  static void complete(const work_completion& completion, bool invoke)
+  {
+    // Take over the reference added by post_completion or start.
+    service_handler_ptr handler(static_cast<service_handler_t*>(completion.target), false);
 
-      // Post to work_service to executing do_close.
-      work_service().post(boost::bind(&service_handler_t::do_close,
-                                      shared_from_this(),
-                                      ec));
+    if (invoke)
+      handler->do_completion(event_t(completion.state, completion.value, completion.ec));
+  }
+
+  /// Take a reference for closing the handler from io_service_load, unless it's being released.
+  static bool acquire_entry(io_load_entry& entry)
+  {
+    service_handler_t* handler_ptr = static_cast<service_handler_t*>(entry.target);
+
+    long count = handler_ptr->ref_count_.load(boost::memory_order_relaxed);
+    do
+    {
+      // The last reference is gone, the handler is going back to the pool.
+      if (count == 0)
+        return false;
+    } while (!handler_ptr->ref_count_.compare_exchange_weak(count, count + 1, boost::memory_order_relaxed));
+
+    return true;
+  }
+
+  /// Close the handler from io_service_load, then drop the reference taken by acquire_entry.
+  static void close_entry(io_load_entry& entry, const boost::system::error_code& ec)
+  {
+    service_handler_ptr handler(static_cast<service_handler_t*>(entry.target), false);
+
+    handler->close(ec);
+  }
+
+  /// Do the completion of open, read, write or close in work_service thread.
+  void do_completion(const event_t event)
+  {
+    switch (event.state)
+    {
+      case event_t::open:
+        do_open();
+        break;
+
+      case event_t::read:
+        do_read(event.value);
+        break;
+
+      case event_t::write:
+        do_write(event.value);
+        break;
+
+      case event_t::close:
+      default:
+        do_close(event.ec);
     }
   }
 
@@ -576,6 +1078,8 @@ private:
     if (stopped_)
       return;
 
+    running_guard guard(running_);
+
     // Call on_open function of the work handler.
     work_handler_->on_open(*this);
   }
@@ -587,6 +1091,8 @@ private:
     if (stopped_)
       return;
 
+    running_guard guard(running_);
+
     // Call on_read function of the work handler.
     work_handler_->on_read(*this, bytes_transferred);
   }
@@ -598,6 +1104,8 @@ private:
     if (stopped_)
       return;
 
+    running_guard guard(running_);
+
     // Call on_write function of the work handler.
     work_handler_->on_write(*this, bytes_transferred);
   }
@@ -633,6 +1141,8 @@ private:
     if (stopped_)
       return;
 
+    running_guard guard(running_);
+
     // Call on_parent function of the work handler.
     work_handler_->on_parent(*this, event);
   }
@@ -644,6 +1154,8 @@ private:
     if (stopped_)
       return;
 
+    running_guard guard(running_);
+
     // Call on_child function of the work handler.
     work_handler_->on_child(*this, event);
   }
@@ -651,38 +1163,141 @@ private:
   /// Do on_close and reset handler for next connaction in work_service thread.
   void do_close(const boost::system::error_code& ec)
   {
+    running_guard guard(running_);
+
     // Call on_close function of the work handler.
     work_handler_->on_close(*this, ec);
 
     // Destroy all timer.
     session_timer_.reset();
     io_timer_.reset();
+    write_timer_.reset();
 
     // Leave socket/io_service_/work_service_ for finishing uncompleted operations.
   }
 
+  /// Queue the event, and schedule delivering of queued events if not scheduled.
+  void dispatch_event(const pending_event& event)
+  {
+    {
+      scoped_lock_t lock(events_mutex_);
+
+      pending_events_.push_back(event);
+
+      // Delivering is scheduled or running, the event will be delivered by it.
+      if (events_scheduled_)
+        return;
+
+      events_scheduled_ = true;
+    }
+
+    // Run at once if in work_service thread.
+    work_service().dispatch(mem_fn_handler0<service_handler_ptr,
+                                            service_handler_t,
+                                            &service_handler_t::do_events>(shared_from_this()));
+  }
+
+  /// Deliver all queued events in work_service thread.
+  void do_events()
+  {
+    // Running a callback of the work handler, deliver the events later to avoid re-entrance.
+    if (running_ != 0)
+    {
+      work_service().post(mem_fn_handler0<service_handler_ptr,
+                                          service_handler_t,
+                                          &service_handler_t::do_events>(shared_from_this()));
+      return;
+    }
+
+    running_guard guard(running_);
+
+    for (;;)
+    {
+      {
+        scoped_lock_t lock(events_mutex_);
+
+        if (pending_events_.empty())
+        {
+          events_scheduled_ = false;
+          return;
+        }
+
+        pending_events_.swap(delivering_events_);
+      }
+
+      for (size_t i = 0; i < delivering_events_.size(); ++i)
+        (this->*delivering_events_[i].function)(delivering_events_[i].event);
+
+      delivering_events_.clear();
+    }
+  }
+
 private:
-  typedef boost::shared_ptr<work_handler_t> work_handler_ptr;
-  typedef boost::shared_ptr<socket_t> socket_ptr;
-  typedef boost::shared_ptr<boost::asio::deadline_timer> timer_ptr;
+  typedef boost::optional<boost::asio::deadline_timer> timer_t;
+  typedef boost::asio::detail::mutex mutex_t;
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
 
-  /// Work handler of the service_handler.
-  work_handler_ptr work_handler_;
+  /// In place factory for constructing a timer on the given io_service.
+  struct timer_factory
+    : public boost::in_place_factory_base
+  {
+    explicit timer_factory(io_service_t& io_service)
+      : io_service_(io_service)
+    {
+    }
 
-  /// Socket for the service_handler.
-  socket_ptr socket_;
+    template<typename T>
+    void* apply(void* address) const
+    {
+      return new (address) T(io_service_);
+    }
 
-  /// Timer for session timeout.
-  timer_ptr session_timer_;
+    io_service_t& io_service_;
+  };
 
-  /// The expiry seconds of session.
-  unsigned int session_timeout_;
+  /// Offset of the work handler from the start of the handler.
+  static std::size_t work_handler_offset()
+  {
+    const std::size_t alignment = boost::alignment_of<work_handler_t>::value;
 
-  /// Timer for i/o operation timeout.
-  timer_ptr io_timer_;
+    return (sizeof(service_handler_t) + alignment - 1) & ~(alignment - 1);
+  }
 
-  /// The expiry seconds of i/o operation.
-  unsigned int io_timeout_;
+  /// In place factory for making the socket by the work allocator on the given io_service.
+  template<typename Work_Allocator>
+  struct socket_factory
+    : public boost::in_place_factory_base
+  {
+    socket_factory(Work_Allocator& work_allocator, io_service_t& io_service)
+      : work_allocator_(work_allocator),
+        io_service_(io_service)
+    {
+    }
+
+    template<typename T>
+    void* apply(void* address) const
+    {
+      return work_allocator_.make_socket(address, io_service_);
+    }
+
+    Work_Allocator& work_allocator_;
+    io_service_t& io_service_;
+  };
+
+  // Members are grouped by access pattern. The reference count is changed
+  //   from every thread, keep it away from the fields of the hot path.
+
+  /// Reference count of the service_handler.
+  boost::atomic<long> ref_count_;
+
+  /// Padding for avoiding false sharing with the reference count.
+  char ref_count_pad_[BAS_CACHE_LINE_SIZE];
+
+  /// Flag to indicate the handler is stopped or not.
+  bool stopped_;
+
+  /// Flag to indicate end of stream is delivered to on_read.
+  bool half_close_;
 
   /// The io_service object for executing asynchronous operations.
   io_service_t* io_service_;
@@ -690,14 +1305,78 @@ private:
   /// The io_service object for executing synchronous works.
   io_service_t* work_service_;
 
-  /// Flag to indicate the handler is stopped or not.
-  bool stopped_;
+  /// Number of running callbacks of the work handler, only used in work_service thread.
+  size_t running_;
+
+  /// The queue for delivering completions from io_service to work_service.
+  completion_queue* completion_queue_;
+
+  /// The scheduler of work_service, null if scheduling is disabled.
+  work_scheduler* scheduler_;
+
+  /// The priority class of the handler.
+  size_t priority_;
+
+  /// The tenant of the handler.
+  size_t tenant_;
+
+  /// The connection counter of the io_service.
+  io_service_load* io_load_;
+
+  /// The entry of the handler in the connection list of the io_service.
+  io_load_entry io_entry_;
+
+  /// Work handler of the service_handler, made by the work allocator behind the handler.
+  work_handler_t* work_handler_;
+
+  /// Socket for the service_handler, made in place by the work allocator when bound.
+  boost::optional<socket_t> socket_;
 
   /// Buffer for incoming data.
   io_buffer read_buffer_;
 
   /// Buffer for outcoming data.
   io_buffer write_buffer_;
+
+  /// Timer for session timeout, constructed in place when bound.
+  timer_t session_timer_;
+
+  /// Timer for connect and read operation timeout, constructed in place when bound.
+  timer_t io_timer_;
+
+  /// Timer for write operation timeout, reads and writes of a full-duplex
+  /// connection are timed apart, constructed in place when bound.
+  timer_t write_timer_;
+
+  /// Timer for deferring writes over budget, constructed in place when first used.
+  timer_t pace_timer_;
+
+  /// The limiter of the handler, null if no limit or paced by the kernel.
+  rate_limiter_ptr rate_limiter_;
+
+  /// The limiter shared by a group of handlers.
+  rate_limiter_ptr group_rate_limiter_;
+
+  /// The expiry seconds of session.
+  unsigned int session_timeout_;
+
+  /// The expiry seconds of i/o operation.
+  unsigned int io_timeout_;
+
+  /// The object recycling the service_handler, delete it if not set.
+  recycler_ptr recycler_;
+
+  /// Mutex for protecting pending events.
+  mutex_t events_mutex_;
+
+  /// Flag to indicate delivering of pending events is scheduled or running.
+  bool events_scheduled_;
+
+  /// Events queued by parent_dispatch and child_dispatch.
+  std::vector<pending_event> pending_events_;
+
+  /// Events being delivered, only used in work_service thread.
+  std::vector<pending_event> delivering_events_;
 };
 
 } // namespace bas
@@ -11,9 +11,10 @@
 #ifndef BAS_SERVICE_HANDLER_POOL_HPP
 #define BAS_SERVICE_HANDLER_POOL_HPP
 
+#include <bas/config.hpp>
+
 #include <boost/assert.hpp>
 #include <boost/asio/detail/mutex.hpp>
-#include <boost/bind.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -36,6 +37,7 @@ namespace bas {
 template<typename Work_Handler, typename Work_Allocator, typename Socket_Service = boost::asio::ip::tcp::socket>
 class service_handler_pool
   : public boost::enable_shared_from_this<service_handler_pool<Work_Handler, Work_Allocator, Socket_Service> >,
+    public service_handler_recycler<service_handler<Work_Handler, Socket_Service> >,
     private boost::noncopyable
 {
 public:
@@ -52,7 +54,7 @@ public:
 
   /// The type of the service_handler.
   typedef service_handler<Work_Handler, Socket_Service> service_handler_t;
-  typedef boost::shared_ptr<service_handler_t> service_handler_ptr;
+  typedef typename service_handler_t::service_handler_ptr service_handler_ptr;
 
   /// The type of the work_allocator.
   typedef Work_Allocator work_allocator_t;
@@ -136,7 +138,7 @@ public:
     return service_handler;
   }
 
-  /// Put a handler to the pool.
+  /// Put a handler to the pool, called when the last reference of the handler is released.
   void put_handler(service_handler_t* handler_ptr)
   {
     BOOST_ASSERT(handler_ptr != 0);
@@ -182,28 +184,40 @@ private:
   /// Release handlers in the pool.
   void clear(void)
   {
-    // Lock for synchronize access to data.
-    scoped_lock_t lock(mutex_);
+    std::vector<service_handler_t*> service_handlers;
+
+    {
+      // Lock for synchronize access to data.
+      scoped_lock_t lock(mutex_);
 
-    if (closed_)
-      return;
+      if (closed_)
+        return;
 
-    closed_ = true;
+      closed_ = true;
 
-    for (size_t i = service_handlers_.size(); i > 0; --i)
-      service_handlers_[i - 1].reset();
+      service_handlers.swap(service_handlers_);
+    }
+
+    // Delete handlers out of the lock, the pool may be released by the last one.
+    for (size_t i = service_handlers.size(); i > 0; --i)
+      delete service_handlers[i - 1];
 
-    service_handlers_.clear();
+    service_handlers.clear();
   }
   
   /// Make a new handler.
   service_handler_t* make_handler(void)
   {
-    return new service_handler_t(work_allocator().make_handler(),
-                                 read_buffer_size_,
-                                 write_buffer_size_,
-                                 session_timeout_,
-                                 io_timeout_);
+    service_handler_t* handler_ptr = new service_handler_t(work_allocator(),
+                                                           read_buffer_size_,
+                                                           write_buffer_size_,
+                                                           session_timeout_,
+                                                           io_timeout_);
+
+    // Return the handler to this pool when its last reference is released.
+    handler_ptr->set_recycler(shared_from_this());
+
+    return handler_ptr;
   }
 
   /// Push a handler into the pool.
@@ -220,12 +234,7 @@ private:
       return false;
     }
 
-    service_handler_ptr service_handler(handler_ptr,
-                                        bind(&service_handler_pool::put_handler,
-                                             shared_from_this(),
-                                             _1));
-
-    service_handlers_.push_back(service_handler);
+    service_handlers_.push_back(handler_ptr);
 
     return true;
   }
@@ -255,6 +264,7 @@ private:
 
       if (!service_handlers_.empty())
       {
+        // Take the first reference of the handler.
         service_handler = service_handlers_.back();
         service_handlers_.pop_back();
       }
@@ -273,8 +283,8 @@ private:
   // Flag to indicate that the pool has been closed and all handlers need to be deleted.
   bool closed_;
 
-  /// The pool of service_handler.
-  std::vector<service_handler_ptr> service_handlers_;
+  /// The pool of idle service_handler, which are not referenced.
+  std::vector<service_handler_t*> service_handlers_;
 
   /// The allocator of work_handler.
   work_allocator_ptr work_allocator_;
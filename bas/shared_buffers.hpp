@@ -0,0 +1,84 @@
+//
+// shared_buffers.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_SHARED_BUFFERS_HPP
+#define BAS_SHARED_BUFFERS_HPP
+
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace bas {
+
+/// Buffer sequence sharing one copy of the given sequence.
+//    Copying it only copies a reference counted pointer, so a gathered buffer
+//    sequence is not copied again when the handler of an asynchronous
+//    operation is copied.
+template<typename Buffers>
+class shared_buffers
+{
+public:
+  /// The type of the buffers in the sequence.
+  typedef typename Buffers::value_type value_type;
+
+  /// The type of the iterator of the sequence.
+  typedef typename Buffers::const_iterator const_iterator;
+
+  /// Constructor, copy the given sequence once.
+  explicit shared_buffers(const Buffers& buffers)
+    : buffers_(boost::make_shared<Buffers>(buffers))
+  {
+  }
+
+  /// Get an iterator to the first buffer in the sequence.
+  const_iterator begin() const
+  {
+    return buffers_->begin();
+  }
+
+  /// Get an iterator to one past the end of the sequence.
+  const_iterator end() const
+  {
+    return buffers_->end();
+  }
+
+private:
+  boost::shared_ptr<Buffers> buffers_;
+};
+
+/// Trait for holding a buffer sequence across asynchronous operations.
+//    Sequences of fixed size are cheap to copy and hold by value.
+template<typename Buffers>
+struct buffers_holder
+{
+  typedef Buffers type;
+
+  static const type& hold(const Buffers& buffers)
+  {
+    return buffers;
+  }
+};
+
+/// Hold a std::vector of buffers by shared_buffers.
+template<typename Buffer, typename Allocator>
+struct buffers_holder<std::vector<Buffer, Allocator> >
+{
+  typedef shared_buffers<std::vector<Buffer, Allocator> > type;
+
+  static type hold(const std::vector<Buffer, Allocator>& buffers)
+  {
+    return type(buffers);
+  }
+};
+
+} // namespace bas
+
+#endif // BAS_SHARED_BUFFERS_HPP
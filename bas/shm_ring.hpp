@@ -0,0 +1,269 @@
+//
+// shm_ring.hpp
+// ~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_SHM_RING_HPP
+#define BAS_SHM_RING_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/array.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/assert.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <new>
+
+namespace bas {
+
+/// A value alone in its cache line.
+template<typename T>
+struct shm_padded
+{
+  T value;
+  char pad[BAS_CACHE_LINE_SIZE - sizeof(T)];
+};
+
+/// The control block of a ring, placed in shared memory before its data.
+//    Positions are free running byte counts, the producer only writes head
+//    and the consumer only writes tail. A side going to sleep sets its
+//    waiting flag, the other side wakes it only when the flag is set.
+struct shm_ring_header
+{
+  /// Bytes written by the producer.
+  shm_padded<boost::atomic<boost::uint64_t> > head;
+
+  /// Bytes read by the consumer.
+  shm_padded<boost::atomic<boost::uint64_t> > tail;
+
+  /// Set by the consumer waiting for data.
+  shm_padded<boost::atomic<boost::uint32_t> > reader_waiting;
+
+  /// Set by the producer waiting for space.
+  shm_padded<boost::atomic<boost::uint32_t> > writer_waiting;
+
+  /// Set by the producer when it will write no more.
+  boost::atomic<boost::uint32_t> writer_closed;
+
+  /// Set by the consumer when it will read no more.
+  boost::atomic<boost::uint32_t> reader_closed;
+};
+
+/// A single producer/single consumer byte ring over memory shared by two processes.
+//    The ring does not own the memory, it's a view attached to a block of
+//    footprint(capacity) bytes. One side is the producer and the other is the
+//    consumer, each one calls only its own operations.
+class shm_ring
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Constructor.
+  shm_ring()
+    : header_(0),
+      data_(0),
+      capacity_(0)
+  {
+  }
+
+  /// Get the bytes of shared memory used by a ring of capacity.
+  static size_t footprint(size_t capacity)
+  {
+    return sizeof(shm_ring_header) + capacity;
+  }
+
+  /// Attach to the memory of a ring, capacity must be a power of 2.
+  ///   The memory is initialized if init is set, by the side creating it.
+  void attach(void* memory, size_t capacity, bool init)
+  {
+    BOOST_ASSERT(memory != 0);
+    BOOST_ASSERT(capacity != 0 && (capacity & (capacity - 1)) == 0);
+
+    header_ = static_cast<shm_ring_header*>(memory);
+    data_ = static_cast<char*>(memory) + sizeof(shm_ring_header);
+    capacity_ = capacity;
+
+    if (init)
+    {
+      new (&header_->head.value) boost::atomic<boost::uint64_t>(0);
+      new (&header_->tail.value) boost::atomic<boost::uint64_t>(0);
+      new (&header_->reader_waiting.value) boost::atomic<boost::uint32_t>(0);
+      new (&header_->writer_waiting.value) boost::atomic<boost::uint32_t>(0);
+      new (&header_->writer_closed) boost::atomic<boost::uint32_t>(0);
+      new (&header_->reader_closed) boost::atomic<boost::uint32_t>(0);
+    }
+  }
+
+  /// Detach from the memory.
+  void detach()
+  {
+    header_ = 0;
+    data_ = 0;
+    capacity_ = 0;
+  }
+
+  /// Check whether the ring is attached.
+  bool attached() const
+  {
+    return header_ != 0;
+  }
+
+  /// Copy as much of the buffers as the free space allows, producer only.
+  template<typename ConstBufferSequence>
+  size_t write(const ConstBufferSequence& buffers)
+  {
+    boost::uint64_t head = header_->head.value.load(boost::memory_order_relaxed);
+    boost::uint64_t tail = header_->tail.value.load(boost::memory_order_acquire);
+    size_t space = capacity_ - static_cast<size_t>(head - tail);
+    if (space == 0)
+      return 0;
+
+    // The free space may wrap around the end of data.
+    size_t offset = static_cast<size_t>(head) & (capacity_ - 1);
+    size_t first = (std::min)(space, capacity_ - offset);
+    boost::array<boost::asio::mutable_buffer, 2> target =
+    {
+      {
+        boost::asio::mutable_buffer(data_ + offset, first),
+        boost::asio::mutable_buffer(data_, space - first)
+      }
+    };
+
+    size_t n = boost::asio::buffer_copy(target, buffers);
+    header_->head.value.store(head + n, boost::memory_order_release);
+
+    return n;
+  }
+
+  /// Copy as much of the data as the buffers hold, consumer only.
+  template<typename MutableBufferSequence>
+  size_t read(const MutableBufferSequence& buffers)
+  {
+    boost::uint64_t tail = header_->tail.value.load(boost::memory_order_relaxed);
+    boost::uint64_t head = header_->head.value.load(boost::memory_order_acquire);
+    size_t used = static_cast<size_t>(head - tail);
+    if (used == 0)
+      return 0;
+
+    // The data may wrap around the end of data.
+    size_t offset = static_cast<size_t>(tail) & (capacity_ - 1);
+    size_t first = (std::min)(used, capacity_ - offset);
+    boost::array<boost::asio::const_buffer, 2> source =
+    {
+      {
+        boost::asio::const_buffer(data_ + offset, first),
+        boost::asio::const_buffer(data_, used - first)
+      }
+    };
+
+    size_t n = boost::asio::buffer_copy(buffers, source);
+    header_->tail.value.store(tail + n, boost::memory_order_release);
+
+    return n;
+  }
+
+  /// Check whether the ring has no data.
+  bool empty() const
+  {
+    return header_->head.value.load(boost::memory_order_acquire)
+        == header_->tail.value.load(boost::memory_order_acquire);
+  }
+
+  /// Check whether the ring has no space.
+  bool full() const
+  {
+    return header_->head.value.load(boost::memory_order_acquire)
+        - header_->tail.value.load(boost::memory_order_acquire) == capacity_;
+  }
+
+  /// Announce the consumer is going to sleep, returns false if data has come meanwhile.
+  bool wait_readable()
+  {
+    return wait(header_->reader_waiting.value, true);
+  }
+
+  /// Announce the producer is going to sleep, returns false if space has come meanwhile.
+  bool wait_writable()
+  {
+    return wait(header_->writer_waiting.value, false);
+  }
+
+  /// Check after writing whether the consumer is sleeping, it must be woken if true.
+  bool wake_reader()
+  {
+    return wake(header_->reader_waiting.value);
+  }
+
+  /// Check after reading whether the producer is sleeping, it must be woken if true.
+  bool wake_writer()
+  {
+    return wake(header_->writer_waiting.value);
+  }
+
+  /// Mark the end of data, producer only.
+  void close_writer()
+  {
+    header_->writer_closed.store(1, boost::memory_order_release);
+  }
+
+  /// Check whether the producer will write no more.
+  bool writer_closed() const
+  {
+    return header_->writer_closed.load(boost::memory_order_acquire) != 0;
+  }
+
+  /// Mark the data is no longer read, consumer only.
+  void close_reader()
+  {
+    header_->reader_closed.store(1, boost::memory_order_release);
+  }
+
+  /// Check whether the consumer will read no more.
+  bool reader_closed() const
+  {
+    return header_->reader_closed.load(boost::memory_order_acquire) != 0;
+  }
+
+private:
+  /// Set the waiting flag then check the ring again, the full fence pairs with the one of wake.
+  bool wait(boost::atomic<boost::uint32_t>& flag, bool readable)
+  {
+    flag.store(1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+    if (readable ? empty() : full())
+      return true;
+
+    flag.store(0, boost::memory_order_relaxed);
+    return false;
+  }
+
+  /// Take the waiting flag after the positions are published.
+  bool wake(boost::atomic<boost::uint32_t>& flag)
+  {
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+    return flag.load(boost::memory_order_relaxed) != 0 && flag.exchange(0) != 0;
+  }
+
+  /// The control block in shared memory.
+  shm_ring_header* header_;
+
+  /// The data in shared memory.
+  char* data_;
+
+  /// The bytes of data, a power of 2.
+  size_t capacity_;
+};
+
+} // namespace bas
+
+#endif // BAS_SHM_RING_HPP
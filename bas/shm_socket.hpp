@@ -0,0 +1,1180 @@
+//
+// shm_socket.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_SHM_SOCKET_HPP
+#define BAS_SHM_SOCKET_HPP
+
+#include <bas/config.hpp>
+
+#if defined(BAS_HAS_SHM_SOCKET)
+
+#include <boost/asio.hpp>
+#include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstring>
+#include <string>
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bas/mem_fn_handler.hpp>
+#include <bas/shm_ring.hpp>
+#include <bas/socket_traits.hpp>
+
+namespace bas {
+
+// Bytes of each ring of a shared memory socket, must be a power of 2.
+#if !defined(BAS_SHM_RING_SIZE)
+# define BAS_SHM_RING_SIZE  (256 * 1024)
+#endif
+
+class shm_endpoint;
+class shm_socket;
+class shm_acceptor;
+
+/// The protocol of sockets over shared memory between processes of one host.
+//    A connection is set up over a unix domain socket, which passes a memfd
+//    holding two rings, one for each direction, and an eventfd for each side.
+//    Data is then copied through the rings without system calls, a side is
+//    only woken by its eventfd when it waits for data or space. The unix
+//    domain socket stays open to detect the peer going away.
+class shm_protocol
+{
+public:
+  /// The type of the endpoint.
+  typedef shm_endpoint endpoint;
+
+  /// The type of the socket.
+  typedef shm_socket socket;
+
+  /// The type of the acceptor.
+  typedef shm_acceptor acceptor;
+
+  /// The protocol of the socket setting up the connection.
+  typedef boost::asio::local::stream_protocol rendezvous_protocol;
+};
+
+/// The endpoint of shared memory sockets, named by the path of the unix domain
+/// socket setting up the connections.
+class shm_endpoint
+{
+public:
+  /// The type of the protocol.
+  typedef shm_protocol protocol_type;
+
+  /// The type of the endpoint setting up the connection.
+  typedef shm_protocol::rendezvous_protocol::endpoint rendezvous_endpoint_t;
+
+  /// Default constructor.
+  shm_endpoint()
+    : endpoint_()
+  {
+  }
+
+  /// Construct the endpoint with the path.
+  shm_endpoint(const std::string& path)
+    : endpoint_(path)
+  {
+  }
+
+  /// Construct the endpoint with the path.
+  shm_endpoint(const char* path)
+    : endpoint_(path)
+  {
+  }
+
+  /// Construct the endpoint of the unix domain socket.
+  shm_endpoint(const rendezvous_endpoint_t& endpoint)
+    : endpoint_(endpoint)
+  {
+  }
+
+  /// Get the protocol of the endpoint.
+  protocol_type protocol() const
+  {
+    return protocol_type();
+  }
+
+  /// Get the path of the endpoint.
+  std::string path() const
+  {
+    return endpoint_.path();
+  }
+
+  /// Get the endpoint of the unix domain socket.
+  const rendezvous_endpoint_t& rendezvous() const
+  {
+    return endpoint_;
+  }
+
+  friend bool operator==(const shm_endpoint& e1, const shm_endpoint& e2)
+  {
+    return e1.endpoint_ == e2.endpoint_;
+  }
+
+  friend bool operator!=(const shm_endpoint& e1, const shm_endpoint& e2)
+  {
+    return !(e1 == e2);
+  }
+
+  friend bool operator<(const shm_endpoint& e1, const shm_endpoint& e2)
+  {
+    return e1.endpoint_ < e2.endpoint_;
+  }
+
+private:
+  /// The endpoint of the unix domain socket.
+  rendezvous_endpoint_t endpoint_;
+};
+
+/// Remove the socket file left by a previous listener of the endpoint.
+inline void prepare_bind(const shm_endpoint& endpoint)
+{
+  prepare_bind(endpoint.rendezvous());
+}
+
+class shm_channel;
+
+/// A read or write operation waiting on a shm_channel.
+class shm_op
+{
+public:
+  virtual ~shm_op()
+  {
+  }
+
+  /// Try to complete the operation, or fail it with ec if set.
+  ///   Returns true if the handler is posted, false if it must wait.
+  virtual bool perform(shm_channel& channel, const boost::system::error_code& ec) = 0;
+};
+
+/// The state of a shared memory socket, shared with its pending operations.
+//    All operations are called in the thread running the io_service.
+class shm_channel
+  : public boost::enable_shared_from_this<shm_channel>,
+    private boost::noncopyable
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Define type reference of boost::asio::io_service.
+  typedef boost::asio::io_service io_service_t;
+
+  /// The type of the socket setting up the connection.
+  typedef shm_protocol::rendezvous_protocol::socket rendezvous_socket_t;
+
+  typedef boost::shared_ptr<shm_channel> shm_channel_ptr;
+
+  /// Constructor.
+  explicit shm_channel(io_service_t& io_service)
+    : io_service_(io_service),
+      rendezvous_(io_service),
+      doorbell_(io_service),
+      peer_bell_(-1),
+      segment_(0),
+      segment_size_(0),
+      rx_(),
+      tx_(),
+      read_op_(),
+      write_op_(),
+      waiting_(false),
+      peer_gone_(false)
+  {
+  }
+
+  /// Destructor.
+  ~shm_channel()
+  {
+    close();
+  }
+
+  /// Get the io_service object used to perform asynchronous operations.
+  io_service_t& io_service()
+  {
+    return io_service_;
+  }
+
+  /// Get the socket setting up the connection.
+  rendezvous_socket_t& rendezvous()
+  {
+    return rendezvous_;
+  }
+
+  /// Check whether the channel is open.
+  bool is_open() const
+  {
+    return rendezvous_.is_open();
+  }
+
+  /// Check whether the rings are set up.
+  bool established() const
+  {
+    return segment_ != 0;
+  }
+
+  /// Create the rings and pass them to the peer, by the accepting side.
+  void create(size_t ring_size, boost::system::error_code& ec)
+  {
+    size_t segment_size = 2 * shm_ring::footprint(ring_size);
+    void* segment = MAP_FAILED;
+    int memfd = ::memfd_create("bas_shm", MFD_CLOEXEC);
+    int bells[2] = { ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) };
+
+    if (memfd == -1 || bells[0] == -1 || bells[1] == -1 || ::ftruncate(memfd, segment_size) != 0)
+      ec = last_error();
+    else
+    {
+      segment = ::mmap(0, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+      if (segment == MAP_FAILED)
+        ec = last_error();
+    }
+
+    // Initialize the rings before the peer may write, then pass the memory,
+    // the eventfd of the peer and the own one.
+    if (!ec)
+    {
+      map_rings(segment, segment_size, ring_size, true);
+      int fds[3] = { memfd, bells[1], bells[0] };
+      send_fds(ring_size, fds, ec);
+    }
+
+    close_fd(memfd);
+
+    if (!ec)
+    {
+      setup(bells[0], bells[1], ec);
+      return;
+    }
+
+    unmap_rings();
+    if (segment != MAP_FAILED)
+      ::munmap(segment, segment_size);
+
+    close_fd(bells[0]);
+    close_fd(bells[1]);
+  }
+
+  /// Map the rings passed by the peer, by the connecting side.
+  ///   Returns would_block if they have not arrived yet.
+  void attach(boost::system::error_code& ec)
+  {
+    boost::uint64_t ring_size = 0;
+    int fds[3] = { -1, -1, -1 };
+    receive_fds(ring_size, fds, ec);
+    if (ec)
+      return;
+
+    size_t segment_size = 2 * shm_ring::footprint(static_cast<size_t>(ring_size));
+    void* segment = MAP_FAILED;
+    struct stat info;
+
+    if (ring_size == 0 || (ring_size & (ring_size - 1)) != 0)
+      ec = boost::asio::error::invalid_argument;
+    else if (::fstat(fds[0], &info) != 0)
+      ec = last_error();
+    else if (static_cast<size_t>(info.st_size) < segment_size)
+      ec = boost::asio::error::invalid_argument;
+    else
+    {
+      segment = ::mmap(0, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+      if (segment == MAP_FAILED)
+        ec = last_error();
+    }
+
+    close_fd(fds[0]);
+
+    if (!ec)
+    {
+      map_rings(segment, segment_size, static_cast<size_t>(ring_size), false);
+      setup(fds[1], fds[2], ec);
+      return;
+    }
+
+    close_fd(fds[1]);
+    close_fd(fds[2]);
+  }
+
+  /// Start an asynchronous read of any amount of data.
+  template<typename MutableBufferSequence, typename Handler>
+  void async_read_some(const MutableBufferSequence& buffers, Handler handler);
+
+  /// Start an asynchronous write of any amount of data.
+  template<typename ConstBufferSequence, typename Handler>
+  void async_write_some(const ConstBufferSequence& buffers, Handler handler);
+
+  /// Read from the ring of the peer, ec is set to eof at the end of data.
+  ///   Returns 0 without error if there's no data yet.
+  template<typename MutableBufferSequence>
+  size_t read_some(const MutableBufferSequence& buffers, boost::system::error_code& ec)
+  {
+    ec = boost::system::error_code();
+
+    // Check the end before reading, data written before it is still taken.
+    bool closed = peer_gone_ || rx_.writer_closed();
+
+    size_t n = rx_.read(buffers);
+    if (n != 0)
+    {
+      if (rx_.wake_writer())
+        kick();
+
+      return n;
+    }
+
+    if (closed)
+      ec = boost::asio::error::eof;
+
+    return 0;
+  }
+
+  /// Write to the ring of the peer, ec is set to broken_pipe if it's no longer read.
+  ///   Returns 0 without error if there's no space yet.
+  template<typename ConstBufferSequence>
+  size_t write_some(const ConstBufferSequence& buffers, boost::system::error_code& ec)
+  {
+    ec = boost::system::error_code();
+
+    if (peer_gone_ || tx_.reader_closed() || tx_.writer_closed())
+    {
+      ec = boost::asio::error::broken_pipe;
+      return 0;
+    }
+
+    size_t n = tx_.write(buffers);
+    if (n != 0 && tx_.wake_reader())
+      kick();
+
+    return n;
+  }
+
+  /// Shut down reading, writing or both, the peer sees the end of data or of reading.
+  void shutdown(boost::asio::socket_base::shutdown_type what, boost::system::error_code& ec)
+  {
+    if (!established())
+    {
+      ec = boost::asio::error::not_connected;
+      return;
+    }
+
+    if (what != boost::asio::socket_base::shutdown_receive)
+      tx_.close_writer();
+    if (what != boost::asio::socket_base::shutdown_send)
+      rx_.close_reader();
+
+    kick();
+    ec = boost::system::error_code();
+  }
+
+  /// Close the channel, pending operations are completed with operation_aborted.
+  void close()
+  {
+    if (established())
+    {
+      tx_.close_writer();
+      rx_.close_reader();
+      kick();
+    }
+
+    fail_ops(boost::asio::error::operation_aborted);
+
+    boost::system::error_code ignored_ec;
+    doorbell_.close(ignored_ec);
+    rendezvous_.close(ignored_ec);
+    close_fd(peer_bell_);
+
+    if (segment_ != 0)
+      ::munmap(segment_, segment_size_);
+
+    unmap_rings();
+    waiting_ = false;
+    peer_gone_ = false;
+  }
+
+private:
+  /// Attach the rings to the shared memory, the accepting side initializes them.
+  void map_rings(void* segment, size_t segment_size, size_t ring_size, bool accepted)
+  {
+    segment_ = segment;
+    segment_size_ = segment_size;
+
+    // The first ring carries data from the accepting side to the connecting side.
+    char* base = static_cast<char*>(segment);
+    shm_ring& down = accepted ? tx_ : rx_;
+    shm_ring& up = accepted ? rx_ : tx_;
+    down.attach(base, ring_size, accepted);
+    up.attach(base + shm_ring::footprint(ring_size), ring_size, accepted);
+  }
+
+  /// Detach the rings, the shared memory is unmapped by the caller.
+  void unmap_rings()
+  {
+    segment_ = 0;
+    segment_size_ = 0;
+    rx_.detach();
+    tx_.detach();
+  }
+
+  /// Start waiting for the peer with the eventfds.
+  void setup(int doorbell, int peer_bell, boost::system::error_code& ec)
+  {
+    peer_bell_ = peer_bell;
+
+    doorbell_.assign(doorbell, ec);
+    if (ec)
+    {
+      close_fd(doorbell);
+      close();
+      return;
+    }
+
+    // Nothing else comes on the unix domain socket, readiness means the peer is gone.
+    rendezvous_.async_receive(boost::asio::null_buffers(),
+        mem_fn_io_handler<shm_channel_ptr,
+                          shm_channel,
+                          &shm_channel::handle_peer>(shared_from_this()));
+  }
+
+  /// Complete the pending read until it has to wait for the peer.
+  void run_read()
+  {
+    while (read_op_.get() != 0)
+    {
+      if (read_op_->perform(*this, boost::system::error_code()))
+      {
+        read_op_.reset();
+        return;
+      }
+
+      if (rx_.wait_readable())
+      {
+        wait_doorbell();
+        return;
+      }
+    }
+  }
+
+  /// Complete the pending write until it has to wait for the peer.
+  void run_write()
+  {
+    while (write_op_.get() != 0)
+    {
+      if (write_op_->perform(*this, boost::system::error_code()))
+      {
+        write_op_.reset();
+        return;
+      }
+
+      if (tx_.wait_writable())
+      {
+        wait_doorbell();
+        return;
+      }
+    }
+  }
+
+  /// Fail the pending operations with the error.
+  void fail_ops(const boost::system::error_code& ec)
+  {
+    if (read_op_.get() != 0)
+    {
+      read_op_->perform(*this, ec);
+      read_op_.reset();
+    }
+
+    if (write_op_.get() != 0)
+    {
+      write_op_->perform(*this, ec);
+      write_op_.reset();
+    }
+  }
+
+  /// Wait for the peer to wake this side.
+  void wait_doorbell()
+  {
+    if (waiting_)
+      return;
+
+    waiting_ = true;
+    doorbell_.async_read_some(boost::asio::null_buffers(),
+        mem_fn_io_handler<shm_channel_ptr,
+                          shm_channel,
+                          &shm_channel::handle_doorbell>(shared_from_this()));
+  }
+
+  /// Handle the wake up by the peer.
+  void handle_doorbell(const boost::system::error_code& ec, size_t)
+  {
+    waiting_ = false;
+
+    if (ec == boost::asio::error::operation_aborted || !established())
+      return;
+
+    if (ec)
+    {
+      fail_ops(ec);
+      return;
+    }
+
+    // Reset the eventfd, the rings tell what has happened.
+    boost::uint64_t count = 0;
+    ssize_t n = ::read(doorbell_.native_handle(), &count, sizeof(count));
+    (void)n;
+
+    run_read();
+    run_write();
+  }
+
+  /// Handle the peer closing the unix domain socket or going away.
+  void handle_peer(const boost::system::error_code& ec, size_t)
+  {
+    if (ec == boost::asio::error::operation_aborted || !established())
+      return;
+
+    peer_gone_ = true;
+
+    run_read();
+    run_write();
+  }
+
+  /// Wake the peer.
+  void kick()
+  {
+    if (peer_bell_ == -1)
+      return;
+
+    boost::uint64_t one = 1;
+    ssize_t n = ::write(peer_bell_, &one, sizeof(one));
+    (void)n;
+  }
+
+  /// Send the size of rings and the descriptors to the peer.
+  void send_fds(boost::uint64_t ring_size, const int (&fds)[3], boost::system::error_code& ec)
+  {
+    char control[CMSG_SPACE(sizeof(fds))];
+    std::memset(control, 0, sizeof(control));
+
+    iovec iov;
+    iov.iov_base = &ring_size;
+    iov.iov_len = sizeof(ring_size);
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // A small message on a new connection does not block.
+    if (::sendmsg(rendezvous_.native_handle(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(ring_size)))
+      ec = last_error();
+  }
+
+  /// Receive the size of rings and the descriptors from the peer.
+  void receive_fds(boost::uint64_t& ring_size, int (&fds)[3], boost::system::error_code& ec)
+  {
+    char control[CMSG_SPACE(sizeof(fds))];
+    std::memset(control, 0, sizeof(control));
+
+    iovec iov;
+    iov.iov_base = &ring_size;
+    iov.iov_len = sizeof(ring_size);
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = ::recvmsg(rendezvous_.native_handle(), &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (n < 0)
+    {
+      ec = last_error();
+      return;
+    }
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != 0 && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+        && cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+      std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    if (n == 0)
+      ec = boost::asio::error::eof;
+    else if (n != static_cast<ssize_t>(sizeof(ring_size)) || fds[0] == -1 || (msg.msg_flags & MSG_CTRUNC) != 0)
+      ec = boost::asio::error::invalid_argument;
+
+    if (ec)
+    {
+      for (size_t i = 0; i < 3; ++i)
+        close_fd(fds[i]);
+    }
+  }
+
+  /// Close the descriptor if valid.
+  static void close_fd(int& fd)
+  {
+    if (fd != -1)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+
+  /// Get the error of the last system call.
+  static boost::system::error_code last_error()
+  {
+    return boost::system::error_code(errno, boost::asio::error::get_system_category());
+  }
+
+private:
+  /// The io_service used to perform asynchronous operations.
+  io_service_t& io_service_;
+
+  /// The unix domain socket setting up the connection and watching the peer.
+  rendezvous_socket_t rendezvous_;
+
+  /// The eventfd waking this side.
+  boost::asio::posix::stream_descriptor doorbell_;
+
+  /// The eventfd waking the peer.
+  int peer_bell_;
+
+  /// The shared memory holding both rings.
+  void* segment_;
+
+  /// The bytes of the shared memory.
+  size_t segment_size_;
+
+  /// The ring written by the peer.
+  shm_ring rx_;
+
+  /// The ring read by the peer.
+  shm_ring tx_;
+
+  /// The pending read.
+  boost::scoped_ptr<shm_op> read_op_;
+
+  /// The pending write.
+  boost::scoped_ptr<shm_op> write_op_;
+
+  /// Flag to indicate whether the doorbell is waited.
+  bool waiting_;
+
+  /// Flag to indicate whether the peer has closed or gone away.
+  bool peer_gone_;
+};
+
+/// Read operation of shm_channel.
+template<typename MutableBufferSequence, typename Handler>
+class shm_read_op
+  : public shm_op
+{
+public:
+  shm_read_op(const MutableBufferSequence& buffers, Handler handler)
+    : buffers_(buffers),
+      handler_(handler)
+  {
+  }
+
+  virtual bool perform(shm_channel& channel, const boost::system::error_code& e)
+  {
+    boost::system::error_code ec = e;
+    std::size_t n = 0;
+
+    if (!ec)
+    {
+      n = channel.read_some(buffers_, ec);
+      if (n == 0 && !ec && boost::asio::buffer_size(buffers_) != 0)
+        return false;
+    }
+
+    channel.io_service().post(boost::asio::detail::bind_handler(handler_, ec, n));
+    return true;
+  }
+
+private:
+  MutableBufferSequence buffers_;
+  Handler handler_;
+};
+
+/// Write operation of shm_channel.
+template<typename ConstBufferSequence, typename Handler>
+class shm_write_op
+  : public shm_op
+{
+public:
+  shm_write_op(const ConstBufferSequence& buffers, Handler handler)
+    : buffers_(buffers),
+      handler_(handler)
+  {
+  }
+
+  virtual bool perform(shm_channel& channel, const boost::system::error_code& e)
+  {
+    boost::system::error_code ec = e;
+    std::size_t n = 0;
+
+    if (!ec)
+    {
+      n = channel.write_some(buffers_, ec);
+      if (n == 0 && !ec && boost::asio::buffer_size(buffers_) != 0)
+        return false;
+    }
+
+    channel.io_service().post(boost::asio::detail::bind_handler(handler_, ec, n));
+    return true;
+  }
+
+private:
+  ConstBufferSequence buffers_;
+  Handler handler_;
+};
+
+template<typename MutableBufferSequence, typename Handler>
+void shm_channel::async_read_some(const MutableBufferSequence& buffers, Handler handler)
+{
+  if (!established())
+  {
+    io_service_.post(boost::asio::detail::bind_handler(handler,
+        boost::system::error_code(boost::asio::error::bad_descriptor), std::size_t(0)));
+    return;
+  }
+
+  // Only one read is in progress at a time, as on a stream socket.
+  BOOST_ASSERT(read_op_.get() == 0);
+  read_op_.reset(new shm_read_op<MutableBufferSequence, Handler>(buffers, handler));
+  run_read();
+}
+
+template<typename ConstBufferSequence, typename Handler>
+void shm_channel::async_write_some(const ConstBufferSequence& buffers, Handler handler)
+{
+  if (!established())
+  {
+    io_service_.post(boost::asio::detail::bind_handler(handler,
+        boost::system::error_code(boost::asio::error::bad_descriptor), std::size_t(0)));
+    return;
+  }
+
+  // Only one write is in progress at a time, as on a stream socket.
+  BOOST_ASSERT(write_op_.get() == 0);
+  write_op_.reset(new shm_write_op<ConstBufferSequence, Handler>(buffers, handler));
+  run_write();
+}
+
+/// Connect operation of shm_socket, connects the unix domain socket then waits for the rings.
+template<typename Handler>
+class shm_connect_op
+{
+public:
+  shm_connect_op(const shm_channel::shm_channel_ptr& channel, Handler handler)
+    : channel_(channel),
+      handler_(handler)
+  {
+  }
+
+  /// Handle completion of connect.
+  void operator()(const boost::system::error_code& ec)
+  {
+    if (ec)
+    {
+      handler_(ec);
+      return;
+    }
+
+    channel_->rendezvous().async_receive(boost::asio::null_buffers(), *this);
+  }
+
+  /// Handle the arrival of the rings.
+  void operator()(const boost::system::error_code& e, std::size_t)
+  {
+    boost::system::error_code ec = e;
+    if (!ec)
+      channel_->attach(ec);
+
+    if (ec == boost::asio::error::would_block || ec == boost::asio::error::try_again)
+    {
+      channel_->rendezvous().async_receive(boost::asio::null_buffers(), *this);
+      return;
+    }
+
+    handler_(ec);
+  }
+
+private:
+  shm_channel::shm_channel_ptr channel_;
+  Handler handler_;
+};
+
+/// Stream socket over shared memory, a Socket_Service for service_handler, server and client.
+class shm_socket
+  : private boost::noncopyable
+{
+public:
+  /// Define type reference of boost::asio::io_service.
+  typedef boost::asio::io_service io_service_t;
+
+  /// The socket is the lowest layer itself.
+  typedef shm_socket lowest_layer_type;
+
+  /// The type of the protocol.
+  typedef shm_protocol protocol_type;
+
+  /// The type of the endpoint.
+  typedef shm_endpoint endpoint_type;
+
+#if (BOOST_VERSION >= 106600)
+  /// The type of the executor, for composed operations of boost::asio.
+  typedef io_service_t::executor_type executor_type;
+#endif
+
+  /// Constructor.
+  explicit shm_socket(io_service_t& io_service)
+    : channel_(new shm_channel(io_service))
+  {
+  }
+
+  /// Destructor.
+  ~shm_socket()
+  {
+    channel_->close();
+  }
+
+  /// Get the io_service object used to perform asynchronous operations.
+  io_service_t& get_io_service()
+  {
+    return channel_->io_service();
+  }
+
+#if (BOOST_VERSION >= 106600)
+  /// Get the executor, for composed operations of boost::asio.
+  executor_type get_executor()
+  {
+    return channel_->io_service().get_executor();
+  }
+#endif
+
+  /// Get the lowest layer.
+  lowest_layer_type& lowest_layer()
+  {
+    return *this;
+  }
+
+  /// Get the state shared with pending operations.
+  shm_channel& channel()
+  {
+    return *channel_;
+  }
+
+  /// Get the pointer of the state shared with pending operations.
+  const shm_channel::shm_channel_ptr& channel_ptr() const
+  {
+    return channel_;
+  }
+
+  /// Open the socket, nothing to do before connect.
+  void open(const protocol_type&, boost::system::error_code& ec)
+  {
+    ec = boost::system::error_code();
+  }
+
+  /// Check whether the socket is open.
+  bool is_open() const
+  {
+    return channel_->is_open();
+  }
+
+  /// Binding to a local endpoint is not supported.
+  void bind(const endpoint_type&, boost::system::error_code& ec)
+  {
+    ec = boost::asio::error::operation_not_supported;
+  }
+
+  /// Socket options are not supported.
+  template<typename Option>
+  void set_option(const Option&, boost::system::error_code& ec)
+  {
+    ec = boost::asio::error::operation_not_supported;
+  }
+
+  /// Get the local endpoint.
+  endpoint_type local_endpoint() const
+  {
+    boost::system::error_code ignored_ec;
+    return endpoint_type(channel_->rendezvous().local_endpoint(ignored_ec));
+  }
+
+  /// Get the remote endpoint.
+  endpoint_type remote_endpoint() const
+  {
+    boost::system::error_code ignored_ec;
+    return endpoint_type(channel_->rendezvous().remote_endpoint(ignored_ec));
+  }
+
+  /// Start an asynchronous connect.
+  template<typename Handler>
+  void async_connect(const endpoint_type& peer_endpoint, Handler handler)
+  {
+    channel_->rendezvous().async_connect(peer_endpoint.rendezvous(),
+        shm_connect_op<Handler>(channel_, handler));
+  }
+
+  /// Start an asynchronous read of any amount of data.
+  template<typename MutableBufferSequence, typename Handler>
+  void async_read_some(const MutableBufferSequence& buffers, Handler handler)
+  {
+    channel_->async_read_some(buffers, handler);
+  }
+
+  /// Start an asynchronous write of any amount of data.
+  template<typename ConstBufferSequence, typename Handler>
+  void async_write_some(const ConstBufferSequence& buffers, Handler handler)
+  {
+    channel_->async_write_some(buffers, handler);
+  }
+
+  /// Shut down reading, writing or both.
+  void shutdown(boost::asio::socket_base::shutdown_type what, boost::system::error_code& ec)
+  {
+    channel_->shutdown(what, ec);
+  }
+
+  /// Close the socket.
+  void close(boost::system::error_code& ec)
+  {
+    channel_->close();
+    ec = boost::system::error_code();
+  }
+
+  /// Close the socket.
+  void close()
+  {
+    channel_->close();
+  }
+
+private:
+  /// The state shared with pending operations.
+  shm_channel::shm_channel_ptr channel_;
+};
+
+/// Accept operation of shm_acceptor, creates the rings for the accepted socket.
+template<typename Handler>
+class shm_accept_op
+{
+public:
+  typedef shm_protocol::rendezvous_protocol::acceptor rendezvous_acceptor_t;
+
+  shm_accept_op(rendezvous_acceptor_t& acceptor,
+      const shm_channel::shm_channel_ptr& channel,
+      std::size_t ring_size,
+      Handler handler)
+    : acceptor_(&acceptor),
+      channel_(channel),
+      ring_size_(ring_size),
+      handler_(handler)
+  {
+  }
+
+  void operator()(const boost::system::error_code& e)
+  {
+    boost::system::error_code ec = e;
+    if (!ec)
+      channel_->create(ring_size_, ec);
+
+    // Failing to set up one peer, such as one gone already, does not stop accepting.
+    if (!e && ec)
+    {
+      channel_->close();
+      acceptor_->async_accept(channel_->rendezvous(), *this);
+      return;
+    }
+
+    handler_(ec);
+  }
+
+private:
+  rendezvous_acceptor_t* acceptor_;
+  shm_channel::shm_channel_ptr channel_;
+  std::size_t ring_size_;
+  Handler handler_;
+};
+
+/// Acceptor of shared memory sockets, listening on a unix domain socket.
+class shm_acceptor
+  : private boost::noncopyable
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Define type reference of boost::asio::io_service.
+  typedef boost::asio::io_service io_service_t;
+
+  /// The type of the protocol.
+  typedef shm_protocol protocol_type;
+
+  /// The type of the endpoint.
+  typedef shm_endpoint endpoint_type;
+
+  /// The type of the acceptor of the unix domain socket.
+  typedef shm_protocol::rendezvous_protocol::acceptor rendezvous_acceptor_t;
+
+  /// The type of the native handle, the listening unix domain socket.
+  typedef rendezvous_acceptor_t::native_handle_type native_handle_type;
+
+  /// Constructor.
+  explicit shm_acceptor(io_service_t& io_service, size_t ring_size = BAS_SHM_RING_SIZE)
+    : io_service_(io_service),
+      acceptor_(io_service),
+      ring_size_(ring_size)
+  {
+    BOOST_ASSERT(ring_size != 0 && (ring_size & (ring_size - 1)) == 0);
+  }
+
+  /// Get the io_service object used to perform asynchronous operations.
+  io_service_t& get_io_service()
+  {
+    return io_service_;
+  }
+
+  /// Set the bytes of each ring of accepted sockets, must be a power of 2.
+  void set_ring_size(size_t ring_size)
+  {
+    BOOST_ASSERT(ring_size != 0 && (ring_size & (ring_size - 1)) == 0);
+
+    ring_size_ = ring_size;
+  }
+
+  /// Open the acceptor.
+  void open(const protocol_type& = protocol_type())
+  {
+    acceptor_.open(shm_protocol::rendezvous_protocol());
+  }
+
+  /// Open the acceptor.
+  void open(const protocol_type&, boost::system::error_code& ec)
+  {
+    acceptor_.open(shm_protocol::rendezvous_protocol(), ec);
+  }
+
+  /// Open the acceptor on a listening unix domain socket.
+  void assign(const protocol_type&, const native_handle_type& native_acceptor,
+      boost::system::error_code& ec)
+  {
+    acceptor_.assign(shm_protocol::rendezvous_protocol(), native_acceptor, ec);
+  }
+
+  /// Check whether the acceptor is open.
+  bool is_open() const
+  {
+    return acceptor_.is_open();
+  }
+
+  /// Get the native handle of the listening unix domain socket.
+  native_handle_type native_handle()
+  {
+    return acceptor_.native_handle();
+  }
+
+  /// Set an option of the unix domain socket.
+  template<typename Option>
+  void set_option(const Option& option)
+  {
+    acceptor_.set_option(option);
+  }
+
+  /// Set an option of the unix domain socket.
+  template<typename Option>
+  void set_option(const Option& option, boost::system::error_code& ec)
+  {
+    acceptor_.set_option(option, ec);
+  }
+
+  /// Bind the acceptor to the local endpoint.
+  void bind(const endpoint_type& endpoint)
+  {
+    acceptor_.bind(endpoint.rendezvous());
+  }
+
+  /// Bind the acceptor to the local endpoint.
+  void bind(const endpoint_type& endpoint, boost::system::error_code& ec)
+  {
+    acceptor_.bind(endpoint.rendezvous(), ec);
+  }
+
+  /// Listen for new connections.
+  void listen(int backlog = boost::asio::socket_base::max_connections)
+  {
+    acceptor_.listen(backlog);
+  }
+
+  /// Listen for new connections.
+  void listen(int backlog, boost::system::error_code& ec)
+  {
+    acceptor_.listen(backlog, ec);
+  }
+
+  /// Get the local endpoint.
+  endpoint_type local_endpoint() const
+  {
+    return endpoint_type(acceptor_.local_endpoint());
+  }
+
+  /// Close the acceptor.
+  void close()
+  {
+    acceptor_.close();
+  }
+
+  /// Close the acceptor.
+  void close(boost::system::error_code& ec)
+  {
+    acceptor_.close(ec);
+  }
+
+  /// Start an asynchronous accept, the handler is called when the rings are set up.
+  template<typename Handler>
+  void async_accept(shm_socket& peer, Handler handler)
+  {
+    acceptor_.async_accept(peer.channel().rendezvous(),
+        shm_accept_op<Handler>(acceptor_, peer.channel_ptr(), ring_size_, handler));
+  }
+
+private:
+  /// The io_service used to perform asynchronous operations.
+  io_service_t& io_service_;
+
+  /// The acceptor of the unix domain socket.
+  rendezvous_acceptor_t acceptor_;
+
+  /// The bytes of each ring of accepted sockets.
+  size_t ring_size_;
+};
+
+} // namespace bas
+
+#endif // defined(BAS_HAS_SHM_SOCKET)
+
+#endif // BAS_SHM_SOCKET_HPP
@@ -0,0 +1,80 @@
+//
+// socket_traits.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_SOCKET_TRAITS_HPP
+#define BAS_SOCKET_TRAITS_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/asio.hpp>
+#include <string>
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+# include <errno.h>
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace bas {
+
+/// Types of the protocol carried by a socket, such as tcp::socket,
+/// local::stream_protocol::socket or ssl::stream layered on them.
+template<typename Socket_Service>
+struct socket_traits
+{
+  /// The type of the lowest layer socket.
+  typedef typename Socket_Service::lowest_layer_type lowest_layer_t;
+
+  /// The type of the protocol.
+  typedef typename lowest_layer_t::protocol_type protocol_t;
+
+  /// The type of the endpoint.
+  typedef typename protocol_t::endpoint endpoint_t;
+
+  /// The type of the acceptor for listening.
+  typedef typename protocol_t::acceptor acceptor_t;
+};
+
+/// Prepare the endpoint for binding a listening socket, nothing to do for
+/// network protocols.
+template<typename Endpoint>
+inline void prepare_bind(const Endpoint&)
+{
+}
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+/// Remove the socket file left by a previous listener of the path. The file
+/// is removed only if nothing listens on it, a live listener and other kinds
+/// of files are kept and reported by bind.
+inline void prepare_bind(const boost::asio::local::stream_protocol::endpoint& endpoint)
+{
+  std::string path = endpoint.path();
+  struct stat info;
+  if (path.empty() || ::lstat(path.c_str(), &info) != 0 || !S_ISSOCK(info.st_mode))
+    return;
+
+  // Probe the path, only a refused connection means the listener is gone.
+  int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe == -1)
+    return;
+
+  bool stale = (::connect(probe, endpoint.data(), static_cast<socklen_t>(endpoint.size())) == -1)
+      && (errno == ECONNREFUSED);
+  ::close(probe);
+
+  if (stale)
+    ::unlink(path.c_str());
+}
+#endif
+
+} // namespace bas
+
+#endif // BAS_SOCKET_TRAITS_HPP
@@ -27,7 +27,8 @@ namespace bas {
 #define BAS_SYNC_HANDLER_TIMEOUT_MILLISECONDS      30
 
 /// Class for holding multi endpoint pair.
-class endpoint_group
+template<typename Endpoint = boost::asio::ip::tcp::endpoint>
+class basic_endpoint_group
   : private boost::noncopyable
 {
 public:
@@ -40,14 +41,14 @@ public:
   /// Define type reference of boost::recursive_mutex::scoped_lock.
   typedef boost::recursive_mutex::scoped_lock scoped_lock_t;
 
-  /// Define type reference of boost::asio::ip::tcp::endpoint.
-  typedef boost::asio::ip::tcp::endpoint endpoint_t;
+  /// The type of the endpoint.
+  typedef Endpoint endpoint_t;
 
   /// The type of value in the vector.
   typedef std::pair<endpoint_t, endpoint_t> endpoint_pair_t;
 
   /// Constructor.
-  endpoint_group()
+  basic_endpoint_group()
     : endpoint_pairs_(),
       mutex_(),
       next_endpoint_(0)
@@ -55,14 +56,14 @@ public:
   }
 
   /// Destructor.
-  ~endpoint_group()
+  ~basic_endpoint_group()
   {
     // Release all endpoint_pair.
     endpoint_pairs_.clear();
   }
 
   /// Set endpoint_pair.
-  endpoint_group& set(endpoint_t& peer_endpoint,
+  basic_endpoint_group& set(endpoint_t& peer_endpoint,
                       endpoint_t& local_endpoint = endpoint_t())
   {
     // Lock for synchronize access to data.
@@ -124,6 +125,9 @@ private:
   std::vector<endpoint_pair_t> endpoint_pairs_;
 };
 
+/// The endpoint_group of tcp endpoints.
+typedef basic_endpoint_group<> endpoint_group;
+
 /// A pool of sync_handler objects.
 template<typename Socket_Service = boost::asio::ip::tcp::socket>
 class sync_handler_pool
@@ -153,6 +157,9 @@ public:
   typedef sync_handler_pool<socket_t> sync_handler_pool_t;
   typedef boost::shared_ptr<sync_handler_pool_t> sync_handler_pool_ptr;
 
+  /// The type of the endpoint_group.
+  typedef basic_endpoint_group<typename sync_handler_t::endpoint_t> endpoint_group;
+
   /// The type of the io_service_pool.
   typedef boost::shared_ptr<io_service_pool> io_service_pool_ptr;
 
@@ -292,7 +299,7 @@ private:
   /// Make a new handler.
   sync_handler_t* make_handler(void)
   {
-    endpoint_group::endpoint_pair_t endpoint_pair = endpoint_pairs_.get_endpoints();
+    typename endpoint_group::endpoint_pair_t endpoint_pair = endpoint_pairs_.get_endpoints();
 
     return new sync_handler_t(io_pool_->get_io_service(),
                    endpoint_pair.first,
@@ -399,8 +406,8 @@ public:
   /// The type of the socket that will be used to provide asynchronous operations.
   typedef Socket_Service socket_t;
 
-  /// Define type reference of boost::asio::ip::tcp::endpoint.
-  typedef boost::asio::ip::tcp::endpoint endpoint_t;
+  /// Define type reference of the endpoint of the socket protocol.
+  typedef typename socket_traits<Socket_Service>::endpoint_t endpoint_t;
 
   /// The type of the sync_handler.
   typedef sync_handler<socket_t> sync_handler_t;
@@ -410,6 +417,9 @@ public:
   typedef sync_handler_pool<socket_t> sync_handler_pool_t;
   typedef boost::shared_ptr<sync_handler_pool_t> sync_handler_pool_ptr;
 
+  /// The type of the endpoint_group.
+  typedef basic_endpoint_group<typename sync_handler_t::endpoint_t> endpoint_group;
+
   /// The type of the io_service_pool.
   typedef boost::shared_ptr<io_service_pool> io_service_pool_ptr;
 
@@ -11,16 +11,21 @@
 #ifndef BAS_SYNC_HANDLER_HPP
 #define BAS_SYNC_HANDLER_HPP
 
+#include <bas/config.hpp>
+
 #include <boost/assert.hpp>
 #include <boost/asio.hpp>
-#include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/condition.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 
 #include <bas/io_buffer.hpp>
+#include <bas/mem_fn_handler.hpp>
+#include <bas/shared_buffers.hpp>
+#include <bas/socket_traits.hpp>
 
 namespace bas {
 
@@ -45,8 +50,8 @@ public:
   /// Define type reference of boost::asio::deadline_timer.
   typedef boost::asio::deadline_timer timer_t;
 
-  /// Define type reference of boost::asio::ip::tcp::endpoint.
-  typedef boost::asio::ip::tcp::endpoint endpoint_t;
+  /// Define type reference of the endpoint of the socket protocol.
+  typedef typename socket_traits<Socket_Service>::endpoint_t endpoint_t;
 
   /// Define type reference of boost::recursive_mutex.
   typedef boost::recursive_mutex mutex_t;
@@ -60,6 +65,9 @@ public:
   /// Define the type of the sync_handler.
   typedef sync_handler<socket_t> sync_handler_t;
 
+  /// The type of the reference counted pointer to sync_handler.
+  typedef boost::shared_ptr<sync_handler_t> sync_handler_ptr;
+
   /// Constructor.
   sync_handler(io_service_t& io_service,
       endpoint_t& peer_endpoint,
@@ -125,8 +133,9 @@ public:
   void close()
   {
     // Post to io_service thread.
-    io_service_.post(boost::bind(&sync_handler_t::close_i,
-                                 shared_from_this()));
+    io_service_.post(mem_fn_handler0<sync_handler_ptr,
+                                     sync_handler_t,
+                                     &sync_handler_t::close_i>(shared_from_this()));
   }
 
   /// Get the error code of the handler.
@@ -165,11 +174,15 @@ public:
       return ec_;
 
     // Post to io_service thread.
-    io_service_.post(boost::bind(&sync_handler_t::connect_i,
-                                 shared_from_this(),
-                                 peer_endpoint,
-                                 local_endpoint,
-                                 reconnect));
+    io_service_.post(mem_fn_handler3<sync_handler_ptr,
+                                     sync_handler_t,
+                                     endpoint_t&,
+                                     endpoint_t&,
+                                     bool,
+                                     &sync_handler_t::connect_i>(shared_from_this(),
+                                         peer_endpoint,
+                                         local_endpoint,
+                                         reconnect));
 
     // Waiting for notify.
     waiting_ = true;
@@ -205,9 +218,13 @@ public:
       return error_t(boost::asio::error::already_started);
 
     // Post to io_service thread.
-    io_service_.post(boost::bind(&sync_handler_t::read_some_i<Buffers>,
-                                 shared_from_this(),
-                                 buffers));
+    typedef typename buffers_holder<Buffers>::type buffers_t;
+
+    io_service_.post(mem_fn_handler1<sync_handler_ptr,
+                                     sync_handler_t,
+                                     const buffers_t&,
+                                     &sync_handler_t::template read_some_i<buffers_t> >(shared_from_this(),
+                                         buffers_holder<Buffers>::hold(buffers)));
 
     // Waiting for notify.
     waiting_ = true;
@@ -256,9 +273,13 @@ public:
       return error_t(boost::asio::error::already_started);
 
     // Post to io_service thread.
-    io_service_.post(boost::bind(&sync_handler_t::read_i<Buffers>,
-                                 shared_from_this(),
-                                 buffers));
+    typedef typename buffers_holder<Buffers>::type buffers_t;
+
+    io_service_.post(mem_fn_handler1<sync_handler_ptr,
+                                     sync_handler_t,
+                                     const buffers_t&,
+                                     &sync_handler_t::template read_i<buffers_t> >(shared_from_this(),
+                                         buffers_holder<Buffers>::hold(buffers)));
 
     // Waiting for notify.
     waiting_ = true;
@@ -307,9 +328,13 @@ public:
       return error_t(boost::asio::error::already_started);
 
     // Post to io_service thread.
-    io_service_.post(boost::bind(&sync_handler_t::write_i<Buffers>,
-                                 shared_from_this(),
-                                 buffers));
+    typedef typename buffers_holder<Buffers>::type buffers_t;
+
+    io_service_.post(mem_fn_handler1<sync_handler_ptr,
+                                     sync_handler_t,
+                                     const buffers_t&,
+                                     &sync_handler_t::template write_i<buffers_t> >(shared_from_this(),
+                                         buffers_holder<Buffers>::hold(buffers)));
 
     // Waiting for notify.
     waiting_ = true;
@@ -336,8 +361,9 @@ public:
       return error_t(boost::asio::error::already_started);
 
     // Post to io_service thread.
-    io_service_.post(boost::bind(&sync_handler_t::write_read_i,
-                                 shared_from_this()));
+    io_service_.post(mem_fn_handler0<sync_handler_ptr,
+                                     sync_handler_t,
+                                     &sync_handler_t::write_read_i>(shared_from_this()));
 
     // Waiting for notify.
     waiting_ = true;
@@ -405,9 +431,9 @@ private:
     // Set timer for timeout control and start async_connect.
     set_timer();
     socket_.async_connect(peer_endpoint,
-                boost::bind(&sync_handler_t::handle_connect,
-                            shared_from_this(),
-                            boost::asio::placeholders::error));
+        mem_fn_wait_handler<sync_handler_ptr,
+                            sync_handler_t,
+                            &sync_handler_t::handle_connect>(shared_from_this()));
   }
 
   /// Start asynchronous read operation in io_service thread.
@@ -428,10 +454,9 @@ private:
     // Set timer for timeout control and start async_read_some;
     set_timer();
     socket_.async_read_some(buffers,
-                boost::bind(&sync_handler_t::handle_read_write,
-                            shared_from_this(),
-                            boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred));
+        mem_fn_io_handler<sync_handler_ptr,
+                          sync_handler_t,
+                          &sync_handler_t::handle_read_write>(shared_from_this()));
   }
 
   /// Start asynchronous read operation in io_service thread.
@@ -453,10 +478,9 @@ private:
     set_timer();
     boost::asio::async_read(socket_,
         buffers,
-        boost::bind(&sync_handler_t::handle_read_write,
-                    shared_from_this(),
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+        mem_fn_io_handler<sync_handler_ptr,
+                          sync_handler_t,
+                          &sync_handler_t::handle_read_write>(shared_from_this()));
   }
  
   /// Start asynchronous write operation in io_service thread.
@@ -478,10 +502,9 @@ private:
     set_timer();
     boost::asio::async_write(socket_,
         buffers,
-        boost::bind(&sync_handler_t::handle_read_write,
-                    shared_from_this(),
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+        mem_fn_io_handler<sync_handler_ptr,
+                          sync_handler_t,
+                          &sync_handler_t::handle_read_write>(shared_from_this()));
   }
 
   /// Start asynchronous write operation in io_service thread.
@@ -502,10 +525,9 @@ private:
     set_timer();
     boost::asio::async_write(socket_,
         boost::asio::buffer(buffer().data(), buffer().size()),
-        boost::bind(&sync_handler_t::handle_read_write,
-                    shared_from_this(),
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+        mem_fn_io_handler<sync_handler_ptr,
+                          sync_handler_t,
+                          &sync_handler_t::handle_read_write>(shared_from_this()));
   }
 
   /// Set timer for asynchronous operation timeout control.
@@ -520,9 +542,9 @@ private:
 
     // Set timer to expires from the given milliseconds.
     timer_.expires_from_now(boost::posix_time::milliseconds(timeout_milliseconds_));
-    timer_.async_wait(boost::bind(&sync_handler_t::handle_timeout,
-                                   shared_from_this(),
-                                   boost::asio::placeholders::error));
+    timer_.async_wait(mem_fn_wait_handler<sync_handler_ptr,
+                                          sync_handler_t,
+                                          &sync_handler_t::handle_timeout>(shared_from_this()));
   }
 
   /// Cancel timer for asynchronous operation to be completed or aborted.
@@ -650,7 +672,7 @@ private:
   void close_socket()
   {
     error_t ignored_ec;
-    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
+    socket_.shutdown(boost::asio::socket_base::shutdown_both, ignored_ec);
     socket_.close(ignored_ec);
     opened_ = false;
   }
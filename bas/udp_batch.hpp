@@ -0,0 +1,314 @@
+//
+// udp_batch.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_UDP_BATCH_HPP
+#define BAS_UDP_BATCH_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/assert.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstring>
+#include <vector>
+
+namespace bas {
+
+// Maximum datagrams received or sent by one system call.
+#if !defined(BAS_UDP_BATCH_SIZE)
+# define BAS_UDP_BATCH_SIZE     64
+#endif
+
+// Maximum size of a datagram held by a batch.
+#if !defined(BAS_UDP_DATAGRAM_SIZE)
+# define BAS_UDP_DATAGRAM_SIZE  2048
+#endif
+
+class udp_batch_pool;
+
+/// A batch of datagrams with their peer endpoints, in one block of memory.
+//    A received batch holds the datagrams and their senders, a batch to send
+//    holds the datagrams and their receivers, so an echo may send back the
+//    batch it received as is.
+class udp_batch
+  : private boost::noncopyable
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// The type of the bytes stored in udp_batch.
+  typedef unsigned char byte_t;
+
+  /// Define type reference of boost::asio::ip::udp::endpoint.
+  typedef boost::asio::ip::udp::endpoint endpoint_t;
+
+  /// Constructor.
+  udp_batch(size_t capacity = BAS_UDP_BATCH_SIZE,
+      size_t datagram_size = BAS_UDP_DATAGRAM_SIZE)
+    : ref_count_(0),
+      pool_(),
+      buffer_(capacity * datagram_size, 0),
+      lengths_(capacity, 0),
+      endpoints_(capacity),
+      size_(0),
+      datagram_size_(datagram_size)
+  {
+    BOOST_ASSERT(capacity != 0);
+    BOOST_ASSERT(datagram_size != 0);
+  }
+
+  /// Get the number of datagrams in the batch.
+  size_t size() const
+  {
+    return size_;
+  }
+
+  /// Get the maximum number of datagrams in the batch.
+  size_t capacity() const
+  {
+    return lengths_.size();
+  }
+
+  /// Get the maximum size of a datagram.
+  size_t datagram_size() const
+  {
+    return datagram_size_;
+  }
+
+  /// Check whether the batch is empty.
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+  /// Check whether the batch is full.
+  bool full() const
+  {
+    return size_ == lengths_.size();
+  }
+
+  /// Remove all datagrams.
+  void clear()
+  {
+    size_ = 0;
+  }
+
+  /// Get the data of the datagram at index.
+  byte_t* data(size_t index)
+  {
+    BOOST_ASSERT(index < lengths_.size());
+
+    return &buffer_[index * datagram_size_];
+  }
+
+  /// Get the length of the datagram at index.
+  size_t length(size_t index) const
+  {
+    BOOST_ASSERT(index < lengths_.size());
+
+    return lengths_[index];
+  }
+
+  /// Get the peer endpoint of the datagram at index.
+  endpoint_t& endpoint(size_t index)
+  {
+    BOOST_ASSERT(index < lengths_.size());
+
+    return endpoints_[index];
+  }
+
+  /// Append a datagram, returns false if the batch is full or the data is too long.
+  bool push(const endpoint_t& endpoint, const void* data, size_t length)
+  {
+    if (full() || length > datagram_size_)
+      return false;
+
+    memcpy(this->data(size_), data, length);
+    lengths_[size_] = length;
+    endpoints_[size_] = endpoint;
+    ++size_;
+
+    return true;
+  }
+
+  /// Set the length of the datagram at index, after it's filled in place.
+  void set_length(size_t index, size_t length)
+  {
+    BOOST_ASSERT(index < lengths_.size());
+    BOOST_ASSERT(length <= datagram_size_);
+
+    lengths_[index] = length;
+  }
+
+  /// Set the number of datagrams, after they're filled in place.
+  void resize(size_t size)
+  {
+    BOOST_ASSERT(size <= lengths_.size());
+
+    size_ = size;
+  }
+
+private:
+  friend class udp_batch_pool;
+
+  /// Increment the reference count of the batch.
+  friend void intrusive_ptr_add_ref(udp_batch* batch_ptr)
+  {
+    ++batch_ptr->ref_count_;
+  }
+
+  /// Decrement the reference count of the batch, return it to the pool when no longer referenced.
+  friend void intrusive_ptr_release(udp_batch* batch_ptr);
+
+  /// Reference count of the batch.
+  boost::detail::atomic_count ref_count_;
+
+  /// The pool taking back the batch, only set while the batch is in use.
+  boost::shared_ptr<udp_batch_pool> pool_;
+
+  /// The data of all datagrams.
+  std::vector<byte_t> buffer_;
+
+  /// The length of each datagram.
+  std::vector<size_t> lengths_;
+
+  /// The peer endpoint of each datagram.
+  std::vector<endpoint_t> endpoints_;
+
+  /// The number of datagrams.
+  size_t size_;
+
+  /// The maximum size of a datagram.
+  size_t datagram_size_;
+};
+
+/// Define type reference of the reference counted pointer to udp_batch.
+typedef boost::intrusive_ptr<udp_batch> udp_batch_ptr;
+
+/// A pool of udp_batch objects of the same size, shared by io and work threads.
+class udp_batch_pool
+  : public boost::enable_shared_from_this<udp_batch_pool>,
+    private boost::noncopyable
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Constructor.
+  udp_batch_pool(size_t batch_capacity = BAS_UDP_BATCH_SIZE,
+      size_t datagram_size = BAS_UDP_DATAGRAM_SIZE,
+      size_t pool_high_watermark = 64)
+    : mutex_(),
+      batches_(),
+      batch_capacity_(batch_capacity),
+      datagram_size_(datagram_size),
+      pool_high_watermark_(pool_high_watermark)
+  {
+  }
+
+  /// Destructor.
+  ~udp_batch_pool()
+  {
+    for (size_t i = 0; i < batches_.size(); ++i)
+      delete batches_[i];
+
+    batches_.clear();
+  }
+
+  /// Get an empty batch, a new one is created if the pool is empty.
+  udp_batch_ptr get()
+  {
+    udp_batch* batch_ptr = 0;
+    {
+      scoped_lock_t lock(mutex_);
+
+      if (!batches_.empty())
+      {
+        batch_ptr = batches_.back();
+        batches_.pop_back();
+      }
+    }
+
+    if (batch_ptr == 0)
+      batch_ptr = new udp_batch(batch_capacity_, datagram_size_);
+
+    batch_ptr->clear();
+    batch_ptr->pool_ = shared_from_this();
+
+    return udp_batch_ptr(batch_ptr);
+  }
+
+private:
+  friend void intrusive_ptr_release(udp_batch* batch_ptr);
+
+  /// Define type reference of boost::asio::detail::mutex.
+  typedef boost::asio::detail::mutex mutex_t;
+
+  /// Define type reference of boost::asio::detail::mutex::scoped_lock.
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+
+  /// Take back a batch no longer referenced, delete it if the pool is full.
+  void put(udp_batch* batch_ptr)
+  {
+    {
+      scoped_lock_t lock(mutex_);
+
+      if (batches_.size() < pool_high_watermark_)
+      {
+        batches_.push_back(batch_ptr);
+        return;
+      }
+    }
+
+    delete batch_ptr;
+  }
+
+  /// Mutex for synchronize access to the batches.
+  mutex_t mutex_;
+
+  /// The batches not in use.
+  std::vector<udp_batch*> batches_;
+
+  /// The maximum number of datagrams in a batch.
+  size_t batch_capacity_;
+
+  /// The maximum size of a datagram.
+  size_t datagram_size_;
+
+  /// The maximum number of batches kept in the pool.
+  size_t pool_high_watermark_;
+};
+
+inline void intrusive_ptr_release(udp_batch* batch_ptr)
+{
+  if (--batch_ptr->ref_count_ != 0)
+    return;
+
+  if (batch_ptr->pool_.get() == 0)
+  {
+    delete batch_ptr;
+    return;
+  }
+
+  // Hold the pool, the batch does not keep it while in the pool.
+  boost::shared_ptr<udp_batch_pool> pool;
+  pool.swap(batch_ptr->pool_);
+  pool->put(batch_ptr);
+}
+
+} // namespace bas
+
+#endif // BAS_UDP_BATCH_HPP
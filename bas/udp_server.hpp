@@ -0,0 +1,311 @@
+//
+// udp_server.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_UDP_SERVER_HPP
+#define BAS_UDP_SERVER_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/assert.hpp>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+#include <bas/io_service_group.hpp>
+#include <bas/udp_batch.hpp>
+#include <bas/udp_service_handler.hpp>
+
+namespace bas {
+
+/// The top-level class of the datagram server.
+//    Each socket is served by a udp_service_handler bound to an io_service of
+//    the io_pool and an io_service of the work_pool. With more than one shard,
+//    sockets bound to the same port share it by SO_REUSEPORT, so the kernel
+//    spreads the datagrams among the io threads by their flows.
+template<typename Work_Handler, typename Work_Allocator>
+class udp_server
+  : private boost::noncopyable
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_type;
+
+  /// Define type reference of boost::asio::ip::udp::endpoint.
+  typedef boost::asio::ip::udp::endpoint endpoint_t;
+
+  /// The type of the udp_service_handler.
+  typedef udp_service_handler<Work_Handler> udp_service_handler_t;
+  typedef typename udp_service_handler_t::udp_service_handler_ptr udp_service_handler_ptr;
+
+  typedef boost::shared_ptr<Work_Allocator> work_allocator_ptr;
+  typedef boost::shared_ptr<udp_batch_pool> udp_batch_pool_ptr;
+  typedef boost::shared_ptr<io_service_group> io_service_group_ptr;
+
+  /// Construct server object with internal io_service_group.
+  udp_server(Work_Allocator* work_allocator,
+      endpoint_t& local_endpoint,
+      size_t io_pool_size = BAS_IO_SERVICE_POOL_INIT_SIZE,
+      size_t work_pool_init_size = BAS_IO_SERVICE_POOL_INIT_SIZE,
+      size_t work_pool_high_watermark = BAS_IO_SERVICE_POOL_HIGH_WATERMARK,
+      size_t work_pool_thread_load = BAS_IO_SERVICE_POOL_THREAD_LOAD)
+    : work_allocator_(work_allocator),
+      service_group_(new io_service_group(2)),
+      control_service_pool_(1),
+      handlers_(),
+      batch_pool_(),
+      endpoint_(local_endpoint),
+      shards_(1),
+      batch_size_(BAS_UDP_BATCH_SIZE),
+      datagram_size_(BAS_UDP_DATAGRAM_SIZE),
+      started_(false),
+      block_(false),
+      has_service_group_(true)
+  {
+    BOOST_ASSERT(work_allocator_.get() != 0);
+
+    service_group_->get(io_service_group::io_pool).set(io_pool_size, io_pool_size);
+    service_group_->get(io_service_group::work_pool).set(work_pool_init_size, work_pool_high_watermark, work_pool_thread_load);
+  }
+
+  /// Construct server object with external io_service_group.
+  udp_server(Work_Allocator* work_allocator,
+      endpoint_t& local_endpoint,
+      io_service_group_ptr& service_group)
+    : work_allocator_(work_allocator),
+      service_group_(service_group),
+      control_service_pool_(1),
+      handlers_(),
+      batch_pool_(),
+      endpoint_(local_endpoint),
+      shards_(1),
+      batch_size_(BAS_UDP_BATCH_SIZE),
+      datagram_size_(BAS_UDP_DATAGRAM_SIZE),
+      started_(false),
+      block_(false),
+      has_service_group_(false)
+  {
+    BOOST_ASSERT(work_allocator_.get() != 0);
+    BOOST_ASSERT(service_group_.get() != 0);
+  }
+
+  /// Destructor.
+  ~udp_server()
+  {
+    // Stop server.
+    stop();
+
+    // Release all handlers.
+    handlers_.clear();
+
+    // Destroy instance of io_service_group.
+    service_group_.reset();
+
+    // Destroy work allocator.
+    work_allocator_.reset();
+  }
+
+  /// Set the number of sockets, each one served by its own handler.
+  ///   Sockets bound to a fixed port share it by SO_REUSEPORT, sockets bound
+  ///   to port 0 are given a port of their own.
+  udp_server& set_shards(size_t shards)
+  {
+    BOOST_ASSERT(shards != 0);
+
+    if (!started_)
+      shards_ = shards;
+
+    return *this;
+  }
+
+  /// Set the maximum number of datagrams per batch and the maximum size of a datagram.
+  udp_server& set_batch(size_t batch_size = BAS_UDP_BATCH_SIZE,
+      size_t datagram_size = BAS_UDP_DATAGRAM_SIZE)
+  {
+    BOOST_ASSERT(batch_size != 0);
+    BOOST_ASSERT(datagram_size != 0);
+
+    if (!started_)
+    {
+      batch_size_ = batch_size;
+      datagram_size_ = datagram_size;
+    }
+
+    return *this;
+  }
+
+  /// Get the number of handlers, valid after started.
+  size_t size() const
+  {
+    return handlers_.size();
+  }
+
+  /// Get the handler at index, valid after started.
+  udp_service_handler_t& get(size_t index)
+  {
+    BOOST_ASSERT(index < handlers_.size());
+
+    return *handlers_[index];
+  }
+
+  /// Start server with non-blocked model.
+  void start()
+  {
+    start(false);
+  }
+
+  /// Run server with blocked model.
+  void run()
+  {
+    start(true);
+  }
+
+  /// Stop server.
+  void stop()
+  {
+    if (!started_                 || \
+        service_group_.get() == 0 || \
+        (!has_service_group_ && !service_group_->started()))
+      return;
+
+    // Close all sockets.
+    for (size_t i = 0; i < handlers_.size(); ++i)
+      handlers_[i]->close();
+
+    // Stop control_service_pool.
+    control_service_pool_.stop();
+
+    if (!block_)
+    {
+      // Stop internal io_service_group.
+      if (has_service_group_)
+        service_group_->stop();
+
+      started_ = false;
+    }
+  }
+
+private:
+  /// Start server with given mode.
+  void start(bool block)
+  {
+    if (started_                  || \
+        service_group_.get() == 0 || \
+        (!has_service_group_ && !service_group_->started()))
+      return;
+
+    // Start internal io_service_group first, the io_services are fixed then.
+    if (has_service_group_)
+      service_group_->start();
+
+    if (!open_handlers())
+    {
+      if (has_service_group_)
+        service_group_->stop();
+
+      return;
+    }
+
+    for (size_t i = 0; i < handlers_.size(); ++i)
+      handlers_[i]->start();
+
+    block_ = block;
+
+    if (block)
+    {
+      started_ = true;
+
+      // Start control_service_pool with blocked mode, until stopped.
+      control_service_pool_.run();
+
+      // Stop internal io_service_group.
+      if (has_service_group_)
+        service_group_->stop();
+
+      started_ = false;
+    }
+    else
+    {
+      // Start control_service_pool with non-blocked mode.
+      control_service_pool_.start();
+
+      started_ = true;
+    }
+  }
+
+  /// Create a handler for each shard and open its socket, returns false on error.
+  bool open_handlers()
+  {
+    handlers_.clear();
+    batch_pool_.reset(new udp_batch_pool(batch_size_, datagram_size_));
+
+    bool reuse = (shards_ > 1) && (endpoint_.port() != 0);
+    for (size_t i = 0; i < shards_; ++i)
+    {
+      udp_service_handler_ptr handler(new udp_service_handler_t(work_allocator_->make_handler(),
+          service_group_->get(io_service_group::io_pool).get_io_service(),
+          service_group_->get(io_service_group::work_pool).get_io_service(),
+          batch_pool_));
+
+      boost::system::error_code ec;
+      handler->open(endpoint_, reuse, ec);
+      if (ec)
+      {
+        handlers_.clear();
+        return false;
+      }
+
+      handlers_.push_back(handler);
+    }
+
+    return true;
+  }
+
+private:
+  /// The allocator of work handlers.
+  work_allocator_ptr work_allocator_;
+
+  /// The group of io_service_pool objects used to perform asynchronous operations.
+  io_service_group_ptr service_group_;
+
+  /// The pool of io_service objects used to block run() until stopped.
+  io_service_pool control_service_pool_;
+
+  /// The handlers of the sockets.
+  std::vector<udp_service_handler_ptr> handlers_;
+
+  /// The pool of batches shared by all handlers.
+  udp_batch_pool_ptr batch_pool_;
+
+  /// The server endpoint.
+  endpoint_t endpoint_;
+
+  /// The number of sockets.
+  size_t shards_;
+
+  /// The maximum number of datagrams per batch.
+  size_t batch_size_;
+
+  /// The maximum size of a datagram.
+  size_t datagram_size_;
+
+  /// Flag to indicate whether the server is started.
+  bool started_;
+
+  /// Flag to indicate whether the server is started with blocked mode.
+  bool block_;
+
+  /// Flag to indicate whether the server has internal io_service_group.
+  bool has_service_group_;
+};
+
+} // namespace bas
+
+#endif // BAS_UDP_SERVER_HPP
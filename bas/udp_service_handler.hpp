@@ -0,0 +1,592 @@
+//
+// udp_service_handler.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_UDP_SERVICE_HANDLER_HPP
+#define BAS_UDP_SERVICE_HANDLER_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/array.hpp>
+#include <boost/assert.hpp>
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <deque>
+#include <vector>
+
+#if defined(BAS_HAS_MMSG)
+# include <errno.h>
+# include <sys/socket.h>
+#endif
+
+#include <bas/mem_fn_handler.hpp>
+#include <bas/udp_batch.hpp>
+
+namespace bas {
+
+// Maximum batches received by one readiness of the socket, so a busy socket
+//   does not hold its io_service thread from others.
+#if !defined(BAS_UDP_RECEIVE_ROUNDS)
+# define BAS_UDP_RECEIVE_ROUNDS  4
+#endif
+
+#if defined(SO_REUSEPORT)
+/// Socket option for sharing a port by several sockets, each one is given a part of the datagrams.
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
+/// Object for handle datagram socket asynchronous operations.
+//    The socket waits for readiness in io_service thread, then takes all ready
+//    datagrams into pooled batches, by recvmmsg if available. Each batch is
+//    delivered to on_read of the work handler in work_service thread, and
+//    batches given to async_send are sent by sendmmsg in io_service thread.
+//
+//    The work handler implements:
+//      on_open:  called once when the socket is ready;
+//      on_read:  called with a batch of received datagrams;
+//      on_write: called with the number of datagrams of a batch sent;
+//      on_close: called when the socket is closed, with the error if any.
+template<typename Work_Handler>
+class udp_service_handler
+  : public boost::enable_shared_from_this<udp_service_handler<Work_Handler> >,
+    private boost::noncopyable
+{
+public:
+  using boost::enable_shared_from_this<udp_service_handler<Work_Handler> >::shared_from_this;
+
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Define type reference of boost::asio::io_service.
+  typedef boost::asio::io_service io_service_t;
+
+  /// Define type reference of boost::asio::ip::udp::endpoint.
+  typedef boost::asio::ip::udp::endpoint endpoint_t;
+
+  /// The type of the socket.
+  typedef boost::asio::ip::udp::socket socket_t;
+
+  /// The type of the udp_service_handler.
+  typedef udp_service_handler<Work_Handler> udp_service_handler_t;
+  typedef boost::shared_ptr<udp_service_handler_t> udp_service_handler_ptr;
+
+  /// The type of the pool of batches.
+  typedef boost::shared_ptr<udp_batch_pool> udp_batch_pool_ptr;
+
+  /// The type of the work_handler.
+  typedef Work_Handler work_handler_t;
+
+  /// Constructor.
+  udp_service_handler(work_handler_t* work_handler,
+      io_service_t& io_service,
+      io_service_t& work_service,
+      const udp_batch_pool_ptr& batch_pool)
+    : stopped_(true),
+      sending_(false),
+      io_service_(io_service),
+      work_service_(work_service),
+      work_handler_(work_handler),
+      socket_(io_service),
+      batch_pool_(batch_pool),
+      send_queue_(),
+      send_index_(0),
+      truncated_(0)
+#if defined(BAS_HAS_MMSG)
+      ,
+      messages_(),
+      iovecs_()
+#endif
+  {
+    BOOST_ASSERT(work_handler_.get() != 0);
+    BOOST_ASSERT(batch_pool_.get() != 0);
+  }
+
+  /// Get the io_service object used to perform asynchronous operations.
+  io_service_t& io_service()
+  {
+    return io_service_;
+  }
+
+  /// Get the io_service object used to dispatch synchronous works.
+  io_service_t& work_service()
+  {
+    return work_service_;
+  }
+
+  /// Get the socket associated with the handler.
+  socket_t& socket()
+  {
+    return socket_;
+  }
+
+  /// Get the work handler, only for use in work_service thread.
+  work_handler_t& work_handler()
+  {
+    return *work_handler_;
+  }
+
+  /// Get the number of received datagrams dropped for being longer than the
+  /// datagram_size of the batches, from any thread.
+  size_t truncated() const
+  {
+    return truncated_.load(boost::memory_order_relaxed);
+  }
+
+  /// Get an empty batch from the pool for datagrams to send, from any thread.
+  udp_batch_ptr make_batch()
+  {
+    return batch_pool_->get();
+  }
+
+  /// Open the socket and bind it to the local endpoint, before start.
+  ///   Several sockets bound to the same port share its datagrams if reuse is set.
+  void open(const endpoint_t& local_endpoint, bool reuse, boost::system::error_code& ec)
+  {
+    socket_.open(local_endpoint.protocol(), ec);
+    if (ec)
+      return;
+
+#if defined(SO_REUSEPORT)
+    if (reuse)
+      socket_.set_option(reuse_port(true), ec);
+#else
+    if (reuse)
+      ec = boost::asio::error::operation_not_supported;
+#endif
+
+    if (!ec)
+      socket_.bind(local_endpoint, ec);
+
+    // Datagrams are taken until none is ready, then the socket waits again.
+    if (!ec)
+      socket_.non_blocking(true, ec);
+
+    if (ec)
+    {
+      boost::system::error_code ignored_ec;
+      socket_.close(ignored_ec);
+    }
+  }
+
+  /// Start receiving datagrams, can be call from any thread.
+  void start()
+  {
+    io_service_.dispatch(mem_fn_handler0<udp_service_handler_ptr,
+                                         udp_service_handler_t,
+                                         &udp_service_handler_t::start_i>(shared_from_this()));
+  }
+
+  /// Send the datagrams of the batch to their endpoints from any thread.
+  ///   The batch must not be changed until on_write is called for it.
+  void async_send(const udp_batch_ptr& batch)
+  {
+    BOOST_ASSERT(batch.get() != 0);
+
+    io_service_.dispatch(mem_fn_handler1<udp_service_handler_ptr,
+                                         udp_service_handler_t,
+                                         const udp_batch_ptr&,
+                                         &udp_service_handler_t::async_send_i>(shared_from_this(), batch));
+  }
+
+  /// Close the handler with the given error_code from any thread.
+  void close(const boost::system::error_code& ec)
+  {
+    // The handler is stopped, do nothing.
+    if (stopped_)
+      return;
+
+    io_service_.dispatch(mem_fn_handler1<udp_service_handler_ptr,
+                                         udp_service_handler_t,
+                                         const boost::system::error_code&,
+                                         &udp_service_handler_t::close_i>(shared_from_this(), ec));
+  }
+
+  /// Close the handler with the error_code 0 from any thread.
+  void close()
+  {
+    close(boost::system::error_code());
+  }
+
+private:
+  /// Start receiving in io_service thread.
+  void start_i()
+  {
+    if (!stopped_ || !socket_.is_open())
+      return;
+
+    stopped_ = false;
+
+    work_service_.post(mem_fn_handler0<udp_service_handler_ptr,
+                                       udp_service_handler_t,
+                                       &udp_service_handler_t::do_open>(shared_from_this()));
+
+    wait_read();
+  }
+
+  /// Wait for datagrams to receive.
+  void wait_read()
+  {
+    socket_.async_receive(boost::asio::null_buffers(),
+        mem_fn_io_handler<udp_service_handler_ptr,
+                          udp_service_handler_t,
+                          &udp_service_handler_t::handle_readable>(shared_from_this()));
+  }
+
+  /// Wait for the socket to accept more datagrams to send.
+  void wait_write()
+  {
+    socket_.async_send(boost::asio::null_buffers(),
+        mem_fn_io_handler<udp_service_handler_ptr,
+                          udp_service_handler_t,
+                          &udp_service_handler_t::handle_writable>(shared_from_this()));
+  }
+
+  /// Handle readiness of the socket for receiving.
+  void handle_readable(const boost::system::error_code& e, size_t)
+  {
+    if (stopped_)
+      return;
+
+    if (e)
+    {
+      close_i(e);
+      return;
+    }
+
+    boost::system::error_code ec;
+    for (size_t i = 0; i < BAS_UDP_RECEIVE_ROUNDS; ++i)
+    {
+      udp_batch_ptr batch = batch_pool_->get();
+      size_t n = receive_batch(*batch, ec);
+
+      // Deliver the batch to work_service thread.
+      if (!batch->empty())
+        work_service_.post(mem_fn_handler1<udp_service_handler_ptr,
+                                           udp_service_handler_t,
+                                           const udp_batch_ptr&,
+                                           &udp_service_handler_t::do_read>(shared_from_this(), batch));
+
+      if (ec || n < batch->capacity())
+        break;
+    }
+
+    if (!ec || ignorable(ec))
+      wait_read();
+    else
+      close_i(ec);
+  }
+
+  /// Handle readiness of the socket for sending.
+  void handle_writable(const boost::system::error_code& e, size_t)
+  {
+    if (stopped_)
+      return;
+
+    if (e)
+    {
+      close_i(e);
+      return;
+    }
+
+    send_i();
+  }
+
+  /// Queue the batch to send in io_service thread.
+  void async_send_i(const udp_batch_ptr& batch)
+  {
+    // The handler has been stopped, do nothing.
+    if (stopped_)
+      return;
+
+    send_queue_.push_back(batch);
+
+    if (!sending_)
+      send_i();
+  }
+
+  /// Send the queued batches until done or the socket is full.
+  void send_i()
+  {
+    sending_ = true;
+
+    while (!send_queue_.empty())
+    {
+      udp_batch& batch = *send_queue_.front();
+
+      while (send_index_ < batch.size())
+      {
+        boost::system::error_code ec;
+        send_index_ += send_batch(batch, send_index_, ec);
+
+        if (ec == boost::asio::error::would_block || ec == boost::asio::error::try_again)
+        {
+          wait_write();
+          return;
+        }
+
+        // A datagram refused for its own reason, such as too long, is dropped.
+        if (ec)
+          ++send_index_;
+      }
+
+      work_service_.post(mem_fn_handler1<udp_service_handler_ptr,
+                                         udp_service_handler_t,
+                                         size_t,
+                                         &udp_service_handler_t::do_write>(shared_from_this(), batch.size()));
+
+      send_queue_.pop_front();
+      send_index_ = 0;
+    }
+
+    sending_ = false;
+  }
+
+  /// Close the handler in io_service thread.
+  void close_i(const boost::system::error_code& ec)
+  {
+    if (stopped_)
+      return;
+
+    stopped_ = true;
+    sending_ = false;
+
+    boost::system::error_code ignored_ec;
+    socket_.close(ignored_ec);
+
+    // Drop the batches not sent.
+    send_queue_.clear();
+    send_index_ = 0;
+
+    work_service_.post(mem_fn_handler1<udp_service_handler_ptr,
+                                       udp_service_handler_t,
+                                       const boost::system::error_code&,
+                                       &udp_service_handler_t::do_close>(shared_from_this(), ec));
+  }
+
+  /// Check whether the error of a datagram leaves the socket usable.
+  static bool ignorable(const boost::system::error_code& ec)
+  {
+    return ec == boost::asio::error::would_block
+        || ec == boost::asio::error::try_again
+        || ec == boost::asio::error::interrupted
+        || ec == boost::asio::error::connection_refused
+        || ec == boost::asio::error::message_size;
+  }
+
+#if defined(BAS_HAS_MMSG)
+  /// Describe the datagrams of the batch from first to the end of space.
+  size_t prepare_messages(udp_batch& batch, size_t first, size_t last, bool receive)
+  {
+    size_t count = last - first;
+    if (messages_.size() < count)
+    {
+      messages_.resize(count);
+      iovecs_.resize(count);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      iovec& iov = iovecs_[i];
+      iov.iov_base = batch.data(first + i);
+      iov.iov_len = receive ? batch.datagram_size() : batch.length(first + i);
+
+      msghdr& header = messages_[i].msg_hdr;
+      memset(&header, 0, sizeof(header));
+      header.msg_name = batch.endpoint(first + i).data();
+      header.msg_namelen = receive ? batch.endpoint(first + i).capacity() : batch.endpoint(first + i).size();
+      header.msg_iov = &iov;
+      header.msg_iovlen = 1;
+      messages_[i].msg_len = 0;
+    }
+
+    return count;
+  }
+#endif
+
+  /// Receive the ready datagrams into the batch without blocking, returns the
+  /// number received. Datagrams longer than datagram_size are truncated by
+  /// the socket, they are dropped and counted instead of delivered.
+  size_t receive_batch(udp_batch& batch, boost::system::error_code& ec)
+  {
+    ec = boost::system::error_code();
+
+#if defined(BAS_HAS_MMSG)
+    size_t count = prepare_messages(batch, 0, batch.capacity(), true);
+    int n = ::recvmmsg(socket_.native_handle(), &messages_[0], static_cast<unsigned int>(count), MSG_DONTWAIT, 0);
+    if (n < 0)
+    {
+      ec = boost::system::error_code(errno, boost::asio::error::get_system_category());
+      return 0;
+    }
+
+    // Move the datagrams after a dropped one into its place.
+    size_t kept = 0;
+    for (int i = 0; i < n; ++i)
+    {
+      if (messages_[i].msg_hdr.msg_flags & MSG_TRUNC)
+      {
+        truncated_.fetch_add(1, boost::memory_order_relaxed);
+        continue;
+      }
+
+      batch.endpoint(i).resize(messages_[i].msg_hdr.msg_namelen);
+      if (kept != static_cast<size_t>(i))
+      {
+        memcpy(batch.data(kept), batch.data(i), messages_[i].msg_len);
+        batch.endpoint(kept) = batch.endpoint(i);
+      }
+
+      batch.set_length(kept++, messages_[i].msg_len);
+    }
+
+    batch.resize(kept);
+    return n;
+#else
+    // A datagram filling the spare byte is longer than datagram_size, a
+    //   longer one fails with message_size on some systems.
+    unsigned char spare = 0;
+    size_t n = 0;
+    size_t kept = 0;
+    while (n < batch.capacity())
+    {
+      boost::array<boost::asio::mutable_buffer, 2> buffers =
+      {
+        {
+          boost::asio::buffer(batch.data(kept), batch.datagram_size()),
+          boost::asio::buffer(&spare, 1)
+        }
+      };
+
+      size_t length = socket_.receive_from(buffers, batch.endpoint(kept), 0, ec);
+      if (ec == boost::asio::error::message_size || (!ec && length > batch.datagram_size()))
+      {
+        truncated_.fetch_add(1, boost::memory_order_relaxed);
+        ec = boost::system::error_code();
+        ++n;
+        continue;
+      }
+
+      if (ec)
+        break;
+
+      batch.set_length(kept++, length);
+      ++n;
+    }
+
+    batch.resize(kept);
+
+    // The datagrams received are delivered, the error is met again on next receive.
+    if (n != 0)
+      ec = boost::system::error_code();
+
+    return n;
+#endif
+  }
+
+  /// Send the datagrams of the batch from first without blocking, returns the number sent.
+  size_t send_batch(udp_batch& batch, size_t first, boost::system::error_code& ec)
+  {
+    ec = boost::system::error_code();
+
+#if defined(BAS_HAS_MMSG)
+    size_t count = prepare_messages(batch, first, batch.size(), false);
+    int n = ::sendmmsg(socket_.native_handle(), &messages_[0], static_cast<unsigned int>(count), MSG_DONTWAIT);
+    if (n < 0)
+    {
+      ec = boost::system::error_code(errno, boost::asio::error::get_system_category());
+      return 0;
+    }
+
+    return n;
+#else
+    size_t n = first;
+    while (n < batch.size())
+    {
+      socket_.send_to(boost::asio::buffer(batch.data(n), batch.length(n)), batch.endpoint(n), 0, ec);
+      if (ec)
+        break;
+
+      ++n;
+    }
+
+    return n - first;
+#endif
+  }
+
+  /// Call on_open of the work handler in work_service thread.
+  void do_open()
+  {
+    work_handler_->on_open(*this);
+  }
+
+  /// Call on_read of the work handler in work_service thread.
+  void do_read(const udp_batch_ptr& batch)
+  {
+    work_handler_->on_read(*this, batch);
+  }
+
+  /// Call on_write of the work handler in work_service thread.
+  void do_write(size_t datagrams)
+  {
+    work_handler_->on_write(*this, datagrams);
+  }
+
+  /// Call on_close of the work handler in work_service thread.
+  void do_close(const boost::system::error_code& ec)
+  {
+    work_handler_->on_close(*this, ec);
+  }
+
+private:
+  /// Flag to indicate whether the handler is stopped.
+  bool stopped_;
+
+  /// Flag to indicate whether the queued batches are being sent.
+  bool sending_;
+
+  /// The io_service used to perform asynchronous operations.
+  io_service_t& io_service_;
+
+  /// The io_service used to perform synchronous works.
+  io_service_t& work_service_;
+
+  /// Work handler of the handler.
+  boost::scoped_ptr<work_handler_t> work_handler_;
+
+  /// The socket.
+  socket_t socket_;
+
+  /// The pool of batches for receiving and sending.
+  udp_batch_pool_ptr batch_pool_;
+
+  /// The batches to send.
+  std::deque<udp_batch_ptr> send_queue_;
+
+  /// The number of datagrams sent of the first batch.
+  size_t send_index_;
+
+  /// The number of received datagrams dropped for being truncated.
+  boost::atomic<size_t> truncated_;
+
+#if defined(BAS_HAS_MMSG)
+  /// The headers of datagrams for recvmmsg and sendmmsg.
+  std::vector<mmsghdr> messages_;
+
+  /// The data of datagrams for recvmmsg and sendmmsg.
+  std::vector<iovec> iovecs_;
+#endif
+};
+
+} // namespace bas
+
+#endif // BAS_UDP_SERVICE_HANDLER_HPP
@@ -0,0 +1,392 @@
+//
+// work_scheduler.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BAS_WORK_SCHEDULER_HPP
+#define BAS_WORK_SCHEDULER_HPP
+
+#include <bas/config.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/shared_ptr.hpp>
+#include <deque>
+#include <map>
+
+#include <bas/completion_queue.hpp>
+#include <bas/mem_fn_handler.hpp>
+
+namespace bas {
+
+// Number of priority classes, class 0 is the most urgent.
+#if !defined(BAS_WORK_PRIORITY_CLASSES)
+# define BAS_WORK_PRIORITY_CLASSES  3
+#endif
+
+#define BAS_WORK_PRIORITY_DEFAULT   1
+#define BAS_WORK_TENANT_DEFAULT     0
+#define BAS_WORK_SCHEDULER_QUANTUM  4
+#define BAS_WORK_SCHEDULER_BATCH    64
+#define BAS_WORK_DELAY_BUCKETS      32
+
+/// Statistics of the queue delay of one priority class.
+struct work_class_stats
+{
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Number of delivered works.
+  boost::uint64_t count;
+
+  /// Sum of queue delay in microseconds.
+  boost::uint64_t total_delay;
+
+  /// Maximum queue delay in microseconds.
+  boost::uint64_t max_delay;
+
+  /// Histogram of queue delay, bucket i counts delays below 2^i microseconds.
+  boost::uint64_t buckets[BAS_WORK_DELAY_BUCKETS];
+
+  work_class_stats()
+    : count(0),
+      total_delay(0),
+      max_delay(0)
+  {
+    for (size_t i = 0; i < BAS_WORK_DELAY_BUCKETS; ++i)
+      buckets[i] = 0;
+  }
+
+  /// Record the queue delay of one work.
+  void add(boost::uint64_t delay)
+  {
+    ++count;
+    total_delay += delay;
+    if (delay > max_delay)
+      max_delay = delay;
+
+    size_t bucket = 0;
+    while (bucket < BAS_WORK_DELAY_BUCKETS - 1 && (delay >> bucket) != 0)
+      ++bucket;
+
+    ++buckets[bucket];
+  }
+
+  /// Add the statistics of another work_service.
+  void merge(const work_class_stats& other)
+  {
+    count += other.count;
+    total_delay += other.total_delay;
+    if (other.max_delay > max_delay)
+      max_delay = other.max_delay;
+
+    for (size_t i = 0; i < BAS_WORK_DELAY_BUCKETS; ++i)
+      buckets[i] += other.buckets[i];
+  }
+
+  /// Get the upper bound in microseconds of the given percentile (0.0 - 1.0) of queue delay.
+  boost::uint64_t percentile(double ratio) const
+  {
+    if (count == 0)
+      return 0;
+
+    boost::uint64_t rank = static_cast<boost::uint64_t>(count * ratio);
+    boost::uint64_t seen = 0;
+    for (size_t i = 0; i < BAS_WORK_DELAY_BUCKETS; ++i)
+    {
+      seen += buckets[i];
+      if (seen > rank)
+        return (i == 0) ? 0 : (boost::uint64_t(1) << i) - 1;
+    }
+
+    return max_delay;
+  }
+};
+
+/// Assign the priority class and tenant of a handler bound with the work allocator.
+//    Overload it in the namespace of a work allocator to tag its handlers, it's
+//    found by argument dependent lookup. By default the tags are unchanged.
+template<typename Work_Allocator>
+inline void assign_work_tags(Work_Allocator&, std::size_t&, std::size_t&)
+{
+}
+
+/// Scheduler of a work_service with priority classes and fair share of tenants.
+//    Works of a higher priority class always run first. Inside a class, the
+//    tenants share the work_service by deficit round robin, each tenant may run
+//    weight * BAS_WORK_SCHEDULER_QUANTUM works in its turn. Works of one
+//    tenant run in the order they were scheduled.
+class work_scheduler
+  : public boost::asio::detail::service_base<work_scheduler>
+{
+public:
+  /// Define type reference of std::size_t.
+  typedef std::size_t size_t;
+
+  /// Define type reference of boost::asio::io_service.
+  typedef boost::asio::io_service io_service_t;
+
+  /// Constructor.
+  explicit work_scheduler(io_service_t& work_service)
+    : boost::asio::detail::service_base<work_scheduler>(work_service),
+      work_service_(work_service),
+      enabled_(false),
+      mutex_(),
+      scheduled_(false)
+  {
+  }
+
+  /// Release all undelivered works.
+  void shutdown_service()
+  {
+    std::deque<work_item> items;
+    {
+      scoped_lock_t lock(mutex_);
+
+      for (size_t i = 0; i < BAS_WORK_PRIORITY_CLASSES; ++i)
+      {
+        for (tenant_map::iterator iter = classes_[i].tenants.begin(); iter != classes_[i].tenants.end(); ++iter)
+        {
+          items.insert(items.end(), iter->second->items.begin(), iter->second->items.end());
+          iter->second->items.clear();
+        }
+
+        classes_[i].active.clear();
+      }
+    }
+
+    for (size_t i = 0; i < items.size(); ++i)
+      items[i].completion.function(items[i].completion, false);
+  }
+
+  /// Enable scheduling of the work_service, handlers bound later will use it.
+  void enable(bool enabled = true)
+  {
+    enabled_ = enabled;
+  }
+
+  /// Get scheduling status of the work_service.
+  bool enabled() const
+  {
+    return enabled_;
+  }
+
+  /// Set the weight of the tenant, it runs weight times the works of a tenant with weight 1.
+  void set_weight(size_t tenant, size_t weight)
+  {
+    BOOST_ASSERT(weight != 0);
+
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    weights_[tenant] = weight;
+    for (size_t i = 0; i < BAS_WORK_PRIORITY_CLASSES; ++i)
+    {
+      tenant_map::iterator iter = classes_[i].tenants.find(tenant);
+      if (iter != classes_[i].tenants.end())
+        iter->second->weight = weight;
+    }
+  }
+
+  /// Get the statistics of queue delay of the given priority class.
+  work_class_stats get_stats(size_t priority)
+  {
+    BOOST_ASSERT(priority < BAS_WORK_PRIORITY_CLASSES);
+
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    return classes_[priority].stats;
+  }
+
+  /// Schedule a work from any thread.
+  void schedule(size_t priority, size_t tenant, const work_completion& completion)
+  {
+    if (priority >= BAS_WORK_PRIORITY_CLASSES)
+      priority = BAS_WORK_PRIORITY_CLASSES - 1;
+
+    work_item item(completion, boost::posix_time::microsec_clock::universal_time());
+
+    {
+      // Lock for synchronize access to data.
+      scoped_lock_t lock(mutex_);
+
+      priority_class& cls = classes_[priority];
+
+      tenant_ptr& queue = cls.tenants[tenant];
+      if (queue.get() == 0)
+      {
+        queue.reset(new tenant_queue(tenant));
+
+        weight_map::iterator iter = weights_.find(tenant);
+        if (iter != weights_.end())
+          queue->weight = iter->second;
+      }
+
+      // Join the round of the class.
+      if (queue->items.empty())
+        cls.active.push_back(queue.get());
+
+      queue->items.push_back(item);
+
+      // Signal the work_service once for all scheduled works.
+      if (scheduled_)
+        return;
+
+      scheduled_ = true;
+    }
+
+    work_service_.post(mem_fn_handler0<work_scheduler*,
+                                       work_scheduler,
+                                       &work_scheduler::run>(this));
+  }
+
+private:
+  typedef boost::asio::detail::mutex mutex_t;
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+
+  /// A scheduled work and the time it was scheduled.
+  struct work_item
+  {
+    work_item(const work_completion& c, const boost::posix_time::ptime& t)
+      : completion(c),
+        time(t)
+    {
+    }
+
+    work_completion completion;
+    boost::posix_time::ptime time;
+  };
+
+  /// Works of one tenant in one priority class.
+  struct tenant_queue
+  {
+    explicit tenant_queue(size_t t)
+      : items(),
+        tenant(t),
+        deficit(0),
+        weight(1)
+    {
+    }
+
+    std::deque<work_item> items;
+    size_t tenant;
+    size_t deficit;
+    size_t weight;
+  };
+
+  typedef boost::shared_ptr<tenant_queue> tenant_ptr;
+  typedef std::map<size_t, tenant_ptr> tenant_map;
+  typedef std::map<size_t, size_t> weight_map;
+
+  /// One priority class.
+  struct priority_class
+  {
+    /// Tenants with queued works, a tenant is removed once its queue is drained.
+    tenant_map tenants;
+
+    /// Tenants with pending works, in round robin order.
+    std::deque<tenant_queue*> active;
+
+    /// Statistics of queue delay.
+    work_class_stats stats;
+  };
+
+  /// Take the next work by priority and deficit round robin, must be called with the lock held.
+  bool next(work_completion& completion, const boost::posix_time::ptime& now)
+  {
+    for (size_t i = 0; i < BAS_WORK_PRIORITY_CLASSES; ++i)
+    {
+      priority_class& cls = classes_[i];
+      if (cls.active.empty())
+        continue;
+
+      tenant_queue* queue = cls.active.front();
+
+      // A new turn of the tenant.
+      if (queue->deficit == 0)
+        queue->deficit = queue->weight * BAS_WORK_SCHEDULER_QUANTUM;
+
+      work_item& item = queue->items.front();
+      completion = item.completion;
+      cls.stats.add((now > item.time) ? (now - item.time).total_microseconds() : 0);
+
+      queue->items.pop_front();
+      --queue->deficit;
+
+      if (queue->items.empty())
+      {
+        // Leave the round, an idle tenant keeps no credit and no queue.
+        //   Its weight is kept in weights_ for the next time it's scheduled.
+        cls.active.pop_front();
+        cls.tenants.erase(queue->tenant);
+      }
+      else if (queue->deficit == 0)
+      {
+        // Turn is over, go to the end of the round.
+        cls.active.pop_front();
+        cls.active.push_back(queue);
+      }
+
+      return true;
+    }
+
+    return false;
+  }
+
+  /// Run scheduled works in work_service thread.
+  void run()
+  {
+    for (size_t count = 0; count < BAS_WORK_SCHEDULER_BATCH; ++count)
+    {
+      work_completion completion;
+      {
+        // Lock for synchronize access to data.
+        scoped_lock_t lock(mutex_);
+
+        if (!next(completion, boost::posix_time::microsec_clock::universal_time()))
+        {
+          scheduled_ = false;
+          return;
+        }
+      }
+
+      completion.function(completion, true);
+    }
+
+    // Let other handlers of the work_service run, continue later.
+    work_service_.post(mem_fn_handler0<work_scheduler*,
+                                       work_scheduler,
+                                       &work_scheduler::run>(this));
+  }
+
+  /// The work_service running the works.
+  io_service_t& work_service_;
+
+  /// Flag to indicate scheduling of the work_service is enabled.
+  boost::atomic<bool> enabled_;
+
+  /// Mutex for synchronize access to data.
+  mutex_t mutex_;
+
+  /// Flag to indicate running of works is scheduled.
+  bool scheduled_;
+
+  /// The priority classes.
+  priority_class classes_[BAS_WORK_PRIORITY_CLASSES];
+
+  /// The weights of tenants.
+  weight_map weights_;
+};
+
+} // namespace bas
+
+#endif // BAS_WORK_SCHEDULER_HPP
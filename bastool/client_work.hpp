@@ -17,11 +17,17 @@ namespace bastool {
 
 using namespace bas;
 
-template<typename Biz_Handler>
+/// Define events of relay mode from server_work to client_work.
+#define BAS_EVENT_RELAY_START             (bas::event::user + 1)
+#define BAS_EVENT_RELAY_WRITE             (bas::event::user + 2)
+#define BAS_EVENT_RELAY_SHUTDOWN          (bas::event::user + 3)
+
+template<typename Biz_Handler, typename Socket_Service>
 class server_work;
 
-/// Object for handle client asynchronous operations.
-template<typename Biz_Handler>
+/// Object for handle client asynchronous operations, the Socket_Service is
+/// the socket of the server_work owning the client.
+template<typename Biz_Handler, typename Socket_Service = boost::asio::ip::tcp::socket>
 class client_work
 {
 public:
@@ -29,19 +35,20 @@ public:
   typedef std::size_t size_t;
 
   /// Define type reference of handlers.
-  typedef server_work<Biz_Handler> server_work_t;
-  typedef client_work<Biz_Handler> client_work_t;
-  typedef service_handler<server_work_t> server_handler_t;
+  typedef server_work<Biz_Handler, Socket_Service> server_work_t;
+  typedef client_work<Biz_Handler, Socket_Service> client_work_t;
+  typedef service_handler<server_work_t, Socket_Service> server_handler_t;
   typedef service_handler<client_work_t> client_handler_t;
 
   /// Define shared_ptr for holding pointers.
-  typedef boost::shared_ptr<server_handler_t> server_handler_ptr;
+  typedef typename server_handler_t::service_handler_ptr server_handler_ptr;
 
   /// Constructor.
   client_work()
   : server_handler_(),
     event_(),
-    passive_close_(false)
+    passive_close_(false),
+    relay_(false)
   {
   }
   
@@ -62,6 +69,7 @@ public:
 
   void on_clear(client_handler_t& handler)
   {
+    relay_ = false;
   }
   
   void on_open(client_handler_t& handler)
@@ -69,7 +77,7 @@ public:
     BOOST_ASSERT(server_handler_.get() != 0);
 
     io_buffer(handler).clear();
-    server_handler_->child_post(bas::event(bas::event::open));
+    server_handler_->child_dispatch(bas::event(bas::event::open));
   }
 
   void on_read(client_handler_t& handler, size_t bytes_transferred)
@@ -77,20 +85,29 @@ public:
     BOOST_ASSERT(server_handler_.get() != 0);
 
     io_buffer(handler).produce(bytes_transferred);
-    server_handler_->child_post(bas::event(bas::event::read, bytes_transferred));
+    server_handler_->child_dispatch(bas::event(bas::event::read, bytes_transferred));
   }
 
   void on_write(client_handler_t& handler, size_t bytes_transferred)
   {
     BOOST_ASSERT(server_handler_.get() != 0);
 
+    // In relay mode, write_buffer is the write queue filled by server_work.
+    if (relay_)
+    {
+      handler.write_buffer().consume(bytes_transferred);
+      handler.write_buffer().crunch();
+      server_handler_->child_dispatch(bas::event(bas::event::write, bytes_transferred));
+      return;
+    }
+
     io_buffer(handler).consume(bytes_transferred);
     io_buffer(handler).crunch();
 
     if (event_.state == bas::event::write_read)
       handler.async_read_some();
     else
-      server_handler_->child_post(bas::event(bas::event::write, bytes_transferred));
+      server_handler_->child_dispatch(bas::event(bas::event::write, bytes_transferred));
   }
 
   void on_close(client_handler_t& handler, const boost::system::error_code& ec)
@@ -99,7 +116,7 @@ public:
     {
       // Notify parent to close.
       if (!passive_close_)
-        server_handler_->child_post(bas::event(bas::event::close, 0, ec));
+        server_handler_->child_dispatch(bas::event(bas::event::close, 0, ec));
 
       server_handler_.reset();
     }
@@ -127,6 +144,20 @@ public:
       case bas::event::read:
         handler.async_read_some();
         break;
+
+      case BAS_EVENT_RELAY_START:
+        relay_ = true;
+        handler.set_half_close();
+        handler.async_read_some();
+        break;
+
+      case BAS_EVENT_RELAY_WRITE:
+        handler.async_write();
+        break;
+
+      case BAS_EVENT_RELAY_SHUTDOWN:
+        handler.shutdown_send();
+        break;
     }
   }
 
@@ -139,6 +170,9 @@ private:
 
   /// Flag for passive close.
   bool passive_close_;
+
+  /// Flag for relay mode.
+  bool relay_;
 };
 
 } // namespace bastool
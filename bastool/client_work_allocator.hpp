@@ -15,11 +15,11 @@
 
 namespace bastool {
 
-template<typename Biz_Handler>
+template<typename Biz_Handler, typename Socket_Service = boost::asio::ip::tcp::socket>
 class client_work_allocator
 {
 public:
-  typedef client_work<Biz_Handler> client_work_t;
+  typedef client_work<Biz_Handler, Socket_Service> client_work_t;
   typedef boost::asio::ip::tcp::socket socket_t;
 
   /// Constructor.
@@ -27,14 +27,14 @@ public:
   {
   }
 
-  socket_t* make_socket(boost::asio::io_service& io_service)
+  socket_t* make_socket(void* address, boost::asio::io_service& io_service)
   {
-    return new socket_t(io_service);
+    return new (address) socket_t(io_service);
   }
 
-  client_work_t* make_handler()
+  client_work_t* make_handler(void* address)
   {
-    return new client_work_t();
+    return new (address) client_work_t();
   }
 };
 
@@ -29,6 +29,7 @@ namespace bastool {
 #define BAS_STATE_DO_CLIENT_READ          0x0200
 #define BAS_STATE_DO_CLIENT_WRITE         0x0400
 #define BAS_STATE_DO_CLIENT_WRITE_READ    0x0600
+#define BAS_STATE_DO_RELAY                0x0800
 #define BAS_STATE_DO_CLIENT_CLOSE         0xEF00
 
 #define BAS_STATE_ON_OPEN                 0x0011
@@ -178,8 +179,20 @@ public:
   bgs_ptr bgs_;
 };
 
+/// Keep the address of an ip endpoint in status_t.
+inline void set_endpoint(status_t::endpoint_t& status_endpoint, const status_t::endpoint_t& endpoint)
+{
+  status_endpoint = endpoint;
+}
+
+/// Endpoints of other protocols, such as local sockets, have no address to keep.
+template<typename Endpoint>
+inline void set_endpoint(status_t::endpoint_t& status_endpoint, const Endpoint& endpoint)
+{
+}
+
 /// Object for handle server asynchronous operations.
-template<typename Biz_Handler>
+template<typename Biz_Handler, typename Socket_Service = boost::asio::ip::tcp::socket>
 class server_work
 {
 public:
@@ -187,17 +200,17 @@ public:
   typedef std::size_t size_t;
 
   /// Define type reference of handlers and allocators.
-  typedef server_work<Biz_Handler> server_work_t;
-  typedef client_work<Biz_Handler> client_work_t;
-  typedef client_work_allocator<Biz_Handler> client_work_allocator_t;
-  typedef service_handler<server_work_t> server_handler_t;
+  typedef server_work<Biz_Handler, Socket_Service> server_work_t;
+  typedef client_work<Biz_Handler, Socket_Service> client_work_t;
+  typedef client_work_allocator<Biz_Handler, Socket_Service> client_work_allocator_t;
+  typedef service_handler<server_work_t, Socket_Service> server_handler_t;
   typedef service_handler<client_work_t> client_handler_t;
   typedef client<client_work_t, client_work_allocator_t> client_t;
 
   /// Define shared_ptr for holding pointers.
   typedef boost::shared_ptr<client_t> client_ptr;
   typedef boost::shared_ptr<Biz_Handler> biz_ptr;
-  typedef boost::shared_ptr<client_handler_t> client_handler_ptr;
+  typedef typename client_handler_t::service_handler_ptr client_handler_ptr;
 
   /// Constructor.
   server_work(Biz_Handler* biz, client_ptr& client)
@@ -205,7 +218,14 @@ public:
       client_(client),
       client_handler_(),
       status_(),
-      passive_close_(false)
+      passive_close_(false),
+      relay_(false),
+      server_eof_(false),
+      client_eof_(false),
+      server_writing_(false),
+      client_writing_(false),
+      server_read_paused_(false),
+      client_read_paused_(false)
   {
     BOOST_ASSERT(biz != 0);
   }
@@ -245,9 +265,10 @@ public:
           {
             // Notify child to close.
             if (!passive_close_)
-              client_handler_->parent_post(bas::event(bas::event::close));
+              client_handler_->parent_dispatch(bas::event(bas::event::close));
 
             client_handler_.reset();
+            relay_ = false;
           }
         
           if (status_.state == BAS_STATE_DO_CLIENT_OPEN)
@@ -279,7 +300,7 @@ public:
           else
           {
             // Notify child to read.
-            client_handler_->parent_post(bas::event(bas::event::read));
+            client_handler_->parent_dispatch(bas::event(bas::event::read));
           }
         }
         else
@@ -308,12 +329,12 @@ public:
             if (status_.state == BAS_STATE_DO_CLIENT_WRITE_READ)
             {
               // Notify child to write and read.
-              client_handler_->parent_post(bas::event(bas::event::write_read));
+              client_handler_->parent_dispatch(bas::event(bas::event::write_read));
             }
             else
             {
               // Notify child to write.
-              client_handler_->parent_post(bas::event(bas::event::write));
+              client_handler_->parent_dispatch(bas::event(bas::event::write));
             }
           }
         }
@@ -322,6 +343,14 @@ public:
 
         break;
 
+      case BAS_STATE_DO_RELAY:
+        if (client_handler_.get() != 0)
+          start_relay(handler);
+        else
+          handler.close();
+
+        break;
+
       case BAS_STATE_DO_CLOSE:
       default:
         handler.close();
@@ -343,7 +372,8 @@ public:
   void on_open(server_handler_t& handler)
   {
     status_.clear();
-    status_.remote_endpoint = handler.socket().lowest_layer().remote_endpoint();
+    relay_ = false;
+    set_endpoint(status_.remote_endpoint, handler.socket().lowest_layer().remote_endpoint());
     status_.set(BAS_STATE_ON_OPEN);
     io_buffer(handler).clear();
     biz_->process(status_, io_buffer(handler), io_buffer(handler));
@@ -352,6 +382,13 @@ public:
 
   void on_read(server_handler_t& handler, size_t bytes_transferred)
   {
+    if (relay_)
+    {
+      io_buffer(handler).produce(bytes_transferred);
+      relay_from_server(handler, bytes_transferred == 0);
+      return;
+    }
+
     status_.set(BAS_STATE_ON_READ, bytes_transferred);
     io_buffer(handler).produce(bytes_transferred);
     biz_->process(status_, io_buffer(handler), io_buffer(handler));
@@ -360,6 +397,21 @@ public:
 
   void on_write(server_handler_t& handler, size_t bytes_transferred)
   {
+    if (relay_)
+    {
+      server_writing_ = false;
+      handler.write_buffer().consume(bytes_transferred);
+      handler.write_buffer().crunch();
+      relay_server_write(handler);
+
+      // Write queue is drained, resume reading of the client socket.
+      if (client_read_paused_)
+        relay_from_client(handler, false);
+
+      check_relay(handler);
+      return;
+    }
+
     status_.set(BAS_STATE_ON_WRITE, bytes_transferred);
     io_buffer(handler).consume(bytes_transferred);
     io_buffer(handler).crunch();
@@ -373,11 +425,12 @@ public:
     {
       // Notify child to close.
       if (!passive_close_)
-        client_handler_->parent_post(bas::event(bas::event::close, 0, ec));
+        client_handler_->parent_dispatch(bas::event(bas::event::close, 0, ec));
 
       client_handler_.reset();
     }
 
+    relay_ = false;
     status_.set(BAS_STATE_ON_CLOSE, 0, ec);
     biz_->process(status_, io_buffer(handler), io_buffer(handler));
     status_.set(BAS_STATE_NONE);
@@ -401,6 +454,12 @@ public:
         break;
 
       case bas::event::read:
+        if (relay_)
+        {
+          relay_from_client(handler, event.value == 0);
+          break;
+        }
+
         status_.set(BAS_STATE_ON_CLIENT_READ, event.value, event.ec);
         // Process should call io_buffer(handler).clear() when need.
         biz_->process(status_, io_buffer(*client_handler_), io_buffer(handler));
@@ -408,6 +467,19 @@ public:
         break;
 
       case bas::event::write:
+        if (relay_)
+        {
+          client_writing_ = false;
+          relay_client_write();
+
+          // Write queue is drained, resume reading of the server socket.
+          if (server_read_paused_)
+            relay_from_server(handler, false);
+
+          check_relay(handler);
+          break;
+        }
+
         status_.set(BAS_STATE_ON_CLIENT_WRITE, event.value, event.ec);
         biz_->process(status_, io_buffer(handler), io_buffer(handler));
         do_io(handler);
@@ -424,6 +496,126 @@ public:
   }
 
 private:
+  /// Start relaying both directions at once.
+  //    The write_buffer of each handler is the write queue of the data read by
+  //    the other one. Reading pauses when the opposite queue cannot hold a full
+  //    read_buffer, and end of stream is relayed by shutting down the sending
+  //    side of the opposite socket after its queue is drained.
+  void start_relay(server_handler_t& handler)
+  {
+    if (handler.write_buffer().capacity() < io_buffer(*client_handler_).capacity()
+        || client_handler_->write_buffer().capacity() < io_buffer(handler).capacity())
+    {
+      handler.close(boost::asio::error::no_buffer_space);
+      return;
+    }
+
+    relay_ = true;
+    server_eof_ = false;
+    client_eof_ = false;
+    server_writing_ = false;
+    client_writing_ = false;
+    server_read_paused_ = false;
+    client_read_paused_ = false;
+
+    handler.set_half_close();
+    client_handler_->parent_dispatch(bas::event(BAS_EVENT_RELAY_START));
+
+    // Data read by the business before relaying is relayed first.
+    relay_from_server(handler, false);
+  }
+
+  /// Queue data read from the server socket and continue reading.
+  void relay_from_server(server_handler_t& handler, bool eof)
+  {
+    bas::io_buffer& input = io_buffer(handler);
+    bas::io_buffer& queue = client_handler_->write_buffer();
+
+    if (eof)
+    {
+      server_eof_ = true;
+      server_read_paused_ = false;
+      relay_client_write();
+      check_relay(handler);
+      return;
+    }
+
+    if (!input.empty())
+    {
+      queue.produce(input);
+      input.clear();
+      relay_client_write();
+    }
+
+    server_read_paused_ = (queue.space() < input.capacity());
+    if (!server_read_paused_)
+      handler.async_read_some();
+  }
+
+  /// Queue data read from the client socket and continue reading.
+  void relay_from_client(server_handler_t& handler, bool eof)
+  {
+    bas::io_buffer& input = io_buffer(*client_handler_);
+    bas::io_buffer& queue = handler.write_buffer();
+
+    if (eof)
+    {
+      client_eof_ = true;
+      client_read_paused_ = false;
+      relay_server_write(handler);
+      check_relay(handler);
+      return;
+    }
+
+    if (!input.empty())
+    {
+      queue.produce(input);
+      input.clear();
+      relay_server_write(handler);
+    }
+
+    client_read_paused_ = (queue.space() < input.capacity());
+    if (!client_read_paused_)
+      client_handler_->parent_dispatch(bas::event(bas::event::read));
+  }
+
+  /// Start writing the queue of the server socket if idle.
+  void relay_server_write(server_handler_t& handler)
+  {
+    if (server_writing_)
+      return;
+
+    if (!handler.write_buffer().empty())
+    {
+      server_writing_ = true;
+      handler.async_write();
+    }
+    else if (client_eof_)
+      handler.shutdown_send();
+  }
+
+  /// Start writing the queue of the client socket if idle.
+  void relay_client_write()
+  {
+    if (client_writing_)
+      return;
+
+    if (!client_handler_->write_buffer().empty())
+    {
+      client_writing_ = true;
+      client_handler_->parent_dispatch(bas::event(BAS_EVENT_RELAY_WRITE));
+    }
+    else if (server_eof_)
+      client_handler_->parent_dispatch(bas::event(BAS_EVENT_RELAY_SHUTDOWN));
+  }
+
+  /// Close after both directions reached end of stream and are drained.
+  void check_relay(server_handler_t& handler)
+  {
+    if (server_eof_ && client_eof_ && !server_writing_ && !client_writing_)
+      handler.close();
+  }
+
   /// The I/O status.
   status_t status_;
 
@@ -438,6 +630,21 @@ private:
 
   /// Flag for passive close.
   bool passive_close_;
+
+  /// Flag for relaying both directions.
+  bool relay_;
+
+  /// Flags for end of stream read from the server and the client socket.
+  bool server_eof_;
+  bool client_eof_;
+
+  /// Flags for writes in progress on the server and the client socket.
+  bool server_writing_;
+  bool client_writing_;
+
+  /// Flags for reads paused by a full write queue.
+  bool server_read_paused_;
+  bool client_read_paused_;
 };
 
 } // namespace bastool
@@ -22,17 +22,17 @@ namespace bastool {
 
 using namespace bas;
 
-template<typename Biz_Handler, typename Biz_Global_Storage>
+template<typename Biz_Handler, typename Biz_Global_Storage, typename Socket_Service = boost::asio::ip::tcp::socket>
 class server_work_allocator
 {
 public:
   /// Define type reference of handlers and allocators.
-  typedef server_work<Biz_Handler> server_work_t;
-  typedef client_work<Biz_Handler> client_work_t;
-  typedef client_work_allocator<Biz_Handler> client_work_allocator_t;
+  typedef server_work<Biz_Handler, Socket_Service> server_work_t;
+  typedef client_work<Biz_Handler, Socket_Service> client_work_t;
+  typedef client_work_allocator<Biz_Handler, Socket_Service> client_work_allocator_t;
   typedef client<client_work_t, client_work_allocator_t> client_t;
   typedef service_handler_pool<client_work_t, client_work_allocator_t> client_handler_pool_t;
-  typedef boost::asio::ip::tcp::socket socket_t;
+  typedef Socket_Service socket_t;
   typedef boost::shared_ptr<Biz_Global_Storage> bgs_ptr;
   typedef boost::shared_ptr<client_t> client_ptr;
 
@@ -40,7 +40,9 @@ public:
   server_work_allocator(Biz_Global_Storage* bgs = 0,
                         client_t* client = 0)
     : bgs_(bgs),
-      client_(client)
+      client_(client),
+      priority_(BAS_WORK_PRIORITY_DEFAULT),
+      tenant_(BAS_WORK_TENANT_DEFAULT)
   {
     /// Open and allocate resource in bgs.
     if (bgs_.get() != 0)
@@ -61,14 +63,35 @@ public:
     client_.reset();
   }
 
-  socket_t* make_socket(boost::asio::io_service& io_service)
+  socket_t* make_socket(void* address, boost::asio::io_service& io_service)
   {
-    return new socket_t(io_service);
+    return new (address) socket_t(io_service);
   }
 
-  server_work_t* make_handler()
+  server_work_t* make_handler(void* address)
   {
-    return new server_work_t(new Biz_Handler(bgs_), client_);
+    return new (address) server_work_t(new Biz_Handler(bgs_), client_);
+  }
+
+  /// Set the priority class and tenant of the handlers, used when work scheduling is enabled.
+  server_work_allocator& set_work_tags(std::size_t priority, std::size_t tenant)
+  {
+    priority_ = priority;
+    tenant_ = tenant;
+
+    return *this;
+  }
+
+  /// Get the priority class of the handlers.
+  std::size_t get_priority() const
+  {
+    return priority_;
+  }
+
+  /// Get the tenant of the handlers.
+  std::size_t get_tenant() const
+  {
+    return tenant_;
   }
 
 private:
@@ -77,8 +100,24 @@ private:
 
   /// The client object.
   client_ptr client_;
+
+  /// The priority class of the handlers.
+  std::size_t priority_;
+
+  /// The tenant of the handlers.
+  std::size_t tenant_;
 };
 
+/// Tag the handlers bound with the server_work_allocator.
+template<typename Biz_Handler, typename Biz_Global_Storage, typename Socket_Service>
+inline void assign_work_tags(server_work_allocator<Biz_Handler, Biz_Global_Storage, Socket_Service>& work_allocator,
+    std::size_t& priority,
+    std::size_t& tenant)
+{
+  priority = work_allocator.get_priority();
+  tenant = work_allocator.get_tenant();
+}
+
 } // namespace bastool
 
 #endif // BASTOOL_SERVER_WORK_ALLOCATOR_HPP
@@ -0,0 +1,270 @@
+//
+// drain_bench.cpp
+// ~~~~~~~~~~~~~~~
+//
+// Measure the graceful stop of a server holding many idle connections over
+//   tcp loopback. Child processes open the connections and keep them, then
+//   the server stops accepting and drains them.
+//
+//   close:    the drain timeout is 0, the server closes all connections itself.
+//   peer:     the children exit, the server waits for the connections to finish.
+//   deadline: the children keep the connections open, the server closes them
+//             when the drain timeout expires.
+//
+//   Usage: drain_bench [connections] [io_threads] [mode] [drain_timeout]
+//   The drain timeout is in seconds, 0 in close mode and 1 in deadline mode
+//   by default, 30 otherwise.
+//
+//   Each connection takes a descriptor of the server process, raise the
+//   limit (ulimit -n) above the number of connections.
+//
+
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <bas/server.hpp>
+
+namespace drain_bench {
+
+/// Connections opened by each child process, each one has its own source address.
+const std::size_t connections_per_child = 20000;
+
+/// The work handler reading until the connection is closed.
+class drain_work
+{
+public:
+  typedef bas::service_handler<drain_work> handler_t;
+
+  void on_clear(handler_t&)
+  {
+  }
+
+  void on_open(handler_t& handler)
+  {
+    handler.async_read_some();
+  }
+
+  void on_read(handler_t& handler, std::size_t)
+  {
+    handler.read_buffer().clear();
+    handler.async_read_some();
+  }
+
+  void on_write(handler_t&, std::size_t)
+  {
+  }
+
+  void on_close(handler_t&, const boost::system::error_code&)
+  {
+  }
+
+  void on_parent(handler_t&, const bas::event)
+  {
+  }
+
+  void on_child(handler_t&, const bas::event)
+  {
+  }
+};
+
+/// The allocator of drain_work.
+class drain_work_allocator
+{
+public:
+  typedef boost::asio::ip::tcp::socket socket_type;
+
+  socket_type* make_socket(void* address, boost::asio::io_service& io_service)
+  {
+    return new (address) socket_type(io_service);
+  }
+
+  drain_work* make_handler(void* address)
+  {
+    return new (address) drain_work();
+  }
+};
+
+typedef bas::server<drain_work, drain_work_allocator> server_t;
+typedef bas::service_handler_pool<drain_work, drain_work_allocator> server_handler_pool_t;
+
+/// Open the connections from a source address and keep them until killed.
+void run_child(std::size_t index, std::size_t count, unsigned short port, int ready)
+{
+  sockaddr_in source;
+  std::memset(&source, 0, sizeof(source));
+  source.sin_family = AF_INET;
+  source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + static_cast<unsigned int>(index));
+
+  sockaddr_in target;
+  std::memset(&target, 0, sizeof(target));
+  target.sin_family = AF_INET;
+  target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  target.sin_port = htons(port);
+
+  std::size_t opened = 0;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+      break;
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&source), sizeof(source)) != 0
+        || ::connect(fd, reinterpret_cast<sockaddr*>(&target), sizeof(target)) != 0)
+    {
+      ::close(fd);
+      break;
+    }
+
+    ++opened;
+  }
+
+  ssize_t n = ::write(ready, &opened, sizeof(opened));
+  (void)n;
+
+  for (;;)
+    ::pause();
+}
+
+} // namespace drain_bench
+
+int main(int argc, char* argv[])
+{
+  using namespace boost::asio::ip;
+
+  std::size_t connections = 100000;
+  std::size_t io_threads = 4;
+  std::string mode = "close";
+  if (argc > 1)
+    connections = boost::lexical_cast<std::size_t>(argv[1]);
+  if (argc > 2)
+    io_threads = boost::lexical_cast<std::size_t>(argv[2]);
+  if (argc > 3)
+    mode = argv[3];
+
+  if (mode != "close" && mode != "peer" && mode != "deadline")
+  {
+    std::cerr << "Usage: drain_bench [connections] [io_threads] [close|peer|deadline] [drain_timeout]\n";
+    return 1;
+  }
+
+  unsigned int drain_timeout = (mode == "close") ? 0 : (mode == "deadline") ? 1 : 30;
+  if (argc > 4)
+    drain_timeout = boost::lexical_cast<unsigned int>(argv[4]);
+
+  // Take as many descriptors as allowed.
+  rlimit limit;
+  if (::getrlimit(RLIMIT_NOFILE, &limit) == 0)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  try
+  {
+    boost::shared_ptr<bas::io_service_group> service_group(new bas::io_service_group(2));
+    service_group->get(bas::io_service_group::io_pool).set(io_threads, io_threads);
+    service_group->get(bas::io_service_group::work_pool).set(io_threads, io_threads);
+    service_group->set_drain_timeout(drain_timeout);
+
+    tcp::endpoint endpoint(address_v4::loopback(), 0);
+    {
+      // Find a free port.
+      boost::asio::io_service io_service;
+      tcp::acceptor acceptor(io_service, endpoint);
+      endpoint = acceptor.local_endpoint();
+    }
+
+    drain_bench::server_t server(new drain_bench::server_handler_pool_t(new drain_bench::drain_work_allocator(),
+                                                                        connections + 1000,
+                                                                        16,
+                                                                        0,
+                                                                        0,
+                                                                        0,
+                                                                        0,
+                                                                        connections + 2000,
+                                                                        1000,
+                                                                        connections + 3000),
+                                 endpoint,
+                                 service_group);
+
+    service_group->start();
+    server.start();
+
+    // Open the connections in child processes.
+    int fds[2];
+    if (::pipe(fds) != 0)
+      return 1;
+
+    std::vector<pid_t> children;
+    for (std::size_t i = 0; i * drain_bench::connections_per_child < connections; ++i)
+    {
+      std::size_t count = (std::min)(drain_bench::connections_per_child,
+          connections - i * drain_bench::connections_per_child);
+
+      pid_t pid = ::fork();
+      if (pid == 0)
+      {
+        ::close(fds[0]);
+        drain_bench::run_child(i, count, endpoint.port(), fds[1]);
+        ::_exit(0);
+      }
+
+      children.push_back(pid);
+    }
+
+    std::size_t opened = 0;
+    for (std::size_t i = 0; i < children.size(); ++i)
+    {
+      std::size_t n = 0;
+      if (::read(fds[0], &n, sizeof(n)) == static_cast<ssize_t>(sizeof(n)))
+        opened += n;
+    }
+
+    // Wait for the server to accept all of them.
+    while (service_group->connections() < opened)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+
+    std::cout << "opened " << opened << " connections\n";
+
+    // The peers go away at once in peer mode, they stay in other modes.
+    if (mode == "peer")
+    {
+      for (std::size_t i = 0; i < children.size(); ++i)
+        ::kill(children[i], SIGKILL);
+    }
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    server.stop();
+    service_group->stop();
+    boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - start;
+
+    bas::drain_stats stats = service_group->get_drain_stats();
+    std::cout << mode << ": drained " << stats.connections << " connections in "
+        << stats.drain_time / 1000.0 << " ms, closed " << stats.closed
+        << ", abandoned " << stats.abandoned << ", stop took "
+        << elapsed.total_microseconds() / 1000.0 << " ms\n";
+
+    for (std::size_t i = 0; i < children.size(); ++i)
+    {
+      ::kill(children[i], SIGKILL);
+      ::waitpid(children[i], 0, 0);
+    }
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}
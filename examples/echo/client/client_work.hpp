@@ -23,10 +23,12 @@ std::string echo_message = "echo server test message.....\r\n";
 std::size_t mlen = echo_message.length();
 char *msg = (char *)echo_message.c_str();
 
+/// The echo client work over a tcp or unix domain socket.
+template<typename Socket_Service = boost::asio::ip::tcp::socket>
 class client_work
 {
 public:
-  typedef bas::service_handler<client_work> client_handler_type;
+  typedef bas::service_handler<client_work, Socket_Service> client_handler_type;
 
   client_work(error_count& counter, unsigned int pause_time)
     : error_count_(counter),
@@ -39,7 +41,7 @@ public:
   }
 
   /// Handle timeout of whole operation in io_service thread.
-  void handle_timeout(boost::shared_ptr<client_handler_type> handler, const boost::system::error_code& e)
+  void handle_timeout(typename client_handler_type::service_handler_ptr handler, const boost::system::error_code& e)
   {
     // The timer has been cancelled, do nothing.
     if (e == boost::asio::error::operation_aborted)
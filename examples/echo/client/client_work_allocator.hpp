@@ -16,10 +16,12 @@
 
 namespace echo {
 
+template<typename Socket_Service = boost::asio::ip::tcp::socket>
 class client_work_allocator
 {
 public:
-  typedef boost::asio::ip::tcp::socket socket_type;
+  typedef Socket_Service socket_type;
+  typedef client_work<socket_type> client_work_type;
 
   client_work_allocator(error_count& counter, unsigned int pause_time)
     : error_count_(counter),
@@ -27,14 +29,14 @@ public:
   {
   }
 
-  socket_type* make_socket(boost::asio::io_service& io_service)
+  socket_type* make_socket(void* address, boost::asio::io_service& io_service)
   {
-    return new socket_type(io_service);
+    return new (address) socket_type(io_service);
   }
 
-  client_work* make_handler()
+  client_work_type* make_handler(void* address)
   {
-    return new client_work(error_count_, pause_time_);
+    return new (address) client_work_type(error_count_, pause_time_);
   }
 
 private:
@@ -24,15 +24,19 @@
 
 namespace echo {
 
+template<typename Socket_Service = boost::asio::ip::tcp::socket>
 class connections
 {
 public:
-  typedef bas::service_handler_pool<client_work, client_work_allocator> client_handler_pool_type;
-  typedef bas::client<client_work, client_work_allocator> client_type;
+  typedef client_work<Socket_Service> client_work_type;
+  typedef client_work_allocator<Socket_Service> client_work_allocator_type;
+  typedef bas::service_handler_pool<client_work_type, client_work_allocator_type, Socket_Service> client_handler_pool_type;
+  typedef bas::client<client_work_type, client_work_allocator_type, Socket_Service> client_type;
+  typedef typename client_type::endpoint_t endpoint_type;
 
   explicit connections(client_handler_pool_type* service_handler_pool,
       error_count& counter,
-      boost::asio::ip::tcp::endpoint& endpoint,
+      endpoint_type& endpoint,
       std::size_t io_pool_size,
       std::size_t work_pool_size,
       unsigned int pause_seconds,
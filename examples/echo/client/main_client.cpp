@@ -16,8 +16,54 @@
 #include <boost/function.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <bas/shm_socket.hpp>
+
 #include "connections.hpp"
 
+/// Parameters of the echo test.
+struct test_param
+{
+  std::size_t io_pool_size;
+  std::size_t work_pool_size;
+  std::size_t preallocated_handler_number;
+  std::size_t read_buffer_size;
+  unsigned int session_timeout;
+  unsigned int io_timeout;
+  unsigned int pause_seconds;
+  std::size_t connection_number;
+  unsigned int wait_seconds;
+  unsigned int test_times;
+};
+
+/// Run the echo test with the socket of the endpoint.
+template<typename Socket_Service>
+void run_test(typename echo::connections<Socket_Service>::endpoint_type endpoint,
+    const test_param& param)
+{
+  typedef echo::connections<Socket_Service> connections_type;
+  typedef typename connections_type::client_handler_pool_type client_handler_pool;
+  typedef typename connections_type::client_work_allocator_type client_work_allocator;
+  echo::error_count counter;
+
+  connections_type client(new client_handler_pool(new client_work_allocator(counter, param.pause_seconds),
+                              param.preallocated_handler_number,
+                              param.read_buffer_size,
+                              0,
+                              param.session_timeout,
+                              param.io_timeout),
+      counter,
+      endpoint,
+      param.io_pool_size,
+      param.work_pool_size,
+      param.pause_seconds,
+      param.connection_number,
+      param.wait_seconds,
+      param.test_times);
+
+  // Run the client until stopped.
+  client.run();
+}
+
 int main(int argc, char* argv[])
 {
   try
@@ -30,6 +76,10 @@ int main(int argc, char* argv[])
       std::cerr << "    echo_client 127.0.0.1 1000 4 16 100 64 30 0 3 1000 10 10\n";
       std::cerr << "  For IPv6, try:\n";
       std::cerr << "    echo_client 0::0 1000 4 16 100 64 30 0 3 1000 10 10\n";
+      std::cerr << "  For a unix domain socket, give its path as address, the port is ignored:\n";
+      std::cerr << "    echo_client /tmp/echo_server.sock 0 4 16 100 64 30 0 3 1000 10 10\n";
+      std::cerr << "  For shared memory sockets, prefix the path with shm:\n";
+      std::cerr << "    echo_client shm:/tmp/echo_server_shm.sock 0 4 16 100 64 30 0 3 1000 10 10\n";
       return 1;
     }
 
@@ -37,37 +87,40 @@ int main(int argc, char* argv[])
 
     // Initialise server.
     unsigned short port = boost::lexical_cast<unsigned short>(argv[2]);
-    std::size_t io_pool_size = boost::lexical_cast<std::size_t>(argv[3]);
-    std::size_t work_pool_size = boost::lexical_cast<std::size_t>(argv[4]);
-    std::size_t preallocated_handler_number = boost::lexical_cast<std::size_t>(argv[5]);
-    std::size_t read_buffer_size = boost::lexical_cast<std::size_t>(argv[6]);
-    unsigned int session_timeout = boost::lexical_cast<unsigned int>(argv[7]);
-    unsigned int io_timeout = boost::lexical_cast<unsigned int>(argv[8]);
-    unsigned int pause_seconds = boost::lexical_cast<unsigned int >(argv[9]);
-    std::size_t connection_number = boost::lexical_cast<std::size_t>(argv[10]);
-    unsigned int wait_seconds = boost::lexical_cast<unsigned int >(argv[11]);
-    unsigned int test_times = boost::lexical_cast<unsigned int >(argv[12]);
+    test_param param;
+    param.io_pool_size = boost::lexical_cast<std::size_t>(argv[3]);
+    param.work_pool_size = boost::lexical_cast<std::size_t>(argv[4]);
+    param.preallocated_handler_number = boost::lexical_cast<std::size_t>(argv[5]);
+    param.read_buffer_size = boost::lexical_cast<std::size_t>(argv[6]);
+    param.session_timeout = boost::lexical_cast<unsigned int>(argv[7]);
+    param.io_timeout = boost::lexical_cast<unsigned int>(argv[8]);
+    param.pause_seconds = boost::lexical_cast<unsigned int >(argv[9]);
+    param.connection_number = boost::lexical_cast<std::size_t>(argv[10]);
+    param.wait_seconds = boost::lexical_cast<unsigned int >(argv[11]);
+    param.test_times = boost::lexical_cast<unsigned int >(argv[12]);
 
-    typedef bas::service_handler_pool<echo::client_work, echo::client_work_allocator> client_handler_pool;
-    echo::error_count counter;
+#if defined(BAS_HAS_SHM_SOCKET)
+    // A path prefixed by shm: selects the shared memory socket.
+    if (std::string(argv[1]).compare(0, 4, "shm:") == 0)
+    {
+      std::cout << "Connect to shared memory socket " << argv[1] + 4 << ".\n";
+      run_test<bas::shm_socket>(bas::shm_endpoint(argv[1] + 4), param);
+      return 0;
+    }
+#endif
 
-    echo::connections client(new client_handler_pool(new echo::client_work_allocator(counter, pause_seconds),
-                                 preallocated_handler_number,
-                                 read_buffer_size,
-                                 0,
-                                 session_timeout,
-                                 io_timeout),
-        counter,
-        tcp::endpoint(address::from_string(argv[1]), port),
-        io_pool_size,
-        work_pool_size,
-        pause_seconds,
-        connection_number,
-        wait_seconds,
-        test_times);
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    // A path selects the unix domain socket, to compare with loopback tcp.
+    if (std::string(argv[1]).find('/') != std::string::npos)
+    {
+      std::cout << "Connect to unix domain socket " << argv[1] << ".\n";
+      run_test<boost::asio::local::stream_protocol::socket>(
+          boost::asio::local::stream_protocol::endpoint(argv[1]), param);
+      return 0;
+    }
+#endif
 
-    // Run the client until stopped.
-    client.run();
+    run_test<tcp::socket>(tcp::endpoint(address::from_string(argv[1]), port), param);
   }
   catch (std::exception& e)
   {
@@ -19,11 +19,22 @@ struct app_param
   std::string    ip;
   unsigned short port;
   std::size_t    accept_queue_size;
+  std::string    local_path;
+  std::string    shm_path;
+  std::string    handoff_path;
+  unsigned int   drain_timeout;
 
   std::size_t    io_thread_size;
   std::size_t    work_thread_init;
   std::size_t    work_thread_high;
   std::size_t    work_thread_load;
+  std::size_t    io_spin_time;
+  int            io_busy_poll;
+
+  int            work_scheduling;
+  std::size_t    work_priority;
+  std::size_t    work_tenant;
+  std::string    tenant_weights;
 
   std::size_t    handler_pool_init;
   std::size_t    handler_pool_low;
@@ -53,11 +64,22 @@ static int get_param(const std::string& config_file,
     ("server.ip"                    , bpo::value<std::string   >()->default_value(""  ), "")
     ("server.port"                  , bpo::value<unsigned short>()->default_value(2012), "")
     ("server.accept_queue_size"     , bpo::value<std::size_t   >()->default_value( 250), "")
+    ("server.local_path"            , bpo::value<std::string   >()->default_value(""  ), "")
+    ("server.shm_path"              , bpo::value<std::string   >()->default_value(""  ), "")
+    ("server.handoff_path"          , bpo::value<std::string   >()->default_value(""  ), "")
+    ("server.drain_timeout"         , bpo::value<unsigned int  >()->default_value(  30), "")
 
     ("server.io_thread_size"        , bpo::value<std::size_t   >()->default_value(   4), "")
     ("server.work_thread_init"      , bpo::value<std::size_t   >()->default_value(   4), "")
     ("server.work_thread_high"      , bpo::value<std::size_t   >()->default_value(  32), "")
     ("server.work_thread_load"      , bpo::value<std::size_t   >()->default_value( 100), "")
+    ("server.io_spin_time"          , bpo::value<std::size_t   >()->default_value(   0), "")
+    ("server.io_busy_poll"          , bpo::value<int           >()->default_value(   0), "")
+
+    ("server.work_scheduling"       , bpo::value<int           >()->default_value(   0), "")
+    ("server.work_priority"         , bpo::value<std::size_t   >()->default_value(   1), "")
+    ("server.work_tenant"           , bpo::value<std::size_t   >()->default_value(   0), "")
+    ("server.tenant_weights"        , bpo::value<std::string   >()->default_value(""  ), "")
 
     ("server.handler_pool_init"     , bpo::value<std::size_t   >()->default_value(1000), "")
     ("server.handler_pool_low"      , bpo::value<std::size_t   >()->default_value(   0), "")
@@ -77,11 +99,22 @@ static int get_param(const std::string& config_file,
   param.ip                    = var_map["server.ip"                   ].as<std::string>();
   param.port                  = var_map["server.port"                 ].as<unsigned short>();
   param.accept_queue_size     = var_map["server.accept_queue_size"    ].as<std::size_t>();
+  param.local_path            = var_map["server.local_path"           ].as<std::string>();
+  param.shm_path              = var_map["server.shm_path"             ].as<std::string>();
+  param.handoff_path          = var_map["server.handoff_path"         ].as<std::string>();
+  param.drain_timeout         = var_map["server.drain_timeout"        ].as<unsigned int>();
 
   param.io_thread_size        = var_map["server.io_thread_size"       ].as<std::size_t>();
   param.work_thread_init      = var_map["server.work_thread_init"     ].as<std::size_t>();
   param.work_thread_high      = var_map["server.work_thread_high"     ].as<std::size_t>();
   param.work_thread_load      = var_map["server.work_thread_load"     ].as<std::size_t>();
+  param.io_spin_time          = var_map["server.io_spin_time"         ].as<std::size_t>();
+  param.io_busy_poll          = var_map["server.io_busy_poll"         ].as<int>();
+
+  param.work_scheduling       = var_map["server.work_scheduling"      ].as<int>();
+  param.work_priority         = var_map["server.work_priority"        ].as<std::size_t>();
+  param.work_tenant           = var_map["server.work_tenant"          ].as<std::size_t>();
+  param.tenant_weights        = var_map["server.tenant_weights"       ].as<std::string>();
 
   param.handler_pool_init     = var_map["server.handler_pool_init"    ].as<std::size_t>();
   param.handler_pool_low      = var_map["server.handler_pool_low"     ].as<std::size_t>();
@@ -7,8 +7,11 @@
 
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <cstdio>
 #include <bas/server.hpp>
 #include <bas/io_service_group.hpp>
+#include <bas/listener_handoff.hpp>
+#include <bas/shm_socket.hpp>
 
 #include <bastool/server_work.hpp>
 #include <bastool/server_work_allocator.hpp>
@@ -17,6 +20,11 @@
 #include "config.hpp"
 #include "app_param.hpp"
 
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+# include <signal.h>
+# include <unistd.h>
+#endif
+
 using namespace bas;
 using namespace bastool;
 using namespace echo;
@@ -39,10 +47,42 @@ public:
   typedef boost::shared_ptr<server_t> server_ptr;
   typedef boost::shared_ptr<io_service_group> io_service_group_ptr;
 
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  /// The same work handlers serving a unix domain socket.
+  typedef boost::asio::local::stream_protocol::socket local_socket_t;
+  typedef server_work<biz_handler_t, local_socket_t> local_server_work_t;
+  typedef server_work_allocator<biz_handler_t, bgs_none, local_socket_t> local_server_work_allocator_t;
+  typedef server<local_server_work_t, local_server_work_allocator_t, local_socket_t> local_server_t;
+  typedef service_handler_pool<local_server_work_t, local_server_work_allocator_t, local_socket_t> local_server_handler_pool_t;
+  typedef boost::shared_ptr<local_server_t> local_server_ptr;
+#endif
+
+#if defined(BAS_HAS_SHM_SOCKET)
+  /// The same work handlers serving shared memory sockets.
+  typedef server_work<biz_handler_t, shm_socket> shm_server_work_t;
+  typedef server_work_allocator<biz_handler_t, bgs_none, shm_socket> shm_server_work_allocator_t;
+  typedef server<shm_server_work_t, shm_server_work_allocator_t, shm_socket> shm_server_t;
+  typedef service_handler_pool<shm_server_work_t, shm_server_work_allocator_t, shm_socket> shm_server_handler_pool_t;
+  typedef boost::shared_ptr<shm_server_t> shm_server_ptr;
+#endif
+
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+  typedef boost::shared_ptr<listener_handoff> listener_handoff_ptr;
+#endif
+
   /// Constructor.
   server_main(const std::string& config_file)
     : config_file_(config_file),
       server_(),
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+      local_server_(),
+#endif
+#if defined(BAS_HAS_SHM_SOCKET)
+      shm_server_(),
+#endif
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+      handoff_(),
+#endif
       service_group_()
   {
   }
@@ -50,7 +90,16 @@ public:
   /// Destructor.
   ~server_main()
   {
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+    handoff_.reset();
+#endif
     server_.reset();
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    local_server_.reset();
+#endif
+#if defined(BAS_HAS_SHM_SOCKET)
+    shm_server_.reset();
+#endif
     service_group_.reset();
   }
 
@@ -63,10 +112,40 @@ public:
       service_group_->start();
 
       // Run the server until stopped.
+#if defined(BAS_HAS_SHM_SOCKET)
+      if (shm_server_.get() != 0)
+        shm_server_->run();
+      else
+#endif
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+      if (local_server_.get() != 0)
+        local_server_->run();
+      else
+#endif
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+      // The listening socket is offered once it's open, the server runs until stop().
+      if (handoff_.get() != 0)
+      {
+        server_->start();
+        offer_listener();
+        return;
+      }
+      else
+#endif
       server_->run();
 
       // Stop io_service_group.
       service_group_->stop();
+
+      report_work_stats();
+
+      // Report cost of busy-poll run mode.
+      if (param_.io_spin_time != 0)
+      {
+        spin_stats stats = service_group_->get(io_service_group::io_pool).get_spin_stats();
+        std::cout << "io spin time " << stats.spin_time << " us, spin hits " << stats.spin_hits
+                  << ", sleeps " << stats.sleeps << ".\n";
+      }
     }
   }
 
@@ -82,8 +161,23 @@ public:
     service_group_->start();
 
     // Run the server with non-blocked mode.
+#if defined(BAS_HAS_SHM_SOCKET)
+    if (shm_server_.get() != 0)
+      shm_server_->start();
+    else
+#endif
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (local_server_.get() != 0)
+      local_server_->start();
+    else
+#endif
     server_->start();
 
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+    if (handoff_.get() != 0)
+      offer_listener();
+#endif
+
     return 0;
   }
 
@@ -96,13 +190,46 @@ public:
   /// Stop the server.
   void stop()
   {
+    // Stop server.
+#if defined(BAS_HAS_SHM_SOCKET)
+    if (shm_server_.get() != 0)
+      shm_server_->stop();
+#endif
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (local_server_.get() != 0)
+      local_server_->stop();
+#endif
     if (server_.get() != 0)
     {
-      // Stop server.
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+      if (handoff_.get() != 0)
+        handoff_->close();
+#endif
+
       server_->stop();
+    }
 
-      // Stop io_service_group.
+    if (service_group_.get() != 0)
+    {
+      // Stop io_service_group, the connections left are closed after the drain timeout.
       service_group_->stop();
+
+      drain_stats drained = service_group_->get_drain_stats();
+      if (drained.connections != 0)
+      {
+        std::cout << "drained " << drained.connections << " connections in " << drained.drain_time / 1000
+                  << " ms, closed " << drained.closed << " at deadline, abandoned " << drained.abandoned << ".\n";
+      }
+
+      report_work_stats();
+
+      // Report cost of busy-poll run mode.
+      if (param_.io_spin_time != 0)
+      {
+        spin_stats stats = service_group_->get(io_service_group::io_pool).get_spin_stats();
+        std::cout << "io spin time " << stats.spin_time << " us, spin hits " << stats.spin_hits
+                  << ", sleeps " << stats.sleeps << ".\n";
+      }
     }
   }
 
@@ -112,7 +239,7 @@ private:
   {
     using namespace boost::asio::ip;
 
-    if (server_.get() != 0)
+    if (service_group_.get() != 0)
       return ECHO_ERR_NONE;
 
     int ret = get_param(config_file_, param_);
@@ -122,11 +249,78 @@ private:
     service_group_.reset(new io_service_group(2));
     service_group_->get(io_service_group::io_pool).set(param_.io_thread_size,
         param_.io_thread_size);
+    service_group_->get(io_service_group::io_pool).set_spin_time(param_.io_spin_time);
     service_group_->get(io_service_group::work_pool).set(param_.work_thread_init,
         param_.work_thread_high,
         param_.work_thread_load);
+    service_group_->set_drain_timeout(param_.drain_timeout);
+
+    // Schedule the handlers by priority and tenant if enabled, weights are given as tenant:weight,...
+    service_group_->get(io_service_group::work_pool).set_work_scheduling(param_.work_scheduling != 0);
+    for (const char* weights = param_.tenant_weights.c_str(); *weights != '\0'; ++weights)
+    {
+      unsigned long tenant = 0, weight = 0;
+      int length = 0;
+      if (std::sscanf(weights, "%lu:%lu%n", &tenant, &weight, &length) != 2 || weight == 0)
+        break;
+
+      service_group_->get(io_service_group::work_pool).set_tenant_weight(tenant, weight);
+      weights += length;
+      if (*weights == '\0')
+        break;
+    }
 
-    server_.reset(new server_t(new server_handler_pool_t(new server_work_allocator_t(0),
+#if defined(BAS_HAS_SHM_SOCKET)
+    // Serve shared memory sockets set up on the path if given.
+    if (!param_.shm_path.empty())
+    {
+      shm_server_.reset(new shm_server_t(new shm_server_handler_pool_t(tag(new shm_server_work_allocator_t(0)),
+                                                                       param_.handler_pool_init,
+                                                                       param_.read_buffer_size,
+                                                                       param_.write_buffer_size,
+                                                                       param_.session_timeout,
+                                                                       param_.io_timeout,
+                                                                       param_.handler_pool_low,
+                                                                       param_.handler_pool_high,
+                                                                       param_.handler_pool_inc,
+                                                                       param_.handler_pool_max),
+                                         shm_endpoint(param_.shm_path),
+                                         service_group_,
+                                         param_.accept_queue_size));
+
+      if (shm_server_.get() == 0)
+        return ECHO_ERR_ALLOC_FAILED;
+
+      return ECHO_ERR_NONE;
+    }
+#endif
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    // Serve the unix domain socket instead of tcp if the path is given.
+    if (!param_.local_path.empty())
+    {
+      local_server_.reset(new local_server_t(new local_server_handler_pool_t(tag(new local_server_work_allocator_t(0)),
+                                                                             param_.handler_pool_init,
+                                                                             param_.read_buffer_size,
+                                                                             param_.write_buffer_size,
+                                                                             param_.session_timeout,
+                                                                             param_.io_timeout,
+                                                                             param_.handler_pool_low,
+                                                                             param_.handler_pool_high,
+                                                                             param_.handler_pool_inc,
+                                                                             param_.handler_pool_max),
+                                             boost::asio::local::stream_protocol::endpoint(param_.local_path),
+                                             service_group_,
+                                             param_.accept_queue_size));
+
+      if (local_server_.get() == 0)
+        return ECHO_ERR_ALLOC_FAILED;
+
+      return ECHO_ERR_NONE;
+    }
+#endif
+
+    server_.reset(new server_t(new server_handler_pool_t(tag(new server_work_allocator_t(0)),
                                                          param_.handler_pool_init,
                                                          param_.read_buffer_size,
                                                          param_.write_buffer_size,
@@ -143,9 +337,87 @@ private:
     if (server_.get() == 0)
       return ECHO_ERR_ALLOC_FAILED;
 
+    server_->set_busy_poll(param_.io_busy_poll);
+
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+    // Take the listening socket from the running server, or from systemd socket activation.
+    //   The handlers are preallocated above, the running server keeps accepting till then.
+    std::vector<int> listeners;
+    if (!param_.handoff_path.empty())
+    {
+      handoff_.reset(new listener_handoff());
+
+      boost::system::error_code ignored_ec;
+      handoff_->take(param_.handoff_path, listeners, ignored_ec);
+    }
+
+    if (listeners.empty())
+      listen_fds(listeners);
+
+    if (!listeners.empty())
+    {
+      server_->set_listener(listeners[0]);
+
+      // Only one endpoint is served.
+      for (size_t i = 1; i < listeners.size(); ++i)
+        ::close(listeners[i]);
+    }
+#endif
+
     return ECHO_ERR_NONE;
   }
 
+  /// Assign the priority class and tenant of the configuration to the handlers of the allocator.
+  template<typename Work_Allocator>
+  Work_Allocator* tag(Work_Allocator* work_allocator)
+  {
+    work_allocator->set_work_tags(param_.work_priority, param_.work_tenant);
+
+    return work_allocator;
+  }
+
+  /// Report queue delay of each priority class if work scheduling is enabled.
+  void report_work_stats()
+  {
+    if (param_.work_scheduling == 0)
+      return;
+
+    for (std::size_t i = 0; i < BAS_WORK_PRIORITY_CLASSES; ++i)
+    {
+      work_class_stats stats = service_group_->get(io_service_group::work_pool).get_work_stats(i);
+      if (stats.count == 0)
+        continue;
+
+      std::cout << "work class " << i << ": " << stats.count << " works, mean delay "
+                << stats.total_delay / stats.count << " us, p99 " << stats.percentile(0.99)
+                << " us, max " << stats.max_delay << " us.\n";
+    }
+  }
+
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+  /// Take over from the server which handed the listening socket, then offer it to the next one.
+  void offer_listener()
+  {
+    handoff_->confirm();
+
+    std::vector<int> listeners(1, server_->listener());
+    boost::system::error_code ec;
+    handoff_->offer(param_.handoff_path,
+        listeners,
+        mem_fn_wait_handler<server_main*, server_main, &server_main::handle_handoff>(this),
+        ec);
+
+    if (ec)
+      std::cerr << "offer listening socket on " << param_.handoff_path << ": " << ec.message() << "\n";
+  }
+
+  /// Handle the listening socket taken by a new server, then drain and exit as signaled.
+  void handle_handoff(const boost::system::error_code&)
+  {
+    ::kill(::getpid(), SIGTERM);
+  }
+#endif
+
 private:
   /// The config file of server.
   std::string config_file_;
@@ -156,6 +428,21 @@ private:
   /// The pointer of server.
   server_ptr server_; 
 
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  /// The pointer of server on unix domain socket.
+  local_server_ptr local_server_;
+#endif
+
+#if defined(BAS_HAS_SHM_SOCKET)
+  /// The pointer of server on shared memory sockets.
+  shm_server_ptr shm_server_;
+#endif
+
+#if defined(BAS_HAS_LISTENER_HANDOFF)
+  /// The handoff of the listening socket between the running server and a new one.
+  listener_handoff_ptr handoff_;
+#endif
+
   /// The group of io_service_pool objects used to perform asynchronous operations.
   io_service_group_ptr service_group_;
 };
@@ -0,0 +1,220 @@
+//
+// handler_bench.cpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Measure the cost of a service_handler: making and deleting handlers, which
+//   now take one cache line aligned block with the work handler, opening
+//   and closing connections, which construct the socket and timers in the
+//   handler, and the round trip of small messages echoed over tcp loopback.
+//
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <bas/server.hpp>
+
+namespace handler_bench {
+
+/// The work handler echoing what it reads.
+class echo_work
+{
+public:
+  typedef bas::service_handler<echo_work> handler_t;
+
+  void on_clear(handler_t&)
+  {
+  }
+
+  void on_open(handler_t& handler)
+  {
+    handler.async_read_some();
+  }
+
+  void on_read(handler_t& handler, std::size_t bytes_transferred)
+  {
+    handler.async_write(boost::asio::buffer(handler.read_buffer().data(), bytes_transferred));
+  }
+
+  void on_write(handler_t& handler, std::size_t)
+  {
+    handler.read_buffer().clear();
+    handler.async_read_some();
+  }
+
+  void on_close(handler_t&, const boost::system::error_code&)
+  {
+  }
+
+  void on_parent(handler_t&, const bas::event)
+  {
+  }
+
+  void on_child(handler_t&, const bas::event)
+  {
+  }
+};
+
+/// The allocator of echo_work.
+class echo_work_allocator
+{
+public:
+  typedef boost::asio::ip::tcp::socket socket_type;
+
+  socket_type* make_socket(void* address, boost::asio::io_service& io_service)
+  {
+    return new (address) socket_type(io_service);
+  }
+
+  echo_work* make_handler(void* address)
+  {
+    return new (address) echo_work();
+  }
+};
+
+typedef bas::server<echo_work, echo_work_allocator> server_t;
+typedef bas::service_handler_pool<echo_work, echo_work_allocator> server_handler_pool_t;
+typedef echo_work::handler_t handler_t;
+
+/// Microseconds elapsed from the given time.
+double elapsed_us(const boost::posix_time::ptime& start)
+{
+  return static_cast<double>((boost::posix_time::microsec_clock::universal_time() - start).total_microseconds());
+}
+
+/// Make and delete handlers in batches, return nanoseconds per handler.
+double make_handlers(std::size_t count, std::size_t buffer_size)
+{
+  echo_work_allocator allocator;
+  std::vector<handler_t*> handlers(1000);
+  std::size_t misaligned = 0;
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  for (std::size_t done = 0; done < count; done += handlers.size())
+  {
+    for (std::size_t i = 0; i < handlers.size(); ++i)
+    {
+      handlers[i] = new handler_t(allocator, buffer_size);
+      if (reinterpret_cast<std::size_t>(handlers[i]) % BAS_CACHE_LINE_SIZE != 0)
+        ++misaligned;
+    }
+
+    for (std::size_t i = 0; i < handlers.size(); ++i)
+      delete handlers[i];
+  }
+  double ns = elapsed_us(start) * 1000.0 / count;
+
+  if (misaligned != 0)
+    std::cout << misaligned << " handlers are not aligned on a cache line\n";
+
+  return ns;
+}
+
+/// Open and close connections one by one, return microseconds per connection.
+double open_connections(const boost::asio::ip::tcp::endpoint& endpoint, std::size_t count)
+{
+  boost::asio::io_service io_service;
+  char byte = 0;
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    boost::asio::ip::tcp::socket socket(io_service);
+    socket.connect(endpoint);
+
+    // Wait for the echo, the handler is bound and started.
+    boost::asio::write(socket, boost::asio::buffer(&byte, 1));
+    boost::asio::read(socket, boost::asio::buffer(&byte, 1));
+  }
+
+  return elapsed_us(start) / count;
+}
+
+/// Echo messages over one connection, return microseconds per round trip.
+double echo_messages(const boost::asio::ip::tcp::endpoint& endpoint,
+    std::size_t count,
+    std::size_t message_size)
+{
+  boost::asio::io_service io_service;
+  boost::asio::ip::tcp::socket socket(io_service);
+  socket.connect(endpoint);
+  socket.set_option(boost::asio::ip::tcp::no_delay(true));
+
+  std::vector<char> message(message_size, 'x');
+  boost::asio::write(socket, boost::asio::buffer(message));
+  boost::asio::read(socket, boost::asio::buffer(message));
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    boost::asio::write(socket, boost::asio::buffer(message));
+    boost::asio::read(socket, boost::asio::buffer(message));
+  }
+
+  return elapsed_us(start) / count;
+}
+
+} // namespace handler_bench
+
+int main(int argc, char* argv[])
+{
+  using namespace boost::asio::ip;
+
+  std::size_t count = 100000;
+  std::size_t message_size = 64;
+  if (argc > 1)
+    count = boost::lexical_cast<std::size_t>(argv[1]);
+  if (argc > 2)
+    message_size = boost::lexical_cast<std::size_t>(argv[2]);
+
+  try
+  {
+    std::cout << "handler block: " << sizeof(handler_bench::handler_t) << " + "
+        << sizeof(handler_bench::echo_work) << " bytes\n";
+
+    double make_ns = handler_bench::make_handlers(count * 10, message_size);
+    std::cout << "make/delete: " << make_ns << " ns per handler\n";
+
+    boost::shared_ptr<bas::io_service_group> service_group(new bas::io_service_group(2));
+    service_group->get(bas::io_service_group::io_pool).set(1, 1);
+    service_group->get(bas::io_service_group::work_pool).set(1, 1);
+
+    tcp::endpoint endpoint(address_v4::loopback(), 0);
+    {
+      // Find a free port.
+      boost::asio::io_service io_service;
+      tcp::acceptor acceptor(io_service, endpoint);
+      endpoint = acceptor.local_endpoint();
+    }
+
+    handler_bench::server_t server(new handler_bench::server_handler_pool_t(new handler_bench::echo_work_allocator(),
+                                                                            100,
+                                                                            message_size,
+                                                                            0,
+                                                                            0),
+                                   endpoint,
+                                   service_group);
+
+    service_group->start();
+    server.start();
+
+    std::cout << "open/close: " << handler_bench::open_connections(endpoint, count / 10)
+        << " us per connection\n";
+
+    std::cout << "echo " << message_size << " bytes: "
+        << handler_bench::echo_messages(endpoint, count, message_size)
+        << " us per round trip\n";
+
+    server.stop();
+    service_group->stop();
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+//
+// handoff_bench.cpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Measure the cost of handing completions from an io_service thread to a
+//   work_service thread, by posting each one or by the completion_queue.
+//
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <iostream>
+
+#include <bas/completion_queue.hpp>
+
+namespace handoff {
+
+/// Completions delivered to the work_service thread.
+boost::atomic<std::size_t> delivered(0);
+
+/// Posted completion.
+void on_post(std::size_t value)
+{
+  delivered += value;
+}
+
+/// Queued completion.
+void on_complete(const bas::work_completion& completion, bool invoke)
+{
+  if (invoke)
+    delivered += completion.value;
+}
+
+/// Produce completions in io_service thread.
+void produce(boost::asio::io_service& work_service,
+    bas::completion_queue* queue,
+    std::size_t count)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    if (queue == 0)
+      work_service.post(boost::bind(&on_post, 1));
+    else
+      queue->push(bas::work_completion(&on_complete, 0, 0, 1));
+  }
+}
+
+/// Run one measurement and return nanoseconds per completion.
+double run(bool use_queue, std::size_t count)
+{
+  boost::asio::io_service io_service;
+  boost::asio::io_service work_service;
+  boost::asio::io_service::work work(work_service);
+
+  delivered = 0;
+
+  bas::completion_queue* queue = 0;
+  if (use_queue)
+    queue = &boost::asio::use_service<bas::completion_queue_service>(work_service).get_queue(io_service);
+
+  boost::thread work_thread(boost::bind(&boost::asio::io_service::run, &work_service));
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+  // Produce in the thread running io_service.
+  io_service.post(boost::bind(&produce, boost::ref(work_service), queue, count));
+  boost::thread io_thread(boost::bind(&boost::asio::io_service::run, &io_service));
+
+  while (delivered != count)
+    boost::this_thread::yield();
+
+  boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - start;
+
+  work_service.stop();
+  io_thread.join();
+  work_thread.join();
+
+  return elapsed.total_microseconds() * 1000.0 / count;
+}
+
+} // namespace handoff
+
+int main(int argc, char* argv[])
+{
+  std::size_t count = 1000000;
+  if (argc > 1)
+    count = boost::lexical_cast<std::size_t>(argv[1]);
+
+  for (int round = 0; round < 3; ++round)
+  {
+    double post_ns = handoff::run(false, count);
+    double queue_ns = handoff::run(true, count);
+
+    std::cout << "post: " << post_ns << " ns/completion, "
+        << "completion_queue: " << queue_ns << " ns/completion\n";
+  }
+
+  return 0;
+}
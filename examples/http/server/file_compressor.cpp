@@ -0,0 +1,180 @@
+//
+// file_compressor.cpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "file_compressor.hpp"
+#include <cstdio>
+#include <fstream>
+#include <boost/bind.hpp>
+
+#if defined(HTTP_SERVER_GZIP)
+#include <zlib.h>
+#endif
+
+#if defined(HTTP_SERVER_BROTLI)
+#include <brotli/encode.h>
+#endif
+
+namespace http {
+namespace server {
+
+namespace {
+
+#if defined(HTTP_SERVER_GZIP)
+bool gzip(const std::string& in, std::string& out)
+{
+  z_stream stream = z_stream();
+
+  // Window bits 15 + 16 for the gzip wrapper.
+  if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+
+  out.resize(deflateBound(&stream, static_cast<uLong>(in.size())));
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+  stream.avail_in = static_cast<uInt>(in.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  stream.avail_out = static_cast<uInt>(out.size());
+
+  int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  return result == Z_STREAM_END;
+}
+#endif // defined(HTTP_SERVER_GZIP)
+
+#if defined(HTTP_SERVER_BROTLI)
+bool brotli(const std::string& in, std::string& out)
+{
+  std::size_t size = BrotliEncoderMaxCompressedSize(in.size());
+  if (size == 0)
+    return false;
+
+  out.resize(size);
+  if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+      in.size(), reinterpret_cast<const uint8_t*>(in.data()),
+      &size, reinterpret_cast<uint8_t*>(&out[0])))
+    return false;
+
+  out.resize(size);
+  return true;
+}
+#endif // defined(HTTP_SERVER_BROTLI)
+
+} // namespace
+
+file_compressor::file_compressor(std::size_t threads)
+  : mutex_(),
+    pending_(),
+    pool_(threads, threads)
+{
+  pool_.start();
+}
+
+file_compressor::~file_compressor()
+{
+  pool_.stop();
+}
+
+bool file_compressor::supports(const std::string& coding)
+{
+#if defined(HTTP_SERVER_GZIP)
+  if (coding == "gzip")
+    return true;
+#endif
+
+#if defined(HTTP_SERVER_BROTLI)
+  if (coding == "br")
+    return true;
+#endif
+
+#if !defined(HTTP_SERVER_GZIP) && !defined(HTTP_SERVER_BROTLI)
+  // No coding is compiled in.
+  (void)coding;
+#endif
+
+  return false;
+}
+
+void file_compressor::compress(const std::string& path, const std::string& coding)
+{
+  if (!supports(coding))
+    return;
+
+  {
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(mutex_);
+
+    if (!pending_.insert(path + '\n' + coding).second)
+      return;
+  }
+
+  pool_.get_io_service().post(boost::bind(&file_compressor::do_compress, this, path, coding));
+}
+
+void file_compressor::do_compress(const std::string& path, const std::string& coding)
+{
+  std::string content;
+  std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+  char buf[8192];
+  while (is && content.size() <= HTTP_SERVER_COMPRESS_MAX_SIZE
+      && is.read(buf, sizeof(buf)).gcount() > 0)
+    content.append(buf, is.gcount());
+
+  std::string compressed;
+  bool done = false;
+  if (content.size() >= HTTP_SERVER_COMPRESS_MIN_SIZE && content.size() <= HTTP_SERVER_COMPRESS_MAX_SIZE)
+  {
+#if defined(HTTP_SERVER_GZIP)
+    if (coding == "gzip")
+      done = gzip(content, compressed);
+#endif
+
+#if defined(HTTP_SERVER_BROTLI)
+    if (coding == "br")
+      done = brotli(content, compressed);
+#endif
+  }
+
+  // Files not made smaller stay pending, they are not tried again until restart.
+  if (!done || compressed.size() >= content.size())
+    return;
+
+  std::string target = path + (coding == "gzip" ? ".gz" : ".br");
+  std::string temporary = target + ".tmp";
+  {
+    std::ofstream os(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    os.write(compressed.data(), compressed.size());
+    os.close();
+    if (os.fail())
+    {
+      std::remove(temporary.c_str());
+      return;
+    }
+  }
+
+  // Replacing by rename fails on some systems if the target exists.
+  if (std::rename(temporary.c_str(), target.c_str()) != 0)
+  {
+    std::remove(target.c_str());
+    if (std::rename(temporary.c_str(), target.c_str()) != 0)
+    {
+      std::remove(temporary.c_str());
+      return;
+    }
+  }
+
+  // Lock for synchronize access to data.
+  scoped_lock_t lock(mutex_);
+
+  pending_.erase(path + '\n' + coding);
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,75 @@
+//
+// file_compressor.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SERVER_FILE_COMPRESSOR_HPP
+#define HTTP_SERVER_FILE_COMPRESSOR_HPP
+
+#include <set>
+#include <string>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <bas/io_service_pool.hpp>
+
+// Define HTTP_SERVER_GZIP to create .gz files with zlib, and
+// HTTP_SERVER_BROTLI to create .br files with the brotli encoder.
+
+#if !defined(HTTP_SERVER_COMPRESS_MIN_SIZE)
+# define HTTP_SERVER_COMPRESS_MIN_SIZE 256
+#endif
+
+#if !defined(HTTP_SERVER_COMPRESS_MAX_SIZE)
+# define HTTP_SERVER_COMPRESS_MAX_SIZE 16777216
+#endif
+
+namespace http {
+namespace server {
+
+/// Creates compressed siblings of files in background threads.
+//    A file is compressed once into "<file>.gz" or "<file>.br" beside it, the
+//    output is written to a temporary file and renamed, so a reader never
+//    sees a partial file.
+class file_compressor
+  : private boost::noncopyable
+{
+public:
+  /// Construct with the number of background threads.
+  explicit file_compressor(std::size_t threads);
+
+  /// Destruct, the compressions queued are finished first.
+  ~file_compressor();
+
+  /// Check whether the content coding can be created.
+  static bool supports(const std::string& coding);
+
+  /// Queue the compression of the file, ignored if already queued.
+  void compress(const std::string& path, const std::string& coding);
+
+private:
+  /// Compress in background thread.
+  void do_compress(const std::string& path, const std::string& coding);
+
+  typedef boost::asio::detail::mutex mutex_t;
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+
+  /// Mutex for synchronize access to data.
+  mutex_t mutex_;
+
+  /// The compressions queued or running.
+  std::set<std::string> pending_;
+
+  /// The threads for compressing.
+  bas::io_service_pool pool_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_FILE_COMPRESSOR_HPP
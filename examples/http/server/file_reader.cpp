@@ -0,0 +1,212 @@
+//
+// file_reader.cpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "file_reader.hpp"
+#include <fcntl.h>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#if defined(BOOST_WINDOWS)
+# include <io.h>
+#else
+# include <unistd.h>
+# include <sys/uio.h>
+#endif
+
+namespace http {
+namespace server {
+
+namespace {
+
+int open_file(const std::string& path)
+{
+#if defined(BOOST_WINDOWS)
+  return ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+  return ::open(path.c_str(), O_RDONLY);
+#endif
+}
+
+void close_file(int fd)
+{
+#if defined(BOOST_WINDOWS)
+  ::_close(fd);
+#else
+  ::close(fd);
+#endif
+}
+
+/// Read at the offset, returns the bytes read, 0 at end of file, negative on error.
+long read_file(int fd, char* data, std::size_t size, boost::uint64_t offset)
+{
+#if defined(BOOST_WINDOWS)
+  // The file is read by one thread at a time, seeking is safe.
+  if (::_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0)
+    return -1;
+  return ::_read(fd, data, static_cast<unsigned int>(size));
+#else
+  return static_cast<long>(::pread(fd, data, size, static_cast<off_t>(offset)));
+#endif
+}
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+/// Give the kernel a hint of how the range is to be read.
+void advise(int fd, boost::uint64_t offset, std::size_t length, int advice)
+{
+  ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), advice);
+}
+#endif
+
+} // namespace
+
+file_reader::file_reader(std::size_t threads)
+  : pool_(threads, threads)
+{
+  pool_.start();
+}
+
+file_reader::~file_reader()
+{
+  pool_.stop();
+}
+
+void file_reader::post(const boost::function<void ()>& read)
+{
+  pool_.get_io_service().post(read);
+}
+
+file_source::file_source(file_reader* reader, const std::string& path)
+  : reader_(reader),
+    fd_(open_file(path)),
+    offset_(0),
+    left_(0),
+    buffer_(),
+    ready_(false)
+{
+}
+
+file_source::~file_source()
+{
+  if (fd_ >= 0)
+    close_file(fd_);
+}
+
+void file_source::set_range(boost::uint64_t offset, std::size_t length)
+{
+  offset_ = offset;
+  left_ = length;
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+  // A long range is streamed, let the kernel read ahead more aggressively.
+  if (fd_ >= 0 && length > HTTP_SERVER_CHUNK_SIZE)
+    advise(fd_, offset, length, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+bool file_source::next(std::string& piece, std::size_t max_size)
+{
+  std::size_t n = 0;
+  if (ready_)
+  {
+    ready_ = false;
+    n = (std::min)(buffer_.size(), max_size);
+    if (n == buffer_.size())
+    {
+      piece.swap(buffer_);
+    }
+    else
+    {
+      piece.assign(buffer_, 0, n);
+      buffer_.erase(0, n);
+      ready_ = true;
+    }
+  }
+  else
+  {
+    n = (std::min)(left_, max_size);
+    piece.resize(n);
+    if (n != 0)
+      n = read_at(&piece[0], n, offset_);
+    piece.resize(n);
+  }
+
+  // A file truncated while sent ends the reply early.
+  offset_ += n;
+  left_ = (n != 0) ? left_ - n : 0;
+  return left_ != 0 || ready_;
+}
+
+bool file_source::async_fill(boost::asio::io_service& io_service,
+    const boost::function<void ()>& handler)
+{
+  if (reader_ == 0 || ready_ || left_ == 0 || fd_ < 0)
+    return false;
+
+  std::size_t size = (std::min)(left_, static_cast<std::size_t>(HTTP_SERVER_CHUNK_SIZE));
+  buffer_.resize(size);
+  std::size_t got = 0;
+
+#if defined(RWF_NOWAIT)
+  // Take what the page cache holds without blocking, the rest is left to the
+  // background threads.
+  struct iovec iov;
+  iov.iov_base = &buffer_[0];
+  iov.iov_len = size;
+  ssize_t n = ::preadv2(fd_, &iov, 1, static_cast<off_t>(offset_), RWF_NOWAIT);
+  if (n == 0 || n == static_cast<ssize_t>(size))
+  {
+    buffer_.resize(static_cast<std::size_t>(n));
+    ready_ = true;
+    return false;
+  }
+  if (n > 0)
+    got = static_cast<std::size_t>(n);
+#endif
+
+  buffer_.resize(got);
+  reader_->post(boost::bind(&file_source::do_fill, shared_from_this(),
+      boost::ref(io_service), handler));
+  return true;
+}
+
+void file_source::do_fill(boost::asio::io_service& io_service, boost::function<void ()> handler)
+{
+  std::size_t got = buffer_.size();
+  std::size_t size = (std::min)(left_, static_cast<std::size_t>(HTTP_SERVER_CHUNK_SIZE));
+  buffer_.resize(size);
+  buffer_.resize(got + read_at(&buffer_[got], size - got, offset_ + got));
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+  // Start reading the next piece while this one is sent.
+  if (left_ > size)
+    advise(fd_, offset_ + size, (std::min)(left_ - size,
+        static_cast<std::size_t>(HTTP_SERVER_CHUNK_SIZE)), POSIX_FADV_WILLNEED);
+#endif
+
+  ready_ = true;
+  io_service.post(handler);
+}
+
+std::size_t file_source::read_at(char* data, std::size_t size, boost::uint64_t offset)
+{
+  std::size_t done = 0;
+  while (done < size)
+  {
+    long n = read_file(fd_, data + done, size - done, offset + done);
+    if (n <= 0)
+      break;
+    done += static_cast<std::size_t>(n);
+  }
+
+  return done;
+}
+
+} // namespace server
+} // namespace http
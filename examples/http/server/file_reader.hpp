@@ -0,0 +1,108 @@
+//
+// file_reader.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SERVER_FILE_READER_HPP
+#define HTTP_SERVER_FILE_READER_HPP
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <bas/io_service_pool.hpp>
+
+#include "reply.hpp"
+
+namespace http {
+namespace server {
+
+/// Opens and reads files in background threads, so a lookup or a read missing
+/// the cache blocks none of the work threads and the connections hashed onto
+/// them.
+class file_reader
+  : private boost::noncopyable
+{
+public:
+  /// Construct with the number of background threads.
+  explicit file_reader(std::size_t threads);
+
+  /// Destruct, the reads queued are finished first.
+  ~file_reader();
+
+  /// Queue a read to the background threads.
+  void post(const boost::function<void ()>& read);
+
+private:
+  /// The threads for reading.
+  bas::io_service_pool pool_;
+};
+
+/// Reads a range of a file one piece at a time.
+//    Without a reader every piece is read by the caller of next. With one, the
+//    piece is first taken from the page cache without blocking where the
+//    system allows it, and only a piece missing the cache is read in the
+//    background, the connection resumes when it's done.
+class file_source
+  : public reply_source,
+    public boost::enable_shared_from_this<file_source>
+{
+public:
+  /// Open the file, the reads are done by the reader if not null.
+  file_source(file_reader* reader, const std::string& path);
+
+  /// Close the file.
+  virtual ~file_source();
+
+  /// Check whether the file is opened.
+  bool is_open() const
+  {
+    return fd_ >= 0;
+  }
+
+  /// Select the range to be read, a long one is read ahead sequentially.
+  void set_range(boost::uint64_t offset, std::size_t length);
+
+  virtual bool next(std::string& piece, std::size_t max_size);
+
+  virtual bool async_fill(boost::asio::io_service& io_service,
+      const boost::function<void ()>& handler);
+
+private:
+  /// Finish reading the piece in background thread.
+  void do_fill(boost::asio::io_service& io_service, boost::function<void ()> handler);
+
+  /// Read at the offset until the size is read or the end of file is reached.
+  std::size_t read_at(char* data, std::size_t size, boost::uint64_t offset);
+
+  /// The reader, null for reading in the caller.
+  file_reader* reader_;
+
+  /// The descriptor of the file, negative if not opened.
+  int fd_;
+
+  /// The offset of the next piece.
+  boost::uint64_t offset_;
+
+  /// The bytes still to be read.
+  std::size_t left_;
+
+  /// The piece read ahead.
+  std::string buffer_;
+
+  /// Whether the piece read ahead is ready.
+  bool ready_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_FILE_READER_HPP
@@ -0,0 +1,906 @@
+//
+// h2_connection.cpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "h2_connection.hpp"
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include "header_emitter.hpp"
+#include "request_handler.hpp"
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// The frame types.
+enum frame_type
+{
+  data_frame = 0x0,
+  headers_frame = 0x1,
+  priority_frame = 0x2,
+  rst_stream_frame = 0x3,
+  settings_frame = 0x4,
+  push_promise_frame = 0x5,
+  ping_frame = 0x6,
+  goaway_frame = 0x7,
+  window_update_frame = 0x8,
+  continuation_frame = 0x9
+};
+
+/// The frame flags.
+enum frame_flag
+{
+  end_stream_flag = 0x1,
+  ack_flag = 0x1,
+  end_headers_flag = 0x4,
+  padded_flag = 0x8,
+  priority_flag = 0x20
+};
+
+/// The error codes.
+enum error_code
+{
+  no_error = 0x0,
+  protocol_error = 0x1,
+  flow_control_error = 0x3,
+  stream_closed = 0x5,
+  frame_size_error = 0x6,
+  refused_stream = 0x7,
+  compression_error = 0x9,
+  enhance_your_calm = 0xb
+};
+
+/// The settings.
+enum setting_id
+{
+  header_table_size = 0x1,
+  enable_push = 0x2,
+  max_concurrent_streams = 0x3,
+  initial_window_size = 0x4,
+  max_frame_size = 0x5,
+  max_header_list_size = 0x6
+};
+
+/// The rest of the preface after the request line "PRI * HTTP/2.0".
+const char preface_rest[] = "SM\r\n\r\n";
+
+/// The frame size and window used before SETTINGS changes them.
+const std::size_t default_frame_size = 16384;
+const boost::int64_t default_window = 65535;
+const boost::int64_t max_window = 0x7fffffff;
+
+boost::uint32_t get_uint32(const char* p)
+{
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return (static_cast<boost::uint32_t>(u[0]) << 24) | (u[1] << 16) | (u[2] << 8) | u[3];
+}
+
+void put_uint32(std::string& out, boost::uint32_t value)
+{
+  out += static_cast<char>(value >> 24);
+  out += static_cast<char>(value >> 16);
+  out += static_cast<char>(value >> 8);
+  out += static_cast<char>(value);
+}
+
+} // namespace
+
+h2_connection::stream::stream()
+  : req(),
+    rep(),
+    offset(0),
+    send_window(0),
+    received(0),
+    remote_closed(false),
+    head_sent(false),
+    blocked(false),
+    waiting(false)
+{
+  req.reset();
+}
+
+h2_connection::h2_connection(request_handler& handler, boost::asio::io_service& work_service,
+    const writer_type& writer)
+  : request_handler_(handler),
+    work_service_(work_service),
+    writer_(writer),
+    decoder_(),
+    encoder_(),
+    state_(preface_state),
+    header_(),
+    payload_(),
+    payload_left_(0),
+    length_(0),
+    type_(0),
+    flags_(0),
+    stream_id_(0),
+    header_block_(),
+    header_block_id_(0),
+    header_block_end_stream_(false),
+    streams_(),
+    ready_(),
+    last_stream_id_(0),
+    send_window_(default_window),
+    received_(0),
+    initial_window_(default_window),
+    max_frame_size_(default_frame_size),
+    control_(),
+    output_(),
+    going_away_(false)
+{
+  // The server preface, other settings are left to their defaults.
+  std::string settings;
+  settings += static_cast<char>(0);
+  settings += static_cast<char>(max_concurrent_streams);
+  put_uint32(settings, HTTP_SERVER_H2_MAX_STREAMS);
+  settings += static_cast<char>(0);
+  settings += static_cast<char>(max_header_list_size);
+  put_uint32(settings, HTTP_SERVER_H2_MAX_HEADER_LIST);
+  queue_frame(settings_frame, 0, 0, settings.data(), settings.size());
+}
+
+void h2_connection::consume(const char* begin, const char* end)
+{
+  while (begin != end && state_ != closed_state)
+  {
+    if (state_ == payload_state)
+    {
+      // DATA is not kept, the request_handler takes no body.
+      std::size_t n = (std::min)(payload_left_, static_cast<std::size_t>(end - begin));
+      if (type_ != data_frame)
+        payload_.append(begin, n);
+      begin += n;
+      payload_left_ -= n;
+      if (payload_left_ == 0)
+      {
+        state_ = header_state;
+        handle_frame();
+      }
+
+      continue;
+    }
+
+    std::size_t size = (state_ == preface_state) ? sizeof(preface_rest) - 1 : 9;
+    std::size_t n = (std::min)(size - header_.size(), static_cast<std::size_t>(end - begin));
+    header_.append(begin, n);
+    begin += n;
+    if (header_.size() < size)
+      break;
+
+    if (state_ == preface_state)
+    {
+      if (header_ != preface_rest)
+      {
+        connection_error(protocol_error);
+        return;
+      }
+
+      header_.clear();
+      state_ = header_state;
+      continue;
+    }
+
+    const unsigned char* h = reinterpret_cast<const unsigned char*>(header_.data());
+    length_ = (h[0] << 16) | (h[1] << 8) | h[2];
+    type_ = h[3];
+    flags_ = h[4];
+    stream_id_ = get_uint32(header_.data() + 5) & 0x7fffffff;
+    header_.clear();
+
+    if (length_ > default_frame_size)
+    {
+      connection_error(frame_size_error);
+      return;
+    }
+
+    // Nothing may come between the frames of a header block.
+    if (header_block_id_ != 0 && (type_ != continuation_frame || stream_id_ != header_block_id_))
+    {
+      connection_error(protocol_error);
+      return;
+    }
+
+    payload_.clear();
+    payload_left_ = length_;
+    state_ = payload_state;
+    if (length_ == 0)
+    {
+      state_ = header_state;
+      handle_frame();
+    }
+  }
+}
+
+bool h2_connection::next_output()
+{
+  output_.clear();
+  output_.swap(control_);
+
+  // One frame of each stream in turn, until the output is large enough.
+  while (output_.size() < HTTP_SERVER_H2_WRITE_SIZE && !ready_.empty())
+  {
+    boost::uint32_t id = ready_.front();
+    ready_.pop_front();
+
+    stream_map::iterator iter = streams_.find(id);
+    if (iter == streams_.end())
+      continue;
+
+    write_result result = write_stream(iter);
+    if (result == stream_continues)
+    {
+      ready_.push_back(id);
+    }
+    else if (result == connection_blocked)
+    {
+      ready_.push_front(id);
+      break;
+    }
+  }
+
+  return !output_.empty();
+}
+
+void h2_connection::close()
+{
+  writer_.clear();
+}
+
+bool h2_connection::closing() const
+{
+  return state_ == closed_state || (going_away_ && streams_.empty());
+}
+
+void h2_connection::handle_frame()
+{
+  switch (type_)
+  {
+  case data_frame:
+    handle_data();
+    break;
+  case headers_frame:
+    handle_headers();
+    break;
+  case priority_frame:
+    if (stream_id_ == 0)
+      connection_error(protocol_error);
+    else if (length_ != 5)
+      reset_stream(stream_id_, frame_size_error);
+    break;
+  case rst_stream_frame:
+    handle_rst_stream();
+    break;
+  case settings_frame:
+    handle_settings();
+    break;
+  case push_promise_frame:
+    connection_error(protocol_error);
+    break;
+  case ping_frame:
+    handle_ping();
+    break;
+  case goaway_frame:
+    handle_goaway();
+    break;
+  case window_update_frame:
+    handle_window_update();
+    break;
+  case continuation_frame:
+    handle_continuation();
+    break;
+  default:
+    // Unknown frames are ignored.
+    break;
+  }
+}
+
+void h2_connection::handle_data()
+{
+  if (stream_id_ == 0 || received_ + length_ > default_window)
+  {
+    connection_error(stream_id_ == 0 ? protocol_error : flow_control_error);
+    return;
+  }
+
+  // The window of the connection is given back whatever becomes of the stream.
+  received_ += length_;
+  update_window(0, received_);
+
+  stream_map::iterator iter = streams_.find(stream_id_);
+  if (iter == streams_.end() || iter->second.remote_closed)
+  {
+    if (stream_id_ > last_stream_id_)
+      connection_error(protocol_error);
+    else
+      reset_stream(stream_id_, stream_closed);
+    return;
+  }
+
+  stream& s = iter->second;
+  if (s.received + length_ > default_window)
+  {
+    reset_stream(stream_id_, flow_control_error);
+    return;
+  }
+
+  s.received += length_;
+  if (flags_ & end_stream_flag)
+  {
+    s.remote_closed = true;
+    dispatch(s, stream_id_);
+  }
+  else
+  {
+    update_window(stream_id_, s.received);
+  }
+}
+
+void h2_connection::handle_headers()
+{
+  if (stream_id_ == 0 || (stream_id_ & 1) == 0)
+  {
+    connection_error(protocol_error);
+    return;
+  }
+
+  // Strip the padding and the priority.
+  std::size_t offset = 0;
+  std::size_t padding = 0;
+  if (flags_ & padded_flag)
+  {
+    if (payload_.empty())
+    {
+      connection_error(protocol_error);
+      return;
+    }
+
+    padding = static_cast<unsigned char>(payload_[0]);
+    offset = 1;
+  }
+
+  if (flags_ & priority_flag)
+    offset += 5;
+
+  if (offset + padding > payload_.size())
+  {
+    connection_error(protocol_error);
+    return;
+  }
+
+  if (streams_.find(stream_id_) == streams_.end())
+  {
+    // A new stream must have a larger id than those before.
+    if (stream_id_ <= last_stream_id_)
+    {
+      connection_error(stream_closed);
+      return;
+    }
+
+    last_stream_id_ = stream_id_;
+    streams_[stream_id_].send_window = initial_window_;
+  }
+
+  header_block_.assign(payload_, offset, payload_.size() - offset - padding);
+  header_block_id_ = stream_id_;
+  header_block_end_stream_ = (flags_ & end_stream_flag) != 0;
+  if (flags_ & end_headers_flag)
+    end_headers(header_block_id_, header_block_end_stream_);
+}
+
+void h2_connection::handle_continuation()
+{
+  if (header_block_id_ == 0)
+  {
+    connection_error(protocol_error);
+    return;
+  }
+
+  if (header_block_.size() + payload_.size() > HTTP_SERVER_H2_MAX_HEADER_BLOCK)
+  {
+    connection_error(enhance_your_calm);
+    return;
+  }
+
+  header_block_ += payload_;
+  if (flags_ & end_headers_flag)
+    end_headers(header_block_id_, header_block_end_stream_);
+}
+
+void h2_connection::handle_rst_stream()
+{
+  if (length_ != 4)
+  {
+    connection_error(frame_size_error);
+    return;
+  }
+
+  if (stream_id_ == 0 || stream_id_ > last_stream_id_)
+  {
+    connection_error(protocol_error);
+    return;
+  }
+
+  streams_.erase(stream_id_);
+}
+
+void h2_connection::handle_settings()
+{
+  if (stream_id_ != 0)
+  {
+    connection_error(protocol_error);
+    return;
+  }
+
+  if (flags_ & ack_flag)
+  {
+    if (length_ != 0)
+      connection_error(frame_size_error);
+    return;
+  }
+
+  if (length_ % 6 != 0)
+  {
+    connection_error(frame_size_error);
+    return;
+  }
+
+  for (std::size_t i = 0; i < payload_.size(); i += 6)
+  {
+    unsigned int id = (static_cast<unsigned char>(payload_[i]) << 8) | static_cast<unsigned char>(payload_[i + 1]);
+    boost::uint32_t value = get_uint32(payload_.data() + i + 2);
+    switch (id)
+    {
+    case header_table_size:
+      // The table is never larger than the default.
+      encoder_.set_max_table_size((std::min)(value, static_cast<boost::uint32_t>(4096)));
+      break;
+    case enable_push:
+      if (value > 1)
+      {
+        connection_error(protocol_error);
+        return;
+      }
+      break;
+    case initial_window_size:
+      {
+        if (value > max_window)
+        {
+          connection_error(flow_control_error);
+          return;
+        }
+
+        // The change applies to the windows of all streams.
+        boost::int64_t delta = static_cast<boost::int64_t>(value) - initial_window_;
+        initial_window_ = value;
+        for (stream_map::iterator iter = streams_.begin(); iter != streams_.end(); ++iter)
+        {
+          stream& s = iter->second;
+          s.send_window += delta;
+          if (s.send_window > max_window)
+          {
+            connection_error(flow_control_error);
+            return;
+          }
+
+          if (s.blocked && s.send_window > 0)
+          {
+            s.blocked = false;
+            ready_.push_back(iter->first);
+          }
+        }
+      }
+      break;
+    case max_frame_size:
+      if (value < default_frame_size || value > 16777215)
+      {
+        connection_error(protocol_error);
+        return;
+      }
+
+      max_frame_size_ = value;
+      break;
+    default:
+      break;
+    }
+  }
+
+  queue_frame(settings_frame, ack_flag, 0, 0, 0);
+}
+
+void h2_connection::handle_ping()
+{
+  if (length_ != 8)
+  {
+    connection_error(frame_size_error);
+    return;
+  }
+
+  if (stream_id_ != 0)
+  {
+    connection_error(protocol_error);
+    return;
+  }
+
+  if ((flags_ & ack_flag) == 0)
+    queue_frame(ping_frame, ack_flag, 0, payload_.data(), payload_.size());
+}
+
+void h2_connection::handle_goaway()
+{
+  if (stream_id_ != 0)
+  {
+    connection_error(protocol_error);
+    return;
+  }
+
+  // The streams opened are finished, no more are accepted.
+  going_away_ = true;
+}
+
+void h2_connection::handle_window_update()
+{
+  if (length_ != 4)
+  {
+    connection_error(frame_size_error);
+    return;
+  }
+
+  boost::uint32_t increment = get_uint32(payload_.data()) & 0x7fffffff;
+  if (stream_id_ == 0)
+  {
+    if (increment == 0 || send_window_ + increment > max_window)
+    {
+      connection_error(increment == 0 ? protocol_error : flow_control_error);
+      return;
+    }
+
+    send_window_ += increment;
+    return;
+  }
+
+  // The stream may have been finished already.
+  stream_map::iterator iter = streams_.find(stream_id_);
+  if (iter == streams_.end())
+    return;
+
+  stream& s = iter->second;
+  if (increment == 0 || s.send_window + increment > max_window)
+  {
+    reset_stream(stream_id_, increment == 0 ? protocol_error : flow_control_error);
+    return;
+  }
+
+  s.send_window += increment;
+  if (s.blocked && s.send_window > 0)
+  {
+    s.blocked = false;
+    ready_.push_back(stream_id_);
+  }
+}
+
+void h2_connection::end_headers(boost::uint32_t id, bool end_stream)
+{
+  // The block is decoded even for a refused stream, to keep the table in step.
+  //   A list over the advertised size stops the decoder, which is out of step
+  //   with the peer then, so it's a connection error as an invalid block.
+  std::vector<header> fields;
+  const unsigned char* block = reinterpret_cast<const unsigned char*>(header_block_.data());
+  header_block_id_ = 0;
+  if (!decoder_.decode(block, block + header_block_.size(), fields, HTTP_SERVER_H2_MAX_HEADER_LIST))
+  {
+    connection_error(compression_error);
+    return;
+  }
+
+  stream_map::iterator iter = streams_.find(id);
+  if (iter == streams_.end())
+    return;
+
+  stream& s = iter->second;
+  if (s.remote_closed)
+  {
+    reset_stream(id, stream_closed);
+    return;
+  }
+
+  // Trailers are ignored, they must end the stream.
+  if (!s.req.method.empty())
+  {
+    if (!end_stream)
+    {
+      reset_stream(id, protocol_error);
+      return;
+    }
+
+    s.remote_closed = true;
+    dispatch(s, id);
+    return;
+  }
+
+  if (going_away_ || streams_.size() > HTTP_SERVER_H2_MAX_STREAMS)
+  {
+    reset_stream(id, refused_stream);
+    return;
+  }
+
+  // Pseudo-header fields come first, :authority takes the place of Host.
+  bool regular = false;
+  for (std::size_t i = 0; i < fields.size(); ++i)
+  {
+    header& field = fields[i];
+    if (field.name.empty() || field.name[0] != ':')
+    {
+      regular = true;
+      s.req.headers.push_back(field);
+      continue;
+    }
+
+    if (regular)
+    {
+      reset_stream(id, protocol_error);
+      return;
+    }
+
+    if (field.name == ":method")
+    {
+      s.req.method = field.value;
+    }
+    else if (field.name == ":path")
+    {
+      s.req.uri = field.value;
+    }
+    else if (field.name == ":authority")
+    {
+      s.req.headers.push_back(header());
+      s.req.headers.back().name = "host";
+      s.req.headers.back().value = field.value;
+    }
+    else if (field.name != ":scheme")
+    {
+      reset_stream(id, protocol_error);
+      return;
+    }
+  }
+
+  if (s.req.method.empty() || s.req.uri.empty())
+  {
+    reset_stream(id, protocol_error);
+    return;
+  }
+
+  s.req.http_version_major = 2;
+  s.req.http_version_minor = 0;
+  if (end_stream)
+  {
+    s.remote_closed = true;
+    dispatch(s, id);
+  }
+}
+
+void h2_connection::dispatch(stream& s, boost::uint32_t id)
+{
+  // The file is opened in background if files are read there.
+  boost::shared_ptr<pending_reply> pending(new pending_reply);
+  std::swap(pending->req, s.req);
+  if (request_handler_.async_handle_request(pending->req, pending->rep, work_service_,
+      boost::bind(&h2_connection::reply_ready, this, id, pending, writer_)))
+  {
+    s.waiting = true;
+    return;
+  }
+
+  std::swap(s.rep, pending->rep);
+  ready_.push_back(id);
+}
+
+void h2_connection::reply_ready(boost::uint32_t id, const boost::shared_ptr<pending_reply>& pending,
+    const writer_type& /*writer*/)
+{
+  stream_map::iterator iter = streams_.find(id);
+  if (iter == streams_.end())
+    return;
+
+  std::swap(iter->second.rep, pending->rep);
+  resume(iter);
+}
+
+void h2_connection::piece_ready(boost::uint32_t id, const writer_type& /*writer*/)
+{
+  stream_map::iterator iter = streams_.find(id);
+  if (iter != streams_.end())
+    resume(iter);
+}
+
+void h2_connection::resume(stream_map::iterator iter)
+{
+  iter->second.waiting = false;
+  ready_.push_back(iter->first);
+  if (writer_)
+    writer_();
+}
+
+h2_connection::write_result h2_connection::write_stream(stream_map::iterator iter)
+{
+  boost::uint32_t id = iter->first;
+  stream& s = iter->second;
+  if (!s.head_sent)
+  {
+    std::string block;
+    encode_head(s, block);
+    bool end = s.rep.content.empty() && !s.rep.source;
+
+    // A head larger than a frame goes on in CONTINUATION frames.
+    std::size_t n = (std::min)(block.size(), max_frame_size_);
+    append_frame_header(output_, n, headers_frame,
+        (end ? end_stream_flag : 0) | (n == block.size() ? end_headers_flag : 0), id);
+    output_.append(block, 0, n);
+    for (std::size_t offset = n; offset < block.size(); offset += n)
+    {
+      n = (std::min)(block.size() - offset, max_frame_size_);
+      append_frame_header(output_, n, continuation_frame,
+          (offset + n == block.size()) ? end_headers_flag : 0, id);
+      output_.append(block, offset, n);
+    }
+
+    s.head_sent = true;
+    if (end)
+    {
+      streams_.erase(iter);
+      return stream_finished;
+    }
+
+    return stream_continues;
+  }
+
+  // The next piece of a streaming reply is read after the last one is sent,
+  // a piece missing the page cache is read in background first.
+  if (s.offset == s.rep.content.size() && s.rep.source)
+  {
+    if (s.rep.source->async_fill(work_service_,
+        boost::bind(&h2_connection::piece_ready, this, id, writer_)))
+    {
+      s.waiting = true;
+      return stream_waiting;
+    }
+
+    s.rep.content.clear();
+    s.offset = 0;
+    if (!s.rep.source->next(s.rep.content, HTTP_SERVER_CHUNK_SIZE))
+      s.rep.source.reset();
+  }
+
+  std::size_t left = s.rep.content.size() - s.offset;
+  std::size_t n = (std::min)(left, max_frame_size_);
+  if (n != 0)
+  {
+    if (send_window_ <= 0)
+      return connection_blocked;
+
+    if (s.send_window <= 0)
+    {
+      s.blocked = true;
+      return stream_blocked;
+    }
+
+    n = static_cast<std::size_t>((std::min)(static_cast<boost::int64_t>(n), (std::min)(send_window_, s.send_window)));
+  }
+
+  bool end = !s.rep.source && n == left;
+  append_frame_header(output_, n, data_frame, end ? end_stream_flag : 0, id);
+  output_.append(s.rep.content, s.offset, n);
+  s.offset += n;
+  s.send_window -= n;
+  send_window_ -= n;
+
+  if (end)
+  {
+    streams_.erase(iter);
+    return stream_finished;
+  }
+
+  return stream_continues;
+}
+
+void h2_connection::encode_head(stream& s, std::string& block)
+{
+  encoder_.begin(block);
+  encoder_.encode(":status", boost::lexical_cast<std::string>(static_cast<int>(s.rep.status)), block);
+  encode_lines(header_emitter::common_headers(), block);
+  if (s.rep.fixed_headers != 0)
+    encode_lines(*s.rep.fixed_headers, block);
+
+  // Names are lower case in HTTP/2, the headers of HTTP/1 connections are dropped.
+  for (std::size_t i = 0; i < s.rep.headers.size(); ++i)
+  {
+    std::string name = boost::algorithm::to_lower_copy(s.rep.headers[i].name);
+    if (name != "connection" && name != "keep-alive" && name != "transfer-encoding")
+      encoder_.encode(name, s.rep.headers[i].value, block);
+  }
+}
+
+void h2_connection::encode_lines(const std::string& lines, std::string& block)
+{
+  std::size_t begin = 0;
+  while (begin < lines.size())
+  {
+    std::size_t end = lines.find("\r\n", begin);
+    if (end == std::string::npos)
+      end = lines.size();
+
+    std::size_t colon = lines.find(':', begin);
+    if (colon < end)
+    {
+      std::size_t value = lines.find_first_not_of(' ', colon + 1);
+      if (value > end)
+        value = end;
+
+      encoder_.encode(boost::algorithm::to_lower_copy(lines.substr(begin, colon - begin)),
+          lines.substr(value, end - value), block);
+    }
+
+    begin = end + 2;
+  }
+}
+
+void h2_connection::queue_frame(unsigned char type, unsigned char flags, boost::uint32_t id,
+    const char* payload, std::size_t length)
+{
+  append_frame_header(control_, length, type, flags, id);
+  control_.append(payload, length);
+}
+
+void h2_connection::append_frame_header(std::string& out, std::size_t length,
+    unsigned char type, unsigned char flags, boost::uint32_t id)
+{
+  out += static_cast<char>(length >> 16);
+  out += static_cast<char>(length >> 8);
+  out += static_cast<char>(length);
+  out += static_cast<char>(type);
+  out += static_cast<char>(flags);
+  put_uint32(out, id);
+}
+
+void h2_connection::update_window(boost::uint32_t id, std::size_t& received)
+{
+  if (received < default_window / 2)
+    return;
+
+  std::string increment;
+  put_uint32(increment, static_cast<boost::uint32_t>(received));
+  queue_frame(window_update_frame, 0, id, increment.data(), increment.size());
+  received = 0;
+}
+
+void h2_connection::reset_stream(boost::uint32_t id, boost::uint32_t code)
+{
+  std::string payload;
+  put_uint32(payload, code);
+  queue_frame(rst_stream_frame, 0, id, payload.data(), payload.size());
+  streams_.erase(id);
+}
+
+void h2_connection::connection_error(boost::uint32_t code)
+{
+  std::string payload;
+  put_uint32(payload, last_stream_id_);
+  put_uint32(payload, code);
+  queue_frame(goaway_frame, 0, 0, payload.data(), payload.size());
+
+  // The replies not sent are dropped.
+  streams_.clear();
+  ready_.clear();
+  going_away_ = true;
+  state_ = closed_state;
+}
+
+} // namespace server
+} // namespace http
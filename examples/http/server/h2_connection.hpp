@@ -0,0 +1,275 @@
+//
+// h2_connection.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SERVER_H2_CONNECTION_HPP
+#define HTTP_SERVER_H2_CONNECTION_HPP
+
+#include <deque>
+#include <map>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "hpack.hpp"
+#include "reply.hpp"
+#include "request.hpp"
+
+#if !defined(HTTP_SERVER_H2_MAX_STREAMS)
+# define HTTP_SERVER_H2_MAX_STREAMS 100
+#endif
+
+#if !defined(HTTP_SERVER_H2_MAX_HEADER_BLOCK)
+# define HTTP_SERVER_H2_MAX_HEADER_BLOCK 65536
+#endif
+
+/// The decoded size of a header list, advertised as SETTINGS_MAX_HEADER_LIST_SIZE.
+#if !defined(HTTP_SERVER_H2_MAX_HEADER_LIST)
+# define HTTP_SERVER_H2_MAX_HEADER_LIST 65536
+#endif
+
+#if !defined(HTTP_SERVER_H2_WRITE_SIZE)
+# define HTTP_SERVER_H2_WRITE_SIZE 65536
+#endif
+
+namespace http {
+namespace server {
+
+class request_handler;
+
+/// The HTTP/2 protocol of a cleartext connection started with the preface.
+//    Frames are parsed from the bytes received and each request is handed to
+//    the request_handler once its stream is half closed by the client. The
+//    replies are multiplexed into the output by round robin, one DATA frame of
+//    a stream at a time, within the flow control windows of the stream and the
+//    connection. The output is formatted only when the last one is written.
+//    A reply, or a piece of it, produced in background is taken in the work
+//    thread and the writer is called to send it.
+class h2_connection
+  : private boost::noncopyable
+{
+public:
+  /// The function starting the write of the output when the connection is idle.
+  typedef boost::function<void ()> writer_type;
+
+  /// Construct with the handler of requests, the work service of the
+  /// connection and its writer, the server SETTINGS is queued.
+  h2_connection(request_handler& handler, boost::asio::io_service& work_service,
+      const writer_type& writer);
+
+  /// Release the writer, called when the connection is closed.
+  void close();
+
+  /// Process the bytes received after the request line of the preface.
+  void consume(const char* begin, const char* end);
+
+  /// Format the frames to be sent next. Returns false if there's none.
+  bool next_output();
+
+  /// Get the output formatted by next_output.
+  const std::string& output() const
+  {
+    return output_;
+  }
+
+  /// Check whether the connection is to be closed after the output is sent.
+  bool closing() const;
+
+private:
+  /// A stream opened by the client.
+  struct stream
+  {
+    stream();
+
+    /// The request received.
+    request req;
+
+    /// The reply to be sent.
+    reply rep;
+
+    /// The offset of the content to be sent next.
+    std::size_t offset;
+
+    /// The flow control window for sending.
+    boost::int64_t send_window;
+
+    /// The bytes received and not yet given back by WINDOW_UPDATE.
+    std::size_t received;
+
+    /// Whether the client has half closed the stream.
+    bool remote_closed;
+
+    /// Whether the reply head has been sent.
+    bool head_sent;
+
+    /// Whether the stream waits for its window.
+    bool blocked;
+
+    /// Whether the reply or its next piece is produced in background.
+    bool waiting;
+  };
+
+  /// A request of which the reply is produced in background, kept apart from
+  /// the stream so a reset of the stream meanwhile leaves both intact.
+  struct pending_reply
+  {
+    request req;
+    reply rep;
+  };
+
+  typedef std::map<boost::uint32_t, stream> stream_map;
+
+  /// The states of the input.
+  enum input_state
+  {
+    preface_state,
+    header_state,
+    payload_state,
+    closed_state
+  };
+
+  /// Handle a frame received, the payload is complete unless it's DATA.
+  void handle_frame();
+  void handle_data();
+  void handle_headers();
+  void handle_continuation();
+  void handle_rst_stream();
+  void handle_settings();
+  void handle_ping();
+  void handle_goaway();
+  void handle_window_update();
+
+  /// Decode the header block of the stream.
+  void end_headers(boost::uint32_t id, bool end_stream);
+
+  /// Produce the reply of a request received.
+  void dispatch(stream& s, boost::uint32_t id);
+
+  /// Take the reply produced in background, the writer bound keeps the
+  /// connection alive until then.
+  void reply_ready(boost::uint32_t id, const boost::shared_ptr<pending_reply>& pending,
+      const writer_type& writer);
+
+  /// Resume the stream of which the next piece has been read in background.
+  void piece_ready(boost::uint32_t id, const writer_type& writer);
+
+  /// Queue the stream waiting in background and start writing if idle.
+  void resume(stream_map::iterator iter);
+
+  /// Result of writing a stream.
+  enum write_result
+  {
+    stream_finished,
+    stream_continues,
+    stream_blocked,
+    stream_waiting,
+    connection_blocked
+  };
+
+  /// Append the head or the next DATA frame of the stream to the output.
+  write_result write_stream(stream_map::iterator iter);
+
+  /// Encode the reply head of the stream.
+  void encode_head(stream& s, std::string& block);
+
+  /// Encode the headers preformatted as "Name: value\r\n" lines.
+  void encode_lines(const std::string& lines, std::string& block);
+
+  /// Queue a frame to be sent before the streams.
+  void queue_frame(unsigned char type, unsigned char flags, boost::uint32_t id,
+      const char* payload, std::size_t length);
+
+  /// Append a frame header to the string.
+  static void append_frame_header(std::string& out, std::size_t length,
+      unsigned char type, unsigned char flags, boost::uint32_t id);
+
+  /// Give back the window of the bytes received when half of it is used.
+  void update_window(boost::uint32_t id, std::size_t& received);
+
+  /// Reset a stream with the error code.
+  void reset_stream(boost::uint32_t id, boost::uint32_t code);
+
+  /// Send GOAWAY with the error code and stop reading.
+  void connection_error(boost::uint32_t code);
+
+  /// The handler of requests.
+  request_handler& request_handler_;
+
+  /// The work service of the connection.
+  boost::asio::io_service& work_service_;
+
+  /// The writer of the connection, empty after close.
+  writer_type writer_;
+
+  /// The decoder of the header blocks received.
+  hpack_decoder decoder_;
+
+  /// The encoder of the header blocks sent.
+  hpack_encoder encoder_;
+
+  /// The state of the input.
+  input_state state_;
+
+  /// The bytes of the preface or frame header received.
+  std::string header_;
+
+  /// The payload of the frame received, not kept for DATA.
+  std::string payload_;
+
+  /// The length of the payload still to be received.
+  std::size_t payload_left_;
+
+  /// The fields of the frame being received.
+  std::size_t length_;
+  unsigned char type_;
+  unsigned char flags_;
+  boost::uint32_t stream_id_;
+
+  /// The header block being received and its stream, 0 if none.
+  std::string header_block_;
+  boost::uint32_t header_block_id_;
+  bool header_block_end_stream_;
+
+  /// The open streams.
+  stream_map streams_;
+
+  /// The streams with reply to send in round robin order.
+  std::deque<boost::uint32_t> ready_;
+
+  /// The largest stream id received.
+  boost::uint32_t last_stream_id_;
+
+  /// The flow control window of the connection for sending.
+  boost::int64_t send_window_;
+
+  /// The bytes received by the connection and not yet given back.
+  std::size_t received_;
+
+  /// The initial window of streams for sending set by the client.
+  boost::int64_t initial_window_;
+
+  /// The largest DATA frame the client accepts.
+  std::size_t max_frame_size_;
+
+  /// The frames queued before the streams.
+  std::string control_;
+
+  /// The output being sent.
+  std::string output_;
+
+  /// Whether GOAWAY has been received or sent.
+  bool going_away_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_H2_CONNECTION_HPP
@@ -0,0 +1,76 @@
+//
+// header_emitter.cpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "header_emitter.hpp"
+#include <boost/thread/tss.hpp>
+
+namespace http {
+namespace server {
+namespace header_emitter {
+
+namespace {
+
+/// The common headers of a thread and the second they are formatted for.
+struct common_block
+{
+  std::time_t second;
+  std::string text;
+};
+
+boost::thread_specific_ptr<common_block> thread_block;
+
+} // namespace
+
+std::string http_date(std::time_t t)
+{
+  std::tm tm;
+#if defined(_WIN32)
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+
+  char buf[64];
+  std::size_t n = std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return std::string(buf, n);
+}
+
+const std::string& common_headers()
+{
+  common_block* block = thread_block.get();
+  if (block == 0)
+  {
+    block = new common_block;
+    block->second = static_cast<std::time_t>(-1);
+    thread_block.reset(block);
+  }
+
+  std::time_t now = std::time(0);
+  if (now != block->second)
+  {
+    block->second = now;
+    block->text = "Date: " + http_date(now) + "\r\nServer: " HTTP_SERVER_NAME "\r\n";
+  }
+
+  return block->text;
+}
+
+std::string join(const std::vector<header>& headers)
+{
+  std::string text;
+  for (std::size_t i = 0; i < headers.size(); ++i)
+    text.append(headers[i].name).append(": ").append(headers[i].value).append("\r\n");
+
+  return text;
+}
+
+} // namespace header_emitter
+} // namespace server
+} // namespace http
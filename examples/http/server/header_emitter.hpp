@@ -0,0 +1,41 @@
+//
+// header_emitter.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SERVER_HEADER_EMITTER_HPP
+#define HTTP_SERVER_HEADER_EMITTER_HPP
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include "header.hpp"
+
+#if !defined(HTTP_SERVER_NAME)
+# define HTTP_SERVER_NAME "bas"
+#endif
+
+namespace http {
+namespace server {
+namespace header_emitter {
+
+/// Format a time as HTTP date.
+std::string http_date(std::time_t t);
+
+/// Get the preformatted "Date" and "Server" headers of the calling thread,
+/// the block is formatted again at most once a second.
+const std::string& common_headers();
+
+/// Join headers into one preformatted block.
+std::string join(const std::vector<header>& headers);
+
+} // namespace header_emitter
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_HEADER_EMITTER_HPP
@@ -0,0 +1,571 @@
+//
+// hpack.cpp
+// ~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "hpack.hpp"
+#include <boost/cstdint.hpp>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// An entry of the static table.
+struct static_entry
+{
+  const char* name;
+  const char* value;
+};
+
+/// The static table defined by RFC 7541 Appendix A.
+const static_entry static_entries[] =
+{
+  { ":authority", "" },
+  { ":method", "GET" },
+  { ":method", "POST" },
+  { ":path", "/" },
+  { ":path", "/index.html" },
+  { ":scheme", "http" },
+  { ":scheme", "https" },
+  { ":status", "200" },
+  { ":status", "204" },
+  { ":status", "206" },
+  { ":status", "304" },
+  { ":status", "400" },
+  { ":status", "404" },
+  { ":status", "500" },
+  { "accept-charset", "" },
+  { "accept-encoding", "gzip, deflate" },
+  { "accept-language", "" },
+  { "accept-ranges", "" },
+  { "accept", "" },
+  { "access-control-allow-origin", "" },
+  { "age", "" },
+  { "allow", "" },
+  { "authorization", "" },
+  { "cache-control", "" },
+  { "content-disposition", "" },
+  { "content-encoding", "" },
+  { "content-language", "" },
+  { "content-length", "" },
+  { "content-location", "" },
+  { "content-range", "" },
+  { "content-type", "" },
+  { "cookie", "" },
+  { "date", "" },
+  { "etag", "" },
+  { "expect", "" },
+  { "expires", "" },
+  { "from", "" },
+  { "host", "" },
+  { "if-match", "" },
+  { "if-modified-since", "" },
+  { "if-none-match", "" },
+  { "if-range", "" },
+  { "if-unmodified-since", "" },
+  { "last-modified", "" },
+  { "link", "" },
+  { "location", "" },
+  { "max-forwards", "" },
+  { "proxy-authenticate", "" },
+  { "proxy-authorization", "" },
+  { "range", "" },
+  { "referer", "" },
+  { "refresh", "" },
+  { "retry-after", "" },
+  { "server", "" },
+  { "set-cookie", "" },
+  { "strict-transport-security", "" },
+  { "transfer-encoding", "" },
+  { "user-agent", "" },
+  { "vary", "" },
+  { "via", "" },
+  { "www-authenticate", "" }
+};
+
+const std::size_t static_size = sizeof(static_entries) / sizeof(static_entries[0]);
+
+/// A code of the Huffman table.
+struct huffman_code
+{
+  boost::uint32_t code;
+  unsigned char bits;
+};
+
+/// The Huffman codes defined by RFC 7541 Appendix B, the last one is EOS.
+const huffman_code huffman_codes[] =
+{
+  { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+  { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+  { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+  { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+  { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+  { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+  { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+  { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+  { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+  { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+  { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 },
+  { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+  { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 },
+  { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+  { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+  { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+  { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+  { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+  { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 },
+  { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+  { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+  { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+  { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 },
+  { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+  { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+  { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+  { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+  { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+  { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+  { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+  { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 },
+  { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+  { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+  { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+  { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+  { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+  { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+  { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+  { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+  { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+  { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 },
+  { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+  { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+  { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+  { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+  { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+  { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 },
+  { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+  { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+  { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+  { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+  { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+  { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 },
+  { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+  { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+  { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+  { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+  { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+  { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 },
+  { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+  { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+  { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+  { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+  { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+  { 0x3fffffff, 30 }
+};
+
+/// A node of the Huffman decoding tree. A child is the index of a node if
+/// positive, or the symbol plus one negated if negative, 0 if absent.
+struct huffman_node
+{
+  short next[2];
+};
+
+/// The tables built once at startup.
+class static_tables
+{
+public:
+  static_tables()
+    : headers(static_size),
+      nodes(1)
+  {
+    for (std::size_t i = 0; i < static_size; ++i)
+    {
+      headers[i].name = static_entries[i].name;
+      headers[i].value = static_entries[i].value;
+    }
+
+    huffman_node empty = { { 0, 0 } };
+    nodes[0] = empty;
+    for (std::size_t symbol = 0; symbol < sizeof(huffman_codes) / sizeof(huffman_codes[0]); ++symbol)
+    {
+      std::size_t node = 0;
+      for (int i = huffman_codes[symbol].bits - 1; i > 0; --i)
+      {
+        int bit = (huffman_codes[symbol].code >> i) & 1;
+        if (nodes[node].next[bit] == 0)
+        {
+          nodes[node].next[bit] = static_cast<short>(nodes.size());
+          nodes.push_back(empty);
+        }
+
+        node = nodes[node].next[bit];
+      }
+
+      nodes[node].next[huffman_codes[symbol].code & 1] = static_cast<short>(-1 - static_cast<int>(symbol));
+    }
+  }
+
+  /// The static table.
+  std::vector<header> headers;
+
+  /// The Huffman decoding tree, the root first.
+  std::vector<huffman_node> nodes;
+};
+
+const static_tables tables;
+
+/// Size of an entry as defined by HPACK.
+std::size_t entry_size(const std::string& name, const std::string& value)
+{
+  return name.size() + value.size() + 32;
+}
+
+bool decode_integer(const unsigned char*& p, const unsigned char* end,
+    unsigned int prefix_bits, std::size_t& value)
+{
+  if (p == end)
+    return false;
+
+  std::size_t mask = (1u << prefix_bits) - 1;
+  value = *p++ & mask;
+  if (value < mask)
+    return true;
+
+  // Values over 2^28 are refused, no field is that large.
+  for (unsigned int shift = 0; shift <= 21; shift += 7)
+  {
+    if (p == end)
+      return false;
+
+    unsigned char c = *p++;
+    value += static_cast<std::size_t>(c & 0x7f) << shift;
+    if ((c & 0x80) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+bool huffman_decode(const unsigned char* p, std::size_t length, std::string& out)
+{
+  // The padding is the most significant bits of EOS, up to 7 bits all 1.
+  std::size_t node = 0;
+  std::size_t depth = 0;
+  bool ones = true;
+  for (const unsigned char* end = p + length; p != end; ++p)
+  {
+    for (int i = 7; i >= 0; --i)
+    {
+      int bit = (*p >> i) & 1;
+      int next = tables.nodes[node].next[bit];
+      if (next < 0)
+      {
+        // EOS in a string is an error.
+        if (next == -257)
+          return false;
+
+        out += static_cast<char>(-1 - next);
+        node = 0;
+        depth = 0;
+        ones = true;
+      }
+      else
+      {
+        node = next;
+        ++depth;
+        ones = ones && bit == 1;
+      }
+    }
+  }
+
+  return depth <= 7 && ones;
+}
+
+bool decode_string(const unsigned char*& p, const unsigned char* end, std::string& out)
+{
+  if (p == end)
+    return false;
+
+  bool huffman = (*p & 0x80) != 0;
+  std::size_t length = 0;
+  if (!decode_integer(p, end, 7, length) || length > static_cast<std::size_t>(end - p))
+    return false;
+
+  out.clear();
+  if (huffman)
+  {
+    if (!huffman_decode(p, length, out))
+      return false;
+  }
+  else
+  {
+    out.assign(reinterpret_cast<const char*>(p), length);
+  }
+
+  p += length;
+  return true;
+}
+
+void encode_integer(std::size_t value, unsigned int prefix_bits, unsigned char first, std::string& out)
+{
+  std::size_t mask = (1u << prefix_bits) - 1;
+  if (value < mask)
+  {
+    out += static_cast<char>(first | value);
+    return;
+  }
+
+  out += static_cast<char>(first | mask);
+  for (value -= mask; value >= 128; value >>= 7)
+    out += static_cast<char>((value & 0x7f) | 0x80);
+  out += static_cast<char>(value);
+}
+
+void encode_string(const std::string& in, std::string& out)
+{
+  encode_integer(in.size(), 7, 0, out);
+  out += in;
+}
+
+} // namespace
+
+hpack_table::hpack_table(std::size_t max_size)
+  : entries_(),
+    size_(0),
+    max_size_(max_size)
+{
+}
+
+std::size_t hpack_table::max_size() const
+{
+  return max_size_;
+}
+
+void hpack_table::set_max_size(std::size_t max_size)
+{
+  max_size_ = max_size;
+  evict(max_size_);
+}
+
+const header* hpack_table::get(std::size_t index) const
+{
+  if (index == 0)
+    return 0;
+
+  if (index <= static_size)
+    return &tables.headers[index - 1];
+
+  index -= static_size + 1;
+  return (index < entries_.size()) ? &entries_[index] : 0;
+}
+
+std::size_t hpack_table::find(const std::string& name, const std::string& value, bool& value_matched) const
+{
+  std::size_t name_index = 0;
+  value_matched = false;
+  for (std::size_t i = 0; i < static_size; ++i)
+  {
+    if (tables.headers[i].name == name)
+    {
+      if (tables.headers[i].value == value)
+      {
+        value_matched = true;
+        return i + 1;
+      }
+
+      if (name_index == 0)
+        name_index = i + 1;
+    }
+  }
+
+  for (std::size_t i = 0; i < entries_.size(); ++i)
+  {
+    if (entries_[i].name == name)
+    {
+      if (entries_[i].value == value)
+      {
+        value_matched = true;
+        return static_size + i + 1;
+      }
+
+      if (name_index == 0)
+        name_index = static_size + i + 1;
+    }
+  }
+
+  return name_index;
+}
+
+void hpack_table::add(const std::string& name, const std::string& value)
+{
+  // An entry larger than the table empties it.
+  std::size_t size = entry_size(name, value);
+  if (size > max_size_)
+  {
+    evict(0);
+    return;
+  }
+
+  evict(max_size_ - size);
+  entries_.push_front(header());
+  entries_.front().name = name;
+  entries_.front().value = value;
+  size_ += size;
+}
+
+void hpack_table::evict(std::size_t limit)
+{
+  while (size_ > limit && !entries_.empty())
+  {
+    size_ -= entry_size(entries_.back().name, entries_.back().value);
+    entries_.pop_back();
+  }
+}
+
+hpack_decoder::hpack_decoder(std::size_t max_table_size)
+  : table_(max_table_size),
+    max_table_size_(max_table_size)
+{
+}
+
+bool hpack_decoder::decode(const unsigned char* begin, const unsigned char* end, std::vector<header>& headers,
+    std::size_t max_list_size)
+{
+  // A short field may copy a large table entry, the decoded size is limited
+  // apart from the size of the block.
+  std::size_t list_size = 0;
+
+  // Table size updates are allowed at the beginning of a block only.
+  bool update_allowed = true;
+  const unsigned char* p = begin;
+  while (p != end)
+  {
+    std::size_t index = 0;
+    if ((*p & 0x80) != 0)
+    {
+      // Indexed field.
+      if (!decode_integer(p, end, 7, index))
+        return false;
+
+      const header* h = table_.get(index);
+      if (h == 0)
+        return false;
+
+      list_size += entry_size(h->name, h->value);
+      if (list_size > max_list_size)
+        return false;
+
+      headers.push_back(*h);
+    }
+    else if ((*p & 0xe0) == 0x20)
+    {
+      // Dynamic table size update.
+      std::size_t size = 0;
+      if (!update_allowed || !decode_integer(p, end, 5, size) || size > max_table_size_)
+        return false;
+
+      table_.set_max_size(size);
+      continue;
+    }
+    else
+    {
+      // Literal field with incremental indexing, without indexing or never
+      // indexed, the name is indexed or literal.
+      bool indexing = (*p & 0x40) != 0;
+      if (!decode_integer(p, end, indexing ? 6 : 4, index))
+        return false;
+
+      header h;
+      if (index != 0)
+      {
+        const header* n = table_.get(index);
+        if (n == 0)
+          return false;
+
+        h.name = n->name;
+      }
+      else if (!decode_string(p, end, h.name))
+      {
+        return false;
+      }
+
+      if (!decode_string(p, end, h.value))
+        return false;
+
+      list_size += entry_size(h.name, h.value);
+      if (list_size > max_list_size)
+        return false;
+
+      if (indexing)
+        table_.add(h.name, h.value);
+
+      headers.push_back(h);
+    }
+
+    update_allowed = false;
+  }
+
+  return true;
+}
+
+hpack_encoder::hpack_encoder(std::size_t max_table_size)
+  : table_(max_table_size),
+    pending_size_(std::string::npos)
+{
+}
+
+void hpack_encoder::set_max_table_size(std::size_t max_table_size)
+{
+  // The smallest size since the last block is sent, the entries evicted by
+  // it are gone for the decoder as well.
+  if (pending_size_ == std::string::npos || max_table_size < pending_size_)
+    pending_size_ = max_table_size;
+
+  table_.set_max_size(max_table_size);
+}
+
+void hpack_encoder::begin(std::string& block)
+{
+  if (pending_size_ == std::string::npos)
+    return;
+
+  encode_integer(pending_size_, 5, 0x20, block);
+  if (table_.max_size() != pending_size_)
+    encode_integer(table_.max_size(), 5, 0x20, block);
+
+  pending_size_ = std::string::npos;
+}
+
+void hpack_encoder::encode(const std::string& name, const std::string& value, std::string& block)
+{
+  bool value_matched = false;
+  std::size_t index = table_.find(name, value, value_matched);
+  if (value_matched)
+  {
+    encode_integer(index, 7, 0x80, block);
+    return;
+  }
+
+  // Values changing on every reply would only evict the useful entries.
+  bool indexing = name != "content-length" && name != "content-range"
+      && name != "etag" && name != "last-modified";
+  if (indexing)
+    encode_integer(index, 6, 0x40, block);
+  else
+    encode_integer(index, 4, 0x00, block);
+
+  if (index == 0)
+    encode_string(name, block);
+  encode_string(value, block);
+
+  if (indexing)
+    table_.add(name, value);
+}
+
+} // namespace server
+} // namespace http
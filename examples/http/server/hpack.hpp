@@ -0,0 +1,111 @@
+//
+// hpack.hpp
+// ~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SERVER_HPACK_HPP
+#define HTTP_SERVER_HPACK_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "header.hpp"
+
+namespace http {
+namespace server {
+
+/// The header table of HPACK, the static entries followed by the dynamic ones.
+class hpack_table
+{
+public:
+  /// Construct with the maximum size of the dynamic entries.
+  explicit hpack_table(std::size_t max_size);
+
+  /// Get the maximum size of the dynamic entries.
+  std::size_t max_size() const;
+
+  /// Change the maximum size, the oldest entries over it are evicted.
+  void set_max_size(std::size_t max_size);
+
+  /// Get the entry of the index starting from 1, null if out of range.
+  const header* get(std::size_t index) const;
+
+  /// Find the index of the field, or of its name only if the value is not
+  /// matched. Returns 0 if not found.
+  std::size_t find(const std::string& name, const std::string& value, bool& value_matched) const;
+
+  /// Add a dynamic entry, the oldest entries are evicted to make room.
+  void add(const std::string& name, const std::string& value);
+
+private:
+  /// Evict the oldest entries until the size is no more than the limit.
+  void evict(std::size_t limit);
+
+  /// The dynamic entries, newest first.
+  std::deque<header> entries_;
+
+  /// The size of the dynamic entries as defined by HPACK.
+  std::size_t size_;
+
+  /// The maximum size of the dynamic entries.
+  std::size_t max_size_;
+};
+
+/// Decoder of HPACK header blocks.
+class hpack_decoder
+{
+public:
+  /// Construct with the maximum table size allowed to the encoder.
+  explicit hpack_decoder(std::size_t max_table_size = 4096);
+
+  /// Decode a header block. Returns false if the block is invalid, or the
+  /// decoded list is larger than max_list_size, counted as HTTP/2 does by
+  /// name and value sizes plus 32 per field. The decoder can't be used
+  /// anymore then.
+  bool decode(const unsigned char* begin, const unsigned char* end, std::vector<header>& headers,
+      std::size_t max_list_size);
+
+private:
+  /// The header table.
+  hpack_table table_;
+
+  /// The maximum table size allowed to the encoder.
+  std::size_t max_table_size_;
+};
+
+/// Encoder of HPACK header blocks. Strings are sent without Huffman coding.
+class hpack_encoder
+{
+public:
+  /// Construct with the maximum table size allowed by the decoder.
+  explicit hpack_encoder(std::size_t max_table_size = 4096);
+
+  /// Change the maximum table size allowed by the decoder, the change is
+  /// sent at the beginning of the next block.
+  void set_max_table_size(std::size_t max_table_size);
+
+  /// Start a header block.
+  void begin(std::string& block);
+
+  /// Append a header field to the block, the name must be lower case.
+  /// Fields with values changing on every reply are not indexed.
+  void encode(const std::string& name, const std::string& value, std::string& block);
+
+private:
+  /// The header table.
+  hpack_table table_;
+
+  /// The table size to be sent at the beginning of the next block, or
+  /// npos if unchanged.
+  std::size_t pending_size_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_HPACK_HPP
@@ -20,11 +20,17 @@ struct mapping
   const char* mime_type;
 } mappings[] =
 {
+  { "css", "text/css" },
   { "gif", "image/gif" },
   { "htm", "text/html" },
   { "html", "text/html" },
   { "jpg", "image/jpeg" },
+  { "js", "application/javascript" },
+  { "json", "application/json" },
   { "png", "image/png" },
+  { "svg", "image/svg+xml" },
+  { "txt", "text/plain" },
+  { "xml", "application/xml" },
   { 0, 0 } // Marks end of list.
 };
 
@@ -41,6 +47,15 @@ std::string extension_to_type(const std::string& extension)
   return "text/plain";
 }
 
+bool is_compressible(const std::string& mime_type)
+{
+  return mime_type.compare(0, 5, "text/") == 0
+      || mime_type == "application/javascript"
+      || mime_type == "application/json"
+      || mime_type == "application/xml"
+      || mime_type == "image/svg+xml";
+}
+
 } // namespace mime_types
 } // namespace server
 } // namespace http
@@ -20,6 +20,9 @@ namespace mime_types {
 /// Convert a file extension into a MIME type.
 std::string extension_to_type(const std::string& extension);
 
+/// Check whether content of the MIME type is worth compressing.
+bool is_compressible(const std::string& mime_type);
+
 } // namespace mime_types
 } // namespace server
 } // namespace http
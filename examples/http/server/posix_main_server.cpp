@@ -31,9 +31,9 @@ int main(int argc, char* argv[])
   try
   {
     // Check command line arguments.
-    if (argc != 11)
+    if (argc < 11 || argc > 14)
     {
-      std::cerr << "Usage: http_server <ip> <port> <io_pool> <work_init> <work_high> <thread_load> <accept_queue> <pre_handler> <session_timeout> <doc_root>\n";
+      std::cerr << "Usage: http_server <ip> <port> <io_pool> <work_init> <work_high> <thread_load> <accept_queue> <pre_handler> <session_timeout> <doc_root> [compress_threads] [read_threads] [list_directories]\n";
       std::cerr << "  For IPv4, try:\n";
       std::cerr << "    http_server 0.0.0.0 80 4 4 16 100 250 500 0 .\n";
       std::cerr << "  For IPv6, try:\n";
@@ -50,11 +50,14 @@ int main(int argc, char* argv[])
     std::size_t accept_queue_length = boost::lexical_cast<std::size_t>(argv[7]);
     std::size_t preallocated_handler_number = boost::lexical_cast<std::size_t>(argv[8]);
     std::size_t session_timeout = boost::lexical_cast<std::size_t>(argv[9]);
+    std::size_t compress_threads = (argc > 11) ? boost::lexical_cast<std::size_t>(argv[11]) : 0;
+    std::size_t read_threads = (argc > 12) ? boost::lexical_cast<std::size_t>(argv[12]) : 0;
+    bool list_directories = (argc > 13) && boost::lexical_cast<int>(argv[13]) != 0;
 
     typedef bas::server<http::server::server_work, http::server::server_work_allocator> server;
     typedef bas::service_handler_pool<http::server::server_work, http::server::server_work_allocator> server_handler_pool;
 
-    server s(new server_handler_pool(new http::server::server_work_allocator(argv[10]),
+    server s(new server_handler_pool(new http::server::server_work_allocator(argv[10], compress_threads, read_threads, list_directories),
                 preallocated_handler_number,
                 8192,
                 0,
@@ -9,6 +9,7 @@
 //
 
 #include "reply.hpp"
+#include "header_emitter.hpp"
 #include <string>
 #include <boost/lexical_cast.hpp>
 #include <boost/asio.hpp>
@@ -19,6 +20,9 @@ namespace server {
 
 namespace status_strings {
 
+// Protocol switching is defined by HTTP/1.1 only.
+const std::string switching_protocols =
+  "HTTP/1.1 101 Switching Protocols\r\n";
 const std::string ok =
   "HTTP/1.0 200 OK\r\n";
 const std::string created =
@@ -27,6 +31,8 @@ const std::string accepted =
   "HTTP/1.0 202 Accepted\r\n";
 const std::string no_content =
   "HTTP/1.0 204 No Content\r\n";
+const std::string partial_content =
+  "HTTP/1.0 206 Partial Content\r\n";
 const std::string multiple_choices =
   "HTTP/1.0 300 Multiple Choices\r\n";
 const std::string moved_permanently =
@@ -43,6 +49,8 @@ const std::string forbidden =
   "HTTP/1.0 403 Forbidden\r\n";
 const std::string not_found =
   "HTTP/1.0 404 Not Found\r\n";
+const std::string requested_range_not_satisfiable =
+  "HTTP/1.0 416 Requested Range Not Satisfiable\r\n";
 const std::string internal_server_error =
   "HTTP/1.0 500 Internal Server Error\r\n";
 const std::string not_implemented =
@@ -52,44 +60,50 @@ const std::string bad_gateway =
 const std::string service_unavailable =
   "HTTP/1.0 503 Service Unavailable\r\n";
 
-boost::asio::const_buffer to_buffer(reply::status_type status)
+const std::string& to_string(reply::status_type status)
 {
   switch (status)
   {
+  case reply::switching_protocols:
+    return switching_protocols;
   case reply::ok:
-    return boost::asio::buffer(ok);
+    return ok;
   case reply::created:
-    return boost::asio::buffer(created);
+    return created;
   case reply::accepted:
-    return boost::asio::buffer(accepted);
+    return accepted;
   case reply::no_content:
-    return boost::asio::buffer(no_content);
+    return no_content;
+  case reply::partial_content:
+    return partial_content;
   case reply::multiple_choices:
-    return boost::asio::buffer(multiple_choices);
+    return multiple_choices;
   case reply::moved_permanently:
-    return boost::asio::buffer(moved_permanently);
+    return moved_permanently;
   case reply::moved_temporarily:
-    return boost::asio::buffer(moved_temporarily);
+    return moved_temporarily;
   case reply::not_modified:
-    return boost::asio::buffer(not_modified);
+    return not_modified;
   case reply::bad_request:
-    return boost::asio::buffer(bad_request);
+    return bad_request;
   case reply::unauthorized:
-    return boost::asio::buffer(unauthorized);
+    return unauthorized;
   case reply::forbidden:
-    return boost::asio::buffer(forbidden);
+    return forbidden;
   case reply::not_found:
-    return boost::asio::buffer(not_found);
+    return not_found;
+  case reply::requested_range_not_satisfiable:
+    return requested_range_not_satisfiable;
   case reply::internal_server_error:
-    return boost::asio::buffer(internal_server_error);
+    return internal_server_error;
   case reply::not_implemented:
-    return boost::asio::buffer(not_implemented);
+    return not_implemented;
   case reply::bad_gateway:
-    return boost::asio::buffer(bad_gateway);
+    return bad_gateway;
   case reply::service_unavailable:
-    return boost::asio::buffer(service_unavailable);
+    return service_unavailable;
   default:
-    return boost::asio::buffer(internal_server_error);
+    return internal_server_error;
   }
 }
 
@@ -99,27 +113,113 @@ namespace misc_strings {
 
 const char name_value_separator[] = { ':', ' ' };
 const char crlf[] = { '\r', '\n' };
+const char last_chunk[] = { '0', '\r', '\n', '\r', '\n' };
+const char chunked_headers[] = "Transfer-Encoding: chunked\r\nConnection: close\r\n";
 
 } // namespace misc_strings
 
-std::vector<boost::asio::const_buffer> reply::to_buffers()
+reply::reply()
+  : status(ok),
+    headers(),
+    content(),
+    fixed_headers(0),
+    source(),
+    chunked(false),
+    head(),
+    chunk_head()
 {
-  std::vector<boost::asio::const_buffer> buffers;
-  buffers.push_back(status_strings::to_buffer(status));
+}
+
+std::vector<boost::asio::const_buffer> reply::to_buffers(bool chunked_allowed)
+{
+  chunked = false;
+  if (source && chunked_allowed)
+  {
+    chunked = true;
+    for (std::size_t i = 0; i < headers.size(); ++i)
+      if (headers[i].name == "Content-Length")
+        chunked = false;
+  }
+
+  // Format the head into one block, the capacity is kept between replies.
+  head.clear();
+  head.append(status_strings::to_string(status));
+  head.append(header_emitter::common_headers());
+
+  // The chunked coding is defined by HTTP/1.1 only.
+  if (chunked)
+  {
+    head[7] = '1';
+    head.append(misc_strings::chunked_headers, sizeof(misc_strings::chunked_headers) - 1);
+  }
+  if (fixed_headers != 0)
+    head.append(*fixed_headers);
   for (std::size_t i = 0; i < headers.size(); ++i)
   {
     header& h = headers[i];
-    buffers.push_back(boost::asio::buffer(h.name));
-    buffers.push_back(boost::asio::buffer(misc_strings::name_value_separator));
-    buffers.push_back(boost::asio::buffer(h.value));
-    buffers.push_back(boost::asio::buffer(misc_strings::crlf));
+    head.append(h.name);
+    head.append(misc_strings::name_value_separator, sizeof(misc_strings::name_value_separator));
+    head.append(h.value);
+    head.append(misc_strings::crlf, sizeof(misc_strings::crlf));
   }
-  buffers.push_back(boost::asio::buffer(misc_strings::crlf));
-  buffers.push_back(boost::asio::buffer(content));
+  head.append(misc_strings::crlf, sizeof(misc_strings::crlf));
+
+  std::vector<boost::asio::const_buffer> buffers;
+  buffers.reserve(4);
+  buffers.push_back(boost::asio::buffer(head));
+  if (source)
+    append_piece(buffers);
+  else if (!content.empty())
+    buffers.push_back(boost::asio::buffer(content));
 
   return buffers;
 }
 
+std::vector<boost::asio::const_buffer> reply::next_buffers()
+{
+  std::vector<boost::asio::const_buffer> buffers;
+  if (source)
+  {
+    buffers.reserve(4);
+    append_piece(buffers);
+  }
+
+  return buffers;
+}
+
+void reply::append_piece(std::vector<boost::asio::const_buffer>& buffers)
+{
+  // The piece replaces the one written, so only one is kept in memory.
+  content.clear();
+  bool more = source->next(content, HTTP_SERVER_CHUNK_SIZE);
+  if (!more)
+    source.reset();
+
+  if (!chunked)
+  {
+    if (!content.empty())
+      buffers.push_back(boost::asio::buffer(content));
+    return;
+  }
+
+  if (!content.empty())
+  {
+    static const char digits[] = "0123456789abcdef";
+    chunk_head.clear();
+    for (std::size_t n = content.size(); n != 0; n >>= 4)
+      chunk_head.insert(chunk_head.begin(), digits[n & 0xf]);
+    chunk_head.append(misc_strings::crlf, sizeof(misc_strings::crlf));
+
+    buffers.push_back(boost::asio::buffer(chunk_head));
+    buffers.push_back(boost::asio::buffer(content));
+    buffers.push_back(boost::asio::buffer(misc_strings::crlf));
+  }
+
+  // The last chunk is sent with the final piece.
+  if (!more)
+    buffers.push_back(boost::asio::buffer(misc_strings::last_chunk));
+}
+
 namespace stock_replies {
 
 const char ok[] = "";
@@ -138,6 +238,7 @@ const char no_content[] =
   "<head><title>No Content</title></head>"
   "<body><h1>204 Content</h1></body>"
   "</html>";
+const char partial_content[] = "";
 const char multiple_choices[] =
   "<html>"
   "<head><title>Multiple Choices</title></head>"
@@ -178,6 +279,11 @@ const char not_found[] =
   "<head><title>Not Found</title></head>"
   "<body><h1>404 Not Found</h1></body>"
   "</html>";
+const char requested_range_not_satisfiable[] =
+  "<html>"
+  "<head><title>Requested Range Not Satisfiable</title></head>"
+  "<body><h1>416 Requested Range Not Satisfiable</h1></body>"
+  "</html>";
 const char internal_server_error[] =
   "<html>"
   "<head><title>Internal Server Error</title></head>"
@@ -211,6 +317,8 @@ std::string to_string(reply::status_type status)
     return accepted;
   case reply::no_content:
     return no_content;
+  case reply::partial_content:
+    return partial_content;
   case reply::multiple_choices:
     return multiple_choices;
   case reply::moved_permanently:
@@ -227,6 +335,8 @@ std::string to_string(reply::status_type status)
     return forbidden;
   case reply::not_found:
     return not_found;
+  case reply::requested_range_not_satisfiable:
+    return requested_range_not_satisfiable;
   case reply::internal_server_error:
     return internal_server_error;
   case reply::not_implemented:
@@ -246,6 +356,9 @@ void reply::reset()
 {
   content.clear();
   headers.clear();
+  fixed_headers = 0;
+  source.reset();
+  chunked = false;
 }
 
 reply reply::stock_reply(reply::status_type status)
@@ -14,21 +14,51 @@
 #include <string>
 #include <vector>
 #include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 #include "header.hpp"
 
+#if !defined(HTTP_SERVER_CHUNK_SIZE)
+# define HTTP_SERVER_CHUNK_SIZE 65536
+#endif
+
 namespace http {
 namespace server {
 
+/// The producer of the content of a streaming reply.
+class reply_source
+{
+public:
+  virtual ~reply_source()
+  {
+  }
+
+  /// Append the next piece of content, no more than max_size bytes. Returns
+  /// false if the content is complete, the piece may be empty then only.
+  virtual bool next(std::string& piece, std::size_t max_size) = 0;
+
+  /// Start producing the next piece in background if it may block, the
+  /// handler is posted to the io_service when next can be called without
+  /// blocking. Returns false if there's no need to wait.
+  virtual bool async_fill(boost::asio::io_service& /*io_service*/,
+      const boost::function<void ()>& /*handler*/)
+  {
+    return false;
+  }
+};
+
 /// A reply to be sent to a client.
 struct reply
 {
   /// The status of the reply.
   enum status_type
   {
+    switching_protocols = 101,
     ok = 200,
     created = 201,
     accepted = 202,
     no_content = 204,
+    partial_content = 206,
     multiple_choices = 300,
     moved_permanently = 301,
     moved_temporarily = 302,
@@ -37,6 +67,7 @@ struct reply
     unauthorized = 401,
     forbidden = 403,
     not_found = 404,
+    requested_range_not_satisfiable = 416,
     internal_server_error = 500,
     not_implemented = 501,
     bad_gateway = 502,
@@ -49,16 +80,49 @@ struct reply
   /// The content to be sent in the reply.
   std::string content;
 
+  /// Preformatted headers shared by many replies, null if none. The block
+  /// is not owned and must remain valid until the write operation has
+  /// completed.
+  const std::string* fixed_headers;
+
+  /// The producer of the content, null if the content is complete. The
+  /// content is then filled one piece at a time, each replacing the one
+  /// before after it is written.
+  boost::shared_ptr<reply_source> source;
+
+  /// Whether the content of a streaming reply is sent in chunks.
+  bool chunked;
+
+  /// The status line and all headers formatted by to_buffers.
+  std::string head;
+
+  /// The size line of the current chunk.
+  std::string chunk_head;
+
+  /// Construct an empty reply.
+  reply();
+
   /// Reset to initial state.
   void reset();
 
-  /// Convert the reply into a vector of buffers. The buffers do not own the
-  /// underlying memory blocks, therefore the reply object must remain valid and
-  /// not be changed until the write operation has completed.
-  std::vector<boost::asio::const_buffer> to_buffers();
+  /// Convert the reply into a vector of buffers, one for the formatted head
+  /// and one for the content. The buffers do not own the underlying memory
+  /// blocks, therefore the reply object must remain valid and not be changed
+  /// until the write operation has completed. A streaming reply without
+  /// Content-Length is sent in chunks if allowed, otherwise its end is marked
+  /// by closing the connection.
+  std::vector<boost::asio::const_buffer> to_buffers(bool chunked_allowed = false);
+
+  /// Get the buffers of the next piece of a streaming reply after the write
+  /// of the last one has completed, empty if the reply has been sent.
+  std::vector<boost::asio::const_buffer> next_buffers();
 
   /// Get a stock reply.
   static reply stock_reply(status_type status);
+
+private:
+  /// Fill the next piece of content and append its buffers.
+  void append_piece(std::vector<boost::asio::const_buffer>& buffers);
 };
 
 } // namespace server
@@ -9,10 +9,20 @@
 //
 
 #include "request_handler.hpp"
-#include <fstream>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <ctime>
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
+#include "header_emitter.hpp"
 #include "mime_types.hpp"
 #include "reply.hpp"
 #include "request.hpp"
@@ -20,9 +30,134 @@
 namespace http {
 namespace server {
 
-request_handler::request_handler(const std::string& doc_root)
-  : doc_root_(doc_root)
+namespace {
+
+/// Escape the characters special to HTML.
+std::string html_escape(const std::string& in)
+{
+  std::string out;
+  for (std::size_t i = 0; i < in.size(); ++i)
+  {
+    switch (in[i])
+    {
+    case '&': out += "&amp;"; break;
+    case '<': out += "&lt;"; break;
+    case '>': out += "&gt;"; break;
+    case '"': out += "&quot;"; break;
+    default: out += in[i]; break;
+    }
+  }
+
+  return out;
+}
+
+/// Percent-encode a path segment.
+std::string url_encode(const std::string& in)
+{
+  static const char digits[] = "0123456789ABCDEF";
+  std::string out;
+  for (std::size_t i = 0; i < in.size(); ++i)
+  {
+    unsigned char c = static_cast<unsigned char>(in[i]);
+    if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~' || c == '/')
+    {
+      out += in[i];
+    }
+    else
+    {
+      out += '%';
+      out += digits[c >> 4];
+      out += digits[c & 0xf];
+    }
+  }
+
+  return out;
+}
+
+/// Lists a directory one piece at a time, the entries are not sorted since
+/// that would need all of them in memory.
+class directory_source
+  : public reply_source
+{
+public:
+  directory_source(const boost::filesystem::directory_iterator& iter, const std::string& path)
+    : iter_(iter),
+      head_("<html><head><title>Index of " + html_escape(path) + "</title></head>"
+          "<body><h1>Index of " + html_escape(path) + "</h1><ul>"),
+      tail_("</ul></body></html>")
+  {
+  }
+
+  virtual bool next(std::string& piece, std::size_t max_size)
+  {
+    piece.swap(head_);
+    head_.clear();
+
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator end;
+    for (; iter_ != end; iter_.increment(ec))
+    {
+      if (ec)
+      {
+        iter_ = end;
+        break;
+      }
+
+      // Hidden files are not listed.
+      std::string name = iter_->path().filename().string();
+      if (name.empty() || name[0] == '.')
+        continue;
+
+      if (boost::filesystem::is_directory(iter_->status(ec)))
+        name += '/';
+
+      std::string entry = "<li><a href=\"" + url_encode(name) + "\">" + html_escape(name) + "</a></li>";
+      if (!piece.empty() && piece.size() + entry.size() > max_size)
+        return true;
+
+      piece += entry;
+    }
+
+    if (!piece.empty() && piece.size() + tail_.size() > max_size)
+      return true;
+
+    piece += tail_;
+    return false;
+  }
+
+private:
+  boost::filesystem::directory_iterator iter_;
+  std::string head_;
+  std::string tail_;
+};
+
+} // namespace
+
+request_handler::request_handler(const std::string& doc_root, std::size_t compress_threads,
+    std::size_t read_threads, bool list_directories)
+  : doc_root_(doc_root),
+    list_directories_(list_directories),
+    compressor_(),
+    reader_(),
+    file_headers_(),
+    compressible_headers_()
 {
+  if (compress_threads != 0)
+    compressor_.reset(new file_compressor(compress_threads));
+  if (read_threads != 0)
+    reader_.reset(new file_reader(read_threads));
+
+  // Headers not changed by request are formatted once.
+  std::vector<header> headers(1);
+  headers[0].name = "Accept-Ranges";
+  headers[0].value = "bytes";
+  file_headers_ = header_emitter::join(headers);
+
+  // Caches must key the reply by Accept-Encoding whichever variant is sent.
+  headers.resize(2);
+  headers[1].name = "Vary";
+  headers[1].value = "Accept-Encoding";
+  compressible_headers_ = header_emitter::join(headers);
 }
 
 void request_handler::handle_request(const request& req, reply& rep)
@@ -43,9 +178,18 @@ void request_handler::handle_request(const request& req, reply& rep)
     return;
   }
 
-  // If path ends in slash (i.e. is a directory) then add "index.html".
+  // If path ends in slash (i.e. is a directory) then add "index.html", the
+  // directory is listed if there's none and listing is enabled.
   if (request_path[request_path.size() - 1] == '/')
   {
+    struct stat info;
+    std::string directory = doc_root_ + request_path;
+    if (list_directories_ && ::stat((directory + "index.html").c_str(), &info) != 0)
+    {
+      list_directory(directory, request_path, rep);
+      return;
+    }
+
     request_path += "index.html";
   }
 
@@ -58,25 +202,347 @@ void request_handler::handle_request(const request& req, reply& rep)
     extension = request_path.substr(last_dot_pos + 1);
   }
 
-  // Open the file to send back.
+  // Serve a compressed variant of text files if the client accepts it.
   std::string full_path = doc_root_ + request_path;
-  std::ifstream is(full_path.c_str(), std::ios::in | std::ios::binary);
-  if (!is)
+  std::string mime_type = mime_types::extension_to_type(extension);
+  std::string encoding;
+  if (mime_types::is_compressible(mime_type))
+    encoding = choose_encoding(req, full_path);
+
+  // Open the file to send back.
+  struct stat info;
+  boost::shared_ptr<file_source> source(new file_source(reader_.get(), full_path));
+  if (!source->is_open() || ::stat(full_path.c_str(), &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG)
   {
     rep = reply::stock_reply(reply::not_found);
     return;
   }
 
-  // Fill out the reply to be sent to the client.
+  // Validators of the variant sent, a compressed variant has its own tag.
+  std::size_t size = static_cast<std::size_t>(info.st_size);
+  std::string etag = make_etag(size, info.st_mtime, encoding);
+  std::string last_modified = header_emitter::http_date(info.st_mtime);
+  const std::string* fixed_headers = mime_types::is_compressible(mime_type)
+      ? &compressible_headers_ : &file_headers_;
+
+  if (not_modified(req, etag, info.st_mtime))
+  {
+    rep.status = reply::not_modified;
+    rep.fixed_headers = fixed_headers;
+    add_header(rep, "ETag", etag);
+    add_header(rep, "Last-Modified", last_modified);
+    return;
+  }
+
+  // A single range is served if the validator of If-Range still holds.
   rep.status = reply::ok;
-  char buf[512];
-  while (is.read(buf, sizeof(buf)).gcount() > 0)
-    rep.content.append(buf, is.gcount());
+  std::size_t first = 0;
+  std::size_t last = (size != 0) ? size - 1 : 0;
+  const std::string* range = find_header(req, "Range");
+  if (range != 0 && if_range_matches(req, etag, info.st_mtime))
+  {
+    switch (parse_range(*range, size, first, last))
+    {
+    case range_satisfiable:
+      rep.status = reply::partial_content;
+      break;
+    case range_unsatisfiable:
+      rep = reply::stock_reply(reply::requested_range_not_satisfiable);
+      add_header(rep, "Content-Range", "bytes */" + boost::lexical_cast<std::string>(size));
+      return;
+    default:
+      break;
+    }
+  }
+
+  // Fill out the reply to be sent to the client, only the range is read by
+  // pieces while it is sent.
+  std::size_t length = (rep.status == reply::partial_content) ? last - first + 1 : size;
+  if (length != 0)
+  {
+    source->set_range(first, length);
+    rep.source = source;
+  }
+
   rep.headers.resize(2);
   rep.headers[0].name = "Content-Length";
-  rep.headers[0].value = boost::lexical_cast<std::string>(rep.content.size());
+  rep.headers[0].value = boost::lexical_cast<std::string>(length);
   rep.headers[1].name = "Content-Type";
-  rep.headers[1].value = mime_types::extension_to_type(extension);
+  rep.headers[1].value = mime_type;
+  rep.fixed_headers = fixed_headers;
+  add_header(rep, "ETag", etag);
+  add_header(rep, "Last-Modified", last_modified);
+  if (rep.status == reply::partial_content)
+    add_header(rep, "Content-Range", "bytes " + boost::lexical_cast<std::string>(first)
+        + "-" + boost::lexical_cast<std::string>(last) + "/" + boost::lexical_cast<std::string>(size));
+  if (!encoding.empty())
+    add_header(rep, "Content-Encoding", encoding);
+}
+
+bool request_handler::async_handle_request(const request& req, reply& rep,
+    boost::asio::io_service& io_service, const boost::function<void ()>& handler)
+{
+  if (!reader_)
+  {
+    handle_request(req, rep);
+    return false;
+  }
+
+  reader_->post(boost::bind(&request_handler::do_handle_request, this,
+      boost::cref(req), boost::ref(rep), boost::ref(io_service), handler));
+  return true;
+}
+
+void request_handler::do_handle_request(const request& req, reply& rep,
+    boost::asio::io_service& io_service, boost::function<void ()> handler)
+{
+  handle_request(req, rep);
+  io_service.post(handler);
+}
+
+void request_handler::list_directory(const std::string& directory,
+    const std::string& request_path, reply& rep)
+{
+  boost::system::error_code ec;
+  boost::filesystem::directory_iterator iter(directory, ec);
+  if (ec)
+  {
+    rep = reply::stock_reply(reply::not_found);
+    return;
+  }
+
+  // The length is unknown, the listing is sent in chunks.
+  rep.status = reply::ok;
+  rep.source.reset(new directory_source(iter, request_path));
+  add_header(rep, "Content-Type", "text/html");
+}
+
+std::string request_handler::choose_encoding(const request& req, std::string& path)
+{
+  // Codings in order of preference and suffixes of their files.
+  static const char* codings[] = { "br", "zstd", "gzip" };
+  static const char* suffixes[] = { ".br", ".zst", ".gz" };
+
+  const std::string* accept_header = find_header(req, "Accept-Encoding");
+  struct stat original;
+  if (accept_header == 0 || ::stat(path.c_str(), &original) != 0)
+    return std::string();
+
+  const std::string& accept = *accept_header;
+
+  // A sibling older than the file is stale.
+  for (std::size_t i = 0; i < sizeof(codings) / sizeof(codings[0]); ++i)
+  {
+    struct stat sibling;
+    std::string sibling_path = path + suffixes[i];
+    if (accepts_encoding(accept, codings[i])
+        && ::stat(sibling_path.c_str(), &sibling) == 0
+        && sibling.st_mtime >= original.st_mtime)
+    {
+      path = sibling_path;
+      return codings[i];
+    }
+  }
+
+  // Create the most preferred one for later requests.
+  if (compressor_)
+  {
+    for (std::size_t i = 0; i < sizeof(codings) / sizeof(codings[0]); ++i)
+    {
+      if (accepts_encoding(accept, codings[i]) && file_compressor::supports(codings[i]))
+      {
+        compressor_->compress(path, codings[i]);
+        break;
+      }
+    }
+  }
+
+  return std::string();
+}
+
+bool request_handler::accepts_encoding(const std::string& accept, const std::string& coding)
+{
+  // Items are "coding[;q=value]", "*" matches the codings not listed.
+  bool any = false;
+  std::vector<std::string> items;
+  boost::algorithm::split(items, accept, boost::algorithm::is_any_of(","));
+  for (std::size_t i = 0; i < items.size(); ++i)
+  {
+    std::string item = items[i];
+    double quality = 1.0;
+    std::size_t semicolon = item.find(';');
+    if (semicolon != std::string::npos)
+    {
+      std::string parameter = boost::algorithm::trim_copy(item.substr(semicolon + 1));
+      if (boost::algorithm::istarts_with(parameter, "q="))
+        quality = std::atof(parameter.c_str() + 2);
+
+      item.erase(semicolon);
+    }
+
+    boost::algorithm::trim(item);
+    if (boost::algorithm::iequals(item, coding))
+      return quality > 0;
+
+    if (item == "*")
+      any = quality > 0;
+  }
+
+  return any;
+}
+
+const std::string* request_handler::find_header(const request& req, const char* name)
+{
+  for (std::size_t i = 0; i < req.headers.size(); ++i)
+  {
+    if (boost::algorithm::iequals(req.headers[i].name, name))
+      return &req.headers[i].value;
+  }
+
+  return 0;
+}
+
+void request_handler::add_header(reply& rep, const std::string& name, const std::string& value)
+{
+  rep.headers.push_back(header());
+  rep.headers.back().name = name;
+  rep.headers.back().value = value;
+}
+
+std::string request_handler::make_etag(std::size_t size, std::time_t mtime, const std::string& encoding)
+{
+  std::ostringstream os;
+  os << '"' << std::hex << size << '-' << static_cast<unsigned long>(mtime);
+  if (!encoding.empty())
+    os << '-' << encoding;
+  os << '"';
+  return os.str();
+}
+
+bool request_handler::parse_http_date(const std::string& value, std::time_t& t)
+{
+  static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+  // Only the preferred format "Sun, 06 Nov 1994 08:49:37 GMT" is accepted.
+  std::tm tm = std::tm();
+  char month[4] = { 0 };
+  if (std::sscanf(value.c_str(), "%*3s, %2d %3s %4d %2d:%2d:%2d GMT",
+      &tm.tm_mday, month, &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+    return false;
+
+  tm.tm_mon = -1;
+  for (int i = 0; i < 12; ++i)
+  {
+    if (std::strcmp(month, months[i]) == 0)
+      tm.tm_mon = i;
+  }
+
+  if (tm.tm_mon < 0)
+    return false;
+
+  tm.tm_year -= 1900;
+#if defined(_WIN32)
+  t = _mkgmtime(&tm);
+#else
+  t = timegm(&tm);
+#endif
+  return t != static_cast<std::time_t>(-1);
+}
+
+bool request_handler::etag_matches(const std::string& list, const std::string& etag)
+{
+  if (boost::algorithm::trim_copy(list) == "*")
+    return true;
+
+  // Weak comparison, the "W/" prefix is ignored.
+  std::vector<std::string> tags;
+  boost::algorithm::split(tags, list, boost::algorithm::is_any_of(","));
+  for (std::size_t i = 0; i < tags.size(); ++i)
+  {
+    std::string tag = boost::algorithm::trim_copy(tags[i]);
+    if (boost::algorithm::starts_with(tag, "W/"))
+      tag.erase(0, 2);
+
+    if (tag == etag)
+      return true;
+  }
+
+  return false;
+}
+
+bool request_handler::not_modified(const request& req, const std::string& etag, std::time_t mtime)
+{
+  // If-None-Match takes precedence over If-Modified-Since.
+  const std::string* none_match = find_header(req, "If-None-Match");
+  if (none_match != 0)
+    return etag_matches(*none_match, etag);
+
+  const std::string* modified_since = find_header(req, "If-Modified-Since");
+  std::time_t since;
+  return modified_since != 0 && parse_http_date(*modified_since, since) && mtime <= since;
+}
+
+bool request_handler::if_range_matches(const request& req, const std::string& etag, std::time_t mtime)
+{
+  const std::string* if_range = find_header(req, "If-Range");
+  if (if_range == 0)
+    return true;
+
+  // An entity tag is compared strongly, a date must be the exact modification time.
+  std::string value = boost::algorithm::trim_copy(*if_range);
+  if (!value.empty() && (value[0] == '"' || boost::algorithm::starts_with(value, "W/")))
+    return value == etag;
+
+  std::time_t t;
+  return parse_http_date(value, t) && t == mtime;
+}
+
+request_handler::range_result request_handler::parse_range(const std::string& value,
+    std::size_t size, std::size_t& first, std::size_t& last)
+{
+  // Only a single "bytes=first-last", "bytes=first-" or "bytes=-suffix" is
+  // supported, others are ignored and the whole file is sent.
+  std::string spec = boost::algorithm::trim_copy(value);
+  if (!boost::algorithm::istarts_with(spec, "bytes=") || spec.find(',') != std::string::npos)
+    return range_ignored;
+
+  spec.erase(0, 6);
+  boost::algorithm::trim(spec);
+  std::size_t dash = spec.find('-');
+  if (dash == std::string::npos)
+    return range_ignored;
+
+  std::string first_text = boost::algorithm::trim_copy(spec.substr(0, dash));
+  std::string last_text = boost::algorithm::trim_copy(spec.substr(dash + 1));
+  if (!boost::algorithm::all(first_text, boost::algorithm::is_digit())
+      || !boost::algorithm::all(last_text, boost::algorithm::is_digit())
+      || (first_text.empty() && last_text.empty()))
+    return range_ignored;
+
+  if (first_text.empty())
+  {
+    std::size_t suffix = std::strtoul(last_text.c_str(), 0, 10);
+    if (suffix == 0 || size == 0)
+      return range_unsatisfiable;
+
+    first = (suffix >= size) ? 0 : size - suffix;
+    last = size - 1;
+    return range_satisfiable;
+  }
+
+  first = std::strtoul(first_text.c_str(), 0, 10);
+  if (first >= size)
+    return range_unsatisfiable;
+
+  last = last_text.empty() ? size - 1 : std::strtoul(last_text.c_str(), 0, 10);
+  if (last < first)
+    return range_ignored;
+
+  if (last >= size)
+    last = size - 1;
+
+  return range_satisfiable;
 }
 
 bool request_handler::url_decode(const std::string& in, std::string& out)
@@ -11,8 +11,14 @@
 #ifndef HTTP_SERVER_REQUEST_HANDLER_HPP
 #define HTTP_SERVER_REQUEST_HANDLER_HPP
 
+#include <ctime>
 #include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "file_compressor.hpp"
+#include "file_reader.hpp"
 
 namespace http {
 namespace server {
@@ -25,16 +31,91 @@ class request_handler
   : private boost::noncopyable
 {
 public:
-  /// Construct with a directory containing files to be served.
-  explicit request_handler(const std::string& doc_root);
+  /// Construct with a directory containing files to be served, the number
+  /// of threads creating compressed files, 0 for serving existing ones only,
+  /// the number of threads reading files, 0 for reading in the caller, and
+  /// whether directories without index file are listed.
+  explicit request_handler(const std::string& doc_root, std::size_t compress_threads = 0,
+      std::size_t read_threads = 0, bool list_directories = false);
 
   /// Handle a request and produce a reply.
   void handle_request(const request& req, reply& rep);
 
+  /// Handle a request in the threads reading files if enabled, so neither
+  /// opening nor checking the file blocks the caller, the handler is posted
+  /// to the io_service when the reply is produced. The request and the reply
+  /// must remain valid until then. Returns false if the reply is produced by
+  /// the caller already.
+  bool async_handle_request(const request& req, reply& rep,
+      boost::asio::io_service& io_service, const boost::function<void ()>& handler);
+
 private:
   /// The directory containing the files to be served.
   std::string doc_root_;
 
+  /// Whether directories without index file are listed.
+  bool list_directories_;
+
+  /// The compressor of files, null if disabled.
+  boost::scoped_ptr<file_compressor> compressor_;
+
+  /// The reader of files, null if disabled.
+  boost::scoped_ptr<file_reader> reader_;
+
+  /// Preformatted headers of every file reply.
+  std::string file_headers_;
+
+  /// Preformatted headers of every reply of a compressible file.
+  std::string compressible_headers_;
+
+  /// Produce the reply in background thread and post the handler.
+  void do_handle_request(const request& req, reply& rep,
+      boost::asio::io_service& io_service, boost::function<void ()> handler);
+
+  /// List a directory without index file.
+  static void list_directory(const std::string& directory,
+      const std::string& request_path, reply& rep);
+
+  /// Choose a compressed sibling of the file accepted by the client, the path
+  /// is changed and the coding is returned, empty if none.
+  std::string choose_encoding(const request& req, std::string& path);
+
+  /// Check whether the coding is accepted by the Accept-Encoding value.
+  static bool accepts_encoding(const std::string& accept, const std::string& coding);
+
+  /// Find the value of a request header, null if not found.
+  static const std::string* find_header(const request& req, const char* name);
+
+  /// Append a header to the reply.
+  static void add_header(reply& rep, const std::string& name, const std::string& value);
+
+  /// Make the entity tag of a file variant from its size and modification time.
+  static std::string make_etag(std::size_t size, std::time_t mtime, const std::string& encoding);
+
+  /// Parse an HTTP date. Returns false if the date is invalid.
+  static bool parse_http_date(const std::string& value, std::time_t& t);
+
+  /// Check whether the entity tag is in the If-None-Match list.
+  static bool etag_matches(const std::string& list, const std::string& etag);
+
+  /// Check whether the conditional headers allow a 304 reply.
+  static bool not_modified(const request& req, const std::string& etag, std::time_t mtime);
+
+  /// Check whether the If-Range validator still holds.
+  static bool if_range_matches(const request& req, const std::string& etag, std::time_t mtime);
+
+  /// Result of parsing a Range header.
+  enum range_result
+  {
+    range_ignored,
+    range_satisfiable,
+    range_unsatisfiable
+  };
+
+  /// Parse a single byte range of a file of the size.
+  static range_result parse_range(const std::string& value,
+      std::size_t size, std::size_t& first, std::size_t& last);
+
   /// Perform URL-decoding on a string. Returns false if the encoding was
   /// invalid.
   static bool url_decode(const std::string& in, std::string& out);
@@ -14,15 +14,22 @@
 #include <boost/assert.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <bas/service_handler.hpp>
 
 #include <iostream>
+#include <vector>
 
+#include "h2_connection.hpp"
 #include "request_handler.hpp"
 #include "request_parser.hpp"
 #include "request.hpp"
 #include "reply.hpp"
+#include "websocket.hpp"
+#include "ws_hub.hpp"
+#include "ws_session.hpp"
 
 namespace http {
 namespace server {  
@@ -33,8 +40,12 @@ public:
 
   typedef bas::service_handler<server_work> server_handler_type;
 
-  server_work(request_handler& handler)
-    : request_handler_(handler)
+  server_work(request_handler& handler, ws_hub& hub)
+    : request_handler_(handler),
+      hub_(hub),
+      h2_(),
+      ws_(),
+      writing_(false)
   {
   }
   
@@ -43,6 +54,9 @@ public:
     request_.reset();
     request_parser_.reset();
     reply_.reset();
+    h2_.reset();
+    ws_.reset();
+    writing_ = false;
   }
 
   void on_open(server_handler_type& handler)
@@ -52,36 +66,91 @@ public:
 
   void on_read(server_handler_type& handler, std::size_t bytes_transferred)
   {
-    boost::tribool result;
-    boost::tie(result, boost::tuples::ignore) = request_parser_.parse(
-        request_, handler.read_buffer().data(), handler.read_buffer().data() + bytes_transferred);
-
-    if (result)
+    char* begin = reinterpret_cast<char*>(handler.read_buffer().data());
+    char* end = begin + bytes_transferred;
+    if (ws_)
     {
-      request_handler_.handle_request(request_, reply_);
-      handler.async_write(reply_.to_buffers());
+      ws_->consume(begin, end);
+      handler.read_buffer().clear();
+      continue_ws(handler);
+      if (!ws_->closing())
+        handler.async_read_some();
+      return;
     }
-    else if (!result)
+
+    if (!h2_)
     {
-      reply_ = reply::stock_reply(reply::bad_request);
-      handler.async_write(reply_.to_buffers());
+      boost::tribool result;
+      char* parsed = begin;
+      boost::tie(result, parsed) = request_parser_.parse(request_, begin, end);
+
+      if (result && websocket::is_upgrade(request_))
+      {
+        start_websocket(handler, parsed, end);
+        return;
+      }
+
+      // The request line of the HTTP/2 preface, the rest is left to h2_connection.
+      if (!result || request_.method != "PRI" || request_.uri != "*" || request_.http_version_major != 2)
+      {
+        handle_http1(handler, result);
+        return;
+      }
+
+      h2_.reset(new h2_connection(request_handler_, handler.work_service(),
+          boost::bind(&server_work::wake_h2, handler.shared_from_this())));
+      begin = parsed;
     }
-    else
-    {
-      handler.read_buffer().clear();
-      on_clear(handler);
 
+    h2_->consume(begin, end);
+    handler.read_buffer().clear();
+    continue_h2(handler);
+    if (!h2_->closing())
       handler.async_read_some();
-    }
   }
 
-  void on_write(server_handler_type& handler, std::size_t bytes_transferred)
+  void on_write(server_handler_type& handler, std::size_t /*bytes_transferred*/)
   {
-    handler.close();
+    if (ws_)
+    {
+      // The first write is the upgrade reply, frames follow it.
+      if (writing_)
+      {
+        writing_ = false;
+        reply_.reset();
+        ws_->start(handler.work_service(),
+            boost::bind(&server_work::wake_ws, handler.shared_from_this()));
+      }
+      else
+      {
+        ws_->written();
+      }
+      continue_ws(handler);
+      return;
+    }
+
+    if (h2_)
+    {
+      writing_ = false;
+      continue_h2(handler);
+      return;
+    }
+
+    // The next piece of a streaming reply is produced only after the last one
+    // is written, so a slow client holds back the producer.
+    write_reply(handler, false);
   }
 
   void on_close(server_handler_type& handler, const boost::system::error_code& e)
   {
+    // Leave the hub in the work thread, on_clear runs elsewhere.
+    if (ws_)
+      ws_->close();
+
+    // Release the writer holding the handler.
+    if (h2_)
+      h2_->close();
+
     switch (e.value())
     {
       // Operation successfully completed.
@@ -114,6 +183,120 @@ public:
   }
 
 private:
+  /// Reply to a request of HTTP/1, or keep reading until it's complete.
+  void handle_http1(server_handler_type& handler, boost::tribool result)
+  {
+    if (result)
+    {
+      // The file is opened in background if files are read there.
+      if (!request_handler_.async_handle_request(request_, reply_, handler.work_service(),
+          boost::bind(&server_work::resume_reply, handler.shared_from_this(), true)))
+        write_reply(handler, true);
+    }
+    else if (!result)
+    {
+      reply_ = reply::stock_reply(reply::bad_request);
+      handler.async_write(reply_.to_buffers());
+    }
+    else
+    {
+      handler.read_buffer().clear();
+      on_clear(handler);
+
+      handler.async_read_some();
+    }
+  }
+
+  /// Write the head or the next piece of the reply once it's ready, a piece
+  /// of file missing the page cache is read in background first.
+  void write_reply(server_handler_type& handler, bool head)
+  {
+    if (reply_.source && reply_.source->async_fill(handler.work_service(),
+        boost::bind(&server_work::resume_reply, handler.shared_from_this(), head)))
+      return;
+
+    if (head)
+    {
+      // Chunks are understood by HTTP/1.1 clients only.
+      bool chunked_allowed = request_.http_version_major > 1
+          || (request_.http_version_major == 1 && request_.http_version_minor >= 1);
+      handler.async_write(reply_.to_buffers(chunked_allowed));
+      return;
+    }
+
+    std::vector<boost::asio::const_buffer> buffers = reply_.next_buffers();
+    if (buffers.empty())
+      handler.close();
+    else
+      handler.async_write(buffers);
+  }
+
+  /// Resume writing the reply of the handler after it is produced or a piece
+  /// is read.
+  static void resume_reply(server_handler_type::service_handler_ptr handler, bool head)
+  {
+    handler->work_handler().write_reply(*handler, head);
+  }
+
+  /// Reply to a WebSocket upgrade, the connection is kept for frames if accepted.
+  void start_websocket(server_handler_type& handler, const char* begin, const char* end)
+  {
+    if (!websocket::accept(request_, reply_))
+    {
+      handler.async_write(reply_.to_buffers());
+      return;
+    }
+
+    // The peer is checked by the heartbeat of the hub instead.
+    handler.cancel_session_timeout();
+
+    ws_.reset(new ws_session(hub_, request_.uri));
+    writing_ = true;
+    handler.async_write(reply_.to_buffers());
+
+    ws_->consume(begin, end);
+    handler.read_buffer().clear();
+    if (!ws_->closing())
+      handler.async_read_some();
+  }
+
+  /// Write the next frames of WebSocket if idle, or close when the session is
+  /// finished and the output is sent.
+  void continue_ws(server_handler_type& handler)
+  {
+    std::vector<boost::asio::const_buffer> buffers;
+    if (ws_->next_output(buffers))
+      handler.async_write(buffers);
+    else if (ws_->finished())
+      handler.close();
+  }
+
+  /// Wake up the writing of the WebSocket session of the handler.
+  static void wake_ws(server_handler_type::service_handler_ptr handler)
+  {
+    handler->work_handler().continue_ws(*handler);
+  }
+
+  /// Write the next output of HTTP/2 if idle, or close when the connection is
+  /// finished and the output is sent.
+  void continue_h2(server_handler_type& handler)
+  {
+    if (!writing_ && h2_->next_output())
+    {
+      writing_ = true;
+      handler.async_write(boost::asio::buffer(h2_->output()));
+    }
+
+    if (h2_->closing() && !writing_)
+      handler.close();
+  }
+
+  /// Wake up the writing of the HTTP/2 connection of the handler.
+  static void wake_h2(server_handler_type::service_handler_ptr handler)
+  {
+    handler->work_handler().continue_h2(*handler);
+  }
+
   /// The handler used to process the incoming request.
   request_handler& request_handler_;
 
@@ -125,6 +308,18 @@ private:
 
   /// The reply to be sent back to the client.
   reply reply_;
+
+  /// The hub of WebSocket topics.
+  ws_hub& hub_;
+
+  /// The HTTP/2 protocol, null for HTTP/1 connections.
+  boost::scoped_ptr<h2_connection> h2_;
+
+  /// The WebSocket session, null unless the connection is upgraded.
+  boost::shared_ptr<ws_session> ws_;
+
+  /// Whether a write of HTTP/2 output or of the upgrade reply is in progress.
+  bool writing_;
 };
 
 } // namespace server
@@ -13,6 +13,7 @@
 
 #include "request_handler.hpp"
 #include "server_work.hpp"
+#include "ws_hub.hpp"
 
 namespace http {
 namespace server {
@@ -22,24 +23,35 @@ class server_work_allocator
 public:
   typedef boost::asio::ip::tcp::socket socket_type;
 
-  server_work_allocator(const std::string& doc_root)
-   : request_handler_(doc_root)
+  server_work_allocator(const std::string& doc_root, std::size_t compress_threads = 0,
+      std::size_t read_threads = 0, bool list_directories = false)
+   : request_handler_(doc_root, compress_threads, read_threads, list_directories),
+     hub_()
   {
   }
 
-  socket_type* make_socket(boost::asio::io_service& io_service)
+  socket_type* make_socket(void* address, boost::asio::io_service& io_service)
   {
-    return new socket_type(io_service);
+    return new (address) socket_type(io_service);
   }
 
-  server_work* make_handler()
+  /// Get the hub to publish messages to WebSocket topics.
+  ws_hub& hub()
   {
-    return new server_work(request_handler_);
+    return hub_;
+  }
+
+  server_work* make_handler(void* address)
+  {
+    return new (address) server_work(request_handler_, hub_);
   }
 
 private:
   /// The handler for all incoming requests.
   request_handler request_handler_;
+
+  /// The hub of WebSocket topics shared by all connections.
+  ws_hub hub_;
 };
 
 } // namespace server
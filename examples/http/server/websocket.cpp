@@ -0,0 +1,205 @@
+//
+// websocket.cpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "websocket.hpp"
+#include <cstring>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/uuid/detail/sha1.hpp>
+#include "reply.hpp"
+#include "request.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define HTTP_SERVER_WS_SSE2
+#endif
+
+namespace http {
+namespace server {
+namespace websocket {
+
+namespace {
+
+/// The GUID appended to the key by RFC 6455.
+const char key_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/// Find the value of a request header, null if not found.
+const std::string* find_header(const request& req, const char* name)
+{
+  for (std::size_t i = 0; i < req.headers.size(); ++i)
+  {
+    if (boost::algorithm::iequals(req.headers[i].name, name))
+      return &req.headers[i].value;
+  }
+
+  return 0;
+}
+
+/// Check whether the comma separated list of the header has the token.
+bool has_token(const request& req, const char* name, const char* token)
+{
+  const std::string* value = find_header(req, name);
+  if (value == 0)
+    return false;
+
+  std::vector<std::string> items;
+  boost::algorithm::split(items, *value, boost::algorithm::is_any_of(","));
+  for (std::size_t i = 0; i < items.size(); ++i)
+  {
+    if (boost::algorithm::iequals(boost::algorithm::trim_copy(items[i]), token))
+      return true;
+  }
+
+  return false;
+}
+
+/// Encode bytes in base64.
+std::string base64_encode(const unsigned char* data, std::size_t size)
+{
+  static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  std::string out;
+  out.reserve((size + 2) / 3 * 4);
+  for (std::size_t i = 0; i < size; i += 3)
+  {
+    unsigned int n = data[i] << 16;
+    if (i + 1 < size)
+      n |= data[i + 1] << 8;
+    if (i + 2 < size)
+      n |= data[i + 2];
+
+    out.push_back(alphabet[(n >> 18) & 0x3f]);
+    out.push_back(alphabet[(n >> 12) & 0x3f]);
+    out.push_back((i + 1 < size) ? alphabet[(n >> 6) & 0x3f] : '=');
+    out.push_back((i + 2 < size) ? alphabet[n & 0x3f] : '=');
+  }
+
+  return out;
+}
+
+} // namespace
+
+bool is_upgrade(const request& req)
+{
+  return has_token(req, "Upgrade", "websocket") && has_token(req, "Connection", "Upgrade");
+}
+
+bool accept(const request& req, reply& rep)
+{
+  const std::string* version = find_header(req, "Sec-WebSocket-Version");
+  const std::string* key = find_header(req, "Sec-WebSocket-Key");
+  bool http11 = req.http_version_major > 1
+      || (req.http_version_major == 1 && req.http_version_minor >= 1);
+  if (req.method != "GET" || !http11 || version == 0 || *version != "13"
+      || key == 0 || key->size() != 24)
+  {
+    rep = reply::stock_reply(reply::bad_request);
+    return false;
+  }
+
+  rep.status = reply::switching_protocols;
+  rep.headers.resize(3);
+  rep.headers[0].name = "Upgrade";
+  rep.headers[0].value = "websocket";
+  rep.headers[1].name = "Connection";
+  rep.headers[1].value = "Upgrade";
+  rep.headers[2].name = "Sec-WebSocket-Accept";
+  rep.headers[2].value = accept_key(*key);
+  return true;
+}
+
+std::string accept_key(const std::string& key)
+{
+  boost::uuids::detail::sha1 sha1;
+  sha1.process_bytes(key.data(), key.size());
+  sha1.process_bytes(key_guid, sizeof(key_guid) - 1);
+
+  unsigned int digest[5];
+  sha1.get_digest(digest);
+
+  unsigned char bytes[20];
+  for (std::size_t i = 0; i < 5; ++i)
+  {
+    bytes[i * 4] = static_cast<unsigned char>(digest[i] >> 24);
+    bytes[i * 4 + 1] = static_cast<unsigned char>(digest[i] >> 16);
+    bytes[i * 4 + 2] = static_cast<unsigned char>(digest[i] >> 8);
+    bytes[i * 4 + 3] = static_cast<unsigned char>(digest[i]);
+  }
+
+  return base64_encode(bytes, sizeof(bytes));
+}
+
+std::string make_frame(opcode op, const char* data, std::size_t size)
+{
+  std::string frame;
+  frame.reserve(size + 10);
+  frame.push_back(static_cast<char>(0x80 | op));
+  if (size < 126)
+  {
+    frame.push_back(static_cast<char>(size));
+  }
+  else if (size < 65536)
+  {
+    frame.push_back(static_cast<char>(126));
+    frame.push_back(static_cast<char>(size >> 8));
+    frame.push_back(static_cast<char>(size));
+  }
+  else
+  {
+    frame.push_back(static_cast<char>(127));
+    boost::uint64_t length = size;
+    for (int shift = 56; shift >= 0; shift -= 8)
+      frame.push_back(static_cast<char>(length >> shift));
+  }
+
+  frame.append(data, size);
+  return frame;
+}
+
+void unmask(char* data, std::size_t size, const unsigned char key[4], boost::uint64_t offset)
+{
+  // Rotate the key so the first byte of the piece takes key[0].
+  unsigned char k[4];
+  for (std::size_t i = 0; i < 4; ++i)
+    k[i] = key[(offset + i) & 3];
+
+  std::size_t i = 0;
+
+#if defined(HTTP_SERVER_WS_SSE2)
+  int word;
+  std::memcpy(&word, k, 4);
+  __m128i mask = _mm_set1_epi32(word);
+  for (; i + 16 <= size; i += 16)
+  {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(block, mask));
+  }
+#endif
+
+  // A word at a time, the key repeated in memory order is endian neutral.
+  boost::uint64_t mask64;
+  std::memcpy(&mask64, k, 4);
+  std::memcpy(reinterpret_cast<char*>(&mask64) + 4, k, 4);
+  for (; i + 8 <= size; i += 8)
+  {
+    boost::uint64_t block;
+    std::memcpy(&block, data + i, 8);
+    block ^= mask64;
+    std::memcpy(data + i, &block, 8);
+  }
+
+  for (; i < size; ++i)
+    data[i] ^= k[i & 3];
+}
+
+} // namespace websocket
+} // namespace server
+} // namespace http
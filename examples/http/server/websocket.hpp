@@ -0,0 +1,66 @@
+//
+// websocket.hpp
+// ~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SERVER_WEBSOCKET_HPP
+#define HTTP_SERVER_WEBSOCKET_HPP
+
+#include <string>
+#include <boost/cstdint.hpp>
+
+namespace http {
+namespace server {
+
+struct reply;
+struct request;
+
+namespace websocket {
+
+/// The opcodes of RFC 6455 frames.
+enum opcode
+{
+  continuation = 0x0,
+  text = 0x1,
+  binary = 0x2,
+  close = 0x8,
+  ping = 0x9,
+  pong = 0xa
+};
+
+/// The status codes of close frames.
+enum close_code
+{
+  normal_closure = 1000,
+  going_away = 1001,
+  protocol_error = 1002,
+  message_too_big = 1009
+};
+
+/// Check whether the request asks to upgrade the connection to WebSocket.
+bool is_upgrade(const request& req);
+
+/// Produce the reply accepting the upgrade, or a bad request if the version
+/// or the key is not supported. Returns true if accepted.
+bool accept(const request& req, reply& rep);
+
+/// Compute Sec-WebSocket-Accept from Sec-WebSocket-Key.
+std::string accept_key(const std::string& key);
+
+/// Format an unmasked frame sent by the server.
+std::string make_frame(opcode op, const char* data, std::size_t size);
+
+/// Unmask the payload in place, the offset is the position of the first byte
+/// in the whole payload so a payload can be unmasked piece by piece.
+void unmask(char* data, std::size_t size, const unsigned char key[4], boost::uint64_t offset);
+
+} // namespace websocket
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_WEBSOCKET_HPP
@@ -0,0 +1,164 @@
+//
+// ws_hub.cpp
+// ~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "ws_hub.hpp"
+#include <set>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+namespace http {
+namespace server {
+
+/// The sessions of a work thread, used in that thread only.
+class ws_hub::thread_state
+  : public boost::enable_shared_from_this<thread_state>,
+    private boost::noncopyable
+{
+public:
+  typedef boost::shared_ptr<boost::asio::deadline_timer> timer_ptr;
+
+  thread_state(boost::asio::io_service& io_service, const ws_session::frame_ptr& ping)
+    : io_service_(io_service),
+      ping_(ping),
+      sessions_(),
+      topics_(),
+      armed_(false)
+  {
+  }
+
+  boost::asio::io_service& io_service()
+  {
+    return io_service_;
+  }
+
+  void attach(ws_session* session)
+  {
+    sessions_.insert(session);
+    topics_[session->topic()].insert(session);
+
+    // The timer lives in its pending wait only, so it's gone with the
+    // io_service and doesn't tick while the thread has no session.
+    if (!armed_)
+    {
+      armed_ = true;
+      arm(timer_ptr(new boost::asio::deadline_timer(io_service_)));
+    }
+  }
+
+  void detach(ws_session* session)
+  {
+    sessions_.erase(session);
+    topic_map::iterator iter = topics_.find(session->topic());
+    if (iter != topics_.end())
+    {
+      iter->second.erase(session);
+      if (iter->second.empty())
+        topics_.erase(iter);
+    }
+  }
+
+  void deliver(const std::string& topic, const ws_session::frame_ptr& frame)
+  {
+    topic_map::iterator iter = topics_.find(topic);
+    if (iter == topics_.end())
+      return;
+
+    // Sessions are detached in on_close only, never while sending.
+    for (session_set::iterator s = iter->second.begin(); s != iter->second.end(); ++s)
+      (*s)->send(frame);
+  }
+
+private:
+  typedef std::set<ws_session*> session_set;
+  typedef std::map<std::string, session_set> topic_map;
+
+  void arm(const timer_ptr& timer)
+  {
+    timer->expires_from_now(boost::posix_time::seconds(HTTP_SERVER_WS_PING_INTERVAL));
+    timer->async_wait(boost::bind(&thread_state::handle_timer,
+        shared_from_this(), timer, boost::asio::placeholders::error));
+  }
+
+  void handle_timer(const timer_ptr& timer, const boost::system::error_code& e)
+  {
+    if (e || sessions_.empty())
+    {
+      armed_ = false;
+      return;
+    }
+
+    for (session_set::iterator s = sessions_.begin(); s != sessions_.end(); ++s)
+      (*s)->heartbeat(ping_);
+
+    arm(timer);
+  }
+
+  /// The work service of the thread.
+  boost::asio::io_service& io_service_;
+
+  /// The ping frame of the hub.
+  ws_session::frame_ptr ping_;
+
+  /// All the sessions of the thread.
+  session_set sessions_;
+
+  /// The sessions of each topic.
+  topic_map topics_;
+
+  /// Whether the heartbeat timer is pending.
+  bool armed_;
+};
+
+ws_hub::ws_hub()
+  : mutex_(),
+    threads_(),
+    ping_(new std::string(websocket::make_frame(websocket::ping, 0, 0)))
+{
+}
+
+void ws_hub::attach(boost::asio::io_service& work_service, ws_session* session)
+{
+  get_state(work_service).attach(session);
+}
+
+void ws_hub::detach(boost::asio::io_service& work_service, ws_session* session)
+{
+  get_state(work_service).detach(session);
+}
+
+void ws_hub::publish(const std::string& topic, const std::string& message, bool binary)
+{
+  ws_session::frame_ptr frame(new std::string(websocket::make_frame(
+      binary ? websocket::binary : websocket::text, message.data(), message.size())));
+
+  std::vector<thread_state_ptr> threads;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    threads.reserve(threads_.size());
+    for (thread_map::iterator iter = threads_.begin(); iter != threads_.end(); ++iter)
+      threads.push_back(iter->second);
+  }
+
+  for (std::size_t i = 0; i < threads.size(); ++i)
+    threads[i]->io_service().post(boost::bind(&thread_state::deliver, threads[i], topic, frame));
+}
+
+ws_hub::thread_state& ws_hub::get_state(boost::asio::io_service& work_service)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  thread_state_ptr& state = threads_[&work_service];
+  if (!state)
+    state.reset(new thread_state(work_service, ping_));
+  return *state;
+}
+
+} // namespace server
+} // namespace http
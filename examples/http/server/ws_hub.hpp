@@ -0,0 +1,71 @@
+//
+// ws_hub.hpp
+// ~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SERVER_WS_HUB_HPP
+#define HTTP_SERVER_WS_HUB_HPP
+
+#include <map>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "ws_session.hpp"
+
+#if !defined(HTTP_SERVER_WS_PING_INTERVAL)
+# define HTTP_SERVER_WS_PING_INTERVAL 20
+#endif
+
+namespace http {
+namespace server {
+
+/// The topics of WebSocket sessions and their heartbeat.
+//    The sessions are kept by the work thread they run in, each thread has
+//    its own subscribers of the topics and one timer pinging its sessions, so
+//    there is no lock and no timer per connection. A message published is
+//    framed once and the frame is handed to each thread with subscribers.
+class ws_hub
+  : private boost::noncopyable
+{
+public:
+  /// Construct the hub.
+  ws_hub();
+
+  /// Add the session to the thread of the work service, called in that thread.
+  void attach(boost::asio::io_service& work_service, ws_session* session);
+
+  /// Remove the session from the thread of the work service, called in that thread.
+  void detach(boost::asio::io_service& work_service, ws_session* session);
+
+  /// Send a message to all the sessions of the topic, from any thread.
+  void publish(const std::string& topic, const std::string& message, bool binary = false);
+
+private:
+  class thread_state;
+  typedef boost::shared_ptr<thread_state> thread_state_ptr;
+  typedef std::map<boost::asio::io_service*, thread_state_ptr> thread_map;
+
+  /// Get the state of the thread of the work service, created if not found.
+  thread_state& get_state(boost::asio::io_service& work_service);
+
+  /// The mutex protecting the map of threads.
+  boost::mutex mutex_;
+
+  /// The states of the work threads having had sessions.
+  thread_map threads_;
+
+  /// The ping frame shared by all the heartbeats.
+  ws_session::frame_ptr ping_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_WS_HUB_HPP
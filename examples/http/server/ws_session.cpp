@@ -0,0 +1,300 @@
+//
+// ws_session.cpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "ws_session.hpp"
+#include <algorithm>
+#include "ws_hub.hpp"
+
+namespace http {
+namespace server {
+
+ws_session::ws_session(ws_hub& hub, const std::string& topic)
+  : hub_(hub),
+    topic_(topic),
+    work_service_(0),
+    writer_(),
+    state_(header_state),
+    header_(),
+    opcode_(0),
+    fin_(false),
+    payload_size_(0),
+    payload_received_(0),
+    control_(),
+    message_(),
+    message_opcode_(0),
+    queue_(),
+    writing_(),
+    received_(false),
+    ping_sent_(false),
+    closing_(false)
+{
+}
+
+void ws_session::start(boost::asio::io_service& work_service, const writer_type& writer)
+{
+  work_service_ = &work_service;
+  writer_ = writer;
+  hub_.attach(work_service, this);
+}
+
+void ws_session::close()
+{
+  if (work_service_ != 0)
+  {
+    hub_.detach(*work_service_, this);
+    work_service_ = 0;
+  }
+
+  // The writer holds the connection, release it.
+  writer_.clear();
+  queue_.clear();
+  closing_ = true;
+}
+
+void ws_session::consume(const char* begin, const char* end)
+{
+  if (begin != end)
+    received_ = true;
+
+  while (begin != end && !closing_)
+  {
+    if (state_ == header_state)
+    {
+      // The header is 2 bytes, the extended length and the mask key.
+      std::size_t needed = 2;
+      if (header_.size() >= 2)
+      {
+        unsigned char length = static_cast<unsigned char>(header_[1]) & 0x7f;
+        needed += (length == 126) ? 2 : (length == 127) ? 8 : 0;
+        needed += 4;
+      }
+
+      std::size_t n = std::min<std::size_t>(needed - header_.size(), end - begin);
+      header_.append(begin, n);
+      begin += n;
+      if (header_.size() < needed)
+        continue;
+
+      // Frames of the client must be masked and without extensions, the
+      // first 2 bytes tell it before the rest arrives.
+      if (needed == 2)
+      {
+        if ((header_[0] & 0x70) != 0 || (header_[1] & 0x80) == 0)
+        {
+          fail(websocket::protocol_error);
+          return;
+        }
+        continue;
+      }
+
+      if (!begin_frame())
+        return;
+
+      if (payload_size_ == 0)
+        end_frame();
+      continue;
+    }
+
+    std::string& target = (opcode_ & 0x8) ? control_ : message_;
+    std::size_t n = static_cast<std::size_t>(
+        std::min<boost::uint64_t>(payload_size_ - payload_received_, end - begin));
+    std::size_t offset = target.size();
+    target.append(begin, n);
+    websocket::unmask(&target[offset], n, mask_, payload_received_);
+    payload_received_ += n;
+    begin += n;
+
+    if (payload_received_ == payload_size_)
+      end_frame();
+  }
+}
+
+bool ws_session::begin_frame()
+{
+  unsigned char b0 = static_cast<unsigned char>(header_[0]);
+  unsigned char b1 = static_cast<unsigned char>(header_[1]);
+  fin_ = (b0 & 0x80) != 0;
+  opcode_ = b0 & 0x0f;
+
+  std::size_t pos = 2;
+  payload_size_ = b1 & 0x7f;
+  if (payload_size_ == 126 || payload_size_ == 127)
+  {
+    std::size_t bytes = (payload_size_ == 126) ? 2 : 8;
+    payload_size_ = 0;
+    for (std::size_t i = 0; i < bytes; ++i)
+      payload_size_ = (payload_size_ << 8) | static_cast<unsigned char>(header_[pos++]);
+  }
+  for (std::size_t i = 0; i < 4; ++i)
+    mask_[i] = static_cast<unsigned char>(header_[pos++]);
+  payload_received_ = 0;
+
+  switch (opcode_)
+  {
+  case websocket::close:
+  case websocket::ping:
+  case websocket::pong:
+    if (!fin_ || payload_size_ > 125)
+    {
+      fail(websocket::protocol_error);
+      return false;
+    }
+    control_.clear();
+    break;
+
+  case websocket::continuation:
+  case websocket::text:
+  case websocket::binary:
+    // A message starts with text or binary and goes on with continuations.
+    if ((opcode_ == websocket::continuation) != (message_opcode_ != 0))
+    {
+      fail(websocket::protocol_error);
+      return false;
+    }
+    if (payload_size_ > HTTP_SERVER_WS_MAX_MESSAGE - message_.size())
+    {
+      fail(websocket::message_too_big);
+      return false;
+    }
+    if (opcode_ != websocket::continuation)
+      message_opcode_ = opcode_;
+    break;
+
+  default:
+    fail(websocket::protocol_error);
+    return false;
+  }
+
+  state_ = payload_state;
+  return true;
+}
+
+void ws_session::end_frame()
+{
+  header_.clear();
+  state_ = header_state;
+
+  switch (opcode_)
+  {
+  case websocket::close:
+    // Echo the status code and close once it's sent.
+    queue_.push_back(frame_ptr(new std::string(websocket::make_frame(websocket::close,
+        control_.data(), std::min<std::size_t>(control_.size(), 2)))));
+    closing_ = true;
+    wake();
+    break;
+
+  case websocket::ping:
+    send(frame_ptr(new std::string(websocket::make_frame(websocket::pong,
+        control_.data(), control_.size()))));
+    break;
+
+  case websocket::pong:
+    ping_sent_ = false;
+    break;
+
+  default:
+    if (fin_)
+    {
+      hub_.publish(topic_, message_, message_opcode_ == websocket::binary);
+      message_.clear();
+      message_opcode_ = 0;
+    }
+    break;
+  }
+}
+
+void ws_session::send(const frame_ptr& frame)
+{
+  if (closing_)
+    return;
+
+  // The subscriber doesn't read fast enough, drop it rather than buffering
+  // without limit.
+  if (queue_.size() >= HTTP_SERVER_WS_MAX_QUEUE)
+  {
+    queue_.clear();
+    closing_ = true;
+    wake();
+    return;
+  }
+
+  queue_.push_back(frame);
+  wake();
+}
+
+void ws_session::heartbeat(const frame_ptr& ping)
+{
+  if (closing_)
+    return;
+
+  if (received_)
+  {
+    received_ = false;
+    ping_sent_ = false;
+    return;
+  }
+
+  if (ping_sent_)
+  {
+    queue_.clear();
+    closing_ = true;
+    wake();
+    return;
+  }
+
+  ping_sent_ = true;
+  send(ping);
+}
+
+bool ws_session::next_output(std::vector<boost::asio::const_buffer>& buffers)
+{
+  if (writer_.empty() || !writing_.empty() || queue_.empty())
+    return false;
+
+  // Gather frames into one write, they are kept alive until it's done.
+  std::size_t count = std::min<std::size_t>(queue_.size(), HTTP_SERVER_WS_WRITE_FRAMES);
+  writing_.assign(queue_.begin(), queue_.begin() + count);
+  queue_.erase(queue_.begin(), queue_.begin() + count);
+
+  buffers.clear();
+  buffers.reserve(count);
+  for (std::size_t i = 0; i < count; ++i)
+    buffers.push_back(boost::asio::buffer(*writing_[i]));
+  return true;
+}
+
+void ws_session::written()
+{
+  writing_.clear();
+}
+
+bool ws_session::finished() const
+{
+  return closing_ && writing_.empty() && queue_.empty();
+}
+
+void ws_session::fail(websocket::close_code code)
+{
+  char payload[2] = { static_cast<char>(code >> 8), static_cast<char>(code & 0xff) };
+  queue_.push_back(frame_ptr(new std::string(websocket::make_frame(websocket::close,
+      payload, sizeof(payload)))));
+  closing_ = true;
+  wake();
+}
+
+void ws_session::wake()
+{
+  if (writing_.empty() && !writer_.empty())
+    writer_();
+}
+
+} // namespace server
+} // namespace http
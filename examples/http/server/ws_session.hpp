@@ -0,0 +1,174 @@
+//
+// ws_session.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SERVER_WS_SESSION_HPP
+#define HTTP_SERVER_WS_SESSION_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "websocket.hpp"
+
+#if !defined(HTTP_SERVER_WS_MAX_MESSAGE)
+# define HTTP_SERVER_WS_MAX_MESSAGE 65536
+#endif
+
+#if !defined(HTTP_SERVER_WS_MAX_QUEUE)
+# define HTTP_SERVER_WS_MAX_QUEUE 1024
+#endif
+
+#if !defined(HTTP_SERVER_WS_WRITE_FRAMES)
+# define HTTP_SERVER_WS_WRITE_FRAMES 64
+#endif
+
+namespace http {
+namespace server {
+
+class ws_hub;
+
+/// A WebSocket connection subscribed to the topic of its request path.
+//    Text and binary messages received are published to the topic. Frames
+//    are queued by reference, a broadcast frame is shared by all the sessions
+//    of the topic and stays alive until each of them has written it. All the
+//    members are used in the work thread of the connection only.
+class ws_session
+  : public boost::enable_shared_from_this<ws_session>,
+    private boost::noncopyable
+{
+public:
+  /// A formatted frame shared by the sessions it's sent to.
+  typedef boost::shared_ptr<const std::string> frame_ptr;
+
+  /// The function starting the write of the output when the session is idle.
+  typedef boost::function<void ()> writer_type;
+
+  /// Construct with the hub of topics and the topic subscribed.
+  ws_session(ws_hub& hub, const std::string& topic);
+
+  /// Get the topic subscribed.
+  const std::string& topic() const
+  {
+    return topic_;
+  }
+
+  /// Join the hub once the upgrade reply is sent, frames are written by the
+  /// writer from then on.
+  void start(boost::asio::io_service& work_service, const writer_type& writer);
+
+  /// Leave the hub and release the writer, called when the connection is closed.
+  void close();
+
+  /// Process the bytes received.
+  void consume(const char* begin, const char* end);
+
+  /// Queue a frame to be sent. A subscriber too slow to keep up is dropped.
+  void send(const frame_ptr& frame);
+
+  /// Check the peer at each heartbeat, a ping is sent if nothing has been
+  /// received since the last one, and the connection is dropped if the ping
+  /// is not answered by the next.
+  void heartbeat(const frame_ptr& ping);
+
+  /// Take the frames to be written next into the buffers. Returns false if
+  /// there's none or a write is in progress.
+  bool next_output(std::vector<boost::asio::const_buffer>& buffers);
+
+  /// Release the frames written.
+  void written();
+
+  /// Check whether the connection is to be closed, the output is sent.
+  bool finished() const;
+
+  /// Check whether the connection is closing, nothing is read anymore.
+  bool closing() const
+  {
+    return closing_;
+  }
+
+private:
+  /// The states of the input.
+  enum input_state
+  {
+    header_state,
+    payload_state
+  };
+
+  /// Check the frame header received and prepare for the payload.
+  bool begin_frame();
+
+  /// Handle a frame of which the payload is complete.
+  void end_frame();
+
+  /// Queue a close frame with the status code and stop reading.
+  void fail(websocket::close_code code);
+
+  /// Start writing if idle.
+  void wake();
+
+  /// The hub of topics.
+  ws_hub& hub_;
+
+  /// The topic subscribed.
+  std::string topic_;
+
+  /// The work service of the connection, null before start.
+  boost::asio::io_service* work_service_;
+
+  /// The writer of the connection, empty before start and after close.
+  writer_type writer_;
+
+  /// The state of the input.
+  input_state state_;
+
+  /// The bytes of the frame header received.
+  std::string header_;
+
+  /// The fields of the frame being received.
+  unsigned char opcode_;
+  bool fin_;
+  unsigned char mask_[4];
+  boost::uint64_t payload_size_;
+  boost::uint64_t payload_received_;
+
+  /// The payload of the control frame being received.
+  std::string control_;
+
+  /// The data message being received, fragments are joined.
+  std::string message_;
+
+  /// The opcode of the data message being received, 0 if none.
+  unsigned char message_opcode_;
+
+  /// The frames waiting to be written.
+  std::deque<frame_ptr> queue_;
+
+  /// The frames being written.
+  std::vector<frame_ptr> writing_;
+
+  /// Whether anything has been received since the last heartbeat.
+  bool received_;
+
+  /// Whether a ping is waiting for answer.
+  bool ping_sent_;
+
+  /// Whether the connection is closing.
+  bool closing_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_WS_SESSION_HPP
@@ -0,0 +1,422 @@
+//
+// message_framing.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_PROXY_MESSAGE_FRAMING_HPP
+#define HTTP_PROXY_MESSAGE_FRAMING_HPP
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../../http/server/header.hpp"
+
+namespace http {
+namespace proxy {
+
+/// Find the value of a header by case-insensitive name, null if not found.
+inline const std::string* find_header(const std::vector<server::header>& headers, const char* name)
+{
+  for (std::size_t i = 0; i < headers.size(); ++i)
+  {
+    if (boost::algorithm::iequals(headers[i].name, name))
+      return &headers[i].value;
+  }
+
+  return 0;
+}
+
+/// Check whether a comma separated header value contains the token.
+inline bool has_token(const std::string& value, const char* token)
+{
+  std::vector<std::string> items;
+  boost::algorithm::split(items, value, boost::algorithm::is_any_of(","));
+  for (std::size_t i = 0; i < items.size(); ++i)
+  {
+    if (boost::algorithm::iequals(boost::algorithm::trim_copy(items[i]), token))
+      return true;
+  }
+
+  return false;
+}
+
+/// Tracker of the end of a message body, the bytes are passed through unchanged.
+class body_framing
+{
+public:
+  /// The framing of the body.
+  enum type_t
+  {
+    none = 0,
+    length,
+    chunked,
+    until_close
+  };
+
+  body_framing()
+  {
+    reset(none);
+  }
+
+  /// Start a new body.
+  void reset(type_t type, std::size_t content_length = 0)
+  {
+    type_ = type;
+    remaining_ = content_length;
+    state_ = chunk_size;
+    size_digits_ = false;
+    error_ = false;
+    done_ = (type == none) || (type == length && content_length == 0);
+  }
+
+  /// Get the framing of the body.
+  type_t type() const
+  {
+    return type_;
+  }
+
+  /// Is the whole body consumed.
+  bool done() const
+  {
+    return done_;
+  }
+
+  /// Is the chunked encoding invalid.
+  bool error() const
+  {
+    return error_;
+  }
+
+  /// Consume the data, return the number of bytes belonging to the body.
+  std::size_t consume(const unsigned char* data, std::size_t size)
+  {
+    if (done_ || error_)
+      return 0;
+
+    switch (type_)
+    {
+      case length:
+        if (size >= remaining_)
+        {
+          size = remaining_;
+          done_ = true;
+        }
+
+        remaining_ -= size;
+        return size;
+
+      case chunked:
+        return consume_chunked(data, size, 0);
+
+      case until_close:
+        return size;
+
+      case none:
+      default:
+        return 0;
+    }
+  }
+
+  /// Consume the data up to the end of the next piece of payload, the piece
+  /// is the last piece_size bytes of the returned number. Chunked framing is
+  /// left out of the pieces, the other bodies are one piece.
+  std::size_t consume_piece(const unsigned char* data, std::size_t size, std::size_t& piece_size)
+  {
+    if (type_ != chunked || done_ || error_)
+    {
+      piece_size = consume(data, size);
+      return piece_size;
+    }
+
+    piece_size = 0;
+    return consume_chunked(data, size, &piece_size);
+  }
+
+private:
+  /// Walk the chunks, stop after the last CRLF of the message, or after the
+  /// next chunk data if the piece is wanted.
+  std::size_t consume_chunked(const unsigned char* data, std::size_t size, std::size_t* piece_size)
+  {
+    std::size_t i = 0;
+    while (i < size && !done_ && !error_)
+    {
+      if (state_ == chunk_data)
+      {
+        std::size_t n = (std::min)(remaining_, size - i);
+        remaining_ -= n;
+        i += n;
+        if (remaining_ == 0)
+          state_ = chunk_data_cr;
+
+        if (piece_size != 0)
+        {
+          *piece_size = n;
+          return i;
+        }
+
+        continue;
+      }
+
+      unsigned char c = data[i++];
+      switch (state_)
+      {
+        case chunk_size:
+          if (std::isxdigit(c) && remaining_ < (std::size_t(1) << (sizeof(std::size_t) * 8 - 5)))
+          {
+            remaining_ = remaining_ * 16 + (std::isdigit(c) ? c - '0' : std::tolower(c) - 'a' + 10);
+            size_digits_ = true;
+          }
+          else if (!size_digits_)
+            error_ = true;
+          else if (c == ';' || c == ' ' || c == '\t')
+            state_ = chunk_ext;
+          else if (c == '\r')
+            state_ = chunk_size_lf;
+          else
+            error_ = true;
+          break;
+
+        case chunk_ext:
+          if (c == '\r')
+            state_ = chunk_size_lf;
+          break;
+
+        case chunk_size_lf:
+          if (c != '\n')
+            error_ = true;
+          else
+            state_ = (remaining_ == 0) ? trailer_start : chunk_data;
+          break;
+
+        case chunk_data_cr:
+          if (c != '\r')
+            error_ = true;
+          else
+            state_ = chunk_data_lf;
+          break;
+
+        case chunk_data_lf:
+          if (c != '\n')
+            error_ = true;
+          else
+          {
+            state_ = chunk_size;
+            size_digits_ = false;
+          }
+          break;
+
+        case trailer_start:
+          state_ = (c == '\r') ? final_lf : trailer_line;
+          break;
+
+        case trailer_line:
+          if (c == '\r')
+            state_ = trailer_lf;
+          break;
+
+        case trailer_lf:
+          if (c != '\n')
+            error_ = true;
+          else
+            state_ = trailer_start;
+          break;
+
+        case final_lf:
+          if (c != '\n')
+            error_ = true;
+          else
+            done_ = true;
+          break;
+
+        default:
+          error_ = true;
+      }
+    }
+
+    return i;
+  }
+
+  /// The state of the chunked encoding.
+  enum chunk_state
+  {
+    chunk_size,
+    chunk_ext,
+    chunk_size_lf,
+    chunk_data,
+    chunk_data_cr,
+    chunk_data_lf,
+    trailer_start,
+    trailer_line,
+    trailer_lf,
+    final_lf
+  };
+
+  type_t type_;
+  chunk_state state_;
+  std::size_t remaining_;
+  bool size_digits_;
+  bool done_;
+  bool error_;
+};
+
+/// Set the framing of a body by the headers, return false if they are invalid.
+inline bool frame_body(const std::vector<server::header>& headers,
+    body_framing& body,
+    body_framing::type_t otherwise)
+{
+  const std::string* encoding = find_header(headers, "Transfer-Encoding");
+  if (encoding != 0 && !encoding->empty())
+  {
+    // Only chunked as the last coding is understood.
+    if (!boost::algorithm::iends_with(boost::algorithm::trim_copy(*encoding), "chunked"))
+      return false;
+
+    body.reset(body_framing::chunked);
+    return true;
+  }
+
+  const std::string* length = find_header(headers, "Content-Length");
+  if (length != 0)
+  {
+    if (length->empty() || !boost::algorithm::all(*length, boost::algorithm::is_digit()))
+      return false;
+
+    body.reset(body_framing::length, static_cast<std::size_t>(std::strtoul(length->c_str(), 0, 10)));
+    return true;
+  }
+
+  body.reset(otherwise);
+  return true;
+}
+
+/// Find the end of a message head, return the length of the head including
+/// the empty line, 0 if the head is not complete.
+inline std::size_t find_head_end(const unsigned char* data, std::size_t size)
+{
+  for (std::size_t i = 3; i < size; ++i)
+  {
+    if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r')
+      return i + 1;
+  }
+
+  return 0;
+}
+
+/// Fields of a response head used for forwarding.
+struct response_head
+{
+  int status;
+  int http_version_major;
+  int http_version_minor;
+  std::string reason;
+  std::vector<server::header> headers;
+
+  /// Parse a complete head, return false if it is invalid.
+  bool parse(const unsigned char* data, std::size_t size)
+  {
+    std::string text(reinterpret_cast<const char*>(data), size);
+    std::vector<std::string> lines;
+    boost::algorithm::split(lines, text, boost::algorithm::is_any_of("\n"));
+
+    // Status line is "HTTP/x.y SSS reason".
+    if (lines.empty() || std::sscanf(lines[0].c_str(), "HTTP/%d.%d %d",
+        &http_version_major, &http_version_minor, &status) != 3)
+      return false;
+
+    // The reason phrase follows the status code.
+    std::string status_line = boost::algorithm::trim_right_copy(lines[0]);
+    std::size_t space = status_line.find(' ');
+    space = (space == std::string::npos) ? space : status_line.find(' ', space + 1);
+    reason = (space == std::string::npos) ? std::string() : status_line.substr(space + 1);
+
+    headers.clear();
+    for (std::size_t i = 1; i < lines.size(); ++i)
+    {
+      std::string line = boost::algorithm::trim_right_copy(lines[i]);
+      if (line.empty())
+        continue;
+
+      // Folded line continues the previous header.
+      if ((line[0] == ' ' || line[0] == '\t') && !headers.empty())
+      {
+        headers.back().value += ' ' + boost::algorithm::trim_copy(line);
+        continue;
+      }
+
+      std::size_t colon = line.find(':');
+      if (colon == std::string::npos)
+        return false;
+
+      server::header h;
+      h.name = line.substr(0, colon);
+      h.value = boost::algorithm::trim_copy(line.substr(colon + 1));
+      headers.push_back(h);
+    }
+
+    return true;
+  }
+
+  /// Can the connection carry another message after this one.
+  bool keep_alive() const
+  {
+    const std::string* connection = find_header(headers, "Connection");
+    if (http_version_major == 1 && http_version_minor == 0)
+      return connection != 0 && has_token(*connection, "keep-alive");
+
+    return connection == 0 || !has_token(*connection, "close");
+  }
+};
+
+/// Build the status line and the end-to-end headers of a response, without
+/// the empty line. Hop-by-hop headers and those named by the Connection
+/// header are removed, so is the length of a chunked body.
+inline std::string end_to_end_head(const response_head& response)
+{
+  static const char* hop_by_hop[] = { "Connection", "Keep-Alive", "TE", "Trailer",
+      "Transfer-Encoding", "Upgrade" };
+
+  std::vector<std::string> named;
+  const std::string* connection = find_header(response.headers, "Connection");
+  if (connection != 0)
+    boost::algorithm::split(named, *connection, boost::algorithm::is_any_of(","));
+
+  if (find_header(response.headers, "Transfer-Encoding") != 0)
+    named.push_back("Content-Length");
+
+  std::string head;
+  head.reserve(1024);
+  head.append("HTTP/1.1 ").append(boost::lexical_cast<std::string>(response.status));
+  head.append(" ").append(response.reason).append("\r\n");
+
+  for (std::size_t i = 0; i < response.headers.size(); ++i)
+  {
+    const server::header& h = response.headers[i];
+    bool skip = boost::algorithm::istarts_with(h.name, "Proxy-");
+    for (std::size_t j = 0; j < sizeof(hop_by_hop) / sizeof(hop_by_hop[0]) && !skip; ++j)
+      skip = boost::algorithm::iequals(h.name, hop_by_hop[j]);
+
+    for (std::size_t j = 0; j < named.size() && !skip; ++j)
+      skip = boost::algorithm::iequals(h.name, boost::algorithm::trim_copy(named[j]));
+
+    if (!skip)
+      head.append(h.name).append(": ").append(h.value).append("\r\n");
+  }
+
+  return head;
+}
+
+} // namespace proxy
+} // namespace http
+
+#endif // HTTP_PROXY_MESSAGE_FRAMING_HPP
@@ -0,0 +1,132 @@
+//
+// posix_main.cpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#define BOOST_LIB_DIAGNOSTIC
+
+#include <iostream>
+#include <string>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <bas/server.hpp>
+
+#include "proxy_work.hpp"
+
+#if !defined(_WIN32)
+
+#include <pthread.h>
+#include <signal.h>
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    // Check command line arguments.
+    if (argc != 10)
+    {
+      std::cerr << "Usage: http_proxy <ip> <port> <io_pool> <work_pool> <pre_handler> <max_idle> <io_timeout> <cache_mb> <route_file>\n";
+      std::cerr << "  For IPv4, try:\n";
+      std::cerr << "    http_proxy 0.0.0.0 80 4 4 500 32 60 64 routes.conf\n";
+      std::cerr << "  For IPv6, try:\n";
+      std::cerr << "    http_proxy 0::0 80 4 4 500 32 60 64 routes.conf\n";
+      return 1;
+    }
+
+    // Initialise server.
+    unsigned short port = boost::lexical_cast<unsigned short>(argv[2]);
+    std::size_t io_pool_size = boost::lexical_cast<std::size_t>(argv[3]);
+    std::size_t work_pool_size = boost::lexical_cast<std::size_t>(argv[4]);
+    std::size_t preallocated_handler_number = boost::lexical_cast<std::size_t>(argv[5]);
+    std::size_t max_idle = boost::lexical_cast<std::size_t>(argv[6]);
+    unsigned int io_timeout = boost::lexical_cast<unsigned int>(argv[7]);
+    std::size_t cache_size = boost::lexical_cast<std::size_t>(argv[8]) * 1024 * 1024;
+
+    http::proxy::route_table routes;
+    if (!routes.load(argv[9]))
+    {
+      std::cerr << "invalid route file " << argv[9] << "\n";
+      return 1;
+    }
+
+    using http::proxy::proxy_work;
+    using http::proxy::proxy_work_allocator;
+
+    typedef bas::server<proxy_work, proxy_work_allocator> server;
+    typedef bas::service_handler_pool<proxy_work, proxy_work_allocator> server_handler_pool;
+    typedef bas::service_handler_pool<proxy_work::upstream_work_type, proxy_work::upstream_work_allocator_type> client_handler_pool;
+
+    // Idle upstream connections are closed by the io_timeout of the reads watching them.
+    proxy_work::pool_type upstreams(max_idle);
+
+    // A response is stored only if it is no more than 1/64 of the cache.
+    boost::scoped_ptr<proxy_work::cache_type> cache;
+    if (cache_size != 0)
+      cache.reset(new proxy_work::cache_type(cache_size, cache_size / 64));
+
+    proxy_work::client_type c(new client_handler_pool(new proxy_work::upstream_work_allocator_type(upstreams),
+        preallocated_handler_number,
+        8192,
+        16384,
+        0,
+        io_timeout));
+
+    server s(new server_handler_pool(new proxy_work_allocator(routes, c, upstreams, cache.get()),
+                preallocated_handler_number,
+                8192,
+                16384,
+                0,
+                io_timeout),
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(argv[1]), port),
+        io_pool_size,
+        work_pool_size,
+        work_pool_size,
+        100,
+        250);
+
+    // Block all signals for background thread.
+    sigset_t new_mask;
+    sigfillset(&new_mask);
+    sigset_t old_mask;
+    pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
+
+    // Run server in background thread.
+    boost::thread t(boost::bind(&server::run, &s));
+
+    // Restore previous signals.
+    pthread_sigmask(SIG_SETMASK, &old_mask, 0);
+
+    // Wait for signal indicating time to shut down.
+    sigset_t wait_mask;
+    sigemptyset(&wait_mask);
+    sigaddset(&wait_mask, SIGINT);
+    sigaddset(&wait_mask, SIGQUIT);
+    sigaddset(&wait_mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &wait_mask, 0);
+    int sig = 0;
+    sigwait(&wait_mask, &sig);
+
+    // Stop the server.
+    s.stop();
+    t.join();
+
+    // Release the idle upstream connections.
+    upstreams.clear();
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}
+
+#endif // !defined(_WIN32)
@@ -0,0 +1,979 @@
+//
+// proxy_work.hpp
+// ~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_PROXY_PROXY_WORK_HPP
+#define HTTP_PROXY_PROXY_WORK_HPP
+
+#include <boost/asio.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <bas/client.hpp>
+#include <bas/service_handler.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../../http/server/reply.hpp"
+#include "../../http/server/request.hpp"
+#include "../../http/server/request_parser.hpp"
+#include "message_framing.hpp"
+#include "response_cache.hpp"
+#include "route_table.hpp"
+#include "upstream_pool.hpp"
+#include "upstream_work.hpp"
+
+namespace http {
+namespace proxy {
+
+/// Object for handle a downstream connection of the reverse proxy.
+//    Requests are parsed, routed by host and path prefix, and forwarded with
+//    their bodies to a keep-alive upstream connection taken from the pool or
+//    connected by bas::client. Bodies are streamed through the io_buffers with
+//    back-pressure in both directions, the upstream connection is returned to
+//    the pool after a complete exchange. Pipelined requests are served one by
+//    one. Cacheable GET responses are stored in the response_cache while they
+//    are forwarded, and later requests are served from it without upstream.
+class proxy_work
+{
+public:
+  typedef bas::service_handler<proxy_work> proxy_handler_type;
+  typedef boost::intrusive_ptr<proxy_handler_type> proxy_handler_ptr;
+  typedef response_cache<proxy_handler_ptr> cache_type;
+  typedef upstream_work<proxy_work> upstream_work_type;
+  typedef upstream_work_allocator<proxy_work> upstream_work_allocator_type;
+  typedef upstream_work_type::upstream_handler_type upstream_handler_type;
+  typedef upstream_work_type::upstream_handler_ptr upstream_handler_ptr;
+  typedef upstream_work_type::pool_type pool_type;
+  typedef bas::client<upstream_work_type, upstream_work_allocator_type> client_type;
+  typedef boost::asio::ip::tcp::endpoint endpoint_type;
+
+  /// Constructor, the cache is null if disabled.
+  proxy_work(const route_table& routes, client_type& client, pool_type& pool, cache_type* cache)
+    : routes_(routes),
+      client_(client),
+      pool_(pool),
+      cache_(cache),
+      upstream_(),
+      endpoint_(),
+      local_endpoint_(),
+      client_address_(),
+      cache_key_(),
+      capture_(),
+      max_age_(0),
+      cached_(),
+      cached_fields_(),
+      state_(reading_request),
+      reading_(false),
+      writing_(false),
+      filling_(false)
+  {
+    reset_request();
+  }
+
+  void on_clear(proxy_handler_type& handler)
+  {
+    cached_.reset();
+    upstream_.reset();
+    client_address_.clear();
+    state_ = reading_request;
+    reading_ = false;
+    writing_ = false;
+    reset_request();
+  }
+
+  void on_open(proxy_handler_type& handler)
+  {
+    boost::system::error_code ec;
+    client_address_ = handler.socket().remote_endpoint(ec).address().to_string();
+
+    read_request(handler);
+  }
+
+  void on_read(proxy_handler_type& handler, std::size_t bytes_transferred)
+  {
+    reading_ = false;
+    handler.read_buffer().produce(bytes_transferred);
+
+    switch (state_)
+    {
+      case reading_request:
+        parse_request(handler);
+        break;
+
+      case forwarding:
+        forward_request(handler);
+        break;
+
+      // Keep the data until the upstream is ready.
+      default:
+        break;
+    }
+  }
+
+  void on_write(proxy_handler_type& handler, std::size_t bytes_transferred)
+  {
+    writing_ = false;
+
+    // The cached response is written.
+    if (cached_.get() != 0)
+    {
+      cached_.reset();
+      maybe_finish(handler);
+      return;
+    }
+
+    handler.write_buffer().consume(bytes_transferred);
+    handler.write_buffer().crunch();
+
+    write_downstream(handler);
+
+    // Resume the response stopped by a full write_buffer.
+    if (upstream_paused_ && upstream_.get() != 0)
+    {
+      upstream_paused_ = false;
+      forward_response(handler);
+      return;
+    }
+
+    maybe_finish(handler);
+  }
+
+  void on_close(proxy_handler_type& handler, const boost::system::error_code& e)
+  {
+    abort_fill();
+    close_upstream();
+  }
+
+  void on_parent(proxy_handler_type& handler, const bas::event event)
+  {
+    // Woken by the cache after the fill of the waited response.
+    if (event.state == bas::event::notify && state_ == waiting_cache)
+      lookup_cache(handler);
+  }
+
+  void on_child(proxy_handler_type& handler, const bas::event event)
+  {
+    switch (event.state)
+    {
+      case bas::event::open:
+        if (state_ == connecting && upstream_.get() != 0)
+          start_forwarding(handler);
+        break;
+
+      case bas::event::read:
+        if (!upstream_reading_)
+          break;
+
+        upstream_reading_ = false;
+        response_started_ = true;
+        forward_response(handler);
+        break;
+
+      case bas::event::write:
+        if (!upstream_writing_)
+          break;
+
+        upstream_writing_ = false;
+        write_upstream();
+        if (state_ == forwarding && !reading_)
+          forward_request(handler);
+
+        maybe_finish(handler);
+        break;
+
+      case bas::event::close:
+        upstream_closed(handler, event.ec);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  void on_set_child(proxy_handler_type& handler, const upstream_handler_ptr& upstream)
+  {
+    upstream_ = upstream;
+  }
+
+private:
+  /// The state of the downstream connection.
+  enum state_t
+  {
+    reading_request = 0,
+    waiting_cache,
+    connecting,
+    forwarding,
+    closing
+  };
+
+  /// Reset to receive a new request.
+  void reset_request()
+  {
+    abort_fill();
+    capture_.clear();
+    request_.reset();
+    request_parser_.reset();
+    request_body_.reset(body_framing::none);
+    response_body_.reset(body_framing::none);
+    keep_alive_ = false;
+    head_request_ = false;
+    reused_ = false;
+    retried_ = false;
+    cache_waited_ = false;
+    request_sent_ = false;
+    response_head_done_ = false;
+    response_started_ = false;
+    response_forwarded_ = false;
+    response_done_ = false;
+    response_dechunked_ = false;
+    upstream_reusable_ = false;
+    upstream_reading_ = false;
+    upstream_writing_ = false;
+    upstream_paused_ = false;
+  }
+
+  /// Start a read of the downstream connection if none in progress.
+  void start_read(proxy_handler_type& handler)
+  {
+    if (reading_)
+      return;
+
+    handler.read_buffer().crunch();
+    if (handler.read_buffer().space() == 0)
+    {
+      fail(handler, server::reply::bad_request);
+      return;
+    }
+
+    reading_ = true;
+    handler.async_read_some();
+  }
+
+  /// Start the write of the downstream connection if none in progress.
+  void write_downstream(proxy_handler_type& handler)
+  {
+    if (writing_ || handler.write_buffer().empty())
+      return;
+
+    writing_ = true;
+    handler.async_write();
+  }
+
+  /// Read the next request, the bytes left from the previous one come first.
+  void read_request(proxy_handler_type& handler)
+  {
+    state_ = reading_request;
+
+    if (!handler.read_buffer().empty())
+      parse_request(handler);
+    else
+      start_read(handler);
+  }
+
+  void parse_request(proxy_handler_type& handler)
+  {
+    bas::io_buffer& input = handler.read_buffer();
+
+    boost::tribool result;
+    unsigned char* end = 0;
+    boost::tie(result, end) = request_parser_.parse(request_, input.data(), input.data() + input.size());
+    input.consume(end - input.data());
+
+    if (!result)
+    {
+      fail(handler, server::reply::bad_request);
+      return;
+    }
+
+    if (boost::indeterminate(result))
+    {
+      start_read(handler);
+      return;
+    }
+
+    head_request_ = (request_.method == "HEAD");
+
+    const std::string* connection = find_header(request_.headers, "Connection");
+    if (request_.http_version_major == 1 && request_.http_version_minor == 0)
+      keep_alive_ = (connection != 0 && has_token(*connection, "keep-alive"));
+    else
+      keep_alive_ = (connection == 0 || !has_token(*connection, "close"));
+
+    // Tunnels are not supported.
+    if (request_.method == "CONNECT")
+    {
+      fail(handler, server::reply::not_implemented);
+      return;
+    }
+
+    if (!frame_body(request_.headers, request_body_, body_framing::none))
+    {
+      fail(handler, server::reply::bad_request);
+      return;
+    }
+
+    const std::string* host = find_header(request_.headers, "Host");
+    upstream_group_ptr group = routes_.match((host != 0) ? *host : std::string(), request_.uri);
+    if (group.get() == 0)
+    {
+      fail(handler, server::reply::not_found);
+      return;
+    }
+
+    endpoint_ = group->next();
+
+    if (cacheable_request())
+    {
+      cache_key_ = request_.method + ' ' + boost::algorithm::to_lower_copy(*host) + request_.uri;
+      lookup_cache(handler);
+      return;
+    }
+
+    connect_upstream(handler);
+  }
+
+  /// Check whether the response of the request may come from the cache.
+  bool cacheable_request() const
+  {
+    if (cache_ == 0 || request_.method != "GET" || request_body_.type() != body_framing::none)
+      return false;
+
+    if (find_header(request_.headers, "Host") == 0 || find_header(request_.headers, "Authorization") != 0)
+      return false;
+
+    const std::string* control = find_header(request_.headers, "Cache-Control");
+    if (control != 0 && (has_token(*control, "no-cache") || has_token(*control, "no-store")))
+      return false;
+
+    const std::string* pragma = find_header(request_.headers, "Pragma");
+    return pragma == 0 || !has_token(*pragma, "no-cache");
+  }
+
+  /// Serve the request from the cache, or fetch it from the upstream.
+  //    A request waits for a concurrent fetch only once, and fetches by itself
+  //    if the response is still not stored.
+  void lookup_cache(proxy_handler_type& handler)
+  {
+    cached_response_ptr response;
+    proxy_handler_ptr waiter = handler.shared_from_this();
+
+    switch (cache_->lookup(cache_key_, request_.headers, cache_waited_ ? 0 : &waiter, response))
+    {
+      case cache_type::hit:
+        serve_cached(handler, response);
+        return;
+
+      case cache_type::wait:
+        state_ = waiting_cache;
+        cache_waited_ = true;
+        return;
+
+      case cache_type::fill:
+        filling_ = true;
+        break;
+
+      case cache_type::pass:
+      default:
+        break;
+    }
+
+    connect_upstream(handler);
+  }
+
+  /// Write a cached response without copy.
+  void serve_cached(proxy_handler_type& handler, const cached_response_ptr& response)
+  {
+    state_ = forwarding;
+    request_sent_ = true;
+    response_forwarded_ = true;
+    response_done_ = true;
+
+    // The shared head and body are written around the fields of this client.
+    cached_ = response;
+    cached_fields_ = "Age: " + boost::lexical_cast<std::string>(response_age(*response));
+    cached_fields_.append(keep_alive_ ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+
+    writing_ = true;
+    handler.async_write(cached_buffers(response, boost::asio::buffer(cached_fields_)));
+  }
+
+  /// Give up the fill of the cache and wake the waiters.
+  void abort_fill()
+  {
+    if (!filling_)
+      return;
+
+    filling_ = false;
+    capture_.clear();
+    cache_->abort(cache_key_);
+  }
+
+  /// Keep the bytes of the response body for the cache.
+  void capture(const unsigned char* data, std::size_t size)
+  {
+    if (!filling_)
+      return;
+
+    if (capture_.size() + size > cache_->max_response())
+    {
+      abort_fill();
+      return;
+    }
+
+    capture_.append(reinterpret_cast<const char*>(data), size);
+  }
+
+  /// Take an idle upstream connection of this thread, or connect a new one.
+  void connect_upstream(proxy_handler_type& handler)
+  {
+    state_ = connecting;
+
+    upstream_ = pool_.take(handler.work_service(), endpoint_);
+    if (upstream_.get() != 0)
+    {
+      reused_ = true;
+      upstream_->work_handler().attach(handler.shared_from_this());
+      start_forwarding(handler);
+      return;
+    }
+
+    reused_ = false;
+    if (!client_.connect(handler, endpoint_, local_endpoint_))
+      fail(handler, server::reply::service_unavailable);
+  }
+
+  /// Send the request head to the upstream connection and start the exchange.
+  void start_forwarding(proxy_handler_type& handler)
+  {
+    state_ = forwarding;
+
+    bas::io_buffer& queue = upstream_->write_buffer();
+    queue.clear();
+
+    std::string head = make_request_head();
+    if (head.size() > queue.space())
+    {
+      fail(handler, server::reply::bad_request);
+      return;
+    }
+
+    queue.produce(head.size(), reinterpret_cast<const unsigned char*>(head.data()));
+
+    forward_request(handler);
+    if (state_ != forwarding)
+      return;
+
+    upstream_reading_ = true;
+    upstream_->parent_dispatch(bas::event(bas::event::read));
+  }
+
+  /// Build the request head for the upstream, hop-by-hop headers are removed.
+  std::string make_request_head() const
+  {
+    static const char* hop_by_hop[] = { "Connection", "Keep-Alive", "Proxy-Connection", "TE",
+        "Trailer", "Upgrade", "X-Forwarded-For" };
+
+    std::string forwarded_for;
+    std::string head;
+    head.reserve(1024);
+    head.append(request_.method).append(" ").append(request_.uri).append(" HTTP/1.1\r\n");
+
+    for (std::size_t i = 0; i < request_.headers.size(); ++i)
+    {
+      const server::header& h = request_.headers[i];
+      bool skip = false;
+      for (std::size_t j = 0; j < sizeof(hop_by_hop) / sizeof(hop_by_hop[0]) && !skip; ++j)
+        skip = boost::algorithm::iequals(h.name, hop_by_hop[j]);
+
+      if (boost::algorithm::iequals(h.name, "X-Forwarded-For"))
+        forwarded_for = h.value;
+
+      if (!skip)
+        head.append(h.name).append(": ").append(h.value).append("\r\n");
+    }
+
+    // Append the downstream client to the forwarding chain.
+    if (!forwarded_for.empty())
+      forwarded_for.append(", ");
+
+    head.append("X-Forwarded-For: ").append(forwarded_for).append(client_address_).append("\r\n");
+    head.append("Connection: keep-alive\r\n\r\n");
+
+    return head;
+  }
+
+  /// Is the downstream client an HTTP/1.0 one.
+  bool http10_client() const
+  {
+    return request_.http_version_major == 1 && request_.http_version_minor == 0;
+  }
+
+  /// Build the response head for the downstream, the framing and the
+  /// connection are set for the client.
+  std::string make_response_head(const response_head& response) const
+  {
+    std::string head = end_to_end_head(response);
+
+    // Interim responses carry no framing and no connection.
+    if (response.status / 100 == 1 && response.status != 101)
+      return head.append("\r\n");
+
+    const std::string* encoding = find_header(response.headers, "Transfer-Encoding");
+    if (encoding != 0 && !http10_client())
+      head.append("Transfer-Encoding: ").append(*encoding).append("\r\n");
+
+    head.append(keep_alive_ ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+
+    return head;
+  }
+
+  /// Move the request body from the downstream to the upstream connection.
+  void forward_request(proxy_handler_type& handler)
+  {
+    bas::io_buffer& input = handler.read_buffer();
+    bas::io_buffer& queue = upstream_->write_buffer();
+
+    if (!request_body_.done() && !input.empty())
+    {
+      std::size_t n = request_body_.consume(input.data(), (std::min)(input.size(), queue.space()));
+      queue.produce(n, input.data());
+      input.consume(n);
+    }
+
+    if (request_body_.error())
+    {
+      fail(handler, server::reply::bad_request);
+      return;
+    }
+
+    write_upstream();
+
+    // Read more body only when the whole buffer can be queued.
+    if (!request_body_.done() && input.empty() && queue.space() >= input.capacity())
+      start_read(handler);
+  }
+
+  /// Start the write of the upstream connection if none in progress.
+  void write_upstream()
+  {
+    if (upstream_writing_ || upstream_.get() == 0)
+      return;
+
+    if (!upstream_->write_buffer().empty())
+    {
+      upstream_writing_ = true;
+      upstream_->parent_dispatch(bas::event(bas::event::write));
+    }
+    else if (request_body_.done())
+    {
+      request_sent_ = true;
+    }
+  }
+
+  /// Move the response from the upstream to the downstream connection.
+  void forward_response(proxy_handler_type& handler)
+  {
+    bas::io_buffer& input = upstream_->read_buffer();
+    bas::io_buffer& queue = handler.write_buffer();
+
+    while (!response_head_done_)
+    {
+      std::size_t length = find_head_end(input.data(), input.size());
+      if (length == 0)
+      {
+        input.crunch();
+        if (input.space() == 0)
+        {
+          fail(handler, server::reply::bad_gateway);
+          return;
+        }
+
+        upstream_reading_ = true;
+        upstream_->parent_dispatch(bas::event(bas::event::read));
+        return;
+      }
+
+      response_head& head = response_head_;
+      if (!head.parse(input.data(), length))
+      {
+        fail(handler, server::reply::bad_gateway);
+        return;
+      }
+
+      // Interim responses are followed by the final one, HTTP/1.0 clients
+      // don't expect them.
+      if (head.status / 100 == 1 && head.status != 101)
+      {
+        if (!http10_client())
+        {
+          std::string text = make_response_head(head);
+          if (text.size() > queue.space())
+          {
+            upstream_paused_ = true;
+            return;
+          }
+
+          queue.produce(text.size(), reinterpret_cast<const unsigned char*>(text.data()));
+          response_forwarded_ = true;
+        }
+
+        input.consume(length);
+        continue;
+      }
+
+      if (head_request_ || head.status / 100 == 1 || head.status == 204 || head.status == 304)
+        response_body_.reset(body_framing::none);
+      else if (!frame_body(head.headers, response_body_, body_framing::until_close))
+      {
+        handler.close();
+        return;
+      }
+
+      // HTTP/1.0 clients get a chunked body without the framing, ended by close.
+      response_dechunked_ = (response_body_.type() == body_framing::chunked && http10_client());
+      if (response_body_.type() == body_framing::until_close || response_dechunked_)
+        keep_alive_ = false;
+
+      std::string text = make_response_head(head);
+      if (text.size() > queue.space())
+      {
+        upstream_paused_ = true;
+        return;
+      }
+
+      queue.produce(text.size(), reinterpret_cast<const unsigned char*>(text.data()));
+      input.consume(length);
+      response_forwarded_ = true;
+      response_head_done_ = true;
+
+      upstream_reusable_ = head.keep_alive() && response_body_.type() != body_framing::until_close;
+
+      // Only complete responses of a reusable connection are stored.
+      max_age_ = response_max_age(head);
+      if (max_age_ < 0 || !upstream_reusable_)
+        abort_fill();
+    }
+
+    // The cache keeps the payload only, the chunk framing is also left out
+    // for a dechunked response.
+    while (!response_body_.done() && !response_body_.error() && !input.empty() && queue.space() != 0)
+    {
+      std::size_t piece = 0;
+      std::size_t n = response_body_.consume_piece(input.data(), (std::min)(input.size(), queue.space()), piece);
+      if (response_dechunked_)
+        queue.produce(piece, input.data() + n - piece);
+      else
+        queue.produce(n, input.data());
+
+      capture(input.data() + n - piece, piece);
+      input.consume(n);
+    }
+
+    if (response_body_.error())
+    {
+      handler.close();
+      return;
+    }
+
+    write_downstream(handler);
+
+    if (response_body_.done())
+    {
+      // Extra bytes would break the next response of the connection.
+      if (!input.empty())
+        upstream_reusable_ = false;
+
+      response_done_ = true;
+      if (filling_)
+      {
+        filling_ = false;
+        cache_->insert(cache_key_, request_.headers, response_head_, capture_, max_age_);
+      }
+
+      maybe_finish(handler);
+      return;
+    }
+
+    // Read more only when the whole buffer can be queued.
+    input.crunch();
+    if (input.empty() && queue.space() >= input.capacity())
+    {
+      upstream_reading_ = true;
+      upstream_->parent_dispatch(bas::event(bas::event::read));
+    }
+    else
+    {
+      upstream_paused_ = true;
+    }
+  }
+
+  /// Complete the exchange after the response is sent downstream.
+  void maybe_finish(proxy_handler_type& handler)
+  {
+    if (!response_done_ || writing_ || !handler.write_buffer().empty())
+      return;
+
+    if (state_ == closing)
+    {
+      handler.close();
+      return;
+    }
+
+    // Wait for the last write of the request.
+    if (!request_sent_ && request_body_.done() && upstream_writing_)
+      return;
+
+    // The unsent request body makes the downstream out of sync.
+    if (!request_sent_)
+      keep_alive_ = false;
+
+    release_upstream();
+
+    if (keep_alive_)
+    {
+      reset_request();
+      read_request(handler);
+    }
+    else
+    {
+      handler.close();
+    }
+  }
+
+  /// Return the upstream connection to the pool, or close it if it can't be reused.
+  void release_upstream()
+  {
+    if (upstream_.get() == 0)
+      return;
+
+    if (upstream_reusable_ && request_sent_ && !upstream_writing_ && !upstream_reading_)
+    {
+      upstream_handler_ptr upstream = upstream_;
+      upstream_.reset();
+      upstream->work_handler().release(*upstream);
+      return;
+    }
+
+    close_upstream();
+  }
+
+  /// Detach and close the upstream connection.
+  void close_upstream()
+  {
+    if (upstream_.get() == 0)
+      return;
+
+    upstream_handler_ptr upstream = upstream_;
+    upstream_.reset();
+    upstream->work_handler().detach();
+    upstream->close();
+  }
+
+  void upstream_closed(proxy_handler_type& handler, const boost::system::error_code& ec)
+  {
+    upstream_.reset();
+    upstream_reading_ = false;
+    upstream_writing_ = false;
+
+    if (state_ == connecting || (state_ == forwarding && !response_started_))
+    {
+      // A kept connection may be closed by the server just before reused, retry once.
+      if (state_ == forwarding && reused_ && !retried_ && request_body_.type() == body_framing::none)
+      {
+        retried_ = true;
+        request_sent_ = false;
+        connect_upstream(handler);
+        return;
+      }
+
+      fail(handler, server::reply::bad_gateway);
+      return;
+    }
+
+    if (state_ != forwarding || response_done_)
+      return;
+
+    // Close is the end of a response without length.
+    if (response_head_done_ && response_body_.type() == body_framing::until_close)
+    {
+      response_done_ = true;
+      keep_alive_ = false;
+      maybe_finish(handler);
+      return;
+    }
+
+    // The response is truncated.
+    handler.close();
+  }
+
+  /// Send an error reply and close the connection.
+  void fail(proxy_handler_type& handler, server::reply::status_type status)
+  {
+    close_upstream();
+
+    // Too late for a reply after a part of the response is sent.
+    if (response_forwarded_)
+    {
+      handler.close();
+      return;
+    }
+
+    state_ = closing;
+    keep_alive_ = false;
+    response_done_ = true;
+
+    bas::io_buffer& queue = handler.write_buffer();
+    queue.clear();
+
+    server::reply reply = server::reply::stock_reply(status);
+    std::vector<boost::asio::const_buffer> buffers = reply.to_buffers();
+    for (std::size_t i = 0; i < buffers.size(); ++i)
+    {
+      std::size_t size = boost::asio::buffer_size(buffers[i]);
+      if (size > queue.space())
+      {
+        handler.close();
+        return;
+      }
+
+      queue.produce(size, boost::asio::buffer_cast<const unsigned char*>(buffers[i]));
+    }
+
+    write_downstream(handler);
+  }
+
+  /// The routes of the requests.
+  const route_table& routes_;
+
+  /// The client for connecting upstream servers.
+  client_type& client_;
+
+  /// The idle upstream connections.
+  pool_type& pool_;
+
+  /// The response cache, null if disabled.
+  cache_type* cache_;
+
+  /// The upstream connection of the current request.
+  upstream_handler_ptr upstream_;
+
+  /// The upstream server of the current request.
+  endpoint_type endpoint_;
+
+  /// The local endpoint for connecting, any address.
+  endpoint_type local_endpoint_;
+
+  /// The address of the downstream client.
+  std::string client_address_;
+
+  /// The incoming request.
+  server::request request_;
+
+  /// The parser for the incoming request.
+  server::request_parser request_parser_;
+
+  /// The framing of the request body.
+  body_framing request_body_;
+
+  /// The framing of the response body.
+  body_framing response_body_;
+
+  /// The head of the response.
+  response_head response_head_;
+
+  /// The cache key of the request.
+  std::string cache_key_;
+
+  /// The response kept for the cache.
+  std::string capture_;
+
+  /// The freshness lifetime of the response.
+  long max_age_;
+
+  /// The cached response being written.
+  cached_response_ptr cached_;
+
+  /// The fields of the connection written with the cached response.
+  std::string cached_fields_;
+
+  /// The state of the downstream connection.
+  state_t state_;
+
+  /// Flags of the downstream connection.
+  bool reading_;
+  bool writing_;
+  bool keep_alive_;
+
+  /// Flags of the current exchange.
+  bool head_request_;
+  bool reused_;
+  bool retried_;
+  bool cache_waited_;
+  bool filling_;
+  bool request_sent_;
+  bool response_head_done_;
+  bool response_started_;
+  bool response_forwarded_;
+  bool response_done_;
+  bool response_dechunked_;
+  bool upstream_reusable_;
+  bool upstream_reading_;
+  bool upstream_writing_;
+  bool upstream_paused_;
+};
+
+/// Allocator of the downstream connections.
+class proxy_work_allocator
+{
+public:
+  typedef boost::asio::ip::tcp::socket socket_type;
+
+  /// Constructor.
+  proxy_work_allocator(const route_table& routes,
+      proxy_work::client_type& client,
+      proxy_work::pool_type& pool,
+      proxy_work::cache_type* cache)
+    : routes_(routes),
+      client_(client),
+      pool_(pool),
+      cache_(cache)
+  {
+  }
+
+  socket_type* make_socket(void* address, boost::asio::io_service& io_service)
+  {
+    return new (address) socket_type(io_service);
+  }
+
+  proxy_work* make_handler(void* address)
+  {
+    return new (address) proxy_work(routes_, client_, pool_, cache_);
+  }
+
+private:
+  /// The routes of the requests.
+  const route_table& routes_;
+
+  /// The client for connecting upstream servers.
+  proxy_work::client_type& client_;
+
+  /// The idle upstream connections.
+  proxy_work::pool_type& pool_;
+
+  /// The response cache, null if disabled.
+  proxy_work::cache_type* cache_;
+};
+
+} // namespace proxy
+} // namespace http
+
+#endif // HTTP_PROXY_PROXY_WORK_HPP
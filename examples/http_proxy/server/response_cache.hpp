@@ -0,0 +1,448 @@
+//
+// response_cache.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_PROXY_RESPONSE_CACHE_HPP
+#define HTTP_PROXY_RESPONSE_CACHE_HPP
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <bas/service_handler.hpp>
+
+#include "message_framing.hpp"
+
+#if !defined(HTTP_PROXY_CACHE_SHARDS)
+# define HTTP_PROXY_CACHE_SHARDS 16
+#endif
+
+namespace http {
+namespace proxy {
+
+/// A serialized response kept by the cache, never changed after stored.
+struct cached_response
+{
+  /// The status line and the end-to-end headers with the length of the body,
+  /// the Age and Connection fields and the empty line are added per client.
+  std::string head;
+
+  /// The body without the chunk framing.
+  std::string body;
+
+  /// The time the response was generated by the origin.
+  boost::posix_time::ptime date;
+
+  /// The time the response becomes stale.
+  boost::posix_time::ptime expires;
+
+  /// The request headers named by Vary and their values.
+  std::vector<std::string> vary_names;
+  std::vector<std::string> vary_values;
+};
+
+typedef boost::shared_ptr<const cached_response> cached_response_ptr;
+
+/// Get the age in seconds of a cached response.
+inline long response_age(const cached_response& response)
+{
+  long age = (boost::posix_time::second_clock::universal_time() - response.date).total_seconds();
+  return (age > 0) ? age : 0;
+}
+
+/// Buffer sequence of a cached response, holding a reference of it until
+/// the write is completed, so a response is written to many clients without
+/// copy. The fields of the client, ended by the empty line, are written
+/// between the shared head and body, and must be kept by the caller.
+class cached_buffers
+{
+public:
+  typedef boost::asio::const_buffer value_type;
+  typedef const value_type* const_iterator;
+
+  cached_buffers(const cached_response_ptr& response, const value_type& fields)
+    : response_(response)
+  {
+    buffers_[0] = boost::asio::buffer(response->head);
+    buffers_[1] = fields;
+    buffers_[2] = boost::asio::buffer(response->body);
+  }
+
+  const_iterator begin() const
+  {
+    return buffers_;
+  }
+
+  const_iterator end() const
+  {
+    return buffers_ + 3;
+  }
+
+private:
+  cached_response_ptr response_;
+  value_type buffers_[3];
+};
+
+/// Get the freshness lifetime in seconds of a response, -1 if it can't be stored.
+inline long response_max_age(const response_head& head)
+{
+  if (head.status != 200 || find_header(head.headers, "Set-Cookie") != 0)
+    return -1;
+
+  const std::string* vary = find_header(head.headers, "Vary");
+  if (vary != 0 && has_token(*vary, "*"))
+    return -1;
+
+  const std::string* control = find_header(head.headers, "Cache-Control");
+  if (control == 0)
+    return -1;
+
+  if (has_token(*control, "no-store") || has_token(*control, "no-cache") || has_token(*control, "private"))
+    return -1;
+
+  // Shared caches prefer s-maxage over max-age.
+  long max_age = -1;
+  std::vector<std::string> items;
+  boost::algorithm::split(items, *control, boost::algorithm::is_any_of(","));
+  for (std::size_t i = 0; i < items.size(); ++i)
+  {
+    std::string item = boost::algorithm::trim_copy(items[i]);
+    if (boost::algorithm::istarts_with(item, "s-maxage="))
+      return std::atol(item.c_str() + 9);
+
+    if (boost::algorithm::istarts_with(item, "max-age="))
+      max_age = std::atol(item.c_str() + 8);
+  }
+
+  return (max_age > 0) ? max_age : -1;
+}
+
+/// In-process cache of upstream responses.
+//    Responses are keyed by method, host and uri, with variants selected by the
+//    request headers named in Vary. Keys are spread over shards, each has its
+//    own lock and LRU list bounded by a share of the capacity. The first miss
+//    of a key fetches from the upstream and the concurrent misses wait for it,
+//    they are woken by a notify event to the handler when the response is
+//    stored or the fetch is given up.
+template<typename Handler_Ptr>
+class response_cache
+  : private boost::noncopyable
+{
+public:
+  /// Result of lookup.
+  enum result_t
+  {
+    /// The response is found.
+    hit = 0,
+
+    /// Not found, the caller fetches and stores the response.
+    fill,
+
+    /// Not found, the caller is woken after another caller fetches it.
+    wait,
+
+    /// Not found, the caller fetches without storing.
+    pass
+  };
+
+  /// Construct with the capacity in bytes and the maximum size of a response.
+  response_cache(std::size_t capacity, std::size_t max_response)
+    : shards_(new shard[HTTP_PROXY_CACHE_SHARDS]),
+      shard_capacity_(capacity / HTTP_PROXY_CACHE_SHARDS),
+      max_response_(max_response)
+  {
+  }
+
+  /// Get the maximum size of a stored response.
+  std::size_t max_response() const
+  {
+    return max_response_;
+  }
+
+  /// Find a fresh response for the request, the waiter is null if the caller can't wait.
+  result_t lookup(const std::string& key,
+      const std::vector<server::header>& headers,
+      const Handler_Ptr* waiter,
+      cached_response_ptr& response)
+  {
+    boost::posix_time::ptime now = boost::posix_time::second_clock::universal_time();
+    shard& s = get_shard(key);
+
+    // Lock for synchronize access to data.
+    scoped_lock_t lock(s.mutex);
+
+    typename index_map::iterator iter = s.index.find(key);
+    if (iter != s.index.end())
+    {
+      std::vector<lru_iterator>& variants = iter->second;
+      for (std::size_t i = 0; i < variants.size(); )
+      {
+        const cached_response_ptr& r = variants[i]->second;
+        if (r->expires <= now)
+        {
+          erase(s, iter, i);
+          continue;
+        }
+
+        if (match_vary(*r, headers))
+        {
+          s.lru.splice(s.lru.begin(), s.lru, variants[i]);
+          response = r;
+          return hit;
+        }
+
+        ++i;
+      }
+
+      if (variants.empty())
+        s.index.erase(iter);
+    }
+
+    typename pending_map::iterator pending = s.pending.find(key);
+    if (pending != s.pending.end())
+    {
+      if (waiter == 0)
+        return pass;
+
+      pending->second.push_back(*waiter);
+      return wait;
+    }
+
+    s.pending[key];
+    return fill;
+  }
+
+  /// Store the response fetched by the fill of the key and wake the waiters,
+  /// the body is the payload without the chunk framing.
+  void insert(const std::string& key,
+      const std::vector<server::header>& headers,
+      const response_head& head,
+      std::string& body,
+      long max_age)
+  {
+    boost::posix_time::ptime now = boost::posix_time::second_clock::universal_time();
+
+    // The age of the upstream is kept by the date, the length is of the payload.
+    response_head stored = head;
+    long age = 0;
+    for (std::size_t i = 0; i < stored.headers.size(); )
+    {
+      bool is_age = boost::algorithm::iequals(stored.headers[i].name, "Age");
+      if (is_age)
+        age = (std::max)(age, std::atol(stored.headers[i].value.c_str()));
+
+      if (is_age || boost::algorithm::iequals(stored.headers[i].name, "Content-Length"))
+        stored.headers.erase(stored.headers.begin() + i);
+      else
+        ++i;
+    }
+
+    boost::shared_ptr<cached_response> r(new cached_response);
+    r->head = end_to_end_head(stored);
+    r->head.append("Content-Length: ").append(boost::lexical_cast<std::string>(body.size())).append("\r\n");
+    r->body.swap(body);
+    r->date = now - boost::posix_time::seconds(age);
+    r->expires = r->date + boost::posix_time::seconds(max_age);
+
+    const std::string* vary = find_header(head.headers, "Vary");
+    if (vary != 0)
+    {
+      boost::algorithm::split(r->vary_names, *vary, boost::algorithm::is_any_of(","));
+      for (std::size_t i = 0; i < r->vary_names.size(); ++i)
+      {
+        boost::algorithm::trim(r->vary_names[i]);
+        const std::string* value = find_header(headers, r->vary_names[i].c_str());
+        r->vary_values.push_back((value != 0) ? *value : std::string());
+      }
+    }
+
+    std::vector<Handler_Ptr> waiters;
+    shard& s = get_shard(key);
+    {
+      // Lock for synchronize access to data.
+      scoped_lock_t lock(s.mutex);
+
+      take_waiters(s, key, waiters);
+
+      // Replace the variant of the same Vary values.
+      typename index_map::iterator iter = s.index.insert(std::make_pair(key, std::vector<lru_iterator>())).first;
+      for (std::size_t i = 0; i < iter->second.size(); ++i)
+      {
+        if (match_vary(*iter->second[i]->second, r->vary_names, r->vary_values))
+        {
+          erase(s, iter, i);
+          break;
+        }
+      }
+
+      s.lru.push_front(std::make_pair(key, cached_response_ptr(r)));
+      iter->second.push_back(s.lru.begin());
+      s.size += entry_size(key, *r);
+
+      evict(s);
+    }
+
+    wake(waiters);
+  }
+
+  /// Give up the fill of the key and wake the waiters.
+  void abort(const std::string& key)
+  {
+    std::vector<Handler_Ptr> waiters;
+    shard& s = get_shard(key);
+    {
+      // Lock for synchronize access to data.
+      scoped_lock_t lock(s.mutex);
+
+      take_waiters(s, key, waiters);
+    }
+
+    wake(waiters);
+  }
+
+private:
+  typedef boost::asio::detail::mutex mutex_t;
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+  typedef std::list<std::pair<std::string, cached_response_ptr> > lru_list;
+  typedef typename lru_list::iterator lru_iterator;
+  typedef std::map<std::string, std::vector<lru_iterator> > index_map;
+  typedef std::map<std::string, std::vector<Handler_Ptr> > pending_map;
+
+  /// A part of the cache with its own lock.
+  struct shard
+  {
+    shard()
+      : mutex(),
+        lru(),
+        index(),
+        pending(),
+        size(0)
+    {
+    }
+
+    /// Mutex for synchronize access to data.
+    mutex_t mutex;
+
+    /// The responses, most recently used first.
+    lru_list lru;
+
+    /// The variants of each key.
+    index_map index;
+
+    /// The waiters of each key being filled.
+    pending_map pending;
+
+    /// The bytes of the stored responses.
+    std::size_t size;
+  };
+
+  shard& get_shard(const std::string& key)
+  {
+    return shards_[boost::hash<std::string>()(key) % HTTP_PROXY_CACHE_SHARDS];
+  }
+
+  static std::size_t entry_size(const std::string& key, const cached_response& r)
+  {
+    return key.size() + r.head.size() + r.body.size();
+  }
+
+  static bool match_vary(const cached_response& r, const std::vector<server::header>& headers)
+  {
+    for (std::size_t i = 0; i < r.vary_names.size(); ++i)
+    {
+      const std::string* value = find_header(headers, r.vary_names[i].c_str());
+      if (r.vary_values[i] != ((value != 0) ? *value : std::string()))
+        return false;
+    }
+
+    return true;
+  }
+
+  static bool match_vary(const cached_response& r,
+      const std::vector<std::string>& names,
+      const std::vector<std::string>& values)
+  {
+    return r.vary_names == names && r.vary_values == values;
+  }
+
+  /// Erase a variant of the key, the index entry is kept.
+  void erase(shard& s, typename index_map::iterator iter, std::size_t i)
+  {
+    std::vector<lru_iterator>& variants = iter->second;
+    s.size -= entry_size(iter->first, *variants[i]->second);
+    s.lru.erase(variants[i]);
+    variants.erase(variants.begin() + i);
+  }
+
+  /// Drop the least recently used responses over the capacity.
+  void evict(shard& s)
+  {
+    while (s.size > shard_capacity_ && !s.lru.empty())
+    {
+      lru_iterator last = --s.lru.end();
+      typename index_map::iterator iter = s.index.find(last->first);
+      std::vector<lru_iterator>& variants = iter->second;
+      for (std::size_t i = 0; i < variants.size(); ++i)
+      {
+        if (variants[i] == last)
+        {
+          erase(s, iter, i);
+          break;
+        }
+      }
+
+      if (variants.empty())
+        s.index.erase(iter);
+    }
+  }
+
+  static void take_waiters(shard& s, const std::string& key, std::vector<Handler_Ptr>& waiters)
+  {
+    typename pending_map::iterator pending = s.pending.find(key);
+    if (pending == s.pending.end())
+      return;
+
+    waiters.swap(pending->second);
+    s.pending.erase(pending);
+  }
+
+  /// Wake the waiters out of the lock.
+  static void wake(std::vector<Handler_Ptr>& waiters)
+  {
+    for (std::size_t i = 0; i < waiters.size(); ++i)
+      waiters[i]->parent_dispatch(bas::event(bas::event::notify));
+  }
+
+  /// The shards of the cache.
+  boost::scoped_array<shard> shards_;
+
+  /// The capacity of each shard.
+  std::size_t shard_capacity_;
+
+  /// The maximum size of a stored response.
+  std::size_t max_response_;
+};
+
+} // namespace proxy
+} // namespace http
+
+#endif // HTTP_PROXY_RESPONSE_CACHE_HPP
@@ -0,0 +1,166 @@
+//
+// route_table.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_PROXY_ROUTE_TABLE_HPP
+#define HTTP_PROXY_ROUTE_TABLE_HPP
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace http {
+namespace proxy {
+
+/// A group of upstream servers sharing requests by round robin.
+class upstream_group
+  : private boost::noncopyable
+{
+public:
+  typedef boost::asio::ip::tcp::endpoint endpoint_type;
+
+  /// Construct with the endpoints of the servers.
+  explicit upstream_group(const std::vector<endpoint_type>& endpoints)
+    : endpoints_(endpoints),
+      next_(0)
+  {
+    BOOST_ASSERT(!endpoints_.empty());
+  }
+
+  /// Get the server for the next request.
+  const endpoint_type& next()
+  {
+    return endpoints_[next_.fetch_add(1, boost::memory_order_relaxed) % endpoints_.size()];
+  }
+
+private:
+  /// The endpoints of the servers.
+  std::vector<endpoint_type> endpoints_;
+
+  /// Counter for choosing the next server.
+  boost::atomic<std::size_t> next_;
+};
+
+typedef boost::shared_ptr<upstream_group> upstream_group_ptr;
+
+/// Table for routing requests to upstream groups by host and path prefix.
+//    Routes are loaded before the server starts and never changed, so
+//    matching needs no lock.
+class route_table
+  : private boost::noncopyable
+{
+public:
+  /// Add a route, an empty host matches any host.
+  void add(const std::string& host, const std::string& prefix, upstream_group_ptr group)
+  {
+    route r;
+    r.host = boost::algorithm::to_lower_copy(host);
+    r.prefix = prefix;
+    r.group = group;
+    routes_.push_back(r);
+  }
+
+  /// Find the group of the longest matched prefix, routes of the host win over any host.
+  upstream_group_ptr match(const std::string& host, const std::string& uri) const
+  {
+    // Drop the port of the host.
+    std::string name = host.substr(0, host.find(':'));
+    boost::algorithm::to_lower(name);
+
+    const route* best = 0;
+    for (std::size_t i = 0; i < routes_.size(); ++i)
+    {
+      const route& r = routes_[i];
+      if (!r.host.empty() && r.host != name)
+        continue;
+
+      if (uri.compare(0, r.prefix.size(), r.prefix) != 0)
+        continue;
+
+      if (best == 0
+          || (best->host.empty() && !r.host.empty())
+          || (best->host.empty() == r.host.empty() && r.prefix.size() > best->prefix.size()))
+        best = &r;
+    }
+
+    return (best != 0) ? best->group : upstream_group_ptr();
+  }
+
+  /// Load routes from a file, return false on error.
+  //    Each line is "<host> <prefix> <ip:port>[,<ip:port>...]", "*" for any host.
+  bool load(const std::string& file)
+  {
+    std::ifstream is(file.c_str());
+    if (!is)
+      return false;
+
+    std::string line;
+    while (std::getline(is, line))
+    {
+      boost::algorithm::trim(line);
+      if (line.empty() || line[0] == '#')
+        continue;
+
+      std::istringstream fields(line);
+      std::string host, prefix, servers;
+      if (!(fields >> host >> prefix >> servers))
+        return false;
+
+      std::vector<std::string> items;
+      boost::algorithm::split(items, servers, boost::algorithm::is_any_of(","));
+
+      std::vector<upstream_group::endpoint_type> endpoints;
+      for (std::size_t i = 0; i < items.size(); ++i)
+      {
+        std::size_t colon = items[i].rfind(':');
+        if (colon == std::string::npos)
+          return false;
+
+        try
+        {
+          endpoints.push_back(upstream_group::endpoint_type(
+              boost::asio::ip::address::from_string(items[i].substr(0, colon)),
+              boost::lexical_cast<unsigned short>(items[i].substr(colon + 1))));
+        }
+        catch (std::exception&)
+        {
+          return false;
+        }
+      }
+
+      add((host == "*") ? std::string() : host, prefix, upstream_group_ptr(new upstream_group(endpoints)));
+    }
+
+    return !routes_.empty();
+  }
+
+private:
+  /// One route of the table.
+  struct route
+  {
+    std::string host;
+    std::string prefix;
+    upstream_group_ptr group;
+  };
+
+  /// The routes.
+  std::vector<route> routes_;
+};
+
+} // namespace proxy
+} // namespace http
+
+#endif // HTTP_PROXY_ROUTE_TABLE_HPP
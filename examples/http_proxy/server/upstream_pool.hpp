@@ -0,0 +1,119 @@
+//
+// upstream_pool.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_PROXY_UPSTREAM_POOL_HPP
+#define HTTP_PROXY_UPSTREAM_POOL_HPP
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace http {
+namespace proxy {
+
+/// Pool of idle keep-alive connections to the upstream servers.
+//    Connections are kept by the work_service they are bound to, a connection
+//    is only reused by a handler running in the same work_service thread.
+template<typename Handler_Ptr>
+class upstream_pool
+  : private boost::noncopyable
+{
+public:
+  typedef boost::asio::ip::tcp::endpoint endpoint_type;
+
+  /// Construct with the maximum idle connections of each endpoint and work_service.
+  explicit upstream_pool(std::size_t max_idle)
+    : mutex_(),
+      idle_(),
+      max_idle_(max_idle)
+  {
+  }
+
+  /// Take an idle connection, null if none.
+  Handler_Ptr take(boost::asio::io_service& work_service, const endpoint_type& endpoint)
+  {
+    scoped_lock_t lock(mutex_);
+
+    typename idle_map::iterator iter = idle_.find(key_type(&work_service, endpoint));
+    if (iter == idle_.end() || iter->second.empty())
+      return Handler_Ptr();
+
+    // The most recently used connection is the least likely closed by the server.
+    Handler_Ptr handler = iter->second.back();
+    iter->second.pop_back();
+
+    return handler;
+  }
+
+  /// Keep an idle connection, return false if the pool is full.
+  bool put(boost::asio::io_service& work_service, const endpoint_type& endpoint, const Handler_Ptr& handler)
+  {
+    scoped_lock_t lock(mutex_);
+
+    std::vector<Handler_Ptr>& handlers = idle_[key_type(&work_service, endpoint)];
+    if (handlers.size() >= max_idle_)
+      return false;
+
+    handlers.push_back(handler);
+    return true;
+  }
+
+  /// Remove an idle connection closed by the server.
+  void remove(boost::asio::io_service& work_service, const endpoint_type& endpoint, const Handler_Ptr& handler)
+  {
+    scoped_lock_t lock(mutex_);
+
+    typename idle_map::iterator iter = idle_.find(key_type(&work_service, endpoint));
+    if (iter == idle_.end())
+      return;
+
+    iter->second.erase(std::remove(iter->second.begin(), iter->second.end(), handler), iter->second.end());
+  }
+
+  /// Close and release all idle connections.
+  void clear()
+  {
+    idle_map idle;
+    {
+      scoped_lock_t lock(mutex_);
+      idle.swap(idle_);
+    }
+
+    for (typename idle_map::iterator iter = idle.begin(); iter != idle.end(); ++iter)
+    {
+      for (std::size_t i = 0; i < iter->second.size(); ++i)
+        iter->second[i]->close();
+    }
+  }
+
+private:
+  typedef boost::asio::detail::mutex mutex_t;
+  typedef boost::asio::detail::mutex::scoped_lock scoped_lock_t;
+  typedef std::pair<boost::asio::io_service*, endpoint_type> key_type;
+  typedef std::map<key_type, std::vector<Handler_Ptr> > idle_map;
+
+  /// Mutex for synchronize access to data.
+  mutex_t mutex_;
+
+  /// The idle connections.
+  idle_map idle_;
+
+  /// The maximum idle connections of each endpoint and work_service.
+  std::size_t max_idle_;
+};
+
+} // namespace proxy
+} // namespace http
+
+#endif // HTTP_PROXY_UPSTREAM_POOL_HPP
@@ -0,0 +1,226 @@
+//
+// upstream_work.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2012 Xu Ye Jun (moore.xu@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_PROXY_UPSTREAM_WORK_HPP
+#define HTTP_PROXY_UPSTREAM_WORK_HPP
+
+#include <boost/asio.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+#include <bas/service_handler.hpp>
+
+#include "upstream_pool.hpp"
+
+namespace http {
+namespace proxy {
+
+/// Object for handle a connection to an upstream server.
+//    The connection is driven by the parent proxy_work through events. Between
+//    requests it is kept idle in the upstream_pool with a read in progress, so
+//    a close by the server removes it from the pool.
+template<typename Parent_Work>
+class upstream_work
+{
+public:
+  typedef upstream_work<Parent_Work> upstream_work_type;
+  typedef bas::service_handler<upstream_work_type> upstream_handler_type;
+  typedef boost::intrusive_ptr<upstream_handler_type> upstream_handler_ptr;
+  typedef bas::service_handler<Parent_Work> parent_handler_type;
+  typedef boost::intrusive_ptr<parent_handler_type> parent_handler_ptr;
+  typedef upstream_pool<upstream_handler_ptr> pool_type;
+  typedef boost::asio::ip::tcp::endpoint endpoint_type;
+
+  /// Constructor.
+  explicit upstream_work(pool_type& pool)
+    : pool_(pool),
+      parent_(),
+      endpoint_(),
+      reading_(false),
+      idle_(false)
+  {
+  }
+
+  /// Attach to the parent handler, must be called in work_service thread.
+  void attach(const parent_handler_ptr& parent)
+  {
+    parent_ = parent;
+    idle_ = false;
+  }
+
+  /// Detach from the parent handler, no event is sent to it later.
+  void detach()
+  {
+    parent_.reset();
+  }
+
+  /// Keep the connection in the pool for next requests, close it if the pool is full.
+  void release(upstream_handler_type& handler)
+  {
+    parent_.reset();
+    handler.read_buffer().clear();
+    handler.write_buffer().clear();
+
+    if (!pool_.put(handler.work_service(), endpoint_, handler.shared_from_this()))
+    {
+      handler.close();
+      return;
+    }
+
+    idle_ = true;
+
+    // Watch for close by the server while idle.
+    if (!reading_)
+    {
+      reading_ = true;
+      handler.async_read_some();
+    }
+  }
+
+  void on_clear(upstream_handler_type& handler)
+  {
+    parent_.reset();
+    endpoint_ = endpoint_type();
+    reading_ = false;
+    idle_ = false;
+  }
+
+  void on_set_parent(upstream_handler_type& handler, const parent_handler_ptr& parent)
+  {
+    attach(parent);
+  }
+
+  void on_open(upstream_handler_type& handler)
+  {
+    boost::system::error_code ec;
+    endpoint_ = handler.socket().remote_endpoint(ec);
+
+    if (parent_.get() != 0)
+      parent_->child_dispatch(bas::event(bas::event::open));
+  }
+
+  void on_read(upstream_handler_type& handler, std::size_t bytes_transferred)
+  {
+    reading_ = false;
+
+    // Nothing is expected from an idle connection.
+    if (idle_ || parent_.get() == 0)
+    {
+      handler.close();
+      return;
+    }
+
+    handler.read_buffer().produce(bytes_transferred);
+    parent_->child_dispatch(bas::event(bas::event::read, bytes_transferred));
+  }
+
+  void on_write(upstream_handler_type& handler, std::size_t bytes_transferred)
+  {
+    handler.write_buffer().consume(bytes_transferred);
+    handler.write_buffer().crunch();
+
+    if (parent_.get() != 0)
+      parent_->child_dispatch(bas::event(bas::event::write, bytes_transferred));
+  }
+
+  void on_close(upstream_handler_type& handler, const boost::system::error_code& ec)
+  {
+    if (idle_)
+    {
+      idle_ = false;
+      pool_.remove(handler.work_service(), endpoint_, handler.shared_from_this());
+    }
+
+    if (parent_.get() != 0)
+    {
+      parent_->child_dispatch(bas::event(bas::event::close, 0, ec));
+      parent_.reset();
+    }
+  }
+
+  void on_parent(upstream_handler_type& handler, const bas::event event)
+  {
+    switch (event.state)
+    {
+      case bas::event::write:
+        handler.async_write();
+        break;
+
+      case bas::event::read:
+        // A read started while idle is still in progress.
+        if (!reading_)
+        {
+          reading_ = true;
+          handler.async_read_some();
+        }
+
+        break;
+
+      case bas::event::close:
+        parent_.reset();
+        handler.close();
+        break;
+    }
+  }
+
+  void on_child(upstream_handler_type& handler, const bas::event event)
+  {
+  }
+
+private:
+  /// The pool of idle connections.
+  pool_type& pool_;
+
+  /// The parent handler.
+  parent_handler_ptr parent_;
+
+  /// The upstream server.
+  endpoint_type endpoint_;
+
+  /// Flag for read in progress.
+  bool reading_;
+
+  /// Flag for kept in the pool.
+  bool idle_;
+};
+
+/// Allocator of the upstream connections.
+template<typename Parent_Work>
+class upstream_work_allocator
+{
+public:
+  typedef boost::asio::ip::tcp::socket socket_type;
+  typedef upstream_work<Parent_Work> upstream_work_type;
+  typedef typename upstream_work_type::pool_type pool_type;
+
+  /// Constructor.
+  explicit upstream_work_allocator(pool_type& pool)
+    : pool_(pool)
+  {
+  }
+
+  socket_type* make_socket(void* address, boost::asio::io_service& io_service)
+  {
+    return new (address) socket_type(io_service);
+  }
+
+  upstream_work_type* make_handler(void* address)
+  {
+    return new (address) upstream_work_type(pool_);
+  }
+
+private:
+  /// The pool of idle connections.
+  pool_type& pool_;
+};
+
+} // namespace proxy
+} // namespace http
+
+#endif // HTTP_PROXY_UPSTREAM_WORK_HPP
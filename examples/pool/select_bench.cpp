@@ -0,0 +1,105 @@
+//
+// select_bench.cpp
+// ~~~~~~~~~~~~~~~~
+//
+// Measure the cost of choosing an io_service for a new connection from
+//   concurrent accepting threads, for each strategy of io_service_pool and
+//   for a mutex protected round-robin as the reference.
+//
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/mutex.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <iostream>
+#include <vector>
+
+#include <bas/io_service_pool.hpp>
+
+namespace select_bench {
+
+/// Round-robin selection under a mutex.
+class locked_selector
+{
+public:
+  explicit locked_selector(bas::io_service_pool& pool)
+    : mutex_(),
+      io_services_(),
+      next_(0)
+  {
+    for (std::size_t i = 0; i < pool.size(); ++i)
+      io_services_.push_back(&pool.get_io_service());
+  }
+
+  boost::asio::io_service& get_io_service()
+  {
+    boost::asio::detail::mutex::scoped_lock lock(mutex_);
+
+    if (next_ >= io_services_.size())
+      next_ = 0;
+
+    return *io_services_[next_++];
+  }
+
+private:
+  boost::asio::detail::mutex mutex_;
+  std::vector<boost::asio::io_service*> io_services_;
+  std::size_t next_;
+};
+
+/// Choose io_services in a loop.
+template<typename Selector>
+void select(Selector* selector, std::size_t count)
+{
+  for (std::size_t i = 0; i < count; ++i)
+    selector->get_io_service();
+}
+
+/// Run the selection from the given number of threads, return nanoseconds per selection.
+template<typename Selector>
+double run(Selector& selector, std::size_t threads, std::size_t count)
+{
+  boost::thread_group group;
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+  for (std::size_t i = 0; i < threads; ++i)
+    group.create_thread(boost::bind(&select<Selector>, &selector, count));
+
+  group.join_all();
+
+  boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - start;
+
+  return elapsed.total_microseconds() * 1000.0 / (threads * count);
+}
+
+} // namespace select_bench
+
+int main(int argc, char* argv[])
+{
+  std::size_t count = 1000000;
+  if (argc > 1)
+    count = boost::lexical_cast<std::size_t>(argv[1]);
+
+  bas::io_service_pool pool(8);
+  select_bench::locked_selector locked(pool);
+
+  for (std::size_t threads = 1; threads <= 8; threads *= 2)
+  {
+    std::cout << threads << " threads, ns/selection:"
+        << " mutex " << select_bench::run(locked, threads, count);
+
+    pool.set_strategy(bas::io_service_pool::round_robin);
+    std::cout << ", round_robin " << select_bench::run(pool, threads, count);
+
+    pool.set_strategy(bas::io_service_pool::least_loaded);
+    std::cout << ", least_loaded " << select_bench::run(pool, threads, count);
+
+    pool.set_strategy(bas::io_service_pool::power_of_two);
+    std::cout << ", power_of_two " << select_bench::run(pool, threads, count) << "\n";
+  }
+
+  return 0;
+}
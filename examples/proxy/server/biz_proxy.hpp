@@ -69,7 +69,8 @@ public:
         break;
 
       case BAS_STATE_ON_CLIENT_OPEN:
-        status.state = BAS_STATE_DO_READ;
+        // Relay both directions at once until end of stream.
+        status.state = BAS_STATE_DO_RELAY;
         break;
 
       case BAS_STATE_ON_READ:
@@ -0,0 +1,339 @@
+//
+// shm_bench.cpp
+// ~~~~~~~~~~~~~
+//
+// Compare the echo workload over tcp loopback, unix domain socket and the
+//   shared memory socket, between two processes of the host. The latency is
+//   the round trip of one small message, the throughput is the bytes echoed
+//   per second while the client sends and receives at the same time.
+//
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <bas/shm_socket.hpp>
+
+namespace shm_bench {
+
+/// Echo everything read on the socket, until the end of data.
+template<typename Socket>
+class echo_session
+{
+public:
+  echo_session(boost::asio::io_service& io_service, std::size_t buffer_size)
+    : socket_(io_service),
+      buffer_(buffer_size)
+  {
+  }
+
+  Socket& socket()
+  {
+    return socket_;
+  }
+
+  void handle_accept(const boost::system::error_code& ec)
+  {
+    if (!ec)
+      read();
+  }
+
+private:
+  void read()
+  {
+    socket_.async_read_some(boost::asio::buffer(buffer_),
+        boost::bind(&echo_session::handle_read, this, _1, _2));
+  }
+
+  void handle_read(const boost::system::error_code& ec, std::size_t bytes_transferred)
+  {
+    if (ec)
+    {
+      boost::system::error_code ignored_ec;
+      socket_.close(ignored_ec);
+      return;
+    }
+
+    boost::asio::async_write(socket_,
+        boost::asio::buffer(&buffer_[0], bytes_transferred),
+        boost::bind(&echo_session::handle_write, this, _1));
+  }
+
+  void handle_write(const boost::system::error_code& ec)
+  {
+    if (!ec)
+      read();
+  }
+
+  Socket socket_;
+  std::vector<char> buffer_;
+};
+
+/// Send messages one by one and wait for each echo.
+template<typename Socket>
+class latency_client
+{
+public:
+  latency_client(boost::asio::io_service& io_service, std::size_t message_size, std::size_t rounds)
+    : socket_(io_service),
+      out_(message_size, 'x'),
+      in_(message_size),
+      left_(rounds),
+      start_()
+  {
+  }
+
+  Socket& socket()
+  {
+    return socket_;
+  }
+
+  void handle_connect(const boost::system::error_code& ec)
+  {
+    if (ec)
+    {
+      std::cerr << "connect: " << ec.message() << "\n";
+      return;
+    }
+
+    start_ = boost::posix_time::microsec_clock::universal_time();
+    write();
+  }
+
+  boost::posix_time::ptime start() const
+  {
+    return start_;
+  }
+
+private:
+  void write()
+  {
+    boost::asio::async_write(socket_, boost::asio::buffer(out_),
+        boost::bind(&latency_client::handle_write, this, _1));
+  }
+
+  void handle_write(const boost::system::error_code& ec)
+  {
+    if (!ec)
+      boost::asio::async_read(socket_, boost::asio::buffer(in_),
+          boost::bind(&latency_client::handle_read, this, _1));
+  }
+
+  void handle_read(const boost::system::error_code& ec)
+  {
+    if (ec)
+      return;
+
+    if (--left_ != 0)
+      write();
+    else
+      socket_.close();
+  }
+
+  Socket socket_;
+  std::vector<char> out_;
+  std::vector<char> in_;
+  std::size_t left_;
+  boost::posix_time::ptime start_;
+};
+
+/// Send a stream of bytes and receive the echo at the same time.
+template<typename Socket>
+class throughput_client
+{
+public:
+  throughput_client(boost::asio::io_service& io_service, std::size_t chunk_size, std::size_t total)
+    : socket_(io_service),
+      out_(chunk_size, 'x'),
+      in_(chunk_size),
+      to_write_(total),
+      to_read_(total),
+      start_()
+  {
+  }
+
+  Socket& socket()
+  {
+    return socket_;
+  }
+
+  void handle_connect(const boost::system::error_code& ec)
+  {
+    if (ec)
+    {
+      std::cerr << "connect: " << ec.message() << "\n";
+      return;
+    }
+
+    start_ = boost::posix_time::microsec_clock::universal_time();
+    write();
+    read();
+  }
+
+  boost::posix_time::ptime start() const
+  {
+    return start_;
+  }
+
+private:
+  void write()
+  {
+    std::size_t n = (std::min)(to_write_, out_.size());
+    socket_.async_write_some(boost::asio::buffer(&out_[0], n),
+        boost::bind(&throughput_client::handle_write, this, _1, _2));
+  }
+
+  void handle_write(const boost::system::error_code& ec, std::size_t bytes_transferred)
+  {
+    to_write_ -= bytes_transferred;
+    if (!ec && to_write_ != 0)
+      write();
+  }
+
+  void read()
+  {
+    socket_.async_read_some(boost::asio::buffer(in_),
+        boost::bind(&throughput_client::handle_read, this, _1, _2));
+  }
+
+  void handle_read(const boost::system::error_code& ec, std::size_t bytes_transferred)
+  {
+    if (ec)
+      return;
+
+    to_read_ -= (std::min)(to_read_, bytes_transferred);
+    if (to_read_ != 0)
+      read();
+    else
+      socket_.close();
+  }
+
+  Socket socket_;
+  std::vector<char> out_;
+  std::vector<char> in_;
+  std::size_t to_write_;
+  std::size_t to_read_;
+  boost::posix_time::ptime start_;
+};
+
+/// Run the client in a child process, returns the elapsed microseconds.
+template<typename Client, typename Endpoint>
+long run_client(Client& client, boost::asio::io_service& io_service, const Endpoint& endpoint)
+{
+  client.socket().async_connect(endpoint, boost::bind(&Client::handle_connect, &client, _1));
+  io_service.run();
+
+  boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - client.start();
+  return static_cast<long>(elapsed.total_microseconds());
+}
+
+/// Measure one transport with the server in this process and the client in a child.
+template<typename Protocol>
+void run(const char* name,
+    typename Protocol::endpoint endpoint,
+    std::size_t message_size,
+    std::size_t rounds,
+    std::size_t chunk_size,
+    std::size_t total)
+{
+  typedef typename Protocol::socket socket_t;
+  typedef typename Protocol::acceptor acceptor_t;
+
+  bas::prepare_bind(endpoint);
+
+  boost::asio::io_service io_service;
+  acceptor_t acceptor(io_service);
+  acceptor.open(endpoint.protocol());
+  acceptor.bind(endpoint);
+  acceptor.listen();
+  endpoint = acceptor.local_endpoint();
+
+  // The pipe returns the elapsed microseconds of the child.
+  int fds[2];
+  if (::pipe(fds) != 0)
+    return;
+
+  pid_t pid = ::fork();
+  if (pid == 0)
+  {
+    ::close(fds[0]);
+    long elapsed[2] = { 0, 0 };
+    {
+      boost::asio::io_service client_service;
+      latency_client<socket_t> client(client_service, message_size, rounds);
+      elapsed[0] = run_client(client, client_service, endpoint);
+    }
+    {
+      boost::asio::io_service client_service;
+      throughput_client<socket_t> client(client_service, chunk_size, total);
+      elapsed[1] = run_client(client, client_service, endpoint);
+    }
+
+    ssize_t n = ::write(fds[1], elapsed, sizeof(elapsed));
+    (void)n;
+    ::_exit(0);
+  }
+
+  ::close(fds[1]);
+
+  // Serve both connections of the child in turn.
+  for (int i = 0; i < 2; ++i)
+  {
+    echo_session<socket_t> session(io_service, chunk_size);
+    acceptor.async_accept(session.socket(), boost::bind(&echo_session<socket_t>::handle_accept, &session, _1));
+    io_service.run();
+    io_service.reset();
+  }
+
+  long elapsed[2] = { 0, 0 };
+  ssize_t n = ::read(fds[0], elapsed, sizeof(elapsed));
+  (void)n;
+  ::close(fds[0]);
+  ::waitpid(pid, 0, 0);
+
+  std::cout << name << ": latency " << (elapsed[0] * 1000.0 / rounds) << " ns/round trip, throughput "
+      << (elapsed[1] != 0 ? total / static_cast<double>(elapsed[1]) : 0.0) << " MB/s\n";
+}
+
+} // namespace shm_bench
+
+int main(int argc, char* argv[])
+{
+  using namespace boost::asio;
+
+  std::size_t message_size = 64;
+  std::size_t rounds = 100000;
+  std::size_t chunk_size = 64 * 1024;
+  std::size_t total = 1024 * 1024 * 1024;
+  if (argc > 1)
+    message_size = boost::lexical_cast<std::size_t>(argv[1]);
+  if (argc > 2)
+    rounds = boost::lexical_cast<std::size_t>(argv[2]);
+  if (argc > 3)
+    chunk_size = boost::lexical_cast<std::size_t>(argv[3]);
+  if (argc > 4)
+    total = boost::lexical_cast<std::size_t>(argv[4]);
+
+  try
+  {
+    shm_bench::run<ip::tcp>("tcp loopback", ip::tcp::endpoint(ip::address_v4::loopback(), 0),
+        message_size, rounds, chunk_size, total);
+    shm_bench::run<local::stream_protocol>("unix domain socket", local::stream_protocol::endpoint("/tmp/shm_bench_uds.sock"),
+        message_size, rounds, chunk_size, total);
+    shm_bench::run<bas::shm_protocol>("shared memory", bas::shm_endpoint("/tmp/shm_bench_shm.sock"),
+        message_size, rounds, chunk_size, total);
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}
@@ -29,7 +29,7 @@ class ssl_client_work
 public:
   typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket;
   typedef bas::service_handler<ssl_client_work, ssl_socket> client_handler_type;
-  typedef boost::shared_ptr<client_handler_type> client_handler_ptr;
+  typedef client_handler_type::service_handler_ptr client_handler_ptr;
 
   ssl_client_work()
   {
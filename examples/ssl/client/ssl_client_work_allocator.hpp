@@ -29,7 +29,7 @@ public:
   {
   }
 
-  ssl_socket* make_socket(boost::asio::io_service& io_service)
+  ssl_socket* make_socket(void* address, boost::asio::io_service& io_service)
   {
     if (context_.get() == 0)
     {
@@ -38,12 +38,12 @@ public:
        context_->load_verify_file("ca.pem");
     }
 
-    return new ssl_socket(io_service, *context_);
+    return new (address) ssl_socket(io_service, *context_);
   }
 
-  ssl_client_work* make_handler()
+  ssl_client_work* make_handler(void* address)
   {
-    return new ssl_client_work();
+    return new (address) ssl_client_work();
   }
 
 private:
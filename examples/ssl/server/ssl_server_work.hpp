@@ -27,7 +27,7 @@ class ssl_server_work
 public:
   typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket;
   typedef bas::service_handler<ssl_server_work, ssl_socket> server_handler_type;
-  typedef boost::shared_ptr<server_handler_type> server_handler_ptr;
+  typedef server_handler_type::service_handler_ptr server_handler_ptr;
 
   ssl_server_work()
   {
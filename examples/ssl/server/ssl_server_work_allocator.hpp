@@ -34,7 +34,7 @@ public:
     return "test";
   }
 
-  ssl_socket* make_socket(boost::asio::io_service& io_service)
+  ssl_socket* make_socket(void* address, boost::asio::io_service& io_service)
   {
     if (context_.get() == 0)
     {
@@ -49,13 +49,13 @@ public:
        context_->use_tmp_dh_file("dh512.pem");
     }
 
-    return new ssl_socket(io_service, *context_);
+    return new (address) ssl_socket(io_service, *context_);
   }
 
 
-  ssl_server_work* make_handler()
+  ssl_server_work* make_handler(void* address)
   {
-    return new ssl_server_work();
+    return new (address) ssl_server_work();
   }
 
 private:
@@ -0,0 +1,133 @@
+//
+// udp_echo_server.cpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Echo each datagram back to its sender, the received batch is sent back as
+//   is by sendmmsg.
+//
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <iostream>
+
+#include <bas/udp_server.hpp>
+
+#if !defined(_WIN32)
+
+#include <pthread.h>
+#include <signal.h>
+
+namespace udp_echo {
+
+/// The work handler echoing datagrams.
+class echo_work
+{
+public:
+  template<typename Handler>
+  void on_open(Handler&)
+  {
+  }
+
+  template<typename Handler>
+  void on_read(Handler& handler, const bas::udp_batch_ptr& batch)
+  {
+    // The endpoints of the batch are the senders, reply to them.
+    handler.async_send(batch);
+  }
+
+  template<typename Handler>
+  void on_write(Handler&, std::size_t)
+  {
+  }
+
+  template<typename Handler>
+  void on_close(Handler&, const boost::system::error_code& ec)
+  {
+    if (ec)
+      std::cerr << "socket closed: " << ec.message() << "\n";
+  }
+};
+
+/// The allocator of echo_work.
+class echo_work_allocator
+{
+public:
+  echo_work* make_handler()
+  {
+    return new echo_work();
+  }
+};
+
+typedef bas::udp_server<echo_work, echo_work_allocator> server_t;
+
+} // namespace udp_echo
+
+int main(int argc, char* argv[])
+{
+  using namespace boost::asio::ip;
+
+  try
+  {
+    // Check command line arguments.
+    if (argc < 3)
+    {
+      std::cerr << "Usage: udp_echo_server <address> <port> [io_threads] [work_threads] [shards].\n";
+      return 1;
+    }
+
+    std::size_t io_threads = 1;
+    std::size_t work_threads = 1;
+    if (argc > 3)
+      io_threads = boost::lexical_cast<std::size_t>(argv[3]);
+    if (argc > 4)
+      work_threads = boost::lexical_cast<std::size_t>(argv[4]);
+
+    // One socket per io thread by default, the port is shared by SO_REUSEPORT.
+    std::size_t shards = io_threads;
+    if (argc > 5)
+      shards = boost::lexical_cast<std::size_t>(argv[5]);
+
+    udp::endpoint endpoint(address::from_string(argv[1]), boost::lexical_cast<unsigned short>(argv[2]));
+    udp_echo::server_t s(new udp_echo::echo_work_allocator(),
+        endpoint,
+        io_threads,
+        work_threads,
+        work_threads);
+    s.set_shards(shards);
+
+    // Block all signals for background thread.
+    sigset_t new_mask;
+    sigfillset(&new_mask);
+    sigset_t old_mask;
+    pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
+
+    // Run server in background thread.
+    boost::thread t(boost::bind(&udp_echo::server_t::run, &s));
+
+    // Restore previous signals.
+    pthread_sigmask(SIG_SETMASK, &old_mask, 0);
+
+    // Wait for signal indicating time to shut down.
+    sigset_t wait_mask;
+    sigemptyset(&wait_mask);
+    sigaddset(&wait_mask, SIGINT);
+    sigaddset(&wait_mask, SIGQUIT);
+    sigaddset(&wait_mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &wait_mask, 0);
+    int sig = 0;
+    sigwait(&wait_mask, &sig);
+
+    // Stop the server.
+    s.stop();
+    t.join();
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}
+
+#endif // !defined(_WIN32)
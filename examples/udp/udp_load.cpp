@@ -0,0 +1,169 @@
+//
+// udp_load.cpp
+// ~~~~~~~~~~~~
+//
+// Send datagrams to a udp echo server as fast as the sockets accept them,
+//   and report the packets sent and received per second.
+//
+
+#include <boost/atomic.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <iostream>
+#include <vector>
+
+#include <bas/udp_server.hpp>
+
+namespace udp_load {
+
+/// Datagrams sent and received by all sockets.
+boost::atomic<std::size_t> sent(0);
+boost::atomic<std::size_t> received(0);
+
+/// Flag to indicate whether to keep sending.
+boost::atomic<bool> running(true);
+
+/// The work handler sending a batch again each time the last one is sent.
+class load_work
+{
+public:
+  load_work(const boost::asio::ip::udp::endpoint& target,
+      std::size_t datagram_length)
+    : target_(target),
+      payload_(datagram_length, 'x'),
+      batch_()
+  {
+  }
+
+  template<typename Handler>
+  void on_open(Handler& handler)
+  {
+    // Fill a batch once, it's sent again and again.
+    batch_ = handler.make_batch();
+    while (batch_->push(target_, &payload_[0], payload_.size()))
+      ;
+
+    handler.async_send(batch_);
+  }
+
+  template<typename Handler>
+  void on_read(Handler&, const bas::udp_batch_ptr& batch)
+  {
+    received += batch->size();
+  }
+
+  template<typename Handler>
+  void on_write(Handler& handler, std::size_t datagrams)
+  {
+    sent += datagrams;
+
+    if (running)
+      handler.async_send(batch_);
+  }
+
+  template<typename Handler>
+  void on_close(Handler&, const boost::system::error_code&)
+  {
+    batch_.reset();
+  }
+
+private:
+  boost::asio::ip::udp::endpoint target_;
+
+  std::vector<char> payload_;
+
+  bas::udp_batch_ptr batch_;
+};
+
+/// The allocator of load_work.
+class load_work_allocator
+{
+public:
+  load_work_allocator(const boost::asio::ip::udp::endpoint& target,
+      std::size_t datagram_length)
+    : target_(target),
+      datagram_length_(datagram_length)
+  {
+  }
+
+  load_work* make_handler()
+  {
+    return new load_work(target_, datagram_length_);
+  }
+
+private:
+  boost::asio::ip::udp::endpoint target_;
+
+  std::size_t datagram_length_;
+};
+
+typedef bas::udp_server<load_work, load_work_allocator> client_t;
+
+} // namespace udp_load
+
+int main(int argc, char* argv[])
+{
+  using namespace boost::asio::ip;
+
+  try
+  {
+    // Check command line arguments.
+    if (argc < 3)
+    {
+      std::cerr << "Usage: udp_load <address> <port> [sockets] [datagram_length] [batch_size] [seconds].\n";
+      return 1;
+    }
+
+    std::size_t sockets = 1;
+    std::size_t datagram_length = 64;
+    std::size_t batch_size = BAS_UDP_BATCH_SIZE;
+    std::size_t seconds = 10;
+    if (argc > 3)
+      sockets = boost::lexical_cast<std::size_t>(argv[3]);
+    if (argc > 4)
+      datagram_length = boost::lexical_cast<std::size_t>(argv[4]);
+    if (argc > 5)
+      batch_size = boost::lexical_cast<std::size_t>(argv[5]);
+    if (argc > 6)
+      seconds = boost::lexical_cast<std::size_t>(argv[6]);
+
+    udp::endpoint target(address::from_string(argv[1]), boost::lexical_cast<unsigned short>(argv[2]));
+
+    // Each socket is bound to its own port, with an io thread and a work thread.
+    udp::endpoint local(target.address().is_v4() ? udp::v4() : udp::v6(), 0);
+    udp_load::client_t c(new udp_load::load_work_allocator(target, datagram_length),
+        local,
+        sockets,
+        sockets,
+        sockets);
+    c.set_shards(sockets).set_batch(batch_size, datagram_length);
+    c.start();
+
+    std::size_t last_sent = 0;
+    std::size_t last_received = 0;
+    for (std::size_t i = 0; i < seconds; ++i)
+    {
+      boost::this_thread::sleep(boost::posix_time::seconds(1));
+
+      std::size_t now_sent = udp_load::sent;
+      std::size_t now_received = udp_load::received;
+      std::cout << "sent " << now_sent - last_sent << " pps, received "
+          << now_received - last_received << " pps\n";
+
+      last_sent = now_sent;
+      last_received = now_received;
+    }
+
+    udp_load::running = false;
+    c.stop();
+
+    std::cout << "total sent " << udp_load::sent << ", received " << udp_load::received
+        << ", average " << udp_load::received / (seconds ? seconds : 1) << " pps received\n";
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}